@@ -0,0 +1,181 @@
+/* Brotli Compress Implementation
+
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHWARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+*/
+
+#include "BrotliCompress.h"
+#include "BrotliDecompress.h"
+
+#include <stdlib.h>
+
+#ifdef HAVE_BROTLI
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+
+// Firmware decoder allocates from the scratch buffer without reusing freed memory,
+// storing the size of every allocation before it, and needs some space for itself
+#define BROTLI_SCRATCH_ALLOCATION_OVERHEAD 8
+#define BROTLI_SCRATCH_GAP 0x1000
+
+STATIC
+VOID
+SetUint64(
+UINT64 Value,
+UINT8  *Buffer
+)
+{
+    INT32 Index;
+
+    for (Index = 0; Index < 8; Index++) {
+        Buffer[Index] = (UINT8)(Value & 0xFF);
+        Value >>= 8;
+    }
+}
+
+STATIC
+VOID *
+CountingAlloc(
+VOID   *Opaque,
+size_t Size
+)
+{
+    *(UINT64*)Opaque += Size + BROTLI_SCRATCH_ALLOCATION_OVERHEAD;
+    return malloc(Size);
+}
+
+STATIC
+VOID
+CountingFree(
+VOID *Opaque,
+VOID *Address
+)
+{
+    (VOID)Opaque;
+    free(Address);
+}
+
+STATIC
+BOOLEAN
+GetScratchSize(
+CONST UINT8 *Encoded,
+size_t      EncodedSize,
+UINT32      DecodedSize,
+UINT64      *ScratchSize
+)
+{
+    // Decode the stream once with counting allocator to get the memory needed by the firmware decoder
+    // This also checks that the stream is valid
+    BrotliDecoderState *State;
+    BrotliDecoderResult Result;
+    UINT8  *Decoded;
+    size_t AvailableIn = EncodedSize;
+    size_t AvailableOut = DecodedSize;
+    UINT8  *NextOut;
+    UINT64 Allocated = 0;
+
+    Decoded = (UINT8*)malloc(DecodedSize ? DecodedSize : 1);
+    if (Decoded == NULL)
+        return FALSE;
+
+    State = BrotliDecoderCreateInstance(CountingAlloc, CountingFree, &Allocated);
+    if (State == NULL) {
+        free(Decoded);
+        return FALSE;
+    }
+
+    NextOut = Decoded;
+    Result = BrotliDecoderDecompressStream(State, &AvailableIn, &Encoded, &AvailableOut, &NextOut, NULL);
+    BrotliDecoderDestroyInstance(State);
+    free(Decoded);
+
+    if (Result != BROTLI_DECODER_RESULT_SUCCESS || AvailableOut != 0)
+        return FALSE;
+
+    *ScratchSize = Allocated + BROTLI_SCRATCH_GAP;
+    return TRUE;
+}
+
+STATIC
+INT32
+GetWindowBits(
+UINT32 SourceSize,
+INT32  MaxWindowBits
+)
+{
+    // Matches can't be further back than the input size, and a smaller window
+    // reduces memory needed by the firmware decoder
+    INT32 WindowBits = BROTLI_MIN_WINDOW_BITS;
+    while (WindowBits < MaxWindowBits && ((UINT32)1 << WindowBits) - 16 < SourceSize)
+        WindowBits++;
+
+    return WindowBits;
+}
+#endif
+
+INT32
+EFIAPI
+BrotliCompressWithPreset(
+CONST UINT8  *Source,
+UINT32       SourceSize,
+UINT8    *Destination,
+UINT32   *DestinationSize,
+UINT8    Preset
+)
+{
+#ifdef HAVE_BROTLI
+    INT32  Quality;
+    INT32  MaxWindowBits;
+    size_t EncodedSize;
+    UINT64 ScratchSize;
+    UINT64 Needed;
+
+    switch (Preset) {
+    case COMPRESSION_PRESET_FAST:
+        Quality = 5;
+        MaxWindowBits = BROTLI_DEFAULT_WINDOW;
+        break;
+    case COMPRESSION_PRESET_DEFAULT:
+        Quality = 9;
+        MaxWindowBits = BROTLI_DEFAULT_WINDOW;
+        break;
+    case COMPRESSION_PRESET_MAX:
+        Quality = BROTLI_MAX_QUALITY;
+        MaxWindowBits = BROTLI_MAX_WINDOW_BITS;
+        break;
+    default:
+        return ERR_INVALID_PARAMETER;
+    }
+
+    Needed = (UINT64)BROTLI_HEADER_SIZE + BrotliEncoderMaxCompressedSize(SourceSize);
+    if (Needed > 0xFFFFFFFF)
+        return ERR_INVALID_PARAMETER;
+    if (Destination == NULL || *DestinationSize < Needed) {
+        *DestinationSize = (UINT32)Needed;
+        return ERR_BUFFER_TOO_SMALL;
+    }
+
+    EncodedSize = *DestinationSize - BROTLI_HEADER_SIZE;
+    if (!BrotliEncoderCompress(Quality, GetWindowBits(SourceSize, MaxWindowBits), BROTLI_MODE_GENERIC,
+        SourceSize, Source, &EncodedSize, Destination + BROTLI_HEADER_SIZE))
+        return ERR_INVALID_PARAMETER;
+
+    if (!GetScratchSize(Destination + BROTLI_HEADER_SIZE, EncodedSize, SourceSize, &ScratchSize))
+        return ERR_INVALID_PARAMETER;
+
+    SetUint64(SourceSize, Destination);
+    SetUint64(ScratchSize, Destination + 8);
+    *DestinationSize = (UINT32)(BROTLI_HEADER_SIZE + EncodedSize);
+
+    return ERR_SUCCESS;
+#else
+    (VOID)Source; (VOID)SourceSize; (VOID)Destination; (VOID)DestinationSize; (VOID)Preset;
+    return ERR_NOT_IMPLEMENTED;
+#endif
+}
@@ -0,0 +1,38 @@
+/* Brotli Compress Header
+
+    This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHWARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+  */
+
+#ifndef __BROTLICOMPRESS_H__
+#define __BROTLICOMPRESS_H__
+
+#include "../basetypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    // Compresses Source into a Brotli GUID-defined section body with one of COMPRESSION_PRESET_* encoder settings
+    // Returns ERR_BUFFER_TOO_SMALL and the size needed in DestinationSize, if Destination is too small
+    // Returns ERR_NOT_IMPLEMENTED, if Brotli support is not built in
+    INT32
+        EFIAPI
+        BrotliCompressWithPreset(
+        const UINT8  *Source,
+        UINT32       SourceSize,
+        UINT8    *Destination,
+        UINT32   *DestinationSize,
+        UINT8    Preset
+        );
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,87 @@
+/* Brotli Decompress Implementation
+
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHWARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+*/
+
+#include "BrotliDecompress.h"
+
+#ifdef HAVE_BROTLI
+#include <brotli/decode.h>
+#endif
+
+STATIC
+UINT64
+GetUint64(
+CONST UINT8 *Buffer
+)
+{
+    UINT64 Value = 0;
+    INT32  Index;
+
+    for (Index = 7; Index >= 0; Index--)
+        Value = (Value << 8) | Buffer[Index];
+
+    return Value;
+}
+
+INT32
+EFIAPI
+BrotliGetInfo(
+CONST VOID  *Source,
+UINT32      SourceSize,
+UINT32      *DestinationSize,
+UINT32      *ScratchSize
+)
+{
+    UINT64 DecodedSize;
+    UINT64 Scratch;
+
+    if (SourceSize < BROTLI_HEADER_SIZE)
+        return ERR_INVALID_PARAMETER;
+
+    DecodedSize = GetUint64((CONST UINT8*)Source);
+    Scratch = GetUint64((CONST UINT8*)Source + 8);
+    if (DecodedSize > 0xFFFFFFFF || Scratch > 0xFFFFFFFF)
+        return ERR_INVALID_PARAMETER;
+
+    *DestinationSize = (UINT32)DecodedSize;
+    if (ScratchSize)
+        *ScratchSize = (UINT32)Scratch;
+
+    return ERR_SUCCESS;
+}
+
+INT32
+EFIAPI
+BrotliDecompress(
+CONST VOID  *Source,
+UINT32       SourceSize,
+VOID    *Destination,
+UINT32       DestinationSize
+)
+{
+#ifdef HAVE_BROTLI
+    size_t DecodedSize = DestinationSize;
+
+    if (SourceSize < BROTLI_HEADER_SIZE)
+        return ERR_INVALID_PARAMETER;
+
+    // Whole stream is decoded at once, that is the fastest way for in-memory data
+    if (BrotliDecoderDecompress(SourceSize - BROTLI_HEADER_SIZE, (CONST UINT8*)Source + BROTLI_HEADER_SIZE,
+        &DecodedSize, (UINT8*)Destination) != BROTLI_DECODER_RESULT_SUCCESS
+        || DecodedSize != DestinationSize)
+        return ERR_INVALID_PARAMETER;
+
+    return ERR_SUCCESS;
+#else
+    (VOID)Source; (VOID)SourceSize; (VOID)Destination; (VOID)DestinationSize;
+    return ERR_NOT_IMPLEMENTED;
+#endif
+}
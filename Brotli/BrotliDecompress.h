@@ -0,0 +1,72 @@
+/* Brotli Decompress Header
+
+    This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHWARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+  */
+
+#ifndef __BROTLIDECOMPRESS_H__
+#define __BROTLIDECOMPRESS_H__
+
+#include "../basetypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Brotli GUID-defined section data starts with UINT64 decompressed size
+// and UINT64 size of the scratch buffer needed by the firmware decoder
+#define BROTLI_HEADER_SIZE 0x10
+
+    /*
+      Given a Brotli compressed source buffer, this function retrieves the size of
+      the uncompressed buffer and the size of the scratch buffer stored in the header.
+      The scratch buffer is only needed by the firmware decoder, BrotliDecompress doesn't use it.
+
+      @param  Source          The source buffer containing the compressed data.
+      @param  SourceSize      The size, bytes, of the source buffer.
+      @param  DestinationSize A pointer to the size, bytes, of the uncompressed buffer.
+      @param  ScratchSize     A pointer to the size, bytes, of the scratch buffer, can be NULL.
+
+      @retval  EFI_SUCCESS           The sizes were returned.
+      @retval  EFI_INVALID_PARAMETER The header is truncated or the sizes are too big.
+      */
+    INT32
+        EFIAPI
+        BrotliGetInfo(
+        const VOID  *Source,
+        UINT32      SourceSize,
+        UINT32      *DestinationSize,
+        UINT32      *ScratchSize
+        );
+
+    /*
+      Decompresses a Brotli compressed source buffer.
+
+      @param  Source          The source buffer containing the compressed data.
+      @param  SourceSize      The size of source buffer.
+      @param  Destination     The destination buffer to store the decompressed data.
+      @param  DestinationSize The size of destination buffer returned by BrotliGetInfo.
+
+      @retval  EFI_SUCCESS           Decompression completed successfully.
+      @retval  EFI_INVALID_PARAMETER The source buffer is corrupted or its size doesn't match the header.
+      @retval  ERR_NOT_IMPLEMENTED   Brotli support is not built in.
+      */
+    INT32
+        EFIAPI
+        BrotliDecompress(
+        const VOID  *Source,
+        UINT32       SourceSize,
+        VOID    *Destination,
+        UINT32       DestinationSize
+        );
+
+#ifdef __cplusplus
+}
+#endif
+#endif
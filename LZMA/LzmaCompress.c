@@ -16,6 +16,7 @@ WITHWARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include "SDK/C/LzmaEnc.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #define LZMA_HEADER_SIZE (LZMA_PROPS_SIZE + 8)
 
@@ -58,34 +59,74 @@ UINT8 *EncodedData
     }
 }
 
-INT32
-EFIAPI
-LzmaCompress(
+//
+// Encoder settings of compression presets
+// Every parameter set of a preset is tried and the smallest output is kept
+//
+typedef struct {
+    int level;
+    int fb;
+    int lc;
+    int lp;
+    int pb;
+} LZMA_PRESET_PARAMETERS;
+
+static const LZMA_PRESET_PARAMETERS FastPresetParameters[] = {
+    { 1, 32, 3, 0, 2 }
+};
+
+static const LZMA_PRESET_PARAMETERS DefaultPresetParameters[] = {
+    { 9, 273, 3, 0, 2 }
+};
+
+static const LZMA_PRESET_PARAMETERS MaxPresetParameters[] = {
+    { 9, 273, 3, 0, 2 },
+    { 9, 64,  3, 0, 2 },
+    { 9, 273, 4, 0, 2 },
+    { 9, 273, 0, 2, 2 }
+};
+
+STATIC
+UInt32
+GetDictionarySize(
+UINT32 SourceSize
+)
+{
+    // Matches can't be further back than the input size, so a bigger dictionary
+    // only costs match finder allocation and initialization time
+    UInt32 DictionarySize = LZMA_DICTIONARY_SIZE;
+    while (DictionarySize > LZMA_MIN_DICTIONARY_SIZE && (DictionarySize >> 1) >= SourceSize)
+        DictionarySize >>= 1;
+
+    return DictionarySize;
+}
+
+STATIC
+SRes
+EncodeWithParameters(
 CONST UINT8  *Source,
 UINT32       SourceSize,
-UINT8    *Destination,
-UINT32   *DestinationSize
+UINT8        *Destination,
+SizeT        *DestinationSize,
+CONST LZMA_PRESET_PARAMETERS *Parameters,
+BOOLEAN      Multithread
 )
 {
-    SRes              LzmaResult;
     CLzmaEncProps     props;
     SizeT propsSize = LZMA_PROPS_SIZE;
-    SizeT destLen = SourceSize + SourceSize / 3 + 128;
-
-    if (*DestinationSize < destLen)
-    {
-        *DestinationSize = destLen;
-        return ERR_BUFFER_TOO_SMALL;
-    }
 
     LzmaEncProps_Init(&props);
-    props.dictSize = LZMA_DICTIONARY_SIZE;
-    props.level = 9;
-    props.fb = 273;
-
-    LzmaResult = LzmaEncode(
+    props.dictSize = GetDictionarySize(SourceSize);
+    props.level = Parameters->level;
+    props.fb = Parameters->fb;
+    props.lc = Parameters->lc;
+    props.lp = Parameters->lp;
+    props.pb = Parameters->pb;
+    props.numThreads = Multithread ? 2 : 1;
+
+    return LzmaEncode(
         (Byte*)((UINT8*)Destination + LZMA_HEADER_SIZE),
-        &destLen,
+        DestinationSize,
         Source,
         SourceSize,
         &props,
@@ -95,15 +136,100 @@ UINT32   *DestinationSize
         &g_ProgressCallback,
         &SzAllocForLzma,
         &SzAllocForLzma);
+}
 
-    *DestinationSize = destLen + LZMA_HEADER_SIZE;
+INT32
+EFIAPI
+LzmaCompress(
+CONST UINT8  *Source,
+UINT32       SourceSize,
+UINT8    *Destination,
+UINT32   *DestinationSize
+)
+{
+    return LzmaCompressWithPreset(Source, SourceSize, Destination, DestinationSize, COMPRESSION_PRESET_DEFAULT);
+}
 
-    SetEncodedSizeOfBuf((UINT64)SourceSize, Destination);
+INT32
+EFIAPI
+LzmaCompressWithPreset(
+CONST UINT8  *Source,
+UINT32       SourceSize,
+UINT8    *Destination,
+UINT32   *DestinationSize,
+UINT8    Preset
+)
+{
+    return LzmaCompressWithOptions(Source, SourceSize, Destination, DestinationSize, Preset, LZMA_MULTITHREAD_THRESHOLD);
+}
 
-    if (LzmaResult == SZ_OK) {
-        return ERR_SUCCESS;
+INT32
+EFIAPI
+LzmaCompressWithOptions(
+CONST UINT8  *Source,
+UINT32       SourceSize,
+UINT8    *Destination,
+UINT32   *DestinationSize,
+UINT8    Preset,
+UINT32   MultithreadThreshold
+)
+{
+    SRes              LzmaResult;
+    CONST LZMA_PRESET_PARAMETERS *Parameters;
+    UINT32            ParametersCount;
+    UINT32            Index;
+    UINT8             *Candidate;
+    BOOLEAN           Multithread = (MultithreadThreshold != 0 && SourceSize >= MultithreadThreshold);
+    SizeT destLen = SourceSize + SourceSize / 3 + 128;
+    SizeT candidateLen;
+
+    if (*DestinationSize < destLen)
+    {
+        *DestinationSize = destLen;
+        return ERR_BUFFER_TOO_SMALL;
+    }
+
+    switch (Preset) {
+    case COMPRESSION_PRESET_FAST:
+        Parameters = FastPresetParameters;
+        ParametersCount = sizeof(FastPresetParameters) / sizeof(FastPresetParameters[0]);
+        break;
+    case COMPRESSION_PRESET_DEFAULT:
+        Parameters = DefaultPresetParameters;
+        ParametersCount = sizeof(DefaultPresetParameters) / sizeof(DefaultPresetParameters[0]);
+        break;
+    case COMPRESSION_PRESET_MAX:
+        Parameters = MaxPresetParameters;
+        ParametersCount = sizeof(MaxPresetParameters) / sizeof(MaxPresetParameters[0]);
+        break;
+    default:
+        return ERR_INVALID_PARAMETER;
     }
-    else {
+
+    destLen = *DestinationSize - LZMA_HEADER_SIZE;
+    LzmaResult = EncodeWithParameters(Source, SourceSize, Destination, &destLen, &Parameters[0], Multithread);
+    if (LzmaResult != SZ_OK)
         return ERR_INVALID_PARAMETER;
+
+    // Try other parameter sets, if any
+    if (ParametersCount > 1) {
+        Candidate = (UINT8*)malloc(*DestinationSize);
+        if (Candidate == NULL)
+            return ERR_OUT_OF_RESOURCES;
+
+        for (Index = 1; Index < ParametersCount; Index++) {
+            candidateLen = *DestinationSize - LZMA_HEADER_SIZE;
+            if (EncodeWithParameters(Source, SourceSize, Candidate, &candidateLen, &Parameters[Index], Multithread) == SZ_OK
+                && candidateLen < destLen) {
+                memcpy(Destination, Candidate, LZMA_HEADER_SIZE + candidateLen);
+                destLen = candidateLen;
+            }
+        }
+        free(Candidate);
     }
+
+    *DestinationSize = destLen + LZMA_HEADER_SIZE;
+    SetEncodedSizeOfBuf((UINT64)SourceSize, Destination);
+
+    return ERR_SUCCESS;
 }
@@ -22,8 +22,12 @@ extern "C" {
 #endif
 
 #define LZMA_DICTIONARY_SIZE 0x800000
+#define LZMA_MIN_DICTIONARY_SIZE 0x1000
 #define _LZMA_SIZE_OPT
 
+// Inputs of at least this size are encoded with a multithreaded match finder
+#define LZMA_MULTITHREAD_THRESHOLD 0x400000
+
     INT32
         EFIAPI
         LzmaCompress(
@@ -33,6 +37,31 @@ extern "C" {
         UINT32   *DestinationSize
         );
 
+    // Same as LzmaCompress, but with one of COMPRESSION_PRESET_* encoder settings
+    INT32
+        EFIAPI
+        LzmaCompressWithPreset(
+        const UINT8  *Source,
+        UINT32       SourceSize,
+        UINT8    *Destination,
+        UINT32   *DestinationSize,
+        UINT8    Preset
+        );
+
+    // Same as LzmaCompressWithPreset, but inputs of at least MultithreadThreshold bytes
+    // are encoded with a multithreaded match finder, 0 disables it
+    // The output is identical in both cases
+    INT32
+        EFIAPI
+        LzmaCompressWithOptions(
+        const UINT8  *Source,
+        UINT32       SourceSize,
+        UINT8    *Destination,
+        UINT32   *DestinationSize,
+        UINT8    Preset,
+        UINT32   MultithreadThreshold
+        );
+
 #ifdef __cplusplus
 }
 #endif
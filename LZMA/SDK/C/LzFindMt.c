@@ -0,0 +1,237 @@
+/* LzFindMt.c -- pipelined match finder for LZ algorithms
+Not a part of LZMA SDK 9.20 vendored here: written for UEFITool to the interface
+that LzmaEnc.c of that SDK expects from its multithreaded match finder. Public domain */
+
+#include "LzFindMt.h"
+
+void MatchFinderMt_Construct(CMatchFinderMt *p)
+{
+    p->blocks = 0;
+    p->lock = 0;
+    p->thread = 0;
+    p->hasBlock = 0;
+    p->MatchFinder = 0;
+}
+
+static void MatchFinderMt_FillBlock(CMatchFinderMt *p, UInt32 blockIndex)
+{
+    CMatchFinder *mf = p->MatchFinder;
+    UInt32 *buf = p->blocks + blockIndex * kMtBtBlockSize;
+    UInt32 size = 0;
+
+    /* Every record is the number of distance values followed by the values */
+    while (size + p->maxRecordSize <= kMtBtBlockSize && Inline_MatchFinder_GetNumAvailableBytes(mf) != 0)
+    {
+        UInt32 num = p->mfVTable.GetMatches(mf, buf + size + 1);
+        buf[size] = num;
+        size += num + 1;
+    }
+    p->blockSizes[blockIndex] = size;
+}
+
+static void MatchFinderMt_ThreadFunc(void *pp)
+{
+    CMatchFinderMt *p = (CMatchFinderMt *)pp;
+    CMatchFinder *mf = p->MatchFinder;
+    UInt32 numWrittenBlocks = 0;
+
+    for (;;)
+    {
+        int finished;
+
+        MtLock_Enter(p->lock);
+        while (!p->stopWriting && numWrittenBlocks - p->numReadBlocks == kMtBtNumBlocks)
+            MtLock_Wait(p->lock);
+        finished = p->stopWriting;
+        MtLock_Leave(p->lock);
+        if (finished)
+            return;
+
+        MatchFinderMt_FillBlock(p, numWrittenBlocks % kMtBtNumBlocks);
+        finished = (Inline_MatchFinder_GetNumAvailableBytes(mf) == 0);
+
+        MtLock_Enter(p->lock);
+        p->numWrittenBlocks = ++numWrittenBlocks;
+        p->writingFinished = finished;
+        MtLock_WakeAll(p->lock);
+        MtLock_Leave(p->lock);
+        if (finished)
+            return;
+    }
+}
+
+static Bool MatchFinderMt_GetNextBlock(CMatchFinderMt *p)
+{
+    UInt32 blockIndex;
+
+    if (p->thread == 0)
+    {
+        /* No match finder thread, fill blocks in the encoder thread */
+        if (p->hasBlock)
+            p->numReadBlocks++;
+        if (p->numReadBlocks == p->numWrittenBlocks)
+        {
+            if (p->writingFinished)
+            {
+                p->hasBlock = 0;
+                return False;
+            }
+            MatchFinderMt_FillBlock(p, p->numWrittenBlocks % kMtBtNumBlocks);
+            p->numWrittenBlocks++;
+            p->writingFinished = (Inline_MatchFinder_GetNumAvailableBytes(p->MatchFinder) == 0);
+        }
+    }
+    else
+    {
+        MtLock_Enter(p->lock);
+        if (p->hasBlock)
+        {
+            p->numReadBlocks++;
+            MtLock_WakeAll(p->lock);
+        }
+        while (p->numReadBlocks == p->numWrittenBlocks && !p->writingFinished)
+            MtLock_Wait(p->lock);
+        if (p->numReadBlocks == p->numWrittenBlocks)
+        {
+            p->hasBlock = 0;
+            MtLock_Leave(p->lock);
+            return False;
+        }
+        MtLock_Leave(p->lock);
+    }
+
+    blockIndex = p->numReadBlocks % kMtBtNumBlocks;
+    p->btBuf = p->blocks + blockIndex * kMtBtBlockSize;
+    p->btBufPos = 0;
+    p->btBufPosLimit = p->blockSizes[blockIndex];
+    p->hasBlock = 1;
+    return True;
+}
+
+void MatchFinderMt_ReleaseStream(CMatchFinderMt *p)
+{
+    if (p->thread != 0)
+    {
+        MtLock_Enter(p->lock);
+        p->stopWriting = 1;
+        MtLock_WakeAll(p->lock);
+        MtLock_Leave(p->lock);
+        Thread_Join(p->thread);
+        p->thread = 0;
+    }
+    p->hasBlock = 0;
+}
+
+void MatchFinderMt_Destruct(CMatchFinderMt *p, ISzAlloc *alloc)
+{
+    MatchFinderMt_ReleaseStream(p);
+    MtLock_Free(p->lock);
+    p->lock = 0;
+    alloc->Free(alloc, p->blocks);
+    p->blocks = 0;
+}
+
+SRes MatchFinderMt_Create(CMatchFinderMt *p, UInt32 historySize, UInt32 keepAddBufferBefore,
+    UInt32 matchMaxLen, UInt32 keepAddBufferAfter, ISzAlloc *alloc)
+{
+    CMatchFinder *mf = p->MatchFinder;
+    if (!mf->directInput)
+        return SZ_ERROR_PARAM;
+    if (p->lock == 0)
+    {
+        p->lock = MtLock_Create();
+        if (p->lock == 0)
+            return SZ_ERROR_THREAD;
+    }
+    if (p->blocks == 0)
+    {
+        p->blocks = (UInt32 *)alloc->Alloc(alloc, kMtBtNumBlocks * kMtBtBlockSize * sizeof(UInt32));
+        if (p->blocks == 0)
+            return SZ_ERROR_MEM;
+    }
+    if (!MatchFinder_Create(mf, historySize, keepAddBufferBefore, matchMaxLen, keepAddBufferAfter, alloc))
+        return SZ_ERROR_MEM;
+
+    /* Match lengths are increasing, so there are less than matchMaxLen pairs */
+    p->maxRecordSize = 1 + matchMaxLen * 2;
+    return SZ_OK;
+}
+
+static void MatchFinderMt_Init(CMatchFinderMt *p)
+{
+    CMatchFinder *mf = p->MatchFinder;
+
+    MatchFinderMt_ReleaseStream(p);
+    MatchFinder_Init(mf);
+    MatchFinder_CreateVTable(mf, &p->mfVTable);
+
+    /* The match finder thread moves mf->buffer, so the encoder thread keeps its own position */
+    p->pointerToCurPos = Inline_MatchFinder_GetPointerToCurrentPos(mf);
+    p->numAvailBytes = Inline_MatchFinder_GetNumAvailableBytes(mf);
+    p->btBufPos = p->btBufPosLimit = 0;
+    p->numWrittenBlocks = p->numReadBlocks = 0;
+    p->writingFinished = 0;
+    p->stopWriting = 0;
+
+    /* If the thread can't be created, the blocks will be filled in the encoder thread */
+    p->thread = Thread_Create(MatchFinderMt_ThreadFunc, p);
+}
+
+static Byte MatchFinderMt_GetIndexByte(CMatchFinderMt *p, Int32 index)
+{
+    return p->pointerToCurPos[index];
+}
+
+static UInt32 MatchFinderMt_GetNumAvailableBytes(CMatchFinderMt *p)
+{
+    return p->numAvailBytes;
+}
+
+static const Byte * MatchFinderMt_GetPointerToCurrentPos(CMatchFinderMt *p)
+{
+    return p->pointerToCurPos;
+}
+
+static UInt32 MatchFinderMt_GetMatches(CMatchFinderMt *p, UInt32 *distances)
+{
+    const UInt32 *btBuf;
+    UInt32 i, num;
+
+    while (p->btBufPos == p->btBufPosLimit)
+        if (!MatchFinderMt_GetNextBlock(p))
+            return 0;
+
+    btBuf = p->btBuf + p->btBufPos;
+    num = btBuf[0];
+    for (i = 0; i < num; i++)
+        distances[i] = btBuf[i + 1];
+    p->btBufPos += num + 1;
+    p->pointerToCurPos++;
+    p->numAvailBytes--;
+    return num;
+}
+
+static void MatchFinderMt_Skip(CMatchFinderMt *p, UInt32 num)
+{
+    while (num != 0)
+    {
+        while (p->btBufPos == p->btBufPosLimit)
+            if (!MatchFinderMt_GetNextBlock(p))
+                return;
+        p->btBufPos += p->btBuf[p->btBufPos] + 1;
+        p->pointerToCurPos++;
+        p->numAvailBytes--;
+        num--;
+    }
+}
+
+void MatchFinderMt_CreateVTable(CMatchFinderMt *p, IMatchFinder *vTable)
+{
+    (void)p;
+    vTable->Init = (Mf_Init_Func)MatchFinderMt_Init;
+    vTable->GetIndexByte = (Mf_GetIndexByte_Func)MatchFinderMt_GetIndexByte;
+    vTable->GetNumAvailableBytes = (Mf_GetNumAvailableBytes_Func)MatchFinderMt_GetNumAvailableBytes;
+    vTable->GetPointerToCurrentPos = (Mf_GetPointerToCurrentPos_Func)MatchFinderMt_GetPointerToCurrentPos;
+    vTable->GetMatches = (Mf_GetMatches_Func)MatchFinderMt_GetMatches;
+    vTable->Skip = (Mf_Skip_Func)MatchFinderMt_Skip;
+}
@@ -0,0 +1,65 @@
+/* LzFindMt.h -- pipelined match finder for LZ algorithms
+Not a part of LZMA SDK 9.20 vendored here: written for UEFITool to the interface
+that LzmaEnc.c of that SDK expects from its multithreaded match finder. Public domain */
+
+#ifndef __LZ_FIND_MT_H
+#define __LZ_FIND_MT_H
+
+#include "LzFind.h"
+#include "Threads.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  The match finder thread runs the single threaded match finder ahead of the encoder
+  and stores the matches of every position into blocks, which are read by the encoder.
+  The binary tree is updated for every position either way, so the matches are the same
+  as without the thread and the encoded stream is identical.
+  Only direct (in-memory) input is supported, because the buffer must not move.
+*/
+
+#define kMtBtNumBlocks 8
+#define kMtBtBlockSize (1 << 16)
+
+typedef struct _CMatchFinderMt
+{
+  /* encoder thread */
+  const Byte *pointerToCurPos;
+  UInt32 numAvailBytes;
+  const UInt32 *btBuf;
+  UInt32 btBufPos;
+  UInt32 btBufPosLimit;
+  int hasBlock;
+
+  /* shared, protected by lock */
+  UInt32 numWrittenBlocks;
+  UInt32 numReadBlocks;
+  int writingFinished;
+  int stopWriting;
+
+  /* match finder thread */
+  IMatchFinder mfVTable;
+  UInt32 maxRecordSize;
+
+  UInt32 *blocks;
+  UInt32 blockSizes[kMtBtNumBlocks];
+  CMtLock *lock;
+  CThread *thread;
+
+  CMatchFinder *MatchFinder;
+} CMatchFinderMt;
+
+void MatchFinderMt_Construct(CMatchFinderMt *p);
+void MatchFinderMt_Destruct(CMatchFinderMt *p, ISzAlloc *alloc);
+SRes MatchFinderMt_Create(CMatchFinderMt *p, UInt32 historySize, UInt32 keepAddBufferBefore,
+    UInt32 matchMaxLen, UInt32 keepAddBufferAfter, ISzAlloc *alloc);
+void MatchFinderMt_CreateVTable(CMatchFinderMt *p, IMatchFinder *vTable);
+void MatchFinderMt_ReleaseStream(CMatchFinderMt *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
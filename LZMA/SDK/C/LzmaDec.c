@@ -24,7 +24,17 @@
     { UPDATE_1(p); i = (i + i) + 1; A1; }
 #define GET_BIT(p, i) GET_BIT2(p, i, ; , ;)
 
-#define TREE_GET_BIT(probs, i) { GET_BIT((probs + i), i); }
+/* Branchless bit decoding for bits of literals and bit trees, which are hard to predict.
+   Sets mask to 0 for bit 0 and to all ones for bit 1, the result is the same as of GET_BIT2 */
+#define GET_BIT_MASK(p, mask) ttt = *(p); NORMALIZE; bound = (range >> kNumBitModelTotalBits) * ttt; \
+    mask = 0 - (UInt32)(code >= bound); \
+    range = bound + ((range - bound - bound) & mask); code -= bound & mask; \
+    { unsigned p0 = ttt + ((kBitModelTotal - ttt) >> kNumMoveBits); \
+      unsigned p1 = ttt - (ttt >> kNumMoveBits); \
+      *(p) = (CLzmaProb)(p0 ^ ((p0 ^ p1) & mask)); }
+#define GET_BIT_NB(p, i) { GET_BIT_MASK(p, bitMask); i = (i + i) - bitMask; }
+
+#define TREE_GET_BIT(probs, i) GET_BIT_NB((probs + i), i)
 #define TREE_DECODE(probs, limit, i) \
     { i = 1; do { TREE_GET_BIT(probs, i); } while (i < limit); i -= limit; }
 
@@ -152,6 +162,7 @@ static int MY_FAST_CALL LzmaDec_DecodeReal(CLzmaDec *p, SizeT limit, const Byte
     {
         CLzmaProb *prob;
         UInt32 bound;
+        UInt32 bitMask;
         unsigned ttt;
         unsigned posState = processedPos & pbMask;
 
@@ -169,7 +180,18 @@ static int MY_FAST_CALL LzmaDec_DecodeReal(CLzmaDec *p, SizeT limit, const Byte
             {
                 state -= (state < 4) ? state : 3;
                 symbol = 1;
-                do { GET_BIT(prob + symbol, symbol) } while (symbol < 0x100);
+#ifdef _LZMA_SIZE_OPT
+                do { GET_BIT_NB(prob + symbol, symbol) } while (symbol < 0x100);
+#else
+                GET_BIT_NB(prob + symbol, symbol)
+                GET_BIT_NB(prob + symbol, symbol)
+                GET_BIT_NB(prob + symbol, symbol)
+                GET_BIT_NB(prob + symbol, symbol)
+                GET_BIT_NB(prob + symbol, symbol)
+                GET_BIT_NB(prob + symbol, symbol)
+                GET_BIT_NB(prob + symbol, symbol)
+                GET_BIT_NB(prob + symbol, symbol)
+#endif
             }
             else
             {
@@ -184,7 +206,8 @@ static int MY_FAST_CALL LzmaDec_DecodeReal(CLzmaDec *p, SizeT limit, const Byte
                     matchByte <<= 1;
                     bit = (matchByte & offs);
                     probLit = prob + offs + bit + symbol;
-                    GET_BIT2(probLit, symbol, offs &= ~bit, offs &= bit)
+                    GET_BIT_NB(probLit, symbol)
+                    offs &= ~bit ^ bitMask;
                 } while (symbol < 0x100);
             }
             dic[dicPos++] = (Byte)symbol;
@@ -308,7 +331,8 @@ if (state >= kNumStates)
                 unsigned i = 1;
                 do
                 {
-                    GET_BIT2(prob + i, i, ;, distance |= mask);
+                    GET_BIT_NB(prob + i, i)
+                    distance |= mask & bitMask;
                     mask <<= 1;
                 } while (--numDirectBits != 0);
             }
@@ -341,10 +365,10 @@ if (state >= kNumStates)
             distance <<= kNumAlignBits;
             {
                 unsigned i = 1;
-                GET_BIT2(prob + i, i, ;, distance |= 1);
-                GET_BIT2(prob + i, i, ;, distance |= 2);
-                GET_BIT2(prob + i, i, ;, distance |= 4);
-                GET_BIT2(prob + i, i, ;, distance |= 8);
+                GET_BIT_NB(prob + i, i) distance |= 1 & bitMask;
+                GET_BIT_NB(prob + i, i) distance |= 2 & bitMask;
+                GET_BIT_NB(prob + i, i) distance |= 4 & bitMask;
+                GET_BIT_NB(prob + i, i) distance |= 8 & bitMask;
             }
             if (distance == (UInt32)0xFFFFFFFF)
             {
@@ -386,9 +410,20 @@ return SZ_ERROR_DATA;
         ptrdiff_t src = (ptrdiff_t)pos - (ptrdiff_t)dicPos;
         const Byte *lim = dest + curLen;
         dicPos += curLen;
-        do
+        /* Copy 8 bytes at a time if the source is far enough not to overlap them,
+           runs of one byte are filled at once */
+        if (src <= -8)
+        {
+            for (; lim - dest >= 8; dest += 8)
+                memcpy(dest, dest + src, 8);
+        }
+        else if (src == -1)
+        {
+            memset(dest, dest[-1], curLen);
+            dest = (Byte *)lim;
+        }
+        for (; dest != lim; dest++)
             *(dest) = (Byte)*(dest + src);
-        while (++dest != lim);
     }
     else
     {
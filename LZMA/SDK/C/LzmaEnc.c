@@ -1883,7 +1883,8 @@ static SRes LzmaEnc_Alloc(CLzmaEnc *p, UInt32 keepWindowSize, ISzAlloc *alloc, I
 #ifndef _7ZIP_ST
     {
         Bool btMode = (p->matchFinderBase.btMode != 0);
-        p->mtMode = (p->multiThread && !p->fastMode && btMode);
+        /* Multithreaded match finder supports in-memory input only */
+        p->mtMode = (p->multiThread && !p->fastMode && btMode && p->matchFinderBase.directInput);
     }
 #endif
 
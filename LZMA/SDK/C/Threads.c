@@ -0,0 +1,154 @@
+/* Threads.c -- portable threads and synchronization
+Not a part of LZMA SDK 9.20 vendored here: written for UEFITool to the interface
+that LzmaEnc.c of that SDK expects from its multithreaded match finder. Public domain */
+
+#if defined(_WIN32) || defined(_WIN64)
+#define MY_WIN32_THREADS
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <stdlib.h>
+
+#include "Threads.h"
+
+struct _CThread
+{
+#ifdef MY_WIN32_THREADS
+    HANDLE handle;
+#else
+    pthread_t thread;
+#endif
+    THREAD_FUNC_TYPE func;
+    void *param;
+};
+
+struct _CMtLock
+{
+#ifdef MY_WIN32_THREADS
+    CRITICAL_SECTION cs;
+    CONDITION_VARIABLE cond;
+#else
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif
+};
+
+#ifdef MY_WIN32_THREADS
+static unsigned __stdcall Thread_Start(void *pp)
+#else
+static void *Thread_Start(void *pp)
+#endif
+{
+    CThread *p = (CThread *)pp;
+    p->func(p->param);
+    return 0;
+}
+
+CThread *Thread_Create(THREAD_FUNC_TYPE func, void *param)
+{
+    CThread *p = (CThread *)malloc(sizeof(CThread));
+    if (p == 0)
+        return 0;
+    p->func = func;
+    p->param = param;
+#ifdef MY_WIN32_THREADS
+    p->handle = (HANDLE)_beginthreadex(NULL, 0, Thread_Start, p, 0, NULL);
+    if (p->handle == 0)
+#else
+    if (pthread_create(&p->thread, NULL, Thread_Start, p) != 0)
+#endif
+    {
+        free(p);
+        return 0;
+    }
+    return p;
+}
+
+void Thread_Join(CThread *p)
+{
+    if (p == 0)
+        return;
+#ifdef MY_WIN32_THREADS
+    WaitForSingleObject(p->handle, INFINITE);
+    CloseHandle(p->handle);
+#else
+    pthread_join(p->thread, NULL);
+#endif
+    free(p);
+}
+
+CMtLock *MtLock_Create(void)
+{
+    CMtLock *p = (CMtLock *)malloc(sizeof(CMtLock));
+    if (p == 0)
+        return 0;
+#ifdef MY_WIN32_THREADS
+    InitializeCriticalSection(&p->cs);
+    InitializeConditionVariable(&p->cond);
+#else
+    if (pthread_mutex_init(&p->mutex, NULL) != 0)
+    {
+        free(p);
+        return 0;
+    }
+    if (pthread_cond_init(&p->cond, NULL) != 0)
+    {
+        pthread_mutex_destroy(&p->mutex);
+        free(p);
+        return 0;
+    }
+#endif
+    return p;
+}
+
+void MtLock_Free(CMtLock *p)
+{
+    if (p == 0)
+        return;
+#ifdef MY_WIN32_THREADS
+    DeleteCriticalSection(&p->cs);
+#else
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->mutex);
+#endif
+    free(p);
+}
+
+void MtLock_Enter(CMtLock *p)
+{
+#ifdef MY_WIN32_THREADS
+    EnterCriticalSection(&p->cs);
+#else
+    pthread_mutex_lock(&p->mutex);
+#endif
+}
+
+void MtLock_Leave(CMtLock *p)
+{
+#ifdef MY_WIN32_THREADS
+    LeaveCriticalSection(&p->cs);
+#else
+    pthread_mutex_unlock(&p->mutex);
+#endif
+}
+
+void MtLock_Wait(CMtLock *p)
+{
+#ifdef MY_WIN32_THREADS
+    SleepConditionVariableCS(&p->cond, &p->cs, INFINITE);
+#else
+    pthread_cond_wait(&p->cond, &p->mutex);
+#endif
+}
+
+void MtLock_WakeAll(CMtLock *p)
+{
+#ifdef MY_WIN32_THREADS
+    WakeAllConditionVariable(&p->cond);
+#else
+    pthread_cond_broadcast(&p->cond);
+#endif
+}
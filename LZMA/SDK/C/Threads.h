@@ -0,0 +1,40 @@
+/* Threads.h -- portable threads and synchronization
+Not a part of LZMA SDK 9.20 vendored here: written for UEFITool to the interface
+that LzmaEnc.c of that SDK expects from its multithreaded match finder. Public domain */
+
+#ifndef __LZ_THREADS_H
+#define __LZ_THREADS_H
+
+/* This header doesn't include Types.h, because UefiLzma.h undefines _WIN32
+   and Threads.c must be able to include windows.h before any SDK header */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*THREAD_FUNC_TYPE)(void *param);
+
+typedef struct _CThread CThread;
+
+/* Returns NULL, if the thread can't be created */
+CThread *Thread_Create(THREAD_FUNC_TYPE func, void *param);
+/* Waits for the thread to finish and frees it */
+void Thread_Join(CThread *p);
+
+/* Mutex with a condition variable */
+typedef struct _CMtLock CMtLock;
+
+/* Returns NULL, if there is not enough memory or system resources */
+CMtLock *MtLock_Create(void);
+void MtLock_Free(CMtLock *p);
+void MtLock_Enter(CMtLock *p);
+void MtLock_Leave(CMtLock *p);
+/* Must be called inside of Enter/Leave */
+void MtLock_Wait(CMtLock *p);
+void MtLock_WakeAll(CMtLock *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
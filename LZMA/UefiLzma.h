@@ -25,7 +25,6 @@
 #endif
 
 #define _LZMA_SIZE_OPT
-#define _7ZIP_ST
 
 #endif // __UEFILZMA_H__
 
@@ -26,6 +26,10 @@ FFSUtil::~FFSUtil(void)
     delete ffsEngine;
 }
 
+void FFSUtil::setCompressionPreset(UINT8 preset) {
+    ffsEngine->setCompressionPreset(preset);
+}
+
 UINT8 FFSUtil::insert(QModelIndex & index, QByteArray & object, UINT8 mode) {
     return ffsEngine->insert(index, object, mode);
 }
@@ -61,46 +65,30 @@ UINT8 FFSUtil::getRootIndex(QModelIndex &result) {
 
 UINT8 FFSUtil::findFileByGUID(const QModelIndex index, const QString guid, QModelIndex & result)
 {
-    UINT8 ret;
-
     if (!index.isValid()) {
         return ERR_INVALID_SECTION;
     }
 
-    if(!ffsEngine->treeModel()->name(index).compare(guid)) {
-        result = index;
-        return ERR_SUCCESS;
-    }
+    QModelIndexList found;
+    if (ffsEngine->select(QString("*[guid=%1]").arg(guid), found, index))
+        return ERR_ITEM_NOT_FOUND;
 
-    for (int i = 0; i < ffsEngine->treeModel()->rowCount(index); i++) {
-        QModelIndex childIndex = index.child(i, 0);
-        ret = findFileByGUID(childIndex, guid, result);
-        if(result.isValid() && (ret == ERR_SUCCESS))
-            return ERR_SUCCESS;
-    }
-    return ERR_ITEM_NOT_FOUND;
+    result = found.first();
+    return ERR_SUCCESS;
 }
 
 UINT8 FFSUtil::findSectionByIndex(const QModelIndex index, UINT8 type, QModelIndex & result)
 {
-    UINT8 ret;
-
     if (!index.isValid()) {
         return ERR_INVALID_SECTION;
     }
 
-    if(ffsEngine->treeModel()->subtype(index) == type) {
-        result = index;
-        return ERR_SUCCESS;
-    }
+    QModelIndexList found;
+    if (ffsEngine->select(QString("section[type=%1h]").hexarg(type), found, index))
+        return ERR_ITEM_NOT_FOUND;
 
-    for (int i = 0; i < ffsEngine->treeModel()->rowCount(index); i++) {
-        QModelIndex childIndex = index.child(i, 0);
-        ret = findSectionByIndex(childIndex, type, result);
-        if(result.isValid() && (ret == ERR_SUCCESS))
-            return ERR_SUCCESS;
-    }
-    return ERR_ITEM_NOT_FOUND;
+    result = found.first();
+    return ERR_SUCCESS;
 }
 
 UINT8 FFSUtil::dumpFileByGUID(QString guid, QByteArray & buf, UINT8 mode)
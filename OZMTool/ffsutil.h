@@ -23,6 +23,7 @@ class FFSUtil
 public:
     FFSUtil();
     ~FFSUtil();
+    void setCompressionPreset(UINT8 preset);
     UINT8 insert(QModelIndex & index, QByteArray & object, UINT8 mode);
     UINT8 replace(QModelIndex & index, QByteArray & object, UINT8 mode);
     UINT8 extract(QModelIndex & index, QByteArray & extracted, UINT8 mode);
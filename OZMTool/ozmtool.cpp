@@ -424,6 +424,10 @@ UINT8 OZMTool::OZMCreate(QString inputfile, QString outputfile, QString inputFFS
     if(compresskexts)
         printf("Info: Compressing Kexts is selected!\n");
 
+    // Everything has to fit into existing volumes, so get the smallest compressed data possible
+    if(compressdxe || compresskexts)
+        fu->setCompressionPreset(COMPRESSION_PRESET_MAX);
+
     ret = fileOpen(inputfile, bios);
     if (ret) {
         printf("ERROR: Opening '%s' failed!\n", qPrintable(inputfile));
@@ -3,6 +3,7 @@ QMAKE_CFLAGS_RELEASE *= -O1
 QT       += core
 QT       += xml
 QT       -= gui
+greaterThan(QT_MAJOR_VERSION, 4): QT += concurrent
 
 TARGET    = OZMTool
 TEMPLATE  = app
@@ -32,11 +33,15 @@ SOURCES  += ozmtool_main.cpp \
  ../ffsengine.cpp \
  ../treeitem.cpp \
  ../treemodel.cpp \
+ ../Brotli/BrotliCompress.c \
+ ../Brotli/BrotliDecompress.c \
  ../LZMA/LzmaCompress.c \
  ../LZMA/LzmaDecompress.c \
  ../LZMA/SDK/C/LzFind.c \
+ ../LZMA/SDK/C/LzFindMt.c \
  ../LZMA/SDK/C/LzmaDec.c \
  ../LZMA/SDK/C/LzmaEnc.c \
+ ../LZMA/SDK/C/Threads.c \
  ../Tiano/EfiTianoDecompress.c \
  ../Tiano/EfiTianoCompress.c \
  ../Tiano/EfiTianoCompressLegacy.c \
@@ -59,6 +64,8 @@ HEADERS  += ozmtool.h \
  ../treeitem.h \
  ../treemodel.h \
  ../peimage.h \
+ ../Brotli/BrotliCompress.h \
+ ../Brotli/BrotliDecompress.h \
  ../LZMA/LzmaCompress.h \
  ../LZMA/LzmaDecompress.h \
  ../Tiano/EfiTianoDecompress.h \
@@ -71,3 +78,10 @@ HEADERS  += ozmtool.h \
 OTHER_FILES += \
     README \
     build_macos.sh
+
+# Brotli GUID-defined sections are only decompressed and compressed if libbrotli is found
+packagesExist(libbrotlienc libbrotlidec) {
+    CONFIG    += link_pkgconfig
+    PKGCONFIG += libbrotlienc libbrotlidec
+    DEFINES   += HAVE_BROTLI
+}
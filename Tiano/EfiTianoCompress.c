@@ -38,7 +38,24 @@ typedef INT16             NODE;
 #define MAX_HASH_VAL      (3 * WNDSIZ + (WNDSIZ / 512 + 1) * UINT8_MAX)
 #define HASH(p, c)        ((p) + ((c) << (WNDBIT - 9)) + WNDSIZ * 2)
 #define CRCPOLY           0xA001
-#define UPDATE_CRC(c)     mCrc = mCrcTable[(mCrc ^ (c)) & 0xFF] ^ (mCrc >> UINT8_BIT)
+#define HC_HASH_BITS      15
+#define HC_HASH_SIZE      (1U << HC_HASH_BITS)
+#define HC_HASH(p)        ((((UINT32)(p)[0] << 10) ^ ((UINT32)(p)[1] << 5) ^ (p)[2]) & (HC_HASH_SIZE - 1))
+#define HC_MAX_DISTANCE   (WNDSIZ - 1)
+#define HC_FAST_CHAIN     32
+#define OPT_WNDBIT        19
+#define OPT_WNDSIZ        (1U << OPT_WNDBIT)
+#define OPT_HASH_BITS     16
+#define OPT_HASH_SIZE     (1U << OPT_HASH_BITS)
+#define OPT_HASH(p)       ((((UINT32)(p)[0] << 11) ^ ((UINT32)(p)[1] << 5) ^ (p)[2]) & (OPT_HASH_SIZE - 1))
+#define OPT_CHAIN         256
+#define OPT_MATCHES       16
+#define OPT_SEGMENT       4096
+#define OPT_SPAN          (OPT_SEGMENT + MAXMATCH)
+#define OPT_PASSES        3
+#define OPT_BLOCK_SYMBOLS 0xFFFFU
+#define OPT_INFINITE      0xFFFFFFFFU
+#define UPDATE_CRC(c)     Ctx->mCrc = Ctx->mCrcTable[(Ctx->mCrc ^ (c)) & 0xFF] ^ (Ctx->mCrc >> UINT8_BIT)
 
 //
 // C: the Char&Len Set; P: the Position Set; T: the exTra Set
@@ -47,16 +64,35 @@ typedef INT16             NODE;
 #define NC                (UINT8_MAX + MAXMATCH + 2 - THRESHOLD)
 #define CBIT              9
 #define NP                (WNDBIT + 1)
-//#define PBIT              4
-UINT8 gPBIT = 4;
+#define OPT_NP            (OPT_WNDBIT + 1)
 #define NT                (CODE_BIT + 3)
 #define TBIT              5
-#if NT > NP
+#if NT > OPT_NP
   #define                 NPT NT
 #else
-  #define                 NPT NP
+  #define                 NPT OPT_NP
 #endif
 
+//
+// Optimal parser data: a match found at some position, a symbol of the parse
+// and symbol frequencies of a parse or a block
+//
+
+typedef struct {
+  UINT32 Len;
+  UINT32 Dist;
+} TIANO_OPT_MATCH;
+
+typedef struct {
+  UINT16 c;
+  UINT32 p;
+} TIANO_OPT_SYMBOL;
+
+typedef struct {
+  UINT16 CFreq[NC];
+  UINT16 PFreq[OPT_NP];
+} TIANO_OPT_FREQ;
+
 //
 // Function Prototypes
 //
@@ -64,27 +100,32 @@ UINT8 gPBIT = 4;
 STATIC
 VOID 
 PutDword(
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN UINT32 Data
   );
 
 STATIC
 EFI_STATUS 
 AllocateMemory (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
   );
 
 STATIC
 VOID
 FreeMemory (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
   );
 
 STATIC 
 VOID 
 InitSlide (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
   );
 
 STATIC 
 NODE 
 Child (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN NODE q, 
   IN UINT8 c
   );
@@ -92,6 +133,7 @@ Child (
 STATIC 
 VOID 
 MakeChild (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN NODE q, 
   IN UINT8 c, 
   IN NODE r
@@ -100,37 +142,151 @@ MakeChild (
 STATIC 
 VOID 
 Split (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN NODE Old
   );
 
 STATIC 
 VOID 
 InsertNode (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
   );
   
 STATIC 
 VOID 
 DeleteNode (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
   );
 
 STATIC 
 VOID 
 GetNextMatch (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
   );
   
 STATIC 
 EFI_STATUS 
 Encode (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  );
+
+STATIC
+EFI_STATUS
+EncodeHashChain (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  );
+
+STATIC
+UINT32
+MatchLength (
+  IN CONST UINT8 *Ref,
+  IN CONST UINT8 *Cur,
+  IN UINT32 MaxLen
+  );
+
+STATIC
+UINT32
+FindLongestMatch (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
+  IN     UINT32 Pos,
+  OUT    UINT32 *Distance
+  );
+
+STATIC
+VOID
+InsertHashChains (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
+  IN OUT UINT32 *HashedPos,
+  IN     UINT32 Limit
+  );
+
+STATIC
+EFI_STATUS
+EncodeOptimal (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  );
+
+STATIC
+EFI_STATUS
+OptAllocateMemory (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  );
+
+STATIC
+VOID
+OptInsertHashChains (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
+  IN OUT UINT32 *HashedPos,
+  IN     UINT32 Limit
+  );
+
+STATIC
+UINT32
+OptFindMatches (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
+  IN     UINT32 Pos,
+  OUT    TIANO_OPT_MATCH *Matches
+  );
+
+STATIC
+VOID
+OptMakeCosts (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
+  IN     CONST TIANO_OPT_FREQ *Freq
+  );
+
+STATIC
+UINT32
+OptParse (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
+  IN     UINT32 Start,
+  IN     UINT32 Span,
+  IN     UINT32 End,
+  OUT    UINT32 *Covered
+  );
+
+STATIC
+UINT32
+OptBlockBits (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
+  IN     CONST TIANO_OPT_FREQ *Freq
+  );
+
+STATIC
+VOID
+OptSendBlock (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
+  IN     CONST TIANO_OPT_SYMBOL *Symbols,
+  IN     UINT32 Count,
+  IN     CONST TIANO_OPT_FREQ *Freq
+  );
+
+STATIC
+VOID
+OptCountFreq (
+  IN  CONST TIANO_OPT_SYMBOL *Symbols,
+  IN  UINT32 Count,
+  OUT TIANO_OPT_FREQ *Freq
+  );
+
+STATIC
+VOID
+OptAddFreq (
+  OUT TIANO_OPT_FREQ *Sum,
+  IN  CONST TIANO_OPT_FREQ *A,
+  IN  CONST TIANO_OPT_FREQ *B
   );
 
 STATIC 
 VOID 
 CountTFreq (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
   );
 
 STATIC 
 VOID 
 WritePTLen (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN INT32 n, 
   IN INT32 nbit, 
   IN INT32 Special
@@ -139,28 +295,39 @@ WritePTLen (
 STATIC 
 VOID 
 WriteCLen (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
   );
   
 STATIC 
 VOID 
 EncodeC (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN INT32 c
   );
 
 STATIC 
 VOID 
 EncodeP (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN UINT32 p
   );
 
+STATIC
+UINT32
+SendBlockTables (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  );
+
 STATIC 
 VOID 
 SendBlock (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
   );
   
 STATIC 
 VOID 
 Output (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN UINT32 c, 
   IN UINT32 p
   );
@@ -168,21 +335,25 @@ Output (
 STATIC 
 VOID 
 HufEncodeStart (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
   );
   
 STATIC 
 VOID 
 HufEncodeEnd (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
   );
   
 STATIC 
 VOID 
 MakeCrcTable (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
   );
   
 STATIC 
 VOID 
 PutBits (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN INT32 n, 
   IN UINT32 x
   );
@@ -190,6 +361,7 @@ PutBits (
 STATIC 
 INT32 
 FreadCrc (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   OUT UINT8 *p, 
   IN  INT32 n
   );
@@ -197,29 +369,34 @@ FreadCrc (
 STATIC 
 VOID 
 InitPutBits (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
   );
   
 STATIC 
 VOID 
 CountLen (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN INT32 i
   );
 
 STATIC 
 VOID 
 MakeLen (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN INT32 Root
   );
   
 STATIC 
 VOID 
 DownHeap (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN INT32 i
   );
 
 STATIC 
 VOID 
 MakeCode (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN  INT32 n, 
   IN  UINT8 Len[], 
   OUT UINT16 Code[]
@@ -228,6 +405,7 @@ MakeCode (
 STATIC 
 INT32 
 MakeTree (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN  INT32   NParm, 
   IN  UINT16  FreqParm[], 
   OUT UINT8   LenParm[], 
@@ -236,34 +414,177 @@ MakeTree (
 
 
 //
-//  Global Variables
+// Compression context
+// Holds the complete state of a compression run, so different contexts
+// can be used from different threads at the same time. Work buffers are
+// allocated once per context and reused by all compressions done with it.
 //
 
-STATIC UINT8  *mSrc, *mDst, *mSrcUpperLimit, *mDstUpperLimit;
+struct _TIANO_COMPRESS_CONTEXT {
+  UINT8  *mSrc, *mDst, *mSrcUpperLimit, *mDstUpperLimit;
+
+  UINT8  *mLevel, *mText, *mChildCount, *mBuf, mCLen[NC], mPTLen[NPT], *mLen;
+  INT16  mHeap[NC + 1];
+  INT32  mRemainder, mMatchLen, mBitCount, mHeapSize, mN;
+  UINT32 mBufSiz, mOutputPos, mOutputMask, mSubBitBuf, mCrc;
+  UINT32 mCompSize, mOrigSize;
+
+  UINT16 *mFreq, *mSortPtr, mLenCnt[17], mLeft[2 * NC - 1], mRight[2 * NC - 1],
+         mCrcTable[UINT8_MAX + 1], mCFreq[2 * NC - 1],mCCode[NC],
+         mPFreq[2 * OPT_NP - 1], mPTCode[NPT], mTFreq[2 * NT - 1];
+
+  NODE   mPos, mMatchPos, mAvail, *mPosition, *mParent, *mPrev, *mNext;
+
+  //
+  // For EFI 1.1 compression algorithm, mPbit = 4
+  // For Tiano compression algorithm, mPbit = 5
+  //
+  UINT8  mPbit;
+
+  //
+  // Number of symbols in the Position Set, NP unless the optimal parser uses a bigger window
+  //
+  INT32  mNp;
 
-STATIC UINT8  *mLevel, *mText, *mChildCount, *mBuf, mCLen[NC], mPTLen[NPT], *mLen;
-STATIC INT16  mHeap[NC + 1];
-STATIC INT32  mRemainder, mMatchLen, mBitCount, mHeapSize, mN;
-STATIC UINT32 mBufSiz = 0, mOutputPos, mOutputMask, mSubBitBuf, mCrc;
-STATIC UINT32 mCompSize, mOrigSize;
+  //
+  // Last flag byte position in Output() and current tree depth in CountLen()
+  //
+  UINT32 mCPos;
+  INT32  mDepth;
 
-STATIC UINT16 *mFreq, *mSortPtr, mLenCnt[17], mLeft[2 * NC - 1], mRight[2 * NC - 1],
-              mCrcTable[UINT8_MAX + 1], mCFreq[2 * NC - 1],mCCode[NC],
-              mPFreq[2 * NP - 1], mPTCode[NPT], mTFreq[2 * NT - 1];
+  //
+  // Hash chain match finder, used instead of the tree one if mChainLength is not 0
+  // mHashHead holds the last position + 1 for every hash value, mHashPrev links
+  // every position inside the window to the previous one with the same hash
+  //
+  UINT32 *mHashHead, *mHashPrev;
+  UINT32 mChainLength;
 
-STATIC NODE   mPos, mMatchPos, mAvail, *mPosition, *mParent, *mPrev, *mNext = NULL;
+  //
+  // Optimal parser, used instead of both match finders above if mOptimal is set
+  // It keeps its own hash chains over a window of up to OPT_WNDSIZ bytes,
+  // matches found for every position of the segment being parsed, shortest
+  // path search arrays and symbols of the block being built.
+  // These buffers are big, so they are allocated on first use only
+  //
+  BOOLEAN          mOptimal;
+  UINT32           mOptMaxDistance;
+  UINT32           *mOptHashHead, *mOptHashPrev;
+  TIANO_OPT_MATCH  *mOptMatches;
+  UINT8            *mOptMatchCount;
+  UINT32           *mOptCost, *mOptFromDist;
+  UINT16           *mOptFromLen;
+  TIANO_OPT_SYMBOL *mOptBlock, *mOptParse;
+  UINT32           mOptCCost[NC], mOptPCost[OPT_NP];
+};
 
 
 //
 // functions
 //
 
+TIANO_COMPRESS_CONTEXT *
+TianoCompressCreateContext (
+  VOID
+  )
+/*++
+
+Routine Description:
+
+  Create a compression context usable by EfiCompressWithContext
+  and TianoCompressWithContext.
+
+Arguments: (VOID)
+
+Returns:
+
+  The new context or NULL if there is not enough memory.
+
+--*/
+{
+  TIANO_COMPRESS_CONTEXT *Ctx;
+
+  Ctx = calloc (1, sizeof (*Ctx));
+  if (Ctx == NULL) {
+    return NULL;
+  }
+
+  if (EFI_ERROR (AllocateMemory (Ctx))) {
+    FreeMemory (Ctx);
+    free (Ctx);
+    return NULL;
+  }
+
+  MakeCrcTable (Ctx);
+
+  return Ctx;
+}
+
+VOID
+TianoCompressFreeContext (
+  IN TIANO_COMPRESS_CONTEXT *Ctx
+  )
+/*++
+
+Routine Description:
+
+  Free a compression context created by TianoCompressCreateContext.
+
+Arguments:
+
+  Ctx   - The context to free, can be NULL
+
+Returns: (VOID)
+
+--*/
+{
+  if (Ctx == NULL) {
+    return;
+  }
+
+  FreeMemory (Ctx);
+  free (Ctx);
+}
+
+VOID
+TianoCompressSetPreset (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
+  IN     UINT8 Preset
+  )
+/*++
+
+Routine Description:
+
+  Select the match finder used by a compression context.
+
+Arguments:
+
+  Ctx     - The context to configure, can be NULL
+  Preset  - COMPRESSION_PRESET_FAST for the hash chain match finder,
+            COMPRESSION_PRESET_MAX for the optimal parser,
+            COMPRESSION_PRESET_DEFAULT for the binary tree match finder
+
+Returns: (VOID)
+
+--*/
+{
+  if (Ctx == NULL) {
+    return;
+  }
+
+  Ctx->mChainLength = (Preset == COMPRESSION_PRESET_FAST) ? HC_FAST_CHAIN : 0;
+  Ctx->mOptimal = (BOOLEAN)(Preset == COMPRESSION_PRESET_MAX);
+}
+
+STATIC
 EFI_STATUS
-EfiCompress (
+Compress (
+  IN OUT  TIANO_COMPRESS_CONTEXT *Ctx,
   IN      CONST VOID   *SrcBuffer,
   IN      UINT32  SrcSize,
   IN      VOID   *DstBuffer,
-  IN OUT  UINT32  *DstSize
+  IN OUT  UINT32  *DstSize,
+  IN      UINT8   Pbit
   )
 /*++
 
@@ -273,54 +594,59 @@ Routine Description:
 
 Arguments:
 
+  Ctx         - The compression context
   SrcBuffer   - The buffer storing the source data
   SrcSize     - The size of source data
   DstBuffer   - The buffer to store the compressed data
   DstSize     - On input, the size of DstBuffer; On output,
                 the size of the actual compressed data.
+  Pbit        - 4 for EFI 1.1 compression, 5 for Tiano compression
 
 Returns:
 
   EFI_BUFFER_TOO_SMALL  - The DstBuffer is too small. In this case,
                 DstSize contains the size needed.
   EFI_SUCCESS           - Compression is successful.
+  EFI_INVALID_PARAMETER - Parameter supplied is wrong.
 
 --*/
 {
-  EFI_STATUS Status = EFI_SUCCESS;
-  
+  EFI_STATUS Status;
+
+  if (Ctx == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
   //
   // Initializations
   //
-  mBufSiz = 0;
-  mBuf = NULL;
-  mText       = NULL;
-  mLevel      = NULL;
-  mChildCount = NULL;
-  mPosition   = NULL;
-  mParent     = NULL;
-  mPrev       = NULL;
-  mNext       = NULL;
-  gPBIT = 4;
-  
-  mSrc = (UINT8*)SrcBuffer;
-  mSrcUpperLimit = mSrc + SrcSize;
-  mDst = DstBuffer;
-  mDstUpperLimit = mDst + *DstSize;
-
-  PutDword(0L);
-  PutDword(0L);
-  
-  MakeCrcTable ();
-
-  mOrigSize = mCompSize = 0;
-  mCrc = INIT_CRC;
+  Ctx->mPbit = Pbit;
+  Ctx->mNp = NP;
+  Ctx->mCPos = 0;
+  Ctx->mDepth = 0;
+  
+  Ctx->mSrc = (UINT8*)SrcBuffer;
+  Ctx->mSrcUpperLimit = Ctx->mSrc + SrcSize;
+  Ctx->mDst = DstBuffer;
+  Ctx->mDstUpperLimit = Ctx->mDst + *DstSize;
+
+  PutDword(Ctx, 0L);
+  PutDword(Ctx, 0L);
+
+  Ctx->mOrigSize = Ctx->mCompSize = 0;
+  Ctx->mCrc = INIT_CRC;
   
   //
   // Compress it
   //
   
-  Status = Encode();
+  if (Ctx->mOptimal) {
+    Status = EncodeOptimal(Ctx);
+  } else if (Ctx->mChainLength != 0) {
+    Status = EncodeHashChain(Ctx);
+  } else {
+    Status = Encode(Ctx);
+  }
   if (EFI_ERROR (Status)) {
     return EFI_OUT_OF_RESOURCES;
   }
@@ -328,130 +654,101 @@ Returns:
   //
   // Null terminate the compressed data
   //
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = 0;
+  if (Ctx->mDst < Ctx->mDstUpperLimit) {
+    *Ctx->mDst++ = 0;
   }
   
   //
   // Fill in compressed size and original size
   //
-  mDst = DstBuffer;
-  PutDword(mCompSize+1);
-  PutDword(mOrigSize);
+  Ctx->mDst = DstBuffer;
+  PutDword(Ctx, Ctx->mCompSize+1);
+  PutDword(Ctx, Ctx->mOrigSize);
 
   //
   // Return
   //
   
-  if (mCompSize + 1 + 8 > *DstSize) {
-    *DstSize = mCompSize + 1 + 8;
+  if (Ctx->mCompSize + 1 + 8 > *DstSize) {
+    *DstSize = Ctx->mCompSize + 1 + 8;
     return EFI_BUFFER_TOO_SMALL;
   } else {
-    *DstSize = mCompSize + 1 + 8;
+    *DstSize = Ctx->mCompSize + 1 + 8;
     return EFI_SUCCESS;
   }
 
 }
 
 EFI_STATUS
-TianoCompress(
-IN      CONST VOID   *SrcBuffer,
-IN      UINT32  SrcSize,
-IN      VOID   *DstBuffer,
-IN OUT  UINT32  *DstSize
-)
-/*++
-
-Routine Description:
-
-The main compression routine.
-
-Arguments:
-
-SrcBuffer   - The buffer storing the source data
-SrcSize     - The size of source data
-DstBuffer   - The buffer to store the compressed data
-DstSize     - On input, the size of DstBuffer; On output,
-the size of the actual compressed data.
-
-Returns:
-
-EFI_BUFFER_TOO_SMALL  - The DstBuffer is too small. In this case,
-DstSize contains the size needed.
-EFI_SUCCESS           - Compression is successful.
-
---*/
+EfiCompressWithContext (
+  IN OUT  TIANO_COMPRESS_CONTEXT *Ctx,
+  IN      CONST VOID   *SrcBuffer,
+  IN      UINT32  SrcSize,
+  IN      VOID   *DstBuffer,
+  IN OUT  UINT32  *DstSize
+  )
 {
-    EFI_STATUS Status = EFI_SUCCESS;
-
-    //
-    // Initializations
-    //
-    mBufSiz = 0;
-    mBuf = NULL;
-    mText = NULL;
-    mLevel = NULL;
-    mChildCount = NULL;
-    mPosition = NULL;
-    mParent = NULL;
-    mPrev = NULL;
-    mNext = NULL;
-    gPBIT = 5;
-
-    mSrc = (UINT8*)SrcBuffer;
-    mSrcUpperLimit = mSrc + SrcSize;
-    mDst = DstBuffer;
-    mDstUpperLimit = mDst + *DstSize;
-
-    PutDword(0L);
-    PutDword(0L);
-
-    MakeCrcTable();
-
-    mOrigSize = mCompSize = 0;
-    mCrc = INIT_CRC;
+  return Compress(Ctx, SrcBuffer, SrcSize, DstBuffer, DstSize, 4);
+}
 
-    //
-    // Compress it
-    //
+EFI_STATUS
+TianoCompressWithContext (
+  IN OUT  TIANO_COMPRESS_CONTEXT *Ctx,
+  IN      CONST VOID   *SrcBuffer,
+  IN      UINT32  SrcSize,
+  IN      VOID   *DstBuffer,
+  IN OUT  UINT32  *DstSize
+  )
+{
+  return Compress(Ctx, SrcBuffer, SrcSize, DstBuffer, DstSize, 5);
+}
 
-    Status = Encode();
-    if (EFI_ERROR(Status)) {
-        return EFI_OUT_OF_RESOURCES;
-    }
+EFI_STATUS
+EfiCompress (
+  IN      CONST VOID   *SrcBuffer,
+  IN      UINT32  SrcSize,
+  IN      VOID   *DstBuffer,
+  IN OUT  UINT32  *DstSize
+  )
+{
+  EFI_STATUS Status;
+  TIANO_COMPRESS_CONTEXT *Ctx;
 
-    //
-    // Null terminate the compressed data
-    //
-    if (mDst < mDstUpperLimit) {
-        *mDst++ = 0;
-    }
+  Ctx = TianoCompressCreateContext();
+  if (Ctx == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
 
-    //
-    // Fill in compressed size and original size
-    //
-    mDst = DstBuffer;
-    PutDword(mCompSize + 1);
-    PutDword(mOrigSize);
+  Status = Compress(Ctx, SrcBuffer, SrcSize, DstBuffer, DstSize, 4);
+  TianoCompressFreeContext(Ctx);
+  return Status;
+}
 
-    //
-    // Return
-    //
+EFI_STATUS
+TianoCompress (
+  IN      CONST VOID   *SrcBuffer,
+  IN      UINT32  SrcSize,
+  IN      VOID   *DstBuffer,
+  IN OUT  UINT32  *DstSize
+  )
+{
+  EFI_STATUS Status;
+  TIANO_COMPRESS_CONTEXT *Ctx;
 
-    if (mCompSize + 1 + 8 > *DstSize) {
-        *DstSize = mCompSize + 1 + 8;
-        return EFI_BUFFER_TOO_SMALL;
-    }
-    else {
-        *DstSize = mCompSize + 1 + 8;
-        return EFI_SUCCESS;
-    }
+  Ctx = TianoCompressCreateContext();
+  if (Ctx == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
 
+  Status = Compress(Ctx, SrcBuffer, SrcSize, DstBuffer, DstSize, 5);
+  TianoCompressFreeContext(Ctx);
+  return Status;
 }
 
 STATIC 
 VOID 
 PutDword(
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN UINT32 Data
   )
 /*++
@@ -468,26 +765,28 @@ Returns: (VOID)
   
 --*/
 {
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = (UINT8)(((UINT8)(Data        )) & 0xff);
+  if (Ctx->mDst < Ctx->mDstUpperLimit) {
+    *Ctx->mDst++ = (UINT8)(((UINT8)(Data        )) & 0xff);
   }
 
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = (UINT8)(((UINT8)(Data >> 0x08)) & 0xff);
+  if (Ctx->mDst < Ctx->mDstUpperLimit) {
+    *Ctx->mDst++ = (UINT8)(((UINT8)(Data >> 0x08)) & 0xff);
   }
 
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = (UINT8)(((UINT8)(Data >> 0x10)) & 0xff);
+  if (Ctx->mDst < Ctx->mDstUpperLimit) {
+    *Ctx->mDst++ = (UINT8)(((UINT8)(Data >> 0x10)) & 0xff);
   }
 
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = (UINT8)(((UINT8)(Data >> 0x18)) & 0xff);
+  if (Ctx->mDst < Ctx->mDstUpperLimit) {
+    *Ctx->mDst++ = (UINT8)(((UINT8)(Data >> 0x18)) & 0xff);
   }
 }
 
 STATIC
 EFI_STATUS
-AllocateMemory ()
+AllocateMemory (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
 /*++
 
 Routine Description:
@@ -505,32 +804,40 @@ Returns:
 {
   UINT32      i;
   
-  mText       = malloc (WNDSIZ * 2 + MAXMATCH);
+  Ctx->mText       = malloc (WNDSIZ * 2 + MAXMATCH);
   for (i = 0 ; i < WNDSIZ * 2 + MAXMATCH; i ++) {
-    mText[i] = 0;
+    Ctx->mText[i] = 0;
   }
 
-  mLevel      = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof(*mLevel));
-  mChildCount = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof(*mChildCount));
-  mPosition   = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof(*mPosition));
-  mParent     = malloc (WNDSIZ * 2 * sizeof(*mParent));
-  mPrev       = malloc (WNDSIZ * 2 * sizeof(*mPrev));
-  mNext       = malloc ((MAX_HASH_VAL + 1) * sizeof(*mNext));
+  Ctx->mLevel      = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof(*Ctx->mLevel));
+  Ctx->mChildCount = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof(*Ctx->mChildCount));
+  Ctx->mPosition   = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof(*Ctx->mPosition));
+  Ctx->mParent     = malloc (WNDSIZ * 2 * sizeof(*Ctx->mParent));
+  Ctx->mPrev       = malloc (WNDSIZ * 2 * sizeof(*Ctx->mPrev));
+  Ctx->mNext       = malloc ((MAX_HASH_VAL + 1) * sizeof(*Ctx->mNext));
+
+  Ctx->mHashHead   = malloc (HC_HASH_SIZE * sizeof(*Ctx->mHashHead));
+  Ctx->mHashPrev   = malloc (WNDSIZ * sizeof(*Ctx->mHashPrev));
+  if (Ctx->mHashHead == NULL || Ctx->mHashPrev == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
   
-  mBufSiz = 16 * 1024U;
-  while ((mBuf = malloc(mBufSiz)) == NULL) {
-    mBufSiz = (mBufSiz / 10U) * 9U;
-    if (mBufSiz < 4 * 1024U) {
+  Ctx->mBufSiz = 16 * 1024U;
+  while ((Ctx->mBuf = malloc(Ctx->mBufSiz)) == NULL) {
+    Ctx->mBufSiz = (Ctx->mBufSiz / 10U) * 9U;
+    if (Ctx->mBufSiz < 4 * 1024U) {
       return EFI_OUT_OF_RESOURCES;
     }
   }
-  mBuf[0] = 0;
+  Ctx->mBuf[0] = 0;
   
   return EFI_SUCCESS;
 }
 
 VOID
-FreeMemory ()
+FreeMemory (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
 /*++
 
 Routine Description:
@@ -543,45 +850,65 @@ Returns: (VOID)
 
 --*/
 {
-  if (mText) {
-    free (mText);
+  if (Ctx->mText) {
+    free (Ctx->mText);
   }
   
-  if (mLevel) {
-    free (mLevel);
+  if (Ctx->mLevel) {
+    free (Ctx->mLevel);
   }
   
-  if (mChildCount) {
-    free (mChildCount);
+  if (Ctx->mChildCount) {
+    free (Ctx->mChildCount);
   }
   
-  if (mPosition) {
-    free (mPosition);
+  if (Ctx->mPosition) {
+    free (Ctx->mPosition);
   }
   
-  if (mParent) {
-    free (mParent);
+  if (Ctx->mParent) {
+    free (Ctx->mParent);
   }
   
-  if (mPrev) {
-    free (mPrev);
+  if (Ctx->mPrev) {
+    free (Ctx->mPrev);
   }
   
-  if (mNext) {
-    free (mNext);
+  if (Ctx->mNext) {
+    free (Ctx->mNext);
   }
   
-  if (mBuf) {
-    free (mBuf);
+  if (Ctx->mBuf) {
+    free (Ctx->mBuf);
   }  
 
+  if (Ctx->mHashHead) {
+    free (Ctx->mHashHead);
+  }
+
+  if (Ctx->mHashPrev) {
+    free (Ctx->mHashPrev);
+  }
+
+  free (Ctx->mOptHashHead);
+  free (Ctx->mOptHashPrev);
+  free (Ctx->mOptMatches);
+  free (Ctx->mOptMatchCount);
+  free (Ctx->mOptCost);
+  free (Ctx->mOptFromDist);
+  free (Ctx->mOptFromLen);
+  free (Ctx->mOptBlock);
+  free (Ctx->mOptParse);
+
   return;
 }
 
 
 STATIC 
 VOID 
-InitSlide ()
+InitSlide (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
 /*++
 
 Routine Description:
@@ -597,20 +924,20 @@ Returns: (VOID)
   NODE i;
 
   for (i = WNDSIZ; i <= (NODE)(WNDSIZ + UINT8_MAX); i++) {
-    mLevel[i] = 1;
-    mPosition[i] = NIL;  /* sentinel */
+    Ctx->mLevel[i] = 1;
+    Ctx->mPosition[i] = NIL;  /* sentinel */
   }
   for (i = WNDSIZ; i < (NODE)(WNDSIZ * 2); i++) {
-    mParent[i] = NIL;
+    Ctx->mParent[i] = NIL;
   }  
-  mAvail = 1;
+  Ctx->mAvail = 1;
   for (i = 1; i < (NODE)(WNDSIZ - 1); i++) {
-    mNext[i] = (NODE)(i + 1);
+    Ctx->mNext[i] = (NODE)(i + 1);
   }
   
-  mNext[WNDSIZ - 1] = NIL;
+  Ctx->mNext[WNDSIZ - 1] = NIL;
   for (i = WNDSIZ * 2; i <= (NODE)MAX_HASH_VAL; i++) {
-    mNext[i] = NIL;
+    Ctx->mNext[i] = NIL;
   }  
 }
 
@@ -618,6 +945,7 @@ Returns: (VOID)
 STATIC 
 NODE 
 Child (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN NODE q, 
   IN UINT8 c
   )
@@ -640,10 +968,10 @@ Returns:
 {
   NODE r;
   
-  r = mNext[HASH(q, c)];
-  mParent[NIL] = q;  /* sentinel */
-  while (mParent[r] != q) {
-    r = mNext[r];
+  r = Ctx->mNext[HASH(q, c)];
+  Ctx->mParent[NIL] = q;  /* sentinel */
+  while (Ctx->mParent[r] != q) {
+    r = Ctx->mNext[r];
   }
   
   return r;
@@ -652,6 +980,7 @@ Returns:
 STATIC 
 VOID 
 MakeChild (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN NODE q, 
   IN UINT8 c, 
   IN NODE r
@@ -675,18 +1004,19 @@ Returns: (VOID)
   NODE h, t;
   
   h = (NODE)HASH(q, c);
-  t = mNext[h];
-  mNext[h] = r;
-  mNext[r] = t;
-  mPrev[t] = r;
-  mPrev[r] = h;
-  mParent[r] = q;
-  mChildCount[q]++;
+  t = Ctx->mNext[h];
+  Ctx->mNext[h] = r;
+  Ctx->mNext[r] = t;
+  Ctx->mPrev[t] = r;
+  Ctx->mPrev[r] = h;
+  Ctx->mParent[r] = q;
+  Ctx->mChildCount[q]++;
 }
 
 STATIC 
 VOID 
 Split (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   NODE Old
   )
 /*++
@@ -705,25 +1035,27 @@ Returns: (VOID)
 {
   NODE New, t;
 
-  New = mAvail;
-  mAvail = mNext[New];
-  mChildCount[New] = 0;
-  t = mPrev[Old];
-  mPrev[New] = t;
-  mNext[t] = New;
-  t = mNext[Old];
-  mNext[New] = t;
-  mPrev[t] = New;
-  mParent[New] = mParent[Old];
-  mLevel[New] = (UINT8)mMatchLen;
-  mPosition[New] = mPos;
-  MakeChild(New, mText[mMatchPos + mMatchLen], Old);
-  MakeChild(New, mText[mPos + mMatchLen], mPos);
+  New = Ctx->mAvail;
+  Ctx->mAvail = Ctx->mNext[New];
+  Ctx->mChildCount[New] = 0;
+  t = Ctx->mPrev[Old];
+  Ctx->mPrev[New] = t;
+  Ctx->mNext[t] = New;
+  t = Ctx->mNext[Old];
+  Ctx->mNext[New] = t;
+  Ctx->mPrev[t] = New;
+  Ctx->mParent[New] = Ctx->mParent[Old];
+  Ctx->mLevel[New] = (UINT8)Ctx->mMatchLen;
+  Ctx->mPosition[New] = Ctx->mPos;
+  MakeChild(Ctx, New, Ctx->mText[Ctx->mMatchPos + Ctx->mMatchLen], Old);
+  MakeChild(Ctx, New, Ctx->mText[Ctx->mPos + Ctx->mMatchLen], Ctx->mPos);
 }
 
 STATIC 
 VOID 
-InsertNode ()
+InsertNode (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
 /*++
 
 Routine Description:
@@ -739,31 +1071,31 @@ Returns: (VOID)
   NODE q, r, j, t;
   UINT8 c, *t1, *t2;
 
-  if (mMatchLen >= 4) {
+  if (Ctx->mMatchLen >= 4) {
     
     //
     // We have just got a long match, the target tree
     // can be located by MatchPos + 1. Travese the tree
     // from bottom up to get to a proper starting point.
     // The usage of PERC_FLAG ensures proper node deletion
-    // in DeleteNode() later.
+    // in DeleteNode(Ctx) later.
     //
     
-    mMatchLen--;
-    r = (INT16)((mMatchPos + 1) | WNDSIZ);
-    while ((q = mParent[r]) == NIL) {
-      r = mNext[r];
+    Ctx->mMatchLen--;
+    r = (INT16)((Ctx->mMatchPos + 1) | WNDSIZ);
+    while ((q = Ctx->mParent[r]) == NIL) {
+      r = Ctx->mNext[r];
     }
-    while (mLevel[q] >= mMatchLen) {
-      r = q;  q = mParent[q];
+    while (Ctx->mLevel[q] >= Ctx->mMatchLen) {
+      r = q;  q = Ctx->mParent[q];
     }
     t = q;
-    while (mPosition[t] < 0) {
-      mPosition[t] = mPos;
-      t = mParent[t];
+    while (Ctx->mPosition[t] < 0) {
+      Ctx->mPosition[t] = Ctx->mPos;
+      t = Ctx->mParent[t];
     }
     if (t < (NODE)WNDSIZ) {
-      mPosition[t] = (NODE)(mPos | PERC_FLAG);
+      Ctx->mPosition[t] = (NODE)(Ctx->mPos | PERC_FLAG);
     }    
   } else {
     
@@ -771,14 +1103,14 @@ Returns: (VOID)
     // Locate the target tree
     //
     
-    q = (INT16)(mText[mPos] + WNDSIZ);
-    c = mText[mPos + 1];
-    if ((r = Child(q, c)) == NIL) {
-      MakeChild(q, c, mPos);
-      mMatchLen = 1;
+    q = (INT16)(Ctx->mText[Ctx->mPos] + WNDSIZ);
+    c = Ctx->mText[Ctx->mPos + 1];
+    if ((r = Child(Ctx, q, c)) == NIL) {
+      MakeChild(Ctx, q, c, Ctx->mPos);
+      Ctx->mMatchLen = 1;
       return;
     }
-    mMatchLen = 2;
+    Ctx->mMatchLen = 2;
   }
   
   //
@@ -790,55 +1122,57 @@ Returns: (VOID)
   for ( ; ; ) {
     if (r >= (NODE)WNDSIZ) {
       j = MAXMATCH;
-      mMatchPos = r;
+      Ctx->mMatchPos = r;
     } else {
-      j = mLevel[r];
-      mMatchPos = (NODE)(mPosition[r] & ~PERC_FLAG);
+      j = Ctx->mLevel[r];
+      Ctx->mMatchPos = (NODE)(Ctx->mPosition[r] & ~PERC_FLAG);
     }
-    if (mMatchPos >= mPos) {
-      mMatchPos -= WNDSIZ;
+    if (Ctx->mMatchPos >= Ctx->mPos) {
+      Ctx->mMatchPos -= WNDSIZ;
     }    
-    t1 = &mText[mPos + mMatchLen];
-    t2 = &mText[mMatchPos + mMatchLen];
-    while (mMatchLen < j) {
+    t1 = &Ctx->mText[Ctx->mPos + Ctx->mMatchLen];
+    t2 = &Ctx->mText[Ctx->mMatchPos + Ctx->mMatchLen];
+    while (Ctx->mMatchLen < j) {
       if (*t1 != *t2) {
-        Split(r);
+        Split(Ctx, r);
         return;
       }
-      mMatchLen++;
+      Ctx->mMatchLen++;
       t1++;
       t2++;
     }
-    if (mMatchLen >= MAXMATCH) {
+    if (Ctx->mMatchLen >= MAXMATCH) {
       break;
     }
-    mPosition[r] = mPos;
+    Ctx->mPosition[r] = Ctx->mPos;
     q = r;
-    if ((r = Child(q, *t1)) == NIL) {
-      MakeChild(q, *t1, mPos);
+    if ((r = Child(Ctx, q, *t1)) == NIL) {
+      MakeChild(Ctx, q, *t1, Ctx->mPos);
       return;
     }
-    mMatchLen++;
+    Ctx->mMatchLen++;
   }
-  t = mPrev[r];
-  mPrev[mPos] = t;
-  mNext[t] = mPos;
-  t = mNext[r];
-  mNext[mPos] = t;
-  mPrev[t] = mPos;
-  mParent[mPos] = q;
-  mParent[r] = NIL;
+  t = Ctx->mPrev[r];
+  Ctx->mPrev[Ctx->mPos] = t;
+  Ctx->mNext[t] = Ctx->mPos;
+  t = Ctx->mNext[r];
+  Ctx->mNext[Ctx->mPos] = t;
+  Ctx->mPrev[t] = Ctx->mPos;
+  Ctx->mParent[Ctx->mPos] = q;
+  Ctx->mParent[r] = NIL;
   
   //
   // Special usage of 'next'
   //
-  mNext[r] = mPos;
+  Ctx->mNext[r] = Ctx->mPos;
   
 }
 
 STATIC 
 VOID 
-DeleteNode ()
+DeleteNode (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
 /*++
 
 Routine Description:
@@ -854,65 +1188,67 @@ Returns: (VOID)
 {
   NODE q, r, s, t, u;
 
-  if (mParent[mPos] == NIL) {
+  if (Ctx->mParent[Ctx->mPos] == NIL) {
     return;
   }
   
-  r = mPrev[mPos];
-  s = mNext[mPos];
-  mNext[r] = s;
-  mPrev[s] = r;
-  r = mParent[mPos];
-  mParent[mPos] = NIL;
-  if (r >= (NODE)WNDSIZ || --mChildCount[r] > 1) {
+  r = Ctx->mPrev[Ctx->mPos];
+  s = Ctx->mNext[Ctx->mPos];
+  Ctx->mNext[r] = s;
+  Ctx->mPrev[s] = r;
+  r = Ctx->mParent[Ctx->mPos];
+  Ctx->mParent[Ctx->mPos] = NIL;
+  if (r >= (NODE)WNDSIZ || --Ctx->mChildCount[r] > 1) {
     return;
   }
-  t = (NODE)(mPosition[r] & ~PERC_FLAG);
-  if (t >= mPos) {
+  t = (NODE)(Ctx->mPosition[r] & ~PERC_FLAG);
+  if (t >= Ctx->mPos) {
     t -= WNDSIZ;
   }
   s = t;
-  q = mParent[r];
-  while ((u = mPosition[q]) & PERC_FLAG) {
+  q = Ctx->mParent[r];
+  while ((u = Ctx->mPosition[q]) & PERC_FLAG) {
     u &= ~PERC_FLAG;
-    if (u >= mPos) {
+    if (u >= Ctx->mPos) {
       u -= WNDSIZ;
     }
     if (u > s) {
       s = u;
     }
-    mPosition[q] = (INT16)(s | WNDSIZ);
-    q = mParent[q];
+    Ctx->mPosition[q] = (INT16)(s | WNDSIZ);
+    q = Ctx->mParent[q];
   }
   if (q < (NODE)WNDSIZ) {
-    if (u >= mPos) {
+    if (u >= Ctx->mPos) {
       u -= WNDSIZ;
     }
     if (u > s) {
       s = u;
     }
-    mPosition[q] = (INT16)(s | WNDSIZ | PERC_FLAG);
-  }
-  s = Child(r, mText[t + mLevel[r]]);
-  t = mPrev[s];
-  u = mNext[s];
-  mNext[t] = u;
-  mPrev[u] = t;
-  t = mPrev[r];
-  mNext[t] = s;
-  mPrev[s] = t;
-  t = mNext[r];
-  mPrev[t] = s;
-  mNext[s] = t;
-  mParent[s] = mParent[r];
-  mParent[r] = NIL;
-  mNext[r] = mAvail;
-  mAvail = r;
+    Ctx->mPosition[q] = (INT16)(s | WNDSIZ | PERC_FLAG);
+  }
+  s = Child(Ctx, r, Ctx->mText[t + Ctx->mLevel[r]]);
+  t = Ctx->mPrev[s];
+  u = Ctx->mNext[s];
+  Ctx->mNext[t] = u;
+  Ctx->mPrev[u] = t;
+  t = Ctx->mPrev[r];
+  Ctx->mNext[t] = s;
+  Ctx->mPrev[s] = t;
+  t = Ctx->mNext[r];
+  Ctx->mPrev[t] = s;
+  Ctx->mNext[s] = t;
+  Ctx->mParent[s] = Ctx->mParent[r];
+  Ctx->mParent[r] = NIL;
+  Ctx->mNext[r] = Ctx->mAvail;
+  Ctx->mAvail = r;
 }
 
 STATIC 
 VOID 
-GetNextMatch ()
+GetNextMatch (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
 /*++
 
 Routine Description:
@@ -928,20 +1264,22 @@ Returns: (VOID)
 {
   INT32 n;
 
-  mRemainder--;
-  if (++mPos == WNDSIZ * 2) {
-    memmove(&mText[0], &mText[WNDSIZ], WNDSIZ + MAXMATCH);
-    n = FreadCrc(&mText[WNDSIZ + MAXMATCH], WNDSIZ);
-    mRemainder += n;
-    mPos = WNDSIZ;
+  Ctx->mRemainder--;
+  if (++Ctx->mPos == WNDSIZ * 2) {
+    memmove(&Ctx->mText[0], &Ctx->mText[WNDSIZ], WNDSIZ + MAXMATCH);
+    n = FreadCrc(Ctx, &Ctx->mText[WNDSIZ + MAXMATCH], WNDSIZ);
+    Ctx->mRemainder += n;
+    Ctx->mPos = WNDSIZ;
   }
-  DeleteNode();
-  InsertNode();
+  DeleteNode(Ctx);
+  InsertNode(Ctx);
 }
 
 STATIC
 EFI_STATUS
-Encode ()
+Encode (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
 /*++
 
 Routine Description:
@@ -957,111 +1295,1017 @@ Returns:
 
 --*/
 {
-  EFI_STATUS  Status;
   INT32       LastMatchLen;
   NODE        LastMatchPos;
 
-  Status = AllocateMemory();
-  if (EFI_ERROR(Status)) {
-    FreeMemory();
-    return Status;
-  }
+  //
+  // Work buffers are owned by the context, reset them to the state
+  // AllocateMemory left them in
+  //
+  memset(Ctx->mText, 0, WNDSIZ * 2 + MAXMATCH);
+  Ctx->mBuf[0] = 0;
 
-  InitSlide();
+  InitSlide(Ctx);
   
-  HufEncodeStart();
+  HufEncodeStart(Ctx);
 
-  mRemainder = FreadCrc(&mText[WNDSIZ], WNDSIZ + MAXMATCH);
+  Ctx->mRemainder = FreadCrc(Ctx, &Ctx->mText[WNDSIZ], WNDSIZ + MAXMATCH);
   
-  mMatchLen = 0;
-  mPos = WNDSIZ;
-  InsertNode();
-  if (mMatchLen > mRemainder) {
-    mMatchLen = mRemainder;
+  Ctx->mMatchLen = 0;
+  Ctx->mPos = WNDSIZ;
+  InsertNode(Ctx);
+  if (Ctx->mMatchLen > Ctx->mRemainder) {
+    Ctx->mMatchLen = Ctx->mRemainder;
   }
-  while (mRemainder > 0) {
-    LastMatchLen = mMatchLen;
-    LastMatchPos = mMatchPos;
-    GetNextMatch();
-    if (mMatchLen > mRemainder) {
-      mMatchLen = mRemainder;
+  while (Ctx->mRemainder > 0) {
+    LastMatchLen = Ctx->mMatchLen;
+    LastMatchPos = Ctx->mMatchPos;
+    GetNextMatch(Ctx);
+    if (Ctx->mMatchLen > Ctx->mRemainder) {
+      Ctx->mMatchLen = Ctx->mRemainder;
     }
     
-    if (mMatchLen > LastMatchLen || LastMatchLen < THRESHOLD) {
+    if (Ctx->mMatchLen > LastMatchLen || LastMatchLen < THRESHOLD) {
       
       //
       // Not enough benefits are gained by outputting a pointer,
       // so just output the original character
       //
       
-      Output(mText[mPos - 1], 0);
+      Output(Ctx, Ctx->mText[Ctx->mPos - 1], 0);
     } else {
       
       //
       // Outputting a pointer is beneficial enough, do it.
       //
       
-      Output(LastMatchLen + (UINT8_MAX + 1 - THRESHOLD),
-             (mPos - LastMatchPos - 2) & (WNDSIZ - 1));
+      Output(Ctx, LastMatchLen + (UINT8_MAX + 1 - THRESHOLD),
+             (Ctx->mPos - LastMatchPos - 2) & (WNDSIZ - 1));
       while (--LastMatchLen > 0) {
-        GetNextMatch();
+        GetNextMatch(Ctx);
       }
-      if (mMatchLen > mRemainder) {
-        mMatchLen = mRemainder;
+      if (Ctx->mMatchLen > Ctx->mRemainder) {
+        Ctx->mMatchLen = Ctx->mRemainder;
       }
     }
   }
   
-  HufEncodeEnd();
-  FreeMemory();
+  HufEncodeEnd(Ctx);
   return EFI_SUCCESS;
 }
 
-STATIC 
-VOID 
-CountTFreq ()
+STATIC
+UINT32
+MatchLength (
+  IN CONST UINT8 *Ref,
+  IN CONST UINT8 *Cur,
+  IN UINT32 MaxLen
+  )
 /*++
 
 Routine Description:
 
-  Count the frequencies for the Extra Set
+  Count the number of equal bytes at the start of two strings
   
-Arguments: (VOID)
+Arguments:
 
-Returns: (VOID)
+  Ref     - The earlier string
+  Cur     - The current string
+  MaxLen  - The maximum number of bytes to compare
+
+Returns:
+
+  The length of the common prefix
 
 --*/
 {
-  INT32 i, k, n, Count;
+  UINT32 Len;
+  UINT64 Word1;
+  UINT64 Word2;
 
-  for (i = 0; i < NT; i++) {
-    mTFreq[i] = 0;
+  //
+  // Compare 8 bytes at a time while there is enough data left
+  //
+  Len = 0;
+  while (Len + sizeof(UINT64) <= MaxLen) {
+    memcpy(&Word1, Ref + Len, sizeof(UINT64));
+    memcpy(&Word2, Cur + Len, sizeof(UINT64));
+    if (Word1 != Word2) {
+      break;
+    }
+    Len += sizeof(UINT64);
   }
-  n = NC;
-  while (n > 0 && mCLen[n - 1] == 0) {
-    n--;
+  while (Len < MaxLen && Ref[Len] == Cur[Len]) {
+    Len++;
   }
-  i = 0;
-  while (i < n) {
-    k = mCLen[i++];
-    if (k == 0) {
-      Count = 1;
-      while (i < n && mCLen[i] == 0) {
+
+  return Len;
+}
+
+STATIC
+UINT32
+FindLongestMatch (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
+  IN     UINT32 Pos,
+  OUT    UINT32 *Distance
+  )
+/*++
+
+Routine Description:
+
+  Find the longest match for the string at Pos by walking its hash chain
+  
+Arguments:
+
+  Pos       - The position of the string in source buffer, all the previous
+              positions must be in hash chains, at least THRESHOLD bytes must be available
+  Distance  - The distance to the match found
+  
+Returns:
+
+  The length of the match found, 0 if there is none
+
+--*/
+{
+  UINT8  *Cur;
+  UINT8  *Ref;
+  UINT32 Candidate;
+  UINT32 MaxLen;
+  UINT32 BestLen;
+  UINT32 Len;
+  UINT32 ChainLength;
+
+  Cur = Ctx->mSrc + Pos;
+  MaxLen = (UINT32)(Ctx->mSrcUpperLimit - Cur);
+  if (MaxLen > MAXMATCH) {
+    MaxLen = MAXMATCH;
+  }
+
+  BestLen = 0;
+  ChainLength = Ctx->mChainLength;
+  Candidate = Ctx->mHashHead[HC_HASH(Cur)];
+  while (Candidate != 0 && ChainLength-- > 0) {
+    Candidate--;
+    if (Pos - Candidate > HC_MAX_DISTANCE) {
+      break;
+    }
+
+    Ref = Ctx->mSrc + Candidate;
+    //
+    // Skip candidates that can't be longer than the best match found
+    //
+    if (Ref[BestLen] == Cur[BestLen] && Ref[0] == Cur[0]) {
+      Len = MatchLength(Ref, Cur, MaxLen);
+      if (Len > BestLen) {
+        BestLen = Len;
+        *Distance = Pos - Candidate;
+        if (Len == MaxLen) {
+          break;
+        }
+      }
+    }
+
+    //
+    // Chain links are overwritten when the window slides, so stop on one that doesn't go back
+    //
+    if (Ctx->mHashPrev[Candidate & (WNDSIZ - 1)] > Candidate) {
+      break;
+    }
+    Candidate = Ctx->mHashPrev[Candidate & (WNDSIZ - 1)];
+  }
+
+  return BestLen;
+}
+
+STATIC
+VOID
+InsertHashChains (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
+  IN OUT UINT32 *HashedPos,
+  IN     UINT32 Limit
+  )
+/*++
+
+Routine Description:
+
+  Add all strings at positions from HashedPos up to, but not including, Limit
+  to hash chains
+  
+Arguments:
+
+  HashedPos - The first position not yet added, updated on return
+  Limit     - The position to stop at
+  
+Returns: (VOID)
+
+--*/
+{
+  UINT32 Hash;
+
+  while (*HashedPos < Limit && Ctx->mSrc + *HashedPos + THRESHOLD <= Ctx->mSrcUpperLimit) {
+    Hash = HC_HASH(Ctx->mSrc + *HashedPos);
+    Ctx->mHashPrev[*HashedPos & (WNDSIZ - 1)] = Ctx->mHashHead[Hash];
+    Ctx->mHashHead[Hash] = *HashedPos + 1;
+    (*HashedPos)++;
+  }
+}
+
+STATIC
+EFI_STATUS
+EncodeHashChain (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
+/*++
+
+Routine Description:
+
+  The controlling routine for compression process using hash chain match finder.
+  Unlike Encode(), works on the whole source buffer directly and uses lazy
+  matching: a match is only taken if the next position doesn't start a longer one.
+
+Arguments: (VOID)
+
+Returns:
+  
+  EFI_SUCCESS           - The compression is successful
+
+--*/
+{
+  UINT32 Size;
+  UINT32 Pos;
+  UINT32 HashedPos;
+  UINT32 MatchLen;
+  UINT32 MatchDistance;
+  UINT32 NextLen;
+  UINT32 NextDistance;
+
+  Size = (UINT32)(Ctx->mSrcUpperLimit - Ctx->mSrc);
+  memset(Ctx->mHashHead, 0, HC_HASH_SIZE * sizeof(*Ctx->mHashHead));
+  Ctx->mBuf[0] = 0;
+
+  HufEncodeStart(Ctx);
+
+  Pos = 0;
+  HashedPos = 0;
+  MatchLen = 0;
+  MatchDistance = 0;
+  while (Pos < Size) {
+    if (MatchLen == 0) {
+      InsertHashChains(Ctx, &HashedPos, Pos);
+      if (Pos + THRESHOLD <= Size) {
+        MatchLen = FindLongestMatch(Ctx, Pos, &MatchDistance);
+      }
+    }
+
+    if (MatchLen < THRESHOLD) {
+      Output(Ctx, Ctx->mSrc[Pos], 0);
+      Pos++;
+      MatchLen = 0;
+      continue;
+    }
+
+    //
+    // Check if the next position starts a longer match
+    //
+    NextLen = 0;
+    if (MatchLen < MAXMATCH && Pos + 1 + THRESHOLD <= Size) {
+      InsertHashChains(Ctx, &HashedPos, Pos + 1);
+      NextLen = FindLongestMatch(Ctx, Pos + 1, &NextDistance);
+    }
+
+    if (NextLen > MatchLen) {
+      Output(Ctx, Ctx->mSrc[Pos], 0);
+      Pos++;
+      MatchLen = NextLen;
+      MatchDistance = NextDistance;
+      continue;
+    }
+
+    Output(Ctx, MatchLen + (UINT8_MAX + 1 - THRESHOLD), MatchDistance - 1);
+    Pos += MatchLen;
+    MatchLen = 0;
+  }
+
+  Ctx->mOrigSize = Size;
+  HufEncodeEnd(Ctx);
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+OptAllocateMemory (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
+/*++
+
+Routine Description:
+
+  Allocate work buffers of the optimal parser if it wasn't done before
+  
+Arguments: (VOID)
+
+Returns:
+
+  EFI_SUCCESS           - Memory is allocated successfully
+  EFI_OUT_OF_RESOURCES  - Allocation fails
+
+--*/
+{
+  if (Ctx->mOptBlock != NULL) {
+    return EFI_SUCCESS;
+  }
+
+  Ctx->mOptHashHead   = malloc (OPT_HASH_SIZE * sizeof(*Ctx->mOptHashHead));
+  Ctx->mOptHashPrev   = malloc (OPT_WNDSIZ * sizeof(*Ctx->mOptHashPrev));
+  Ctx->mOptMatches    = malloc (OPT_SPAN * OPT_MATCHES * sizeof(*Ctx->mOptMatches));
+  Ctx->mOptMatchCount = malloc (OPT_SPAN * sizeof(*Ctx->mOptMatchCount));
+  Ctx->mOptCost       = malloc ((OPT_SPAN + 1) * sizeof(*Ctx->mOptCost));
+  Ctx->mOptFromDist   = malloc ((OPT_SPAN + 1) * sizeof(*Ctx->mOptFromDist));
+  Ctx->mOptFromLen    = malloc ((OPT_SPAN + 1) * sizeof(*Ctx->mOptFromLen));
+  Ctx->mOptParse      = malloc (OPT_SPAN * sizeof(*Ctx->mOptParse));
+  if (Ctx->mOptHashHead == NULL || Ctx->mOptHashPrev == NULL || Ctx->mOptMatches == NULL ||
+      Ctx->mOptMatchCount == NULL || Ctx->mOptCost == NULL || Ctx->mOptFromDist == NULL ||
+      Ctx->mOptFromLen == NULL || Ctx->mOptParse == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  //
+  // Allocated last, so it tells if all the others are ready
+  //
+  Ctx->mOptBlock = malloc ((OPT_BLOCK_SYMBOLS + OPT_SPAN) * sizeof(*Ctx->mOptBlock));
+  if (Ctx->mOptBlock == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+OptInsertHashChains (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
+  IN OUT UINT32 *HashedPos,
+  IN     UINT32 Limit
+  )
+/*++
+
+Routine Description:
+
+  Add all strings at positions from HashedPos up to, but not including, Limit
+  to hash chains of the optimal parser
+  
+Arguments:
+
+  HashedPos - The first position not yet added, updated on return
+  Limit     - The position to stop at
+  
+Returns: (VOID)
+
+--*/
+{
+  UINT32 Hash;
+
+  while (*HashedPos < Limit && Ctx->mSrc + *HashedPos + THRESHOLD <= Ctx->mSrcUpperLimit) {
+    Hash = OPT_HASH(Ctx->mSrc + *HashedPos);
+    Ctx->mOptHashPrev[*HashedPos & (OPT_WNDSIZ - 1)] = Ctx->mOptHashHead[Hash];
+    Ctx->mOptHashHead[Hash] = *HashedPos + 1;
+    (*HashedPos)++;
+  }
+}
+
+STATIC
+UINT32
+OptFindMatches (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
+  IN     UINT32 Pos,
+  OUT    TIANO_OPT_MATCH *Matches
+  )
+/*++
+
+Routine Description:
+
+  Find matches for the string at Pos, each one longer than the previous.
+  A match of some length is then the closest one having at least that length.
+  
+Arguments:
+
+  Pos       - The position of the string in source buffer, all the previous
+              positions must be in hash chains, at least THRESHOLD bytes must be available
+  Matches   - Receives up to OPT_MATCHES matches, ordered by length
+  
+Returns:
+
+  The number of matches found
+
+--*/
+{
+  UINT8  *Cur;
+  UINT8  *Ref;
+  UINT32 Candidate;
+  UINT32 MaxLen;
+  UINT32 BestLen;
+  UINT32 Len;
+  UINT32 ChainLength;
+  UINT32 Count;
+
+  Cur = Ctx->mSrc + Pos;
+  MaxLen = (UINT32)(Ctx->mSrcUpperLimit - Cur);
+  if (MaxLen > MAXMATCH) {
+    MaxLen = MAXMATCH;
+  }
+
+  Count = 0;
+  BestLen = THRESHOLD - 1;
+  ChainLength = OPT_CHAIN;
+  Candidate = Ctx->mOptHashHead[OPT_HASH(Cur)];
+  while (Candidate != 0 && ChainLength-- > 0) {
+    Candidate--;
+    if (Pos - Candidate > Ctx->mOptMaxDistance) {
+      break;
+    }
+
+    Ref = Ctx->mSrc + Candidate;
+    if (Ref[BestLen] == Cur[BestLen] && Ref[0] == Cur[0]) {
+      Len = MatchLength(Ref, Cur, MaxLen);
+      if (Len > BestLen) {
+        BestLen = Len;
+        //
+        // Replace the last match if there is no more room, the longer one is more useful
+        //
+        if (Count == OPT_MATCHES) {
+          Count--;
+        }
+        Matches[Count].Len = Len;
+        Matches[Count].Dist = Pos - Candidate;
+        Count++;
+        if (Len == MaxLen) {
+          break;
+        }
+      }
+    }
+
+    if (Ctx->mOptHashPrev[Candidate & (OPT_WNDSIZ - 1)] > Candidate) {
+      break;
+    }
+    Candidate = Ctx->mOptHashPrev[Candidate & (OPT_WNDSIZ - 1)];
+  }
+
+  return Count;
+}
+
+STATIC
+VOID
+OptMakeCosts (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
+  IN     CONST TIANO_OPT_FREQ *Freq
+  )
+/*++
+
+Routine Description:
+
+  Estimate the cost in bits of every symbol from Huffman codes made for the given
+  frequencies. Symbols not used yet get the cost of a rare one. Position costs
+  include the extra bits following the position code.
+  
+Arguments:
+
+  Freq  - The frequencies to make codes for, all zero for initial estimation
+  
+Returns: (VOID)
+
+--*/
+{
+  UINT32 i, Total, Unused, Root;
+
+  //
+  // mCFreq, mCLen and other block arrays are only filled by OptSendBlock() in optimal mode,
+  // so they are free to use here
+  //
+  Total = 0;
+  for (i = 0; i < NC; i++) {
+    Ctx->mCFreq[i] = Freq->CFreq[i];
+    Total += Freq->CFreq[i];
+  }
+  if (Total == 0) {
+    for (i = 0; i < NC; i++) {
+      Ctx->mOptCCost[i] = (i < (1U << UINT8_BIT)) ? UINT8_BIT : UINT8_BIT + 4;
+    }
+  } else {
+    Unused = 1;
+    while ((Total >> Unused) != 0 && Unused < 16) {
+      Unused++;
+    }
+    Root = MakeTree(Ctx, NC, Ctx->mCFreq, Ctx->mCLen, Ctx->mCCode);
+    for (i = 0; i < NC; i++) {
+      if (Root < NC) {
+        Ctx->mOptCCost[i] = (i == Root) ? 1 : Unused;
+      } else {
+        Ctx->mOptCCost[i] = Ctx->mCLen[i] ? Ctx->mCLen[i] : Unused;
+      }
+    }
+  }
+
+  Total = 0;
+  for (i = 0; i < (UINT32)Ctx->mNp; i++) {
+    Ctx->mPFreq[i] = Freq->PFreq[i];
+    Total += Freq->PFreq[i];
+  }
+  if (Total == 0) {
+    for (i = 0; i < (UINT32)Ctx->mNp; i++) {
+      Ctx->mOptPCost[i] = 4;
+    }
+  } else {
+    Unused = 1;
+    while ((Total >> Unused) != 0 && Unused < 16) {
+      Unused++;
+    }
+    Root = MakeTree(Ctx, Ctx->mNp, Ctx->mPFreq, Ctx->mPTLen, Ctx->mPTCode);
+    for (i = 0; i < (UINT32)Ctx->mNp; i++) {
+      if (Root < (UINT32)Ctx->mNp) {
+        Ctx->mOptPCost[i] = (i == Root) ? 1 : Unused;
+      } else {
+        Ctx->mOptPCost[i] = Ctx->mPTLen[i] ? Ctx->mPTLen[i] : Unused;
+      }
+    }
+  }
+  for (i = 2; i < (UINT32)Ctx->mNp; i++) {
+    Ctx->mOptPCost[i] += i - 1;
+  }
+}
+
+STATIC
+UINT32
+OptParse (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
+  IN     UINT32 Start,
+  IN     UINT32 Span,
+  IN     UINT32 End,
+  OUT    UINT32 *Covered
+  )
+/*++
+
+Routine Description:
+
+  Find the cheapest sequence of literals and matches for Span bytes at Start
+  using current symbol costs and matches found for every position.
+  The sequence is cut after the first symbol reaching End, the rest will
+  be parsed again as a part of the next segment.
+  
+Arguments:
+
+  Start   - The position of the segment in source buffer
+  Span    - The number of bytes to parse, matches are found for all of them
+  End     - The number of bytes to cover at least
+  Covered - The number of bytes covered by the sequence
+  
+Returns:
+
+  The number of symbols stored to mOptParse
+
+--*/
+{
+  UINT32          i, j, l, MaxLen, Count, SkipUntil, PCost, Cost, p, c;
+  UINT32          *Costs;
+  TIANO_OPT_MATCH *Matches;
+
+  Costs = Ctx->mOptCost;
+  Costs[0] = 0;
+  for (i = 1; i <= Span; i++) {
+    Costs[i] = OPT_INFINITE;
+  }
+
+  SkipUntil = 0;
+  for (i = 0; i < Span; i++) {
+    if (i < SkipUntil || Costs[i] == OPT_INFINITE) {
+      continue;
+    }
+
+    Cost = Costs[i] + Ctx->mOptCCost[Ctx->mSrc[Start + i]];
+    if (Cost < Costs[i + 1]) {
+      Costs[i + 1] = Cost;
+      Ctx->mOptFromLen[i + 1] = 1;
+    }
+
+    Count = Ctx->mOptMatchCount[i];
+    if (Count == 0) {
+      continue;
+    }
+    Matches = Ctx->mOptMatches + i * OPT_MATCHES;
+    MaxLen = Span - i;
+
+    //
+    // Nothing can be better than the longest match possible, take it and skip the positions it covers
+    //
+    if (Matches[Count - 1].Len == MAXMATCH) {
+      Count = 1;
+      Matches += Ctx->mOptMatchCount[i] - 1;
+      SkipUntil = i + ((MaxLen < MAXMATCH) ? MaxLen : MAXMATCH);
+    }
+
+    l = THRESHOLD;
+    for (j = 0; j < Count && l <= MaxLen; j++) {
+      p = Matches[j].Dist - 1;
+      c = 0;
+      while (p) {
+        p >>= 1;
+        c++;
+      }
+      PCost = Costs[i] + Ctx->mOptPCost[c];
+      if (Count == 1 && SkipUntil > i) {
+        l = SkipUntil - i;
+      }
+      for (; l <= Matches[j].Len && l <= MaxLen; l++) {
+        Cost = PCost + Ctx->mOptCCost[l + (UINT8_MAX + 1 - THRESHOLD)];
+        if (Cost < Costs[i + l]) {
+          Costs[i + l] = Cost;
+          Ctx->mOptFromLen[i + l] = (UINT16)l;
+          Ctx->mOptFromDist[i + l] = Matches[j].Dist;
+        }
+      }
+    }
+  }
+
+  //
+  // Walk the cheapest path back, storing symbol lengths at their end positions, then emit them in order
+  //
+  Count = 0;
+  for (i = Span; i > 0; i -= Ctx->mOptFromLen[i]) {
+    Count++;
+  }
+  j = Count;
+  for (i = Span; i > 0; i -= Ctx->mOptFromLen[i]) {
+    j--;
+    l = Ctx->mOptFromLen[i];
+    if (l == 1) {
+      Ctx->mOptParse[j].c = Ctx->mSrc[Start + i - 1];
+      Ctx->mOptParse[j].p = 0;
+    } else {
+      Ctx->mOptParse[j].c = (UINT16)(l + (UINT8_MAX + 1 - THRESHOLD));
+      Ctx->mOptParse[j].p = Ctx->mOptFromDist[i] - 1;
+    }
+  }
+
+  i = 0;
+  for (j = 0; j < Count && i < End; j++) {
+    i += (Ctx->mOptParse[j].c < (1U << UINT8_BIT)) ? 1 : Ctx->mOptParse[j].c - (UINT8_MAX + 1 - THRESHOLD);
+  }
+  *Covered = i;
+  return j;
+}
+
+STATIC
+UINT32
+OptBlockBits (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
+  IN     CONST TIANO_OPT_FREQ *Freq
+  )
+/*++
+
+Routine Description:
+
+  Calculate the exact size of a block with the given symbol frequencies
+  by writing its tables with output disabled and adding code lengths
+  
+Arguments:
+
+  Freq  - The frequencies of symbols in the block
+  
+Returns:
+
+  The size of the block in bits
+
+--*/
+{
+  UINT8  *Dst;
+  UINT8  *DstUpperLimit;
+  UINT32 CompSize;
+  INT32  BitCount;
+  UINT32 SubBitBuf;
+  UINT32 Bits;
+  UINT32 i;
+
+  Dst = Ctx->mDst;
+  DstUpperLimit = Ctx->mDstUpperLimit;
+  CompSize = Ctx->mCompSize;
+  BitCount = Ctx->mBitCount;
+  SubBitBuf = Ctx->mSubBitBuf;
+  Ctx->mDstUpperLimit = Ctx->mDst;
+
+  memcpy(Ctx->mCFreq, Freq->CFreq, sizeof(Freq->CFreq));
+  memcpy(Ctx->mPFreq, Freq->PFreq, sizeof(Freq->PFreq));
+  SendBlockTables(Ctx);
+  Bits = (Ctx->mCompSize - CompSize) * UINT8_BIT + BitCount - Ctx->mBitCount;
+
+  //
+  // Code lengths are all 0 if only one symbol is used, just like in SendBlock()
+  //
+  for (i = 0; i < NC; i++) {
+    Bits += Freq->CFreq[i] * Ctx->mCLen[i];
+  }
+  for (i = 0; i < (UINT32)Ctx->mNp; i++) {
+    Bits += Freq->PFreq[i] * (Ctx->mPTLen[i] + ((i > 1) ? i - 1 : 0));
+  }
+
+  Ctx->mDst = Dst;
+  Ctx->mDstUpperLimit = DstUpperLimit;
+  Ctx->mCompSize = CompSize;
+  Ctx->mBitCount = BitCount;
+  Ctx->mSubBitBuf = SubBitBuf;
+  return Bits;
+}
+
+STATIC
+VOID
+OptSendBlock (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
+  IN     CONST TIANO_OPT_SYMBOL *Symbols,
+  IN     UINT32 Count,
+  IN     CONST TIANO_OPT_FREQ *Freq
+  )
+/*++
+
+Routine Description:
+
+  Huffman code a block of the optimal parser and output it.
+  
+Arguments:
+
+  Symbols - The symbols of the block
+  Count   - The number of symbols
+  Freq    - The frequencies of symbols in the block
+  
+Returns: (VOID)
+
+--*/
+{
+  UINT32 i;
+
+  memcpy(Ctx->mCFreq, Freq->CFreq, sizeof(Freq->CFreq));
+  memcpy(Ctx->mPFreq, Freq->PFreq, sizeof(Freq->PFreq));
+  SendBlockTables(Ctx);
+  for (i = 0; i < Count; i++) {
+    EncodeC(Ctx, Symbols[i].c);
+    if (Symbols[i].c >= (1U << UINT8_BIT)) {
+      EncodeP(Ctx, Symbols[i].p);
+    }
+  }
+}
+
+STATIC
+VOID
+OptCountFreq (
+  IN  CONST TIANO_OPT_SYMBOL *Symbols,
+  IN  UINT32 Count,
+  OUT TIANO_OPT_FREQ *Freq
+  )
+/*++
+
+Routine Description:
+
+  Count symbol frequencies of a parse
+  
+Arguments:
+
+  Symbols - The symbols of the parse
+  Count   - The number of symbols
+  Freq    - Receives the frequencies
+  
+Returns: (VOID)
+
+--*/
+{
+  UINT32 i, c, p;
+
+  memset(Freq, 0, sizeof(*Freq));
+  for (i = 0; i < Count; i++) {
+    Freq->CFreq[Symbols[i].c]++;
+    if (Symbols[i].c >= (1U << UINT8_BIT)) {
+      c = 0;
+      p = Symbols[i].p;
+      while (p) {
+        p >>= 1;
+        c++;
+      }
+      Freq->PFreq[c]++;
+    }
+  }
+}
+
+STATIC
+VOID
+OptAddFreq (
+  OUT TIANO_OPT_FREQ *Sum,
+  IN  CONST TIANO_OPT_FREQ *A,
+  IN  CONST TIANO_OPT_FREQ *B
+  )
+{
+  UINT32 i;
+
+  for (i = 0; i < NC; i++) {
+    Sum->CFreq[i] = (UINT16)(A->CFreq[i] + B->CFreq[i]);
+  }
+  for (i = 0; i < OPT_NP; i++) {
+    Sum->PFreq[i] = (UINT16)(A->PFreq[i] + B->PFreq[i]);
+  }
+}
+
+STATIC
+EFI_STATUS
+EncodeOptimal (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
+/*++
+
+Routine Description:
+
+  The controlling routine for compression process using the optimal parser.
+  The source is parsed in segments of OPT_SEGMENT bytes. Each segment is parsed
+  OPT_PASSES times into the cheapest sequence of symbols according to costs
+  estimated from the block it will likely be added to, the best parse is kept.
+  The segment then either extends the current block or starts a new one,
+  whatever gives smaller output.
+  
+Arguments: (VOID)
+
+Returns:
+  
+  EFI_SUCCESS           - The compression is successful
+  EFI_OUT_OF_RESOURCES  - Not enough memory for work buffers
+
+--*/
+{
+  UINT32         Size;
+  UINT32         Start;
+  UINT32         Span;
+  UINT32         End;
+  UINT32         Pos;
+  UINT32         HashedPos;
+  UINT32         Matched;
+  UINT32         Pass;
+  UINT32         Count;
+  UINT32         Covered;
+  UINT32         BestCount;
+  UINT32         BestCovered;
+  UINT32         Bits;
+  UINT32         BestBits;
+  UINT32         BlockCount;
+  UINT32         BlockBits;
+  TIANO_OPT_FREQ Block;
+  TIANO_OPT_FREQ Last;
+  TIANO_OPT_FREQ Parse;
+  TIANO_OPT_FREQ Best;
+  TIANO_OPT_FREQ Merged;
+
+  if (EFI_ERROR (OptAllocateMemory (Ctx))) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  //
+  // Tiano decompressors handle the window of the legacy compressor, EFI 1.1 ones only the default window
+  //
+  if (Ctx->mPbit == 5) {
+    Ctx->mNp = OPT_NP;
+    Ctx->mOptMaxDistance = OPT_WNDSIZ - 1;
+  } else {
+    Ctx->mNp = NP;
+    Ctx->mOptMaxDistance = WNDSIZ - 1;
+  }
+
+  Size = (UINT32)(Ctx->mSrcUpperLimit - Ctx->mSrc);
+  memset(Ctx->mOptHashHead, 0, OPT_HASH_SIZE * sizeof(*Ctx->mOptHashHead));
+  HufEncodeStart(Ctx);
+
+  memset(&Block, 0, sizeof(Block));
+  memset(&Last, 0, sizeof(Last));
+  BlockCount = 0;
+  BlockBits = 0;
+  HashedPos = 0;
+  Matched = 0;
+  Start = 0;
+  while (Start < Size) {
+    Span = Size - Start;
+    if (Span > OPT_SPAN) {
+      Span = OPT_SPAN;
+    }
+    End = (Span > OPT_SEGMENT) ? OPT_SEGMENT : Span;
+
+    //
+    // Find matches for new positions, ones left from the previous segment are already there
+    //
+    for (Pos = Matched; Pos < Start + Span; Pos++) {
+      OptInsertHashChains(Ctx, &HashedPos, Pos);
+      Ctx->mOptMatchCount[Pos - Start] = 0;
+      if (Pos + THRESHOLD <= Size) {
+        Ctx->mOptMatchCount[Pos - Start] = (UINT8)OptFindMatches(Ctx, Pos, Ctx->mOptMatches + (Pos - Start) * OPT_MATCHES);
+      }
+    }
+    Matched = Start + Span;
+
+    //
+    // Parse the segment several times, each time with costs from the previous parse,
+    // and keep the one adding the least bits per byte to the current block
+    //
+    OptAddFreq(&Merged, &Block, &Last);
+    BestBits = OPT_INFINITE;
+    BestCount = 0;
+    BestCovered = 1;
+    for (Pass = 0; Pass < OPT_PASSES; Pass++) {
+      OptMakeCosts(Ctx, &Merged);
+      Count = OptParse(Ctx, Start, Span, End, &Covered);
+      OptCountFreq(Ctx->mOptParse, Count, &Parse);
+      OptAddFreq(&Merged, &Block, &Parse);
+      Bits = OptBlockBits(Ctx, &Merged) - BlockBits;
+      if ((UINT64)Bits * BestCovered < (UINT64)BestBits * Covered) {
+        BestBits = Bits;
+        BestCount = Count;
+        BestCovered = Covered;
+        Best = Parse;
+        memcpy(Ctx->mOptBlock + BlockCount, Ctx->mOptParse, Count * sizeof(*Ctx->mOptParse));
+      }
+    }
+
+    //
+    // Start a new block if it's cheaper than extending the current one
+    //
+    if (BlockCount != 0) {
+      OptAddFreq(&Merged, &Block, &Best);
+      Bits = OptBlockBits(Ctx, &Best);
+      if (BlockCount + BestCount > OPT_BLOCK_SYMBOLS || BlockBits + Bits < OptBlockBits(Ctx, &Merged)) {
+        OptSendBlock(Ctx, Ctx->mOptBlock, BlockCount, &Block);
+        memmove(Ctx->mOptBlock, Ctx->mOptBlock + BlockCount, BestCount * sizeof(*Ctx->mOptBlock));
+        BlockCount = 0;
+        memset(&Block, 0, sizeof(Block));
+      }
+    }
+    OptAddFreq(&Block, &Block, &Best);
+    BlockCount += BestCount;
+    BlockBits = OptBlockBits(Ctx, &Block);
+    Last = Best;
+
+    //
+    // Keep matches of positions not covered yet
+    //
+    memmove(Ctx->mOptMatches, Ctx->mOptMatches + BestCovered * OPT_MATCHES,
+            (Matched - Start - BestCovered) * OPT_MATCHES * sizeof(*Ctx->mOptMatches));
+    memmove(Ctx->mOptMatchCount, Ctx->mOptMatchCount + BestCovered,
+            (Matched - Start - BestCovered) * sizeof(*Ctx->mOptMatchCount));
+    Start += BestCovered;
+  }
+
+  OptSendBlock(Ctx, Ctx->mOptBlock, BlockCount, &Block);
+  PutBits(Ctx, UINT8_BIT - 1, 0);
+
+  Ctx->mOrigSize = Size;
+  return EFI_SUCCESS;
+}
+
+STATIC 
+VOID 
+CountTFreq (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
+/*++
+
+Routine Description:
+
+  Count the frequencies for the Extra Set
+  
+Arguments: (VOID)
+
+Returns: (VOID)
+
+--*/
+{
+  INT32 i, k, n, Count;
+
+  for (i = 0; i < NT; i++) {
+    Ctx->mTFreq[i] = 0;
+  }
+  n = NC;
+  while (n > 0 && Ctx->mCLen[n - 1] == 0) {
+    n--;
+  }
+  i = 0;
+  while (i < n) {
+    k = Ctx->mCLen[i++];
+    if (k == 0) {
+      Count = 1;
+      while (i < n && Ctx->mCLen[i] == 0) {
         i++;
         Count++;
       }
       if (Count <= 2) {
-        mTFreq[0] = (UINT16)(mTFreq[0] + Count);
+        Ctx->mTFreq[0] = (UINT16)(Ctx->mTFreq[0] + Count);
       } else if (Count <= 18) {
-        mTFreq[1]++;
+        Ctx->mTFreq[1]++;
       } else if (Count == 19) {
-        mTFreq[0]++;
-        mTFreq[1]++;
+        Ctx->mTFreq[0]++;
+        Ctx->mTFreq[1]++;
       } else {
-        mTFreq[2]++;
+        Ctx->mTFreq[2]++;
       }
     } else {
-      mTFreq[k + 2]++;
+      Ctx->mTFreq[k + 2]++;
     }
   }
 }
@@ -1069,6 +2313,7 @@ Returns: (VOID)
 STATIC 
 VOID 
 WritePTLen (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN INT32 n, 
   IN INT32 nbit, 
   IN INT32 Special
@@ -1091,30 +2336,32 @@ Returns: (VOID)
 {
   INT32 i, k;
 
-  while (n > 0 && mPTLen[n - 1] == 0) {
+  while (n > 0 && Ctx->mPTLen[n - 1] == 0) {
     n--;
   }
-  PutBits(nbit, n);
+  PutBits(Ctx, nbit, n);
   i = 0;
   while (i < n) {
-    k = mPTLen[i++];
+    k = Ctx->mPTLen[i++];
     if (k <= 6) {
-      PutBits(3, k);
+      PutBits(Ctx, 3, k);
     } else {
-      PutBits(k - 3, (1U << (k - 3)) - 2);
+      PutBits(Ctx, k - 3, (1U << (k - 3)) - 2);
     }
     if (i == Special) {
-      while (i < 6 && mPTLen[i] == 0) {
+      while (i < 6 && Ctx->mPTLen[i] == 0) {
         i++;
       }
-      PutBits(2, (i - 3) & 3);
+      PutBits(Ctx, 2, (i - 3) & 3);
     }
   }
 }
 
 STATIC 
 VOID 
-WriteCLen ()
+WriteCLen (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
 /*++
 
 Routine Description:
@@ -1130,36 +2377,36 @@ Returns: (VOID)
   INT32 i, k, n, Count;
 
   n = NC;
-  while (n > 0 && mCLen[n - 1] == 0) {
+  while (n > 0 && Ctx->mCLen[n - 1] == 0) {
     n--;
   }
-  PutBits(CBIT, n);
+  PutBits(Ctx, CBIT, n);
   i = 0;
   while (i < n) {
-    k = mCLen[i++];
+    k = Ctx->mCLen[i++];
     if (k == 0) {
       Count = 1;
-      while (i < n && mCLen[i] == 0) {
+      while (i < n && Ctx->mCLen[i] == 0) {
         i++;
         Count++;
       }
       if (Count <= 2) {
         for (k = 0; k < Count; k++) {
-          PutBits(mPTLen[0], mPTCode[0]);
+          PutBits(Ctx, Ctx->mPTLen[0], Ctx->mPTCode[0]);
         }
       } else if (Count <= 18) {
-        PutBits(mPTLen[1], mPTCode[1]);
-        PutBits(4, Count - 3);
+        PutBits(Ctx, Ctx->mPTLen[1], Ctx->mPTCode[1]);
+        PutBits(Ctx, 4, Count - 3);
       } else if (Count == 19) {
-        PutBits(mPTLen[0], mPTCode[0]);
-        PutBits(mPTLen[1], mPTCode[1]);
-        PutBits(4, 15);
+        PutBits(Ctx, Ctx->mPTLen[0], Ctx->mPTCode[0]);
+        PutBits(Ctx, Ctx->mPTLen[1], Ctx->mPTCode[1]);
+        PutBits(Ctx, 4, 15);
       } else {
-        PutBits(mPTLen[2], mPTCode[2]);
-        PutBits(CBIT, Count - 20);
+        PutBits(Ctx, Ctx->mPTLen[2], Ctx->mPTCode[2]);
+        PutBits(Ctx, CBIT, Count - 20);
       }
     } else {
-      PutBits(mPTLen[k + 2], mPTCode[k + 2]);
+      PutBits(Ctx, Ctx->mPTLen[k + 2], Ctx->mPTCode[k + 2]);
     }
   }
 }
@@ -1167,15 +2414,17 @@ Returns: (VOID)
 STATIC 
 VOID 
 EncodeC (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN INT32 c
   )
 {
-  PutBits(mCLen[c], mCCode[c]);
+  PutBits(Ctx, Ctx->mCLen[c], Ctx->mCCode[c]);
 }
 
 STATIC 
 VOID 
 EncodeP (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN UINT32 p
   )
 {
@@ -1187,77 +2436,113 @@ EncodeP (
     q >>= 1;
     c++;
   }
-  PutBits(mPTLen[c], mPTCode[c]);
+  PutBits(Ctx, Ctx->mPTLen[c], Ctx->mPTCode[c]);
   if (c > 1) {
-    PutBits(c - 1, p & (0xFFFFU >> (17 - c)));
+    //
+    // PutBits() takes up to 16 bits, longer positions come from the optimal parser
+    //
+    if (c > 17) {
+      PutBits(Ctx, c - 17, (p >> 16) & (0xFFFFU >> (33 - c)));
+      c = 17;
+    }
+    PutBits(Ctx, c - 1, p & (0xFFFFU >> (17 - c)));
   }
 }
 
 STATIC 
-VOID 
-SendBlock ()
+UINT32 
+SendBlockTables (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
 /*++
 
 Routine Description:
 
-  Huffman code the block and output it.
+  Make Huffman codes for the block from mCFreq and mPFreq,
+  output the block size and the code length tables.
   
 Argument: (VOID)
 
-Returns: (VOID)
+Returns:
+
+  The number of symbols in the block.
 
 --*/
 {
-  UINT32 i, k, Flags, Root, Pos, Size;
-  Flags = 0;
+  UINT32 Root, Size;
 
-  Root = MakeTree(NC, mCFreq, mCLen, mCCode);
-  Size = mCFreq[Root];
-  PutBits(16, Size);
+  Root = MakeTree(Ctx, NC, Ctx->mCFreq, Ctx->mCLen, Ctx->mCCode);
+  Size = Ctx->mCFreq[Root];
+  PutBits(Ctx, 16, Size);
   if (Root >= NC) {
-    CountTFreq();
-    Root = MakeTree(NT, mTFreq, mPTLen, mPTCode);
+    CountTFreq(Ctx);
+    Root = MakeTree(Ctx, NT, Ctx->mTFreq, Ctx->mPTLen, Ctx->mPTCode);
     if (Root >= NT) {
-      WritePTLen(NT, TBIT, 3);
+      WritePTLen(Ctx, NT, TBIT, 3);
     } else {
-      PutBits(TBIT, 0);
-      PutBits(TBIT, Root);
+      PutBits(Ctx, TBIT, 0);
+      PutBits(Ctx, TBIT, Root);
     }
-    WriteCLen();
+    WriteCLen(Ctx);
   } else {
-    PutBits(TBIT, 0);
-    PutBits(TBIT, 0);
-    PutBits(CBIT, 0);
-    PutBits(CBIT, Root);
-  }
-  Root = MakeTree(NP, mPFreq, mPTLen, mPTCode);
-  if (Root >= NP) {
-    WritePTLen(NP, gPBIT, -1);
+    PutBits(Ctx, TBIT, 0);
+    PutBits(Ctx, TBIT, 0);
+    PutBits(Ctx, CBIT, 0);
+    PutBits(Ctx, CBIT, Root);
+  }
+  Root = MakeTree(Ctx, Ctx->mNp, Ctx->mPFreq, Ctx->mPTLen, Ctx->mPTCode);
+  if (Root >= (UINT32)Ctx->mNp) {
+    WritePTLen(Ctx, Ctx->mNp, Ctx->mPbit, -1);
   } else {
-    PutBits(gPBIT, 0);
-    PutBits(gPBIT, Root);
+    PutBits(Ctx, Ctx->mPbit, 0);
+    PutBits(Ctx, Ctx->mPbit, Root);
   }
+
+  return Size;
+}
+
+STATIC 
+VOID 
+SendBlock (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
+/*++
+
+Routine Description:
+
+  Huffman code the block and output it.
+  
+Argument: (VOID)
+
+Returns: (VOID)
+
+--*/
+{
+  UINT32 i, k, Flags, Pos, Size;
+  Flags = 0;
+
+  Size = SendBlockTables(Ctx);
   Pos = 0;
   for (i = 0; i < Size; i++) {
     if (i % UINT8_BIT == 0) {
-      Flags = mBuf[Pos++];
+      Flags = Ctx->mBuf[Pos++];
     } else {
       Flags <<= 1;
     }
     if (Flags & (1U << (UINT8_BIT - 1))) {
-      EncodeC(mBuf[Pos++] + (1U << UINT8_BIT));
-      k = mBuf[Pos++] << UINT8_BIT;
-      k += mBuf[Pos++];
-      EncodeP(k);
+      EncodeC(Ctx, Ctx->mBuf[Pos++] + (1U << UINT8_BIT));
+      k = Ctx->mBuf[Pos++] << UINT8_BIT;
+      k += Ctx->mBuf[Pos++];
+      EncodeP(Ctx, k);
     } else {
-      EncodeC(mBuf[Pos++]);
+      EncodeC(Ctx, Ctx->mBuf[Pos++]);
     }
   }
   for (i = 0; i < NC; i++) {
-    mCFreq[i] = 0;
+    Ctx->mCFreq[i] = 0;
   }
   for (i = 0; i < NP; i++) {
-    mPFreq[i] = 0;
+    Ctx->mPFreq[i] = 0;
   }
 }
 
@@ -1265,6 +2550,7 @@ Returns: (VOID)
 STATIC 
 VOID 
 Output (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN UINT32 c, 
   IN UINT32 p
   )
@@ -1283,59 +2569,61 @@ Returns: (VOID)
 
 --*/
 {
-  STATIC UINT32 CPos;
-
-  if ((mOutputMask >>= 1) == 0) {
-    mOutputMask = 1U << (UINT8_BIT - 1);
-    if (mOutputPos >= mBufSiz - 3 * UINT8_BIT) {
-      SendBlock();
-      mOutputPos = 0;
+  if ((Ctx->mOutputMask >>= 1) == 0) {
+    Ctx->mOutputMask = 1U << (UINT8_BIT - 1);
+    if (Ctx->mOutputPos >= Ctx->mBufSiz - 3 * UINT8_BIT) {
+      SendBlock(Ctx);
+      Ctx->mOutputPos = 0;
     }
-    CPos = mOutputPos++;  
-    mBuf[CPos] = 0;
+    Ctx->mCPos = Ctx->mOutputPos++;  
+    Ctx->mBuf[Ctx->mCPos] = 0;
   }
-  mBuf[mOutputPos++] = (UINT8) c;
-  mCFreq[c]++;
+  Ctx->mBuf[Ctx->mOutputPos++] = (UINT8) c;
+  Ctx->mCFreq[c]++;
   if (c >= (1U << UINT8_BIT)) {
-    mBuf[CPos] |= mOutputMask;
-    mBuf[mOutputPos++] = (UINT8)(p >> UINT8_BIT);
-    mBuf[mOutputPos++] = (UINT8) p;
+    Ctx->mBuf[Ctx->mCPos] |= Ctx->mOutputMask;
+    Ctx->mBuf[Ctx->mOutputPos++] = (UINT8)(p >> UINT8_BIT);
+    Ctx->mBuf[Ctx->mOutputPos++] = (UINT8) p;
     c = 0;
     while (p) {
       p >>= 1;
       c++;
     }
-    mPFreq[c]++;
+    Ctx->mPFreq[c]++;
   }
 }
 
 STATIC
 VOID
-HufEncodeStart ()
+HufEncodeStart (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
 {
   INT32 i;
 
   for (i = 0; i < NC; i++) {
-    mCFreq[i] = 0;
+    Ctx->mCFreq[i] = 0;
   }
   for (i = 0; i < NP; i++) {
-    mPFreq[i] = 0;
+    Ctx->mPFreq[i] = 0;
   }
-  mOutputPos = mOutputMask = 0;
-  InitPutBits();
+  Ctx->mOutputPos = Ctx->mOutputMask = 0;
+  InitPutBits(Ctx);
   return;
 }
 
 STATIC 
 VOID 
-HufEncodeEnd ()
+HufEncodeEnd (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
 {
-  SendBlock();
+  SendBlock(Ctx);
   
   //
   // Flush remaining bits
   //
-  PutBits(UINT8_BIT - 1, 0);
+  PutBits(Ctx, UINT8_BIT - 1, 0);
   
   return;
 }
@@ -1343,7 +2631,9 @@ HufEncodeEnd ()
 
 STATIC 
 VOID 
-MakeCrcTable ()
+MakeCrcTable (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
 {
   UINT32 i, j, r;
 
@@ -1356,13 +2646,14 @@ MakeCrcTable ()
         r >>= 1;
       }
     }
-    mCrcTable[i] = (UINT16)r;    
+    Ctx->mCrcTable[i] = (UINT16)r;    
   }
 }
 
 STATIC 
 VOID 
 PutBits (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN INT32 n, 
   IN UINT32 x
   )
@@ -1383,27 +2674,27 @@ Returns: (VOID)
 {
   UINT8 Temp;  
   
-  if (n < mBitCount) {
-    mSubBitBuf |= x << (mBitCount -= n);
+  if (n < Ctx->mBitCount) {
+    Ctx->mSubBitBuf |= x << (Ctx->mBitCount -= n);
   } else {
       
-    Temp = (UINT8)(mSubBitBuf | (x >> (n -= mBitCount)));
-    if (mDst < mDstUpperLimit) {
-      *mDst++ = Temp;
+    Temp = (UINT8)(Ctx->mSubBitBuf | (x >> (n -= Ctx->mBitCount)));
+    if (Ctx->mDst < Ctx->mDstUpperLimit) {
+      *Ctx->mDst++ = Temp;
     }
-    mCompSize++;
+    Ctx->mCompSize++;
 
     if (n < UINT8_BIT) {
-      mSubBitBuf = x << (mBitCount = UINT8_BIT - n);
+      Ctx->mSubBitBuf = x << (Ctx->mBitCount = UINT8_BIT - n);
     } else {
         
       Temp = (UINT8)(x >> (n - UINT8_BIT));
-      if (mDst < mDstUpperLimit) {
-        *mDst++ = Temp;
+      if (Ctx->mDst < Ctx->mDstUpperLimit) {
+        *Ctx->mDst++ = Temp;
       }
-      mCompSize++;
+      Ctx->mCompSize++;
       
-      mSubBitBuf = x << (mBitCount = 2 * UINT8_BIT - n);
+      Ctx->mSubBitBuf = x << (Ctx->mBitCount = 2 * UINT8_BIT - n);
     }
   }
 }
@@ -1411,6 +2702,7 @@ Returns: (VOID)
 STATIC 
 INT32 
 FreadCrc (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   OUT UINT8 *p, 
   IN  INT32 n
   )
@@ -1433,13 +2725,13 @@ Returns:
 {
   INT32 i;
 
-  for (i = 0; mSrc < mSrcUpperLimit && i < n; i++) {
-    *p++ = *mSrc++;
+  for (i = 0; Ctx->mSrc < Ctx->mSrcUpperLimit && i < n; i++) {
+    *p++ = *Ctx->mSrc++;
   }
   n = i;
 
   p -= n;
-  mOrigSize += n;
+  Ctx->mOrigSize += n;
   while (--i >= 0) {
     UPDATE_CRC(*p++);
   }
@@ -1449,15 +2741,18 @@ Returns:
 
 STATIC 
 VOID 
-InitPutBits ()
+InitPutBits (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx
+  )
 {
-  mBitCount = UINT8_BIT;  
-  mSubBitBuf = 0;
+  Ctx->mBitCount = UINT8_BIT;  
+  Ctx->mSubBitBuf = 0;
 }
 
 STATIC 
 VOID 
 CountLen (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN INT32 i
   )
 /*++
@@ -1474,21 +2769,20 @@ Returns: (VOID)
 
 --*/
 {
-  STATIC INT32 Depth = 0;
-
-  if (i < mN) {
-    mLenCnt[(Depth < 16) ? Depth : 16]++;
+  if (i < Ctx->mN) {
+    Ctx->mLenCnt[(Ctx->mDepth < 16) ? Ctx->mDepth : 16]++;
   } else {
-    Depth++;
-    CountLen(mLeft [i]);
-    CountLen(mRight[i]);
-    Depth--;
+    Ctx->mDepth++;
+    CountLen(Ctx, Ctx->mLeft [i]);
+    CountLen(Ctx, Ctx->mRight[i]);
+    Ctx->mDepth--;
   }
 }
 
 STATIC 
 VOID 
 MakeLen (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN INT32 Root
   )
 /*++
@@ -1507,9 +2801,9 @@ Arguments:
   UINT32 Cum;
 
   for (i = 0; i <= 16; i++) {
-    mLenCnt[i] = 0;
+    Ctx->mLenCnt[i] = 0;
   }
-  CountLen(Root);
+  CountLen(Ctx, Root);
   
   //
   // Adjust the length count array so that
@@ -1518,23 +2812,23 @@ Arguments:
   
   Cum = 0;
   for (i = 16; i > 0; i--) {
-    Cum += mLenCnt[i] << (16 - i);
+    Cum += Ctx->mLenCnt[i] << (16 - i);
   }
   while (Cum != (1U << 16)) {
-    mLenCnt[16]--;
+    Ctx->mLenCnt[16]--;
     for (i = 15; i > 0; i--) {
-      if (mLenCnt[i] != 0) {
-        mLenCnt[i]--;
-        mLenCnt[i+1] += 2;
+      if (Ctx->mLenCnt[i] != 0) {
+        Ctx->mLenCnt[i]--;
+        Ctx->mLenCnt[i+1] += 2;
         break;
       }
     }
     Cum--;
   }
   for (i = 16; i > 0; i--) {
-    k = mLenCnt[i];
+    k = Ctx->mLenCnt[i];
     while (--k >= 0) {
-      mLen[*mSortPtr++] = (UINT8)i;
+      Ctx->mLen[*Ctx->mSortPtr++] = (UINT8)i;
     }
   }
 }
@@ -1542,6 +2836,7 @@ Arguments:
 STATIC 
 VOID 
 DownHeap (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN INT32 i
   )
 {
@@ -1551,23 +2846,24 @@ DownHeap (
   // priority queue: send i-th entry down heap
   //
   
-  k = mHeap[i];
-  while ((j = 2 * i) <= mHeapSize) {
-    if (j < mHeapSize && mFreq[mHeap[j]] > mFreq[mHeap[j + 1]]) {
+  k = Ctx->mHeap[i];
+  while ((j = 2 * i) <= Ctx->mHeapSize) {
+    if (j < Ctx->mHeapSize && Ctx->mFreq[Ctx->mHeap[j]] > Ctx->mFreq[Ctx->mHeap[j + 1]]) {
       j++;
     }
-    if (mFreq[k] <= mFreq[mHeap[j]]) {
+    if (Ctx->mFreq[k] <= Ctx->mFreq[Ctx->mHeap[j]]) {
       break;
     }
-    mHeap[i] = mHeap[j];
+    Ctx->mHeap[i] = Ctx->mHeap[j];
     i = j;
   }
-  mHeap[i] = (INT16)k;
+  Ctx->mHeap[i] = (INT16)k;
 }
 
 STATIC 
 VOID 
 MakeCode (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN  INT32 n, 
   IN  UINT8 Len[], 
   OUT UINT16 Code[]
@@ -1593,7 +2889,7 @@ Returns: (VOID)
 
   Start[1] = 0;
   for (i = 1; i <= 16; i++) {
-    Start[i + 1] = (UINT16)((Start[i] + mLenCnt[i]) << 1);
+    Start[i + 1] = (UINT16)((Start[i] + Ctx->mLenCnt[i]) << 1);
   }
   for (i = 0; i < n; i++) {
     Code[i] = Start[Len[i]]++;
@@ -1603,6 +2899,7 @@ Returns: (VOID)
 STATIC 
 INT32 
 MakeTree (
+  IN OUT TIANO_COMPRESS_CONTEXT *Ctx,
   IN  INT32   NParm, 
   IN  UINT16  FreqParm[], 
   OUT UINT8   LenParm[], 
@@ -1633,52 +2930,52 @@ Returns:
   // make tree, calculate len[], return root
   //
 
-  mN = NParm;
-  mFreq = FreqParm;
-  mLen = LenParm;
-  Avail = mN;
-  mHeapSize = 0;
-  mHeap[1] = 0;
-  for (i = 0; i < mN; i++) {
-    mLen[i] = 0;
-    if (mFreq[i]) {
-      mHeap[++mHeapSize] = (INT16)i;
+  Ctx->mN = NParm;
+  Ctx->mFreq = FreqParm;
+  Ctx->mLen = LenParm;
+  Avail = Ctx->mN;
+  Ctx->mHeapSize = 0;
+  Ctx->mHeap[1] = 0;
+  for (i = 0; i < Ctx->mN; i++) {
+    Ctx->mLen[i] = 0;
+    if (Ctx->mFreq[i]) {
+      Ctx->mHeap[++Ctx->mHeapSize] = (INT16)i;
     }    
   }
-  if (mHeapSize < 2) {
-    CodeParm[mHeap[1]] = 0;
-    return mHeap[1];
+  if (Ctx->mHeapSize < 2) {
+    CodeParm[Ctx->mHeap[1]] = 0;
+    return Ctx->mHeap[1];
   }
-  for (i = mHeapSize / 2; i >= 1; i--) {
+  for (i = Ctx->mHeapSize / 2; i >= 1; i--) {
     
     //
     // make priority queue 
     //
-    DownHeap(i);
+    DownHeap(Ctx, i);
   }
-  mSortPtr = CodeParm;
+  Ctx->mSortPtr = CodeParm;
   do {
-    i = mHeap[1];
-    if (i < mN) {
-      *mSortPtr++ = (UINT16)i;
+    i = Ctx->mHeap[1];
+    if (i < Ctx->mN) {
+      *Ctx->mSortPtr++ = (UINT16)i;
     }
-    mHeap[1] = mHeap[mHeapSize--];
-    DownHeap(1);
-    j = mHeap[1];
-    if (j < mN) {
-      *mSortPtr++ = (UINT16)j;
+    Ctx->mHeap[1] = Ctx->mHeap[Ctx->mHeapSize--];
+    DownHeap(Ctx, 1);
+    j = Ctx->mHeap[1];
+    if (j < Ctx->mN) {
+      *Ctx->mSortPtr++ = (UINT16)j;
     }
     k = Avail++;
-    mFreq[k] = (UINT16)(mFreq[i] + mFreq[j]);
-    mHeap[1] = (INT16)k;
-    DownHeap(1);
-    mLeft[k] = (UINT16)i;
-    mRight[k] = (UINT16)j;
-  } while (mHeapSize > 1);
-  
-  mSortPtr = CodeParm;
-  MakeLen(k);
-  MakeCode(NParm, LenParm, CodeParm);
+    Ctx->mFreq[k] = (UINT16)(Ctx->mFreq[i] + Ctx->mFreq[j]);
+    Ctx->mHeap[1] = (INT16)k;
+    DownHeap(Ctx, 1);
+    Ctx->mLeft[k] = (UINT16)i;
+    Ctx->mRight[k] = (UINT16)j;
+  } while (Ctx->mHeapSize > 1);
+  
+  Ctx->mSortPtr = CodeParm;
+  MakeLen(Ctx, k);
+  MakeCode(Ctx, NParm, LenParm, CodeParm);
   
   //
   // return root
@@ -28,10 +28,80 @@ Header file for compression routine.
 
 #include "../basetypes.h"
 
+//
+// Destination buffer size that is sufficient for any real-world input.
+// Callers can preallocate this much and run the compressor once instead of
+// querying the required size with a NULL destination first, which costs
+// a complete encoding pass. On the rare overflow EFI_BUFFER_TOO_SMALL is
+// still returned together with the exact size needed.
+//
+#define EFI_TIANO_COMPRESS_BOUND(SrcSize) ((SrcSize) + ((SrcSize) >> 3) + 0x1000)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+    //
+    // Opaque compression contexts, holding all the state of the compressor
+    // and the work buffers reused by every compression done with them.
+    // A context must not be used by more than one thread at the same time.
+    //
+    typedef struct _TIANO_COMPRESS_CONTEXT        TIANO_COMPRESS_CONTEXT;
+    typedef struct _TIANO_COMPRESS_LEGACY_CONTEXT TIANO_COMPRESS_LEGACY_CONTEXT;
+
+    /*++
+
+    Routine Description:
+
+    Create and free compression contexts.
+    Create functions return NULL if there is not enough memory.
+
+    --*/
+    TIANO_COMPRESS_CONTEXT *
+        TianoCompressCreateContext(
+        VOID
+        )
+        ;
+
+    VOID
+        TianoCompressFreeContext(
+        TIANO_COMPRESS_CONTEXT *Context
+        )
+        ;
+
+    /*++
+
+    Routine Description:
+
+    Select the match finder used by a compression context.
+    COMPRESSION_PRESET_FAST switches to a hash chain match finder, which is
+    several times faster but produces slightly bigger output.
+    COMPRESSION_PRESET_MAX switches to an optimal parser, which is about ten
+    times slower but produces the smallest output. For Tiano compression
+    it also uses the bigger window of the legacy compressor.
+    COMPRESSION_PRESET_DEFAULT uses the binary tree match finder.
+    The output is decompressible by EfiDecompress and TianoDecompress in any case.
+
+    --*/
+    VOID
+        TianoCompressSetPreset(
+        TIANO_COMPRESS_CONTEXT *Context,
+        UINT8 Preset
+        )
+        ;
+
+    TIANO_COMPRESS_LEGACY_CONTEXT *
+        TianoCompressLegacyCreateContext(
+        VOID
+        )
+        ;
+
+    VOID
+        TianoCompressLegacyFreeContext(
+        TIANO_COMPRESS_LEGACY_CONTEXT *Context
+        )
+        ;
+
     /*++
 
     Routine Description:
@@ -64,6 +134,16 @@ extern "C" {
         )
         ;
 
+    EFI_STATUS
+        TianoCompressWithContext(
+        TIANO_COMPRESS_CONTEXT *Context,
+        CONST VOID   *SrcBuffer,
+        UINT32  SrcSize,
+        VOID   *DstBuffer,
+        UINT32  *DstSize
+        )
+        ;
+
     EFI_STATUS
         TianoCompressLegacy(
         CONST VOID   *SrcBuffer,
@@ -72,6 +152,16 @@ extern "C" {
         UINT32  *DstSize
         )
         ;
+
+    EFI_STATUS
+        TianoCompressLegacyWithContext(
+        TIANO_COMPRESS_LEGACY_CONTEXT *Context,
+        CONST VOID   *SrcBuffer,
+        UINT32  SrcSize,
+        VOID   *DstBuffer,
+        UINT32  *DstSize
+        )
+        ;
     /*++
 
     Routine Description:
@@ -103,6 +193,16 @@ extern "C" {
         UINT32  *DstSize
         )
         ;
+
+    EFI_STATUS
+        EfiCompressWithContext(
+        TIANO_COMPRESS_CONTEXT *Context,
+        CONST VOID   *SrcBuffer,
+        UINT32  SrcSize,
+        VOID   *DstBuffer,
+        UINT32  *DstSize
+        )
+        ;
     EFI_STATUS
         EfiCompressLegacy(
         CONST VOID   *SrcBuffer,
@@ -112,6 +212,16 @@ extern "C" {
         )
         ;
 
+    EFI_STATUS
+        EfiCompressLegacyWithContext(
+        TIANO_COMPRESS_LEGACY_CONTEXT *Context,
+        CONST VOID   *SrcBuffer,
+        UINT32  SrcSize,
+        VOID   *DstBuffer,
+        UINT32  *DstSize
+        )
+        ;
+
 #ifdef __cplusplus
 }
 #endif
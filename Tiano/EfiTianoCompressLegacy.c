@@ -50,7 +50,7 @@ typedef INT32 NODE;
 #define MAX_HASH_VAL  (3 * WNDSIZ + (WNDSIZ / 512 + 1) * UINT8_MAX)
 #define HASH(p, c)    ((p) + ((c) << (WNDBIT - 9)) + WNDSIZ * 2)
 #define CRCPOLY       0xA001
-#define UPDATE_CRC(c) mCrc = mCrcTable[(mCrc ^ (c)) & 0xFF] ^ (mCrc >> UINT8_BIT)
+#define UPDATE_CRC(c) Ctx->mCrc = Ctx->mCrcTable[(Ctx->mCrc ^ (c)) & 0xFF] ^ (Ctx->mCrc >> UINT8_BIT)
 
 //
 // C: the Char&Len Set; P: the Position Set; T: the exTra Set
@@ -73,30 +73,32 @@ typedef INT32 NODE;
 STATIC
   VOID
   PutDword(
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   UINT32 Data
   );
 
 STATIC
   INT32
   AllocateMemory (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   );
 
 STATIC
   VOID
   FreeMemory (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   );
 
 STATIC
   VOID
   InitSlide (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   );
 
 STATIC
   NODE
   Child (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   NODE   NodeQ,
   UINT8  CharC
   );
@@ -104,6 +106,7 @@ STATIC
 STATIC
   VOID
   MakeChild (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   NODE  NodeQ,
   UINT8 CharC,
   NODE  NodeR
@@ -112,42 +115,44 @@ STATIC
 STATIC
   VOID
   Split (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   NODE Old
   );
 
 STATIC
   VOID
   InsertNode (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   );
 
 STATIC
   VOID
   DeleteNode (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   );
 
 STATIC
   VOID
   GetNextMatch (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   );
 
 STATIC
   INT32
   Encode (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   );
 
 STATIC
   VOID
   CountTFreq (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   );
 
 STATIC
   VOID
   WritePTLen (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   INT32 Number,
   INT32 nbit,
   INT32 Special
@@ -156,30 +161,33 @@ STATIC
 STATIC
   VOID
   WriteCLen (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   );
 
 STATIC
   VOID
   EncodeC (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   INT32 Value
   );
 
 STATIC
   VOID
   EncodeP (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   UINT32 Value
   );
 
 STATIC
   VOID
   SendBlock (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   );
 
 STATIC
   VOID
   Output (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   UINT32 c,
   UINT32 p
   );
@@ -187,24 +195,25 @@ STATIC
 STATIC
   VOID
   HufEncodeStart (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   );
 
 STATIC
   VOID
   HufEncodeEnd (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   );
 
 STATIC
   VOID
   MakeCrcTable (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   );
 
 STATIC
   VOID
   PutBits (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   INT32  Number,
   UINT32 Value
   );
@@ -212,6 +221,7 @@ STATIC
 STATIC
   INT32
   FreadCrc (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   UINT8 *Pointer,
   INT32 Number
   );
@@ -219,30 +229,34 @@ STATIC
 STATIC
   VOID
   InitPutBits (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   );
 
 STATIC
   VOID
   CountLen (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   INT32 Index
   );
 
 STATIC
   VOID
   MakeLen (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   INT32 Root
   );
 
 STATIC
   VOID
   DownHeap (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   INT32 Index
   );
 
 STATIC
   VOID
   MakeCode (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   INT32       Number,
   UINT8 Len[  ],
   UINT16 Code[]
@@ -251,6 +265,7 @@ STATIC
 STATIC
   INT32
   MakeTree (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   INT32            NParm,
   UINT16  FreqParm[],
   UINT8   LenParm[ ],
@@ -258,144 +273,125 @@ STATIC
 );
 
 //
-//  Global Variables
+// Compression context
+// Holds the complete state of a compression run, so different contexts
+// can be used from different threads at the same time. Work buffers are
+// allocated once per context and reused by all compressions done with it.
 //
-STATIC UINT8  *mSrc, *mDst, *mSrcUpperLimit, *mDstUpperLimit;
+struct _TIANO_COMPRESS_LEGACY_CONTEXT {
+  UINT8  *mSrc, *mDst, *mSrcUpperLimit, *mDstUpperLimit;
 
-STATIC UINT8  *mLevel, *mText, *mChildCount, *mBuf, mCLen[NC], mPTLen[NPT], *mLen;
-STATIC INT16  mHeap[NC + 1];
-STATIC INT32  mRemainder, mMatchLen, mBitCount, mHeapSize, mN;
-STATIC UINT32 mBufSiz = 0, mOutputPos, mOutputMask, mSubBitBuf, mCrc;
-STATIC UINT32 mCompSize, mOrigSize;
+  UINT8  *mLevel, *mText, *mChildCount, *mBuf, mCLen[NC], mPTLen[NPT], *mLen;
+  INT16  mHeap[NC + 1];
+  INT32  mRemainder, mMatchLen, mBitCount, mHeapSize, mN;
+  UINT32 mBufSiz, mOutputPos, mOutputMask, mSubBitBuf, mCrc;
+  UINT32 mCompSize, mOrigSize;
 
-STATIC UINT16 *mFreq, *mSortPtr, mLenCnt[17], mLeft[2 * NC - 1], mRight[2 * NC - 1], mCrcTable[UINT8_MAX + 1],
-  mCFreq[2 * NC - 1], mCCode[NC], mPFreq[2 * NP - 1], mPTCode[NPT], mTFreq[2 * NT - 1];
+  UINT16 *mFreq, *mSortPtr, mLenCnt[17], mLeft[2 * NC - 1], mRight[2 * NC - 1], mCrcTable[UINT8_MAX + 1],
+    mCFreq[2 * NC - 1], mCCode[NC], mPFreq[2 * NP - 1], mPTCode[NPT], mTFreq[2 * NT - 1];
 
-STATIC UINT8  mPbit;
+  UINT8  mPbit;
 
-STATIC NODE   mPos, mMatchPos, mAvail, *mPosition, *mParent, *mPrev, *mNext = NULL;
+  NODE   mPos, mMatchPos, mAvail, *mPosition, *mParent, *mPrev, *mNext;
+
+  //
+  // Last flag byte position in Output() and current tree depth in CountLen()
+  //
+  UINT32 mCPos;
+  INT32  mDepth;
+};
 
 //
 // functions
 //
-EFI_STATUS
-EfiCompressLegacy(
-CONST VOID   *SrcBuffer,
-UINT32  SrcSize,
-VOID   *DstBuffer,
-UINT32  *DstSize
-)
-/*++
-
-Routine Description:
+TIANO_COMPRESS_LEGACY_CONTEXT *
+TianoCompressLegacyCreateContext (
+  VOID
+  )
+  /*++
 
-The internal implementation of [Efi/Tiano]Compress().
+  Routine Description:
 
-Arguments:
+  Create a compression context usable by EfiCompressLegacyWithContext
+  and TianoCompressLegacyWithContext.
 
-SrcBuffer   - The buffer storing the source data
-SrcSize     - The size of source data
-DstBuffer   - The buffer to store the compressed data
-DstSize     - On input, the size of DstBuffer; On output,
-the size of the actual compressed data.
+  Arguments: (VOID)
 
-Returns:
+  Returns:
 
-EFI_BUFFER_TOO_SMALL  - The DstBuffer is too small. this case,
-DstSize contains the size needed.
-EFI_SUCCESS           - Compression is successful.
-EFI_OUT_OF_RESOURCES  - No resource to complete function.
-EFI_INVALID_PARAMETER - Parameter supplied is wrong.
+  The new context or NULL if there is not enough memory.
 
---*/
+  --*/
 {
-    INT32 Status;
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx;
 
-    //
-    // Initializations
-    //
-    mPbit = 4;
+  Ctx = calloc (1, sizeof (*Ctx));
+  if (Ctx == NULL) {
+    return NULL;
+  }
 
-    mBufSiz = 0;
-    mBuf = NULL;
-    mText = NULL;
-    mLevel = NULL;
-    mChildCount = NULL;
-    mPosition = NULL;
-    mParent = NULL;
-    mPrev = NULL;
-    mNext = NULL;
+  if (AllocateMemory (Ctx)) {
+    FreeMemory (Ctx);
+    free (Ctx);
+    return NULL;
+  }
 
-    mSrc = (UINT8*) SrcBuffer;
-    mSrcUpperLimit = mSrc + SrcSize;
-    mDst = DstBuffer;
-    mDstUpperLimit = mDst + *DstSize;
+  MakeCrcTable (Ctx);
 
-    PutDword(0L);
-    PutDword(0L);
+  return Ctx;
+}
 
-    MakeCrcTable();
+VOID
+TianoCompressLegacyFreeContext (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
+  )
+  /*++
 
-    mOrigSize = mCompSize = 0;
-    mCrc = INIT_CRC;
+  Routine Description:
 
-    //
-    // Compress it
-    //
-    Status = Encode();
-    if (Status) {
-        return EFI_OUT_OF_RESOURCES;
-    }
-    //
-    // Null terminate the compressed data
-    //
-    if (mDst < mDstUpperLimit) {
-        *mDst++ = 0;
-    }
-    //
-    // Fill compressed size and original size
-    //
-    mDst = DstBuffer;
-    PutDword(mCompSize + 1);
-    PutDword(mOrigSize);
+  Free a compression context created by TianoCompressLegacyCreateContext.
 
-    //
-    // Return
-    //
-    if (mCompSize + 1 + 8 > *DstSize) {
-        *DstSize = mCompSize + 1 + 8;
-        return EFI_BUFFER_TOO_SMALL;
-    }
-    else {
-        *DstSize = mCompSize + 1 + 8;
-        return EFI_SUCCESS;
-    }
+  Arguments:
+
+  Ctx - The context to free, can be NULL
 
+  Returns: (VOID)
+
+  --*/
+{
+  if (Ctx == NULL) {
+    return;
+  }
+
+  FreeMemory (Ctx);
+  free (Ctx);
 }
 
+STATIC
 EFI_STATUS
-TianoCompressLegacy (
-CONST VOID   *SrcBuffer,
-UINT32  SrcSize,
-VOID   *DstBuffer,
-UINT32  *DstSize
-)
+Compress (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
+  CONST VOID   *SrcBuffer,
+  UINT32  SrcSize,
+  VOID   *DstBuffer,
+  UINT32  *DstSize,
+  UINT8   Pbit
+  )
   /*++
 
   Routine Description:
 
-  The internal implementation of [Efi/Tiano]Compress().
+  The internal implementation of [Efi/Tiano]CompressLegacy().
 
   Arguments:
 
+  Ctx         - The compression context
   SrcBuffer   - The buffer storing the source data
   SrcSize     - The size of source data
   DstBuffer   - The buffer to store the compressed data
   DstSize     - On input, the size of DstBuffer; On output,
   the size of the actual compressed data.
-  Version     - The version of de/compression algorithm.
-  Version 1 for UEFI 2.0 de/compression algorithm.
-  Version 2 for Tiano de/compression algorithm.
+  Pbit        - 4 for EFI 1.1 compression, 5 for Tiano compression
 
   Returns:
 
@@ -409,70 +405,131 @@ UINT32  *DstSize
 {
   INT32 Status;
 
+  if (Ctx == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
   //
   // Initializations
   //
-  mPbit = 5;
-
-  mBufSiz         = 0;
-  mBuf            = NULL;
-  mText           = NULL;
-  mLevel          = NULL;
-  mChildCount     = NULL;
-  mPosition       = NULL;
-  mParent         = NULL;
-  mPrev           = NULL;
-  mNext           = NULL;
-
-  mSrc            = (UINT8*) SrcBuffer;
-  mSrcUpperLimit  = mSrc + SrcSize;
-  mDst            = DstBuffer;
-  mDstUpperLimit  = mDst +*DstSize;
+  Ctx->mPbit = Pbit;
+  Ctx->mCPos = 0;
+  Ctx->mDepth = 0;
 
-  PutDword (0L);
-  PutDword (0L);
+  Ctx->mSrc            = (UINT8*) SrcBuffer;
+  Ctx->mSrcUpperLimit  = Ctx->mSrc + SrcSize;
+  Ctx->mDst            = DstBuffer;
+  Ctx->mDstUpperLimit  = Ctx->mDst +*DstSize;
 
-  MakeCrcTable ();
+  PutDword (Ctx, 0L);
+  PutDword (Ctx, 0L);
 
-  mOrigSize             = mCompSize = 0;
-  mCrc                  = INIT_CRC;
+  Ctx->mOrigSize             = Ctx->mCompSize = 0;
+  Ctx->mCrc                  = INIT_CRC;
 
   //
   // Compress it
   //
-  Status = Encode ();
+  Status = Encode (Ctx);
   if (Status) {
     return EFI_OUT_OF_RESOURCES;
   }
   //
   // Null terminate the compressed data
   //
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = 0;
+  if (Ctx->mDst < Ctx->mDstUpperLimit) {
+    *Ctx->mDst++ = 0;
   }
   //
   // Fill compressed size and original size
   //
-  mDst = DstBuffer;
-  PutDword (mCompSize + 1);
-  PutDword (mOrigSize);
+  Ctx->mDst = DstBuffer;
+  PutDword (Ctx, Ctx->mCompSize + 1);
+  PutDword (Ctx, Ctx->mOrigSize);
 
   //
   // Return
   //
-  if (mCompSize + 1 + 8 > *DstSize) {
-    *DstSize = mCompSize + 1 + 8;
+  if (Ctx->mCompSize + 1 + 8 > *DstSize) {
+    *DstSize = Ctx->mCompSize + 1 + 8;
     return EFI_BUFFER_TOO_SMALL;
   } else {
-    *DstSize = mCompSize + 1 + 8;
+    *DstSize = Ctx->mCompSize + 1 + 8;
     return EFI_SUCCESS;
   }
 
 }
 
+EFI_STATUS
+EfiCompressLegacyWithContext (
+TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
+CONST VOID   *SrcBuffer,
+UINT32  SrcSize,
+VOID   *DstBuffer,
+UINT32  *DstSize
+)
+{
+  return Compress (Ctx, SrcBuffer, SrcSize, DstBuffer, DstSize, 4);
+}
+
+EFI_STATUS
+TianoCompressLegacyWithContext (
+TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
+CONST VOID   *SrcBuffer,
+UINT32  SrcSize,
+VOID   *DstBuffer,
+UINT32  *DstSize
+)
+{
+  return Compress (Ctx, SrcBuffer, SrcSize, DstBuffer, DstSize, 5);
+}
+
+EFI_STATUS
+EfiCompressLegacy (
+CONST VOID   *SrcBuffer,
+UINT32  SrcSize,
+VOID   *DstBuffer,
+UINT32  *DstSize
+)
+{
+  EFI_STATUS Status;
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx;
+
+  Ctx = TianoCompressLegacyCreateContext ();
+  if (Ctx == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = Compress (Ctx, SrcBuffer, SrcSize, DstBuffer, DstSize, 4);
+  TianoCompressLegacyFreeContext (Ctx);
+  return Status;
+}
+
+EFI_STATUS
+TianoCompressLegacy (
+CONST VOID   *SrcBuffer,
+UINT32  SrcSize,
+VOID   *DstBuffer,
+UINT32  *DstSize
+)
+{
+  EFI_STATUS Status;
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx;
+
+  Ctx = TianoCompressLegacyCreateContext ();
+  if (Ctx == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = Compress (Ctx, SrcBuffer, SrcSize, DstBuffer, DstSize, 5);
+  TianoCompressLegacyFreeContext (Ctx);
+  return Status;
+}
+
 STATIC
   VOID
   PutDword (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   UINT32 Data
   )
   /*++
@@ -489,27 +546,27 @@ STATIC
 
   --*/
 {
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = (UINT8) (((UINT8) (Data)) & 0xff);
+  if (Ctx->mDst < Ctx->mDstUpperLimit) {
+    *Ctx->mDst++ = (UINT8) (((UINT8) (Data)) & 0xff);
   }
 
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = (UINT8) (((UINT8) (Data >> 0x08)) & 0xff);
+  if (Ctx->mDst < Ctx->mDstUpperLimit) {
+    *Ctx->mDst++ = (UINT8) (((UINT8) (Data >> 0x08)) & 0xff);
   }
 
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = (UINT8) (((UINT8) (Data >> 0x10)) & 0xff);
+  if (Ctx->mDst < Ctx->mDstUpperLimit) {
+    *Ctx->mDst++ = (UINT8) (((UINT8) (Data >> 0x10)) & 0xff);
   }
 
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = (UINT8) (((UINT8) (Data >> 0x18)) & 0xff);
+  if (Ctx->mDst < Ctx->mDstUpperLimit) {
+    *Ctx->mDst++ = (UINT8) (((UINT8) (Data >> 0x18)) & 0xff);
   }
 }
 
 STATIC
   INT32
   AllocateMemory (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   )
   /*++
 
@@ -529,37 +586,37 @@ STATIC
 {
   UINT32  Index;
 
-  mText = malloc (WNDSIZ * 2 + MAXMATCH);
+  Ctx->mText = malloc (WNDSIZ * 2 + MAXMATCH);
   for (Index = 0; Index < WNDSIZ * 2 + MAXMATCH; Index++) {
-    mText[Index] = 0;
+    Ctx->mText[Index] = 0;
   }
 
-  mLevel      = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof (*mLevel));
-  mChildCount = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof (*mChildCount));
-  mPosition   = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof (*mPosition));
-  mParent     = malloc (WNDSIZ * 2 * sizeof (*mParent));
-  mPrev       = malloc (WNDSIZ * 2 * sizeof (*mPrev));
-  mNext       = malloc ((MAX_HASH_VAL + 1) * sizeof (*mNext));
+  Ctx->mLevel      = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof (*Ctx->mLevel));
+  Ctx->mChildCount = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof (*Ctx->mChildCount));
+  Ctx->mPosition   = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof (*Ctx->mPosition));
+  Ctx->mParent     = malloc (WNDSIZ * 2 * sizeof (*Ctx->mParent));
+  Ctx->mPrev       = malloc (WNDSIZ * 2 * sizeof (*Ctx->mPrev));
+  Ctx->mNext       = malloc ((MAX_HASH_VAL + 1) * sizeof (*Ctx->mNext));
 
-  mBufSiz     = BLKSIZ;
-  mBuf        = malloc (mBufSiz);
-  while (mBuf == NULL) {
-    mBufSiz = (mBufSiz / 10U) * 9U;
-    if (mBufSiz < 4 * 1024U) {
+  Ctx->mBufSiz     = BLKSIZ;
+  Ctx->mBuf        = malloc (Ctx->mBufSiz);
+  while (Ctx->mBuf == NULL) {
+    Ctx->mBufSiz = (Ctx->mBufSiz / 10U) * 9U;
+    if (Ctx->mBufSiz < 4 * 1024U) {
       return EFI_OUT_OF_RESOURCES;
     }
 
-    mBuf = malloc (mBufSiz);
+    Ctx->mBuf = malloc (Ctx->mBufSiz);
   }
 
-  mBuf[0] = 0;
+  Ctx->mBuf[0] = 0;
 
   return EFI_SUCCESS;
 }
 
 VOID
   FreeMemory (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   )
   /*++
 
@@ -573,36 +630,36 @@ VOID
 
   --*/
 {
-  if (mText != NULL) {
-    free (mText);
+  if (Ctx->mText != NULL) {
+    free (Ctx->mText);
   }
 
-  if (mLevel != NULL) {
-    free (mLevel);
+  if (Ctx->mLevel != NULL) {
+    free (Ctx->mLevel);
   }
 
-  if (mChildCount != NULL) {
-    free (mChildCount);
+  if (Ctx->mChildCount != NULL) {
+    free (Ctx->mChildCount);
   }
 
-  if (mPosition != NULL) {
-    free (mPosition);
+  if (Ctx->mPosition != NULL) {
+    free (Ctx->mPosition);
   }
 
-  if (mParent != NULL) {
-    free (mParent);
+  if (Ctx->mParent != NULL) {
+    free (Ctx->mParent);
   }
 
-  if (mPrev != NULL) {
-    free (mPrev);
+  if (Ctx->mPrev != NULL) {
+    free (Ctx->mPrev);
   }
 
-  if (mNext != NULL) {
-    free (mNext);
+  if (Ctx->mNext != NULL) {
+    free (Ctx->mNext);
   }
 
-  if (mBuf != NULL) {
-    free (mBuf);
+  if (Ctx->mBuf != NULL) {
+    free (Ctx->mBuf);
   }
 
   return ;
@@ -611,7 +668,7 @@ VOID
 STATIC
   VOID
   InitSlide (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   )
   /*++
 
@@ -628,28 +685,29 @@ STATIC
   NODE  Index;
 
     for (Index = (NODE) WNDSIZ; Index <= (NODE) WNDSIZ + UINT8_MAX; Index++) {
-    mLevel[Index]     = 1;
-    mPosition[Index]  = NIL;  // sentinel
+    Ctx->mLevel[Index]     = 1;
+    Ctx->mPosition[Index]  = NIL;  // sentinel
   }
 
     for (Index = (NODE) WNDSIZ; Index < (NODE) WNDSIZ * 2; Index++) {
-    mParent[Index] = NIL;
+    Ctx->mParent[Index] = NIL;
   }
 
-  mAvail = 1;
+  Ctx->mAvail = 1;
     for (Index = 1; Index < (NODE) WNDSIZ - 1; Index++) {
-    mNext[Index] = (NODE) (Index + 1);
+    Ctx->mNext[Index] = (NODE) (Index + 1);
   }
 
-  mNext[WNDSIZ - 1] = NIL;
+  Ctx->mNext[WNDSIZ - 1] = NIL;
     for (Index = (NODE) WNDSIZ * 2; Index <= (NODE) MAX_HASH_VAL; Index++) {
-    mNext[Index] = NIL;
+    Ctx->mNext[Index] = NIL;
   }
 }
 
 STATIC
   NODE
   Child (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   NODE  NodeQ,
   UINT8 CharC
   )
@@ -672,13 +730,13 @@ STATIC
 {
   NODE  NodeR;
 
-  NodeR = mNext[HASH (NodeQ, CharC)];
+  NodeR = Ctx->mNext[HASH (NodeQ, CharC)];
   //
   // sentinel
   //
-  mParent[NIL] = NodeQ;
-  while (mParent[NodeR] != NodeQ) {
-    NodeR = mNext[NodeR];
+  Ctx->mParent[NIL] = NodeQ;
+  while (Ctx->mParent[NodeR] != NodeQ) {
+    NodeR = Ctx->mNext[NodeR];
   }
 
   return NodeR;
@@ -687,6 +745,7 @@ STATIC
 STATIC
   VOID
   MakeChild (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   NODE  Parent,
   UINT8 CharC,
   NODE  Child
@@ -711,18 +770,19 @@ STATIC
   NODE  Node2;
 
   Node1           = (NODE) HASH (Parent, CharC);
-  Node2           = mNext[Node1];
-  mNext[Node1]    = Child;
-  mNext[Child]    = Node2;
-  mPrev[Node2]    = Child;
-  mPrev[Child]    = Node1;
-  mParent[Child]  = Parent;
-  mChildCount[Parent]++;
+  Node2           = Ctx->mNext[Node1];
+  Ctx->mNext[Node1]    = Child;
+  Ctx->mNext[Child]    = Node2;
+  Ctx->mPrev[Node2]    = Child;
+  Ctx->mPrev[Child]    = Node1;
+  Ctx->mParent[Child]  = Parent;
+  Ctx->mChildCount[Parent]++;
 }
 
 STATIC
   VOID
   Split (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   NODE Old
   )
   /*++
@@ -742,26 +802,26 @@ STATIC
   NODE  New;
   NODE  TempNode;
 
-  New               = mAvail;
-  mAvail            = mNext[New];
-  mChildCount[New]  = 0;
-  TempNode          = mPrev[Old];
-  mPrev[New]        = TempNode;
-  mNext[TempNode]   = New;
-  TempNode          = mNext[Old];
-  mNext[New]        = TempNode;
-  mPrev[TempNode]   = New;
-  mParent[New]      = mParent[Old];
-  mLevel[New]       = (UINT8) mMatchLen;
-  mPosition[New]    = mPos;
-  MakeChild (New, mText[mMatchPos + mMatchLen], Old);
-  MakeChild (New, mText[mPos + mMatchLen], mPos);
+  New               = Ctx->mAvail;
+  Ctx->mAvail            = Ctx->mNext[New];
+  Ctx->mChildCount[New]  = 0;
+  TempNode          = Ctx->mPrev[Old];
+  Ctx->mPrev[New]        = TempNode;
+  Ctx->mNext[TempNode]   = New;
+  TempNode          = Ctx->mNext[Old];
+  Ctx->mNext[New]        = TempNode;
+  Ctx->mPrev[TempNode]   = New;
+  Ctx->mParent[New]      = Ctx->mParent[Old];
+  Ctx->mLevel[New]       = (UINT8) Ctx->mMatchLen;
+  Ctx->mPosition[New]    = Ctx->mPos;
+  MakeChild (Ctx, New, Ctx->mText[Ctx->mMatchPos + Ctx->mMatchLen], Old);
+  MakeChild (Ctx, New, Ctx->mText[Ctx->mPos + Ctx->mMatchLen], Ctx->mPos);
 }
 
 STATIC
   VOID
   InsertNode (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   )
   /*++
 
@@ -783,50 +843,50 @@ STATIC
   UINT8 *t1;
   UINT8 *t2;
 
-  if (mMatchLen >= 4) {
+  if (Ctx->mMatchLen >= 4) {
     //
     // We have just got a long match, the target tree
     // can be located by MatchPos + 1. Traverse the tree
     // from bottom up to get to a proper starting point.
     // The usage of PERC_FLAG ensures proper node deletion
-    // DeleteNode() later.
+    // DeleteNode(Ctx) later.
     //
-    mMatchLen--;
-    NodeR = (NODE) ((mMatchPos + 1) | WNDSIZ);
-    NodeQ = mParent[NodeR];
+    Ctx->mMatchLen--;
+    NodeR = (NODE) ((Ctx->mMatchPos + 1) | WNDSIZ);
+    NodeQ = Ctx->mParent[NodeR];
     while (NodeQ == NIL) {
-      NodeR = mNext[NodeR];
-      NodeQ = mParent[NodeR];
+      NodeR = Ctx->mNext[NodeR];
+      NodeQ = Ctx->mParent[NodeR];
     }
 
-    while (mLevel[NodeQ] >= mMatchLen) {
+    while (Ctx->mLevel[NodeQ] >= Ctx->mMatchLen) {
       NodeR = NodeQ;
-      NodeQ = mParent[NodeQ];
+      NodeQ = Ctx->mParent[NodeQ];
     }
 
     NodeT = NodeQ;
-    while (mPosition[NodeT] < 0) {
-      mPosition[NodeT]  = mPos;
-      NodeT             = mParent[NodeT];
+    while (Ctx->mPosition[NodeT] < 0) {
+      Ctx->mPosition[NodeT]  = Ctx->mPos;
+      NodeT             = Ctx->mParent[NodeT];
     }
 
         if (NodeT < (NODE) WNDSIZ) {
-      mPosition[NodeT] = (NODE) (mPos | (UINT32) PERC_FLAG);
+      Ctx->mPosition[NodeT] = (NODE) (Ctx->mPos | (UINT32) PERC_FLAG);
     }
   } else {
     //
     // Locate the target tree
     //
-    NodeQ = (NODE) (mText[mPos] + WNDSIZ);
-    CharC = mText[mPos + 1];
-    NodeR = Child (NodeQ, CharC);
+    NodeQ = (NODE) (Ctx->mText[Ctx->mPos] + WNDSIZ);
+    CharC = Ctx->mText[Ctx->mPos + 1];
+    NodeR = Child (Ctx, NodeQ, CharC);
     if (NodeR == NIL) {
-      MakeChild (NodeQ, CharC, mPos);
-      mMatchLen = 1;
+      MakeChild (Ctx, NodeQ, CharC, Ctx->mPos);
+      Ctx->mMatchLen = 1;
       return ;
     }
 
-    mMatchLen = 2;
+    Ctx->mMatchLen = 2;
   }
   //
   // Traverse down the tree to find a match.
@@ -836,64 +896,64 @@ STATIC
   for (;;) {
         if (NodeR >= (NODE) WNDSIZ) {
       Index2    = MAXMATCH;
-      mMatchPos = NodeR;
+      Ctx->mMatchPos = NodeR;
     } else {
-      Index2    = mLevel[NodeR];
-      mMatchPos = (NODE) (mPosition[NodeR] & (UINT32)~PERC_FLAG);
+      Index2    = Ctx->mLevel[NodeR];
+      Ctx->mMatchPos = (NODE) (Ctx->mPosition[NodeR] & (UINT32)~PERC_FLAG);
     }
 
-    if (mMatchPos >= mPos) {
-      mMatchPos -= WNDSIZ;
+    if (Ctx->mMatchPos >= Ctx->mPos) {
+      Ctx->mMatchPos -= WNDSIZ;
     }
 
-    t1  = &mText[mPos + mMatchLen];
-    t2  = &mText[mMatchPos + mMatchLen];
-    while (mMatchLen < Index2) {
+    t1  = &Ctx->mText[Ctx->mPos + Ctx->mMatchLen];
+    t2  = &Ctx->mText[Ctx->mMatchPos + Ctx->mMatchLen];
+    while (Ctx->mMatchLen < Index2) {
       if (*t1 != *t2) {
-        Split (NodeR);
+        Split (Ctx, NodeR);
         return ;
       }
 
-      mMatchLen++;
+      Ctx->mMatchLen++;
       t1++;
       t2++;
     }
 
-    if (mMatchLen >= MAXMATCH) {
+    if (Ctx->mMatchLen >= MAXMATCH) {
       break;
     }
 
-    mPosition[NodeR]  = mPos;
+    Ctx->mPosition[NodeR]  = Ctx->mPos;
     NodeQ             = NodeR;
-    NodeR             = Child (NodeQ, *t1);
+    NodeR             = Child (Ctx, NodeQ, *t1);
     if (NodeR == NIL) {
-      MakeChild (NodeQ, *t1, mPos);
+      MakeChild (Ctx, NodeQ, *t1, Ctx->mPos);
       return ;
     }
 
-    mMatchLen++;
+    Ctx->mMatchLen++;
   }
 
-  NodeT           = mPrev[NodeR];
-  mPrev[mPos]     = NodeT;
-  mNext[NodeT]    = mPos;
-  NodeT           = mNext[NodeR];
-  mNext[mPos]     = NodeT;
-  mPrev[NodeT]    = mPos;
-  mParent[mPos]   = NodeQ;
-  mParent[NodeR]  = NIL;
+  NodeT           = Ctx->mPrev[NodeR];
+  Ctx->mPrev[Ctx->mPos]     = NodeT;
+  Ctx->mNext[NodeT]    = Ctx->mPos;
+  NodeT           = Ctx->mNext[NodeR];
+  Ctx->mNext[Ctx->mPos]     = NodeT;
+  Ctx->mPrev[NodeT]    = Ctx->mPos;
+  Ctx->mParent[Ctx->mPos]   = NodeQ;
+  Ctx->mParent[NodeR]  = NIL;
 
   //
   // Special usage of 'next'
   //
-  mNext[NodeR] = mPos;
+  Ctx->mNext[NodeR] = Ctx->mPos;
 
 }
 
 STATIC
   VOID
   DeleteNode (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   )
   /*++
 
@@ -914,36 +974,36 @@ STATIC
   NODE  NodeT;
   NODE  NodeU;
 
-  if (mParent[mPos] == NIL) {
+  if (Ctx->mParent[Ctx->mPos] == NIL) {
     return ;
   }
 
-  NodeR         = mPrev[mPos];
-  NodeS         = mNext[mPos];
-  mNext[NodeR]  = NodeS;
-  mPrev[NodeS]  = NodeR;
-  NodeR         = mParent[mPos];
-  mParent[mPos] = NIL;
+  NodeR         = Ctx->mPrev[Ctx->mPos];
+  NodeS         = Ctx->mNext[Ctx->mPos];
+  Ctx->mNext[NodeR]  = NodeS;
+  Ctx->mPrev[NodeS]  = NodeR;
+  NodeR         = Ctx->mParent[Ctx->mPos];
+  Ctx->mParent[Ctx->mPos] = NIL;
     if (NodeR >= (NODE) WNDSIZ) {
     return ;
   }
 
-  mChildCount[NodeR]--;
-  if (mChildCount[NodeR] > 1) {
+  Ctx->mChildCount[NodeR]--;
+  if (Ctx->mChildCount[NodeR] > 1) {
     return ;
   }
 
-  NodeT = (NODE) (mPosition[NodeR] & (UINT32)~PERC_FLAG);
-  if (NodeT >= mPos) {
+  NodeT = (NODE) (Ctx->mPosition[NodeR] & (UINT32)~PERC_FLAG);
+  if (NodeT >= Ctx->mPos) {
     NodeT -= WNDSIZ;
   }
 
   NodeS = NodeT;
-  NodeQ = mParent[NodeR];
-  NodeU = mPosition[NodeQ];
+  NodeQ = Ctx->mParent[NodeR];
+  NodeU = Ctx->mPosition[NodeQ];
   while (NodeU & (UINT32) PERC_FLAG) {
     NodeU &= (UINT32)~PERC_FLAG;
-    if (NodeU >= mPos) {
+    if (NodeU >= Ctx->mPos) {
       NodeU -= WNDSIZ;
     }
 
@@ -951,13 +1011,13 @@ STATIC
       NodeS = NodeU;
     }
 
-    mPosition[NodeQ]  = (NODE) (NodeS | WNDSIZ);
-    NodeQ             = mParent[NodeQ];
-    NodeU             = mPosition[NodeQ];
+    Ctx->mPosition[NodeQ]  = (NODE) (NodeS | WNDSIZ);
+    NodeQ             = Ctx->mParent[NodeQ];
+    NodeU             = Ctx->mPosition[NodeQ];
   }
 
     if (NodeQ < (NODE) WNDSIZ) {
-    if (NodeU >= mPos) {
+    if (NodeU >= Ctx->mPos) {
       NodeU -= WNDSIZ;
     }
 
@@ -965,30 +1025,30 @@ STATIC
       NodeS = NodeU;
     }
 
-    mPosition[NodeQ] = (NODE) (NodeS | WNDSIZ | (UINT32) PERC_FLAG);
-  }
-
-  NodeS           = Child (NodeR, mText[NodeT + mLevel[NodeR]]);
-  NodeT           = mPrev[NodeS];
-  NodeU           = mNext[NodeS];
-  mNext[NodeT]    = NodeU;
-  mPrev[NodeU]    = NodeT;
-  NodeT           = mPrev[NodeR];
-  mNext[NodeT]    = NodeS;
-  mPrev[NodeS]    = NodeT;
-  NodeT           = mNext[NodeR];
-  mPrev[NodeT]    = NodeS;
-  mNext[NodeS]    = NodeT;
-  mParent[NodeS]  = mParent[NodeR];
-  mParent[NodeR]  = NIL;
-  mNext[NodeR]    = mAvail;
-  mAvail          = NodeR;
+    Ctx->mPosition[NodeQ] = (NODE) (NodeS | WNDSIZ | (UINT32) PERC_FLAG);
+  }
+
+  NodeS           = Child (Ctx, NodeR, Ctx->mText[NodeT + Ctx->mLevel[NodeR]]);
+  NodeT           = Ctx->mPrev[NodeS];
+  NodeU           = Ctx->mNext[NodeS];
+  Ctx->mNext[NodeT]    = NodeU;
+  Ctx->mPrev[NodeU]    = NodeT;
+  NodeT           = Ctx->mPrev[NodeR];
+  Ctx->mNext[NodeT]    = NodeS;
+  Ctx->mPrev[NodeS]    = NodeT;
+  NodeT           = Ctx->mNext[NodeR];
+  Ctx->mPrev[NodeT]    = NodeS;
+  Ctx->mNext[NodeS]    = NodeT;
+  Ctx->mParent[NodeS]  = Ctx->mParent[NodeR];
+  Ctx->mParent[NodeR]  = NIL;
+  Ctx->mNext[NodeR]    = Ctx->mAvail;
+  Ctx->mAvail          = NodeR;
 }
 
 STATIC
   VOID
   GetNextMatch (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   )
   /*++
 
@@ -1005,23 +1065,23 @@ STATIC
 {
   INT32 Number;
 
-  mRemainder--;
-  mPos++;
-  if (mPos == WNDSIZ * 2) {
-    memmove (&mText[0], &mText[WNDSIZ], WNDSIZ + MAXMATCH);
-    Number = FreadCrc (&mText[WNDSIZ + MAXMATCH], WNDSIZ);
-    mRemainder += Number;
-    mPos = WNDSIZ;
+  Ctx->mRemainder--;
+  Ctx->mPos++;
+  if (Ctx->mPos == WNDSIZ * 2) {
+    memmove (&Ctx->mText[0], &Ctx->mText[WNDSIZ], WNDSIZ + MAXMATCH);
+    Number = FreadCrc (Ctx, &Ctx->mText[WNDSIZ + MAXMATCH], WNDSIZ);
+    Ctx->mRemainder += Number;
+    Ctx->mPos = WNDSIZ;
   }
 
-  DeleteNode ();
-  InsertNode ();
+  DeleteNode (Ctx);
+  InsertNode (Ctx);
 }
 
 STATIC
   INT32
   Encode (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   )
   /*++
 
@@ -1038,80 +1098,79 @@ STATIC
 
   --*/
 {
-  INT32  Status;
   INT32       LastMatchLen;
   NODE        LastMatchPos;
 
-  Status = AllocateMemory ();
-  if (Status) {
-    FreeMemory ();
-    return Status;
-  }
+  //
+  // Work buffers are owned by the context, reset them to the state
+  // AllocateMemory left them in
+  //
+  memset (Ctx->mText, 0, WNDSIZ * 2 + MAXMATCH);
+  Ctx->mBuf[0] = 0;
 
-  InitSlide ();
+  InitSlide (Ctx);
 
-  HufEncodeStart ();
+  HufEncodeStart (Ctx);
 
-  mRemainder  = FreadCrc (&mText[WNDSIZ], WNDSIZ + MAXMATCH);
+  Ctx->mRemainder  = FreadCrc (Ctx, &Ctx->mText[WNDSIZ], WNDSIZ + MAXMATCH);
 
-  mMatchLen   = 0;
-  mPos        = WNDSIZ;
-  InsertNode ();
-  if (mMatchLen > mRemainder) {
-    mMatchLen = mRemainder;
+  Ctx->mMatchLen   = 0;
+  Ctx->mPos        = WNDSIZ;
+  InsertNode (Ctx);
+  if (Ctx->mMatchLen > Ctx->mRemainder) {
+    Ctx->mMatchLen = Ctx->mRemainder;
   }
 
-  while (mRemainder > 0) {
-    LastMatchLen  = mMatchLen;
-    LastMatchPos  = mMatchPos;
-    GetNextMatch ();
-    if (mMatchLen > mRemainder) {
-      mMatchLen = mRemainder;
+  while (Ctx->mRemainder > 0) {
+    LastMatchLen  = Ctx->mMatchLen;
+    LastMatchPos  = Ctx->mMatchPos;
+    GetNextMatch (Ctx);
+    if (Ctx->mMatchLen > Ctx->mRemainder) {
+      Ctx->mMatchLen = Ctx->mRemainder;
     }
 
-    if (mMatchLen > LastMatchLen || LastMatchLen < THRESHOLD) {
+    if (Ctx->mMatchLen > LastMatchLen || LastMatchLen < THRESHOLD) {
       //
       // Not enough benefits are gained by outputting a pointer,
       // so just output the original character
       //
-      Output (mText[mPos - 1], 0);
+      Output (Ctx, Ctx->mText[Ctx->mPos - 1], 0);
 
     } else {
 
       if (LastMatchLen == THRESHOLD) {
-        if (((mPos - LastMatchPos - 2) & (WNDSIZ - 1)) > (1U << 11)) {
-          Output (mText[mPos - 1], 0);
+        if (((Ctx->mPos - LastMatchPos - 2) & (WNDSIZ - 1)) > (1U << 11)) {
+          Output (Ctx, Ctx->mText[Ctx->mPos - 1], 0);
           continue;
         }
       }
       //
       // Outputting a pointer is beneficial enough, do it.
       //
-      Output (
+      Output (Ctx,
         LastMatchLen + (UINT8_MAX + 1 - THRESHOLD),
-        (mPos - LastMatchPos - 2) & (WNDSIZ - 1)
+        (Ctx->mPos - LastMatchPos - 2) & (WNDSIZ - 1)
         );
       LastMatchLen--;
       while (LastMatchLen > 0) {
-        GetNextMatch ();
+        GetNextMatch (Ctx);
         LastMatchLen--;
       }
 
-      if (mMatchLen > mRemainder) {
-        mMatchLen = mRemainder;
+      if (Ctx->mMatchLen > Ctx->mRemainder) {
+        Ctx->mMatchLen = Ctx->mRemainder;
       }
     }
   }
 
-  HufEncodeEnd ();
-  FreeMemory ();
+  HufEncodeEnd (Ctx);
   return EFI_SUCCESS;
 }
 
 STATIC
   VOID
   CountTFreq (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   )
   /*++
 
@@ -1131,36 +1190,36 @@ STATIC
   INT32 Count;
 
   for (Index = 0; Index < NT; Index++) {
-    mTFreq[Index] = 0;
+    Ctx->mTFreq[Index] = 0;
   }
 
   Number = NC;
-  while (Number > 0 && mCLen[Number - 1] == 0) {
+  while (Number > 0 && Ctx->mCLen[Number - 1] == 0) {
     Number--;
   }
 
   Index = 0;
   while (Index < Number) {
-    Index3 = mCLen[Index++];
+    Index3 = Ctx->mCLen[Index++];
     if (Index3 == 0) {
       Count = 1;
-      while (Index < Number && mCLen[Index] == 0) {
+      while (Index < Number && Ctx->mCLen[Index] == 0) {
         Index++;
         Count++;
       }
 
       if (Count <= 2) {
-        mTFreq[0] = (UINT16) (mTFreq[0] + Count);
+        Ctx->mTFreq[0] = (UINT16) (Ctx->mTFreq[0] + Count);
       } else if (Count <= 18) {
-        mTFreq[1]++;
+        Ctx->mTFreq[1]++;
       } else if (Count == 19) {
-        mTFreq[0]++;
-        mTFreq[1]++;
+        Ctx->mTFreq[0]++;
+        Ctx->mTFreq[1]++;
       } else {
-        mTFreq[2]++;
+        Ctx->mTFreq[2]++;
       }
     } else {
-      mTFreq[Index3 + 2]++;
+      Ctx->mTFreq[Index3 + 2]++;
     }
   }
 }
@@ -1168,6 +1227,7 @@ STATIC
 STATIC
   VOID
   WritePTLen (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   INT32 Number,
   INT32 nbit,
   INT32 Special
@@ -1191,26 +1251,26 @@ STATIC
   INT32 Index;
   INT32 Index3;
 
-  while (Number > 0 && mPTLen[Number - 1] == 0) {
+  while (Number > 0 && Ctx->mPTLen[Number - 1] == 0) {
     Number--;
   }
 
-  PutBits (nbit, Number);
+  PutBits (Ctx, nbit, Number);
   Index = 0;
   while (Index < Number) {
-    Index3 = mPTLen[Index++];
+    Index3 = Ctx->mPTLen[Index++];
     if (Index3 <= 6) {
-      PutBits (3, Index3);
+      PutBits (Ctx, 3, Index3);
     } else {
-      PutBits (Index3 - 3, (1U << (Index3 - 3)) - 2);
+      PutBits (Ctx, Index3 - 3, (1U << (Index3 - 3)) - 2);
     }
 
     if (Index == Special) {
-      while (Index < 6 && mPTLen[Index] == 0) {
+      while (Index < 6 && Ctx->mPTLen[Index] == 0) {
         Index++;
       }
 
-      PutBits (2, (Index - 3) & 3);
+      PutBits (Ctx, 2, (Index - 3) & 3);
     }
   }
 }
@@ -1218,7 +1278,7 @@ STATIC
 STATIC
   VOID
   WriteCLen (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   )
   /*++
 
@@ -1238,38 +1298,38 @@ STATIC
   INT32 Count;
 
   Number = NC;
-  while (Number > 0 && mCLen[Number - 1] == 0) {
+  while (Number > 0 && Ctx->mCLen[Number - 1] == 0) {
     Number--;
   }
 
-  PutBits (CBIT, Number);
+  PutBits (Ctx, CBIT, Number);
   Index = 0;
   while (Index < Number) {
-    Index3 = mCLen[Index++];
+    Index3 = Ctx->mCLen[Index++];
     if (Index3 == 0) {
       Count = 1;
-      while (Index < Number && mCLen[Index] == 0) {
+      while (Index < Number && Ctx->mCLen[Index] == 0) {
         Index++;
         Count++;
       }
 
       if (Count <= 2) {
         for (Index3 = 0; Index3 < Count; Index3++) {
-          PutBits (mPTLen[0], mPTCode[0]);
+          PutBits (Ctx, Ctx->mPTLen[0], Ctx->mPTCode[0]);
         }
       } else if (Count <= 18) {
-        PutBits (mPTLen[1], mPTCode[1]);
-        PutBits (4, Count - 3);
+        PutBits (Ctx, Ctx->mPTLen[1], Ctx->mPTCode[1]);
+        PutBits (Ctx, 4, Count - 3);
       } else if (Count == 19) {
-        PutBits (mPTLen[0], mPTCode[0]);
-        PutBits (mPTLen[1], mPTCode[1]);
-        PutBits (4, 15);
+        PutBits (Ctx, Ctx->mPTLen[0], Ctx->mPTCode[0]);
+        PutBits (Ctx, Ctx->mPTLen[1], Ctx->mPTCode[1]);
+        PutBits (Ctx, 4, 15);
       } else {
-        PutBits (mPTLen[2], mPTCode[2]);
-        PutBits (CBIT, Count - 20);
+        PutBits (Ctx, Ctx->mPTLen[2], Ctx->mPTCode[2]);
+        PutBits (Ctx, CBIT, Count - 20);
       }
     } else {
-      PutBits (mPTLen[Index3 + 2], mPTCode[Index3 + 2]);
+      PutBits (Ctx, Ctx->mPTLen[Index3 + 2], Ctx->mPTCode[Index3 + 2]);
     }
   }
 }
@@ -1277,15 +1337,17 @@ STATIC
 STATIC
   VOID
   EncodeC (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   INT32 Value
   )
 {
-  PutBits (mCLen[Value], mCCode[Value]);
+  PutBits (Ctx, Ctx->mCLen[Value], Ctx->mCCode[Value]);
 }
 
 STATIC
   VOID
   EncodeP (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   UINT32 Value
   )
 {
@@ -1299,16 +1361,16 @@ STATIC
     Index++;
   }
 
-  PutBits (mPTLen[Index], mPTCode[Index]);
+  PutBits (Ctx, Ctx->mPTLen[Index], Ctx->mPTCode[Index]);
   if (Index > 1) {
-    PutBits (Index - 1, Value & (0xFFFFFFFFU >> (32 - Index + 1)));
+    PutBits (Ctx, Index - 1, Value & (0xFFFFFFFFU >> (32 - Index + 1)));
   }
 }
 
 STATIC
   VOID
   SendBlock (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   )
   /*++
 
@@ -1333,69 +1395,70 @@ STATIC
   UINT32  Size;
   Flags = 0;
 
-  Root  = MakeTree (NC, mCFreq, mCLen, mCCode);
-  Size  = mCFreq[Root];
-  PutBits (16, Size);
+  Root  = MakeTree (Ctx, NC, Ctx->mCFreq, Ctx->mCLen, Ctx->mCCode);
+  Size  = Ctx->mCFreq[Root];
+  PutBits (Ctx, 16, Size);
   if (Root >= NC) {
-    CountTFreq ();
-    Root = MakeTree (NT, mTFreq, mPTLen, mPTCode);
+    CountTFreq (Ctx);
+    Root = MakeTree (Ctx, NT, Ctx->mTFreq, Ctx->mPTLen, Ctx->mPTCode);
     if (Root >= NT) {
-      WritePTLen (NT, TBIT, 3);
+      WritePTLen (Ctx, NT, TBIT, 3);
     } else {
-      PutBits (TBIT, 0);
-      PutBits (TBIT, Root);
+      PutBits (Ctx, TBIT, 0);
+      PutBits (Ctx, TBIT, Root);
     }
 
-    WriteCLen ();
+    WriteCLen (Ctx);
   } else {
-    PutBits (TBIT, 0);
-    PutBits (TBIT, 0);
-    PutBits (CBIT, 0);
-    PutBits (CBIT, Root);
+    PutBits (Ctx, TBIT, 0);
+    PutBits (Ctx, TBIT, 0);
+    PutBits (Ctx, CBIT, 0);
+    PutBits (Ctx, CBIT, Root);
   }
 
-  Root = MakeTree (NP, mPFreq, mPTLen, mPTCode);
+  Root = MakeTree (Ctx, NP, Ctx->mPFreq, Ctx->mPTLen, Ctx->mPTCode);
   if (Root >= NP) {
-    WritePTLen (NP, mPbit, -1);
+    WritePTLen (Ctx, NP, Ctx->mPbit, -1);
   } else {
-        PutBits (mPbit, 0);
-        PutBits (mPbit, Root);
+        PutBits (Ctx, Ctx->mPbit, 0);
+        PutBits (Ctx, Ctx->mPbit, Root);
   }
 
   Pos = 0;
   for (Index = 0; Index < Size; Index++) {
     if (Index % UINT8_BIT == 0) {
-      Flags = mBuf[Pos++];
+      Flags = Ctx->mBuf[Pos++];
     } else {
       Flags <<= 1;
     }
 
     if (Flags & (1U << (UINT8_BIT - 1))) {
-      EncodeC (mBuf[Pos++] + (1U << UINT8_BIT));
-      Index3 = mBuf[Pos++];
+      EncodeC (Ctx, Ctx->mBuf[Pos++] + (1U << UINT8_BIT));
+      Index3 = Ctx->mBuf[Pos++];
       for (Index2 = 0; Index2 < 3; Index2++) {
         Index3 <<= UINT8_BIT;
-        Index3 += mBuf[Pos++];
+        Index3 += Ctx->mBuf[Pos++];
       }
 
-      EncodeP (Index3);
+      EncodeP (Ctx, Index3);
     } else {
-      EncodeC (mBuf[Pos++]);
+      EncodeC (Ctx, Ctx->mBuf[Pos++]);
     }
   }
 
   for (Index = 0; Index < NC; Index++) {
-    mCFreq[Index] = 0;
+    Ctx->mCFreq[Index] = 0;
   }
 
   for (Index = 0; Index < NP; Index++) {
-    mPFreq[Index] = 0;
+    Ctx->mPFreq[Index] = 0;
   }
 }
 
 STATIC
   VOID
   Output (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   UINT32 CharC,
   UINT32 Pos
   )
@@ -1414,75 +1477,73 @@ STATIC
 
   --*/
 {
-  STATIC UINT32 CPos;
-
-  if ((mOutputMask >>= 1) == 0) {
-    mOutputMask = 1U << (UINT8_BIT - 1);
+  if ((Ctx->mOutputMask >>= 1) == 0) {
+    Ctx->mOutputMask = 1U << (UINT8_BIT - 1);
     //
     // Check the buffer overflow per outputting UINT8_BIT symbols
     // which is an Original Character or a Pointer. The biggest
     // symbol is a Pointer which occupies 5 bytes.
     //
-    if (mOutputPos >= mBufSiz - 5 * UINT8_BIT) {
-      SendBlock ();
-      mOutputPos = 0;
+    if (Ctx->mOutputPos >= Ctx->mBufSiz - 5 * UINT8_BIT) {
+      SendBlock (Ctx);
+      Ctx->mOutputPos = 0;
     }
 
-    CPos        = mOutputPos++;
-    mBuf[CPos]  = 0;
+    Ctx->mCPos        = Ctx->mOutputPos++;
+    Ctx->mBuf[Ctx->mCPos]  = 0;
   }
 
-  mBuf[mOutputPos++] = (UINT8) CharC;
-  mCFreq[CharC]++;
+  Ctx->mBuf[Ctx->mOutputPos++] = (UINT8) CharC;
+  Ctx->mCFreq[CharC]++;
   if (CharC >= (1U << UINT8_BIT)) {
-    mBuf[CPos] |= mOutputMask;
-    mBuf[mOutputPos++]  = (UINT8) (Pos >> 24);
-    mBuf[mOutputPos++]  = (UINT8) (Pos >> 16);
-    mBuf[mOutputPos++]  = (UINT8) (Pos >> (UINT8_BIT));
-    mBuf[mOutputPos++]  = (UINT8) Pos;
+    Ctx->mBuf[Ctx->mCPos] |= Ctx->mOutputMask;
+    Ctx->mBuf[Ctx->mOutputPos++]  = (UINT8) (Pos >> 24);
+    Ctx->mBuf[Ctx->mOutputPos++]  = (UINT8) (Pos >> 16);
+    Ctx->mBuf[Ctx->mOutputPos++]  = (UINT8) (Pos >> (UINT8_BIT));
+    Ctx->mBuf[Ctx->mOutputPos++]  = (UINT8) Pos;
     CharC               = 0;
     while (Pos) {
       Pos >>= 1;
       CharC++;
     }
 
-    mPFreq[CharC]++;
+    Ctx->mPFreq[CharC]++;
   }
 }
 
 STATIC
   VOID
   HufEncodeStart (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   )
 {
   INT32 Index;
 
   for (Index = 0; Index < NC; Index++) {
-    mCFreq[Index] = 0;
+    Ctx->mCFreq[Index] = 0;
   }
 
   for (Index = 0; Index < NP; Index++) {
-    mPFreq[Index] = 0;
+    Ctx->mPFreq[Index] = 0;
   }
 
-  mOutputPos = mOutputMask = 0;
-  InitPutBits ();
+  Ctx->mOutputPos = Ctx->mOutputMask = 0;
+  InitPutBits (Ctx);
   return ;
 }
 
 STATIC
   VOID
   HufEncodeEnd (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   )
 {
-  SendBlock ();
+  SendBlock (Ctx);
 
   //
   // Flush remaining bits
   //
-  PutBits (UINT8_BIT - 1, 0);
+  PutBits (Ctx, UINT8_BIT - 1, 0);
 
   return ;
 }
@@ -1490,7 +1551,7 @@ STATIC
 STATIC
   VOID
   MakeCrcTable (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   )
 {
   UINT32  Index;
@@ -1507,13 +1568,14 @@ STATIC
       }
     }
 
-    mCrcTable[Index] = (UINT16) Temp;
+    Ctx->mCrcTable[Index] = (UINT16) Temp;
   }
 }
 
 STATIC
   VOID
   PutBits (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   INT32  Number,
   UINT32 Value
   )
@@ -1534,26 +1596,27 @@ STATIC
 {
   UINT8 Temp;
 
-  while (Number >= mBitCount) {
+  while (Number >= Ctx->mBitCount) {
     //
-    // Number -= mBitCount should never equal to 32
+    // Number -= Ctx->mBitCount should never equal to 32
     //
-    Temp = (UINT8) (mSubBitBuf | (Value >> (Number -= mBitCount)));
-    if (mDst < mDstUpperLimit) {
-      *mDst++ = Temp;
+    Temp = (UINT8) (Ctx->mSubBitBuf | (Value >> (Number -= Ctx->mBitCount)));
+    if (Ctx->mDst < Ctx->mDstUpperLimit) {
+      *Ctx->mDst++ = Temp;
     }
 
-    mCompSize++;
-    mSubBitBuf  = 0;
-    mBitCount   = UINT8_BIT;
+    Ctx->mCompSize++;
+    Ctx->mSubBitBuf  = 0;
+    Ctx->mBitCount   = UINT8_BIT;
   }
 
-  mSubBitBuf |= Value << (mBitCount -= Number);
+  Ctx->mSubBitBuf |= Value << (Ctx->mBitCount -= Number);
 }
 
 STATIC
   INT32
   FreadCrc (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   UINT8 *Pointer,
   INT32 Number
   )
@@ -1576,14 +1639,14 @@ STATIC
 {
   INT32 Index;
 
-  for (Index = 0; mSrc < mSrcUpperLimit && Index < Number; Index++) {
-    *Pointer++ = *mSrc++;
+  for (Index = 0; Ctx->mSrc < Ctx->mSrcUpperLimit && Index < Number; Index++) {
+    *Pointer++ = *Ctx->mSrc++;
   }
 
   Number = Index;
 
   Pointer -= Number;
-  mOrigSize += Number;
+  Ctx->mOrigSize += Number;
   Index--;
   while (Index >= 0) {
     UPDATE_CRC (*Pointer++);
@@ -1596,16 +1659,17 @@ STATIC
 STATIC
   VOID
   InitPutBits (
-  VOID
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx
   )
 {
-  mBitCount   = UINT8_BIT;
-  mSubBitBuf  = 0;
+  Ctx->mBitCount   = UINT8_BIT;
+  Ctx->mSubBitBuf  = 0;
 }
 
 STATIC
   VOID
   CountLen (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   INT32 Index
   )
   /*++
@@ -1622,21 +1686,20 @@ STATIC
 
   --*/
 {
-  STATIC INT32  Depth = 0;
-
-  if (Index < mN) {
-    mLenCnt[(Depth < 16) ? Depth : 16]++;
+  if (Index < Ctx->mN) {
+    Ctx->mLenCnt[(Ctx->mDepth < 16) ? Ctx->mDepth : 16]++;
   } else {
-    Depth++;
-    CountLen (mLeft[Index]);
-    CountLen (mRight[Index]);
-    Depth--;
+    Ctx->mDepth++;
+    CountLen (Ctx, Ctx->mLeft[Index]);
+    CountLen (Ctx, Ctx->mRight[Index]);
+    Ctx->mDepth--;
   }
 }
 
 STATIC
   VOID
   MakeLen (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   INT32 Root
   )
   /*++
@@ -1660,10 +1723,10 @@ STATIC
   UINT32  Cum;
 
   for (Index = 0; Index <= 16; Index++) {
-    mLenCnt[Index] = 0;
+    Ctx->mLenCnt[Index] = 0;
   }
 
-  CountLen (Root);
+  CountLen (Ctx, Root);
 
   //
   // Adjust the length count array so that
@@ -1671,15 +1734,15 @@ STATIC
   //
   Cum = 0;
   for (Index = 16; Index > 0; Index--) {
-    Cum += mLenCnt[Index] << (16 - Index);
+    Cum += Ctx->mLenCnt[Index] << (16 - Index);
   }
 
   while (Cum != (1U << 16)) {
-    mLenCnt[16]--;
+    Ctx->mLenCnt[16]--;
     for (Index = 15; Index > 0; Index--) {
-      if (mLenCnt[Index] != 0) {
-        mLenCnt[Index]--;
-        mLenCnt[Index + 1] += 2;
+      if (Ctx->mLenCnt[Index] != 0) {
+        Ctx->mLenCnt[Index]--;
+        Ctx->mLenCnt[Index + 1] += 2;
         break;
       }
     }
@@ -1688,10 +1751,10 @@ STATIC
   }
 
   for (Index = 16; Index > 0; Index--) {
-    Index3 = mLenCnt[Index];
+    Index3 = Ctx->mLenCnt[Index];
     Index3--;
     while (Index3 >= 0) {
-      mLen[*mSortPtr++] = (UINT8) Index;
+      Ctx->mLen[*Ctx->mSortPtr++] = (UINT8) Index;
       Index3--;
     }
   }
@@ -1700,6 +1763,7 @@ STATIC
 STATIC
   VOID
   DownHeap (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   INT32 Index
   )
 {
@@ -1709,28 +1773,29 @@ STATIC
   //
   // priority queue: send Index-th entry down heap
   //
-  Index3  = mHeap[Index];
+  Index3  = Ctx->mHeap[Index];
   Index2  = 2 * Index;
-  while (Index2 <= mHeapSize) {
-    if (Index2 < mHeapSize && mFreq[mHeap[Index2]] > mFreq[mHeap[Index2 + 1]]) {
+  while (Index2 <= Ctx->mHeapSize) {
+    if (Index2 < Ctx->mHeapSize && Ctx->mFreq[Ctx->mHeap[Index2]] > Ctx->mFreq[Ctx->mHeap[Index2 + 1]]) {
       Index2++;
     }
 
-    if (mFreq[Index3] <= mFreq[mHeap[Index2]]) {
+    if (Ctx->mFreq[Index3] <= Ctx->mFreq[Ctx->mHeap[Index2]]) {
       break;
     }
 
-    mHeap[Index]  = mHeap[Index2];
+    Ctx->mHeap[Index]  = Ctx->mHeap[Index2];
     Index         = Index2;
     Index2        = 2 * Index;
   }
 
-  mHeap[Index] = (INT16) Index3;
+  Ctx->mHeap[Index] = (INT16) Index3;
 }
 
 STATIC
   VOID
   MakeCode (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   INT32       Number,
   UINT8 Len[  ],
   UINT16 Code[]
@@ -1756,7 +1821,7 @@ STATIC
 
   Start[1] = 0;
   for (Index = 1; Index <= 16; Index++) {
-    Start[Index + 1] = (UINT16) ((Start[Index] + mLenCnt[Index]) << 1);
+    Start[Index + 1] = (UINT16) ((Start[Index] + Ctx->mLenCnt[Index]) << 1);
   }
 
   for (Index = 0; Index < Number; Index++) {
@@ -1767,6 +1832,7 @@ STATIC
 STATIC
   INT32
   MakeTree (
+  TIANO_COMPRESS_LEGACY_CONTEXT *Ctx,
   INT32            NParm,
   UINT16  FreqParm[],
   UINT8   LenParm[ ],
@@ -1799,57 +1865,57 @@ STATIC
   //
   // make tree, calculate len[], return root
   //
-  mN        = NParm;
-  mFreq     = FreqParm;
-  mLen      = LenParm;
-  Avail     = mN;
-  mHeapSize = 0;
-  mHeap[1]  = 0;
-  for (Index = 0; Index < mN; Index++) {
-    mLen[Index] = 0;
-    if (mFreq[Index]) {
-      mHeapSize++;
-      mHeap[mHeapSize] = (INT16) Index;
+  Ctx->mN        = NParm;
+  Ctx->mFreq     = FreqParm;
+  Ctx->mLen      = LenParm;
+  Avail     = Ctx->mN;
+  Ctx->mHeapSize = 0;
+  Ctx->mHeap[1]  = 0;
+  for (Index = 0; Index < Ctx->mN; Index++) {
+    Ctx->mLen[Index] = 0;
+    if (Ctx->mFreq[Index]) {
+      Ctx->mHeapSize++;
+      Ctx->mHeap[Ctx->mHeapSize] = (INT16) Index;
     }
   }
 
-  if (mHeapSize < 2) {
-    CodeParm[mHeap[1]] = 0;
-    return mHeap[1];
+  if (Ctx->mHeapSize < 2) {
+    CodeParm[Ctx->mHeap[1]] = 0;
+    return Ctx->mHeap[1];
   }
 
-  for (Index = mHeapSize / 2; Index >= 1; Index--) {
+  for (Index = Ctx->mHeapSize / 2; Index >= 1; Index--) {
     //
     // make priority queue
     //
-    DownHeap (Index);
+    DownHeap (Ctx, Index);
   }
 
-  mSortPtr = CodeParm;
+  Ctx->mSortPtr = CodeParm;
   do {
-    Index = mHeap[1];
-    if (Index < mN) {
-      *mSortPtr++ = (UINT16) Index;
+    Index = Ctx->mHeap[1];
+    if (Index < Ctx->mN) {
+      *Ctx->mSortPtr++ = (UINT16) Index;
     }
 
-    mHeap[1] = mHeap[mHeapSize--];
-    DownHeap (1);
-    Index2 = mHeap[1];
-    if (Index2 < mN) {
-      *mSortPtr++ = (UINT16) Index2;
+    Ctx->mHeap[1] = Ctx->mHeap[Ctx->mHeapSize--];
+    DownHeap (Ctx, 1);
+    Index2 = Ctx->mHeap[1];
+    if (Index2 < Ctx->mN) {
+      *Ctx->mSortPtr++ = (UINT16) Index2;
     }
 
     Index3        = Avail++;
-    mFreq[Index3] = (UINT16) (mFreq[Index] + mFreq[Index2]);
-    mHeap[1]      = (INT16) Index3;
-    DownHeap (1);
-    mLeft[Index3]   = (UINT16) Index;
-    mRight[Index3]  = (UINT16) Index2;
-  } while (mHeapSize > 1);
-
-  mSortPtr = CodeParm;
-  MakeLen (Index3);
-  MakeCode (NParm, LenParm, CodeParm);
+    Ctx->mFreq[Index3] = (UINT16) (Ctx->mFreq[Index] + Ctx->mFreq[Index2]);
+    Ctx->mHeap[1]      = (INT16) Index3;
+    DownHeap (Ctx, 1);
+    Ctx->mLeft[Index3]   = (UINT16) Index;
+    Ctx->mRight[Index3]  = (UINT16) Index2;
+  } while (Ctx->mHeapSize > 1);
+
+  Ctx->mSortPtr = CodeParm;
+  MakeLen (Ctx, Index3);
+  MakeCode (Ctx, NParm, LenParm, CodeParm);
 
   //
   // return root
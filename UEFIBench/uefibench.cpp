@@ -0,0 +1,447 @@
+/* uefibench.cpp
+
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+*/
+
+#include "uefibench.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QMap>
+#include <iostream>
+#include <iomanip>
+
+#include "../ffs.h"
+#include "../types.h"
+#include "../treemodel.h"
+#include "../Tiano/EfiTianoDecompress.h"
+#include "../Tiano/EfiTianoCompress.h"
+#include "../LZMA/LzmaDecompress.h"
+#include "../LZMA/LzmaCompress.h"
+#include "../Brotli/BrotliDecompress.h"
+#include "../Brotli/BrotliCompress.h"
+
+// Time stamp counter is used to get cycles per byte, where available
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define BENCH_HAVE_TSC
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC
+#endif
+
+// Cold runs are preceded by writing a buffer bigger than the last level cache
+#define BENCH_EVICT_SIZE 0x4000000
+#define BENCH_CACHE_LINE 64
+
+// Heap allocations made by codecs are counted by the linker wrappers set in uefibench.pro
+static QAtomicInt allocationCount;
+
+#ifdef UEFIBENCH_WRAP_MALLOC
+extern "C" {
+    void* __real_malloc(size_t size);
+    void* __real_calloc(size_t count, size_t size);
+    void* __real_realloc(void* ptr, size_t size);
+
+    void* __wrap_malloc(size_t size)
+    {
+        allocationCount.ref();
+        return __real_malloc(size);
+    }
+
+    void* __wrap_calloc(size_t count, size_t size)
+    {
+        allocationCount.ref();
+        return __real_calloc(count, size);
+    }
+
+    void* __wrap_realloc(void* ptr, size_t size)
+    {
+        allocationCount.ref();
+        return __real_realloc(ptr, size);
+    }
+}
+#endif
+
+static UINT64 readTsc()
+{
+#ifdef BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void evictCaches(QByteArray & buffer)
+{
+    if (buffer.isEmpty())
+        buffer.resize(BENCH_EVICT_SIZE);
+
+    char* data = buffer.data();
+    for (int i = 0; i < BENCH_EVICT_SIZE; i += BENCH_CACHE_LINE)
+        data[i]++;
+}
+
+static UINT8 decode(const UINT8 algorithm, const QByteArray & input, QByteArray & output, QByteArray & scratch)
+{
+    switch (algorithm) {
+    case COMPRESSION_ALGORITHM_EFI11:
+        return EfiDecompress(input.constData(), input.size(), output.data(), output.size(), scratch.data(), scratch.size());
+    case COMPRESSION_ALGORITHM_TIANO:
+        return TianoDecompress(input.constData(), input.size(), output.data(), output.size(), scratch.data(), scratch.size());
+    case COMPRESSION_ALGORITHM_LZMA:
+        return LzmaDecompress(input.constData(), input.size(), output.data());
+    case COMPRESSION_ALGORITHM_BROTLI:
+        return BrotliDecompress(input.constData(), input.size(), output.data(), output.size());
+    default:
+        return ERR_UNKNOWN_COMPRESSION_ALGORITHM;
+    }
+}
+
+static UINT8 encode(const UINT8 algorithm, const QByteArray & input, QByteArray & output, const UINT8 preset, TIANO_COMPRESS_CONTEXT* context)
+{
+    UINT32 size = output.size();
+
+    switch (algorithm) {
+    case COMPRESSION_ALGORITHM_EFI11:
+        return EfiCompressWithContext(context, input.constData(), input.size(), output.data(), &size);
+    case COMPRESSION_ALGORITHM_TIANO:
+        return TianoCompressWithContext(context, input.constData(), input.size(), output.data(), &size);
+    case COMPRESSION_ALGORITHM_LZMA:
+        return LzmaCompressWithOptions((const UINT8*)input.constData(), input.size(), (UINT8*)output.data(), &size,
+            preset, LZMA_MULTITHREAD_THRESHOLD);
+    case COMPRESSION_ALGORITHM_BROTLI:
+        return BrotliCompressWithPreset((const UINT8*)input.constData(), input.size(), (UINT8*)output.data(), &size, preset);
+    default:
+        return ERR_UNKNOWN_COMPRESSION_ALGORITHM;
+    }
+}
+
+static UINT32 encodedSizeBound(const UINT8 algorithm, const QByteArray & input, const UINT8 preset)
+{
+    UINT32 size = 0;
+
+    switch (algorithm) {
+    case COMPRESSION_ALGORITHM_EFI11:
+    case COMPRESSION_ALGORITHM_TIANO:
+        return EFI_TIANO_COMPRESS_BOUND(input.size());
+    case COMPRESSION_ALGORITHM_LZMA:
+        // Asking for the size needed is cheap for LZMA and Brotli
+        if (ERR_BUFFER_TOO_SMALL != LzmaCompressWithOptions((const UINT8*)input.constData(), input.size(), NULL, &size, preset, 0))
+            return 0;
+        return size;
+    case COMPRESSION_ALGORITHM_BROTLI:
+        if (ERR_BUFFER_TOO_SMALL != BrotliCompressWithPreset((const UINT8*)input.constData(), input.size(), NULL, &size, preset))
+            return 0;
+        return size;
+    default:
+        return 0;
+    }
+}
+
+UEFIBench::UEFIBench(QObject *parent) :
+    QObject(parent)
+{
+    ffsEngine = new FfsEngine(this);
+}
+
+UEFIBench::~UEFIBench()
+{
+    delete ffsEngine;
+}
+
+UINT8 UEFIBench::init(const QString & path)
+{
+    QFileInfo fileInfo = QFileInfo(path);
+
+    if (!fileInfo.exists())
+        return ERR_FILE_OPEN;
+
+    QFile inputFile;
+    inputFile.setFileName(path);
+
+    if (!inputFile.open(QFile::ReadOnly))
+        return ERR_FILE_OPEN;
+
+    QByteArray buffer = inputFile.readAll();
+    inputFile.close();
+
+    // Tree model isn't cleared by parsing, so every image gets a new engine
+    delete ffsEngine;
+    ffsEngine = new FfsEngine(this);
+
+    UINT8 result = ffsEngine->parseImageFile(buffer);
+    if (result)
+        return result;
+
+    TreeModel* model = ffsEngine->treeModel();
+    for (int i = 0; i < model->rowCount(); i++)
+        collect(model->index(i, 0));
+
+    return ERR_SUCCESS;
+}
+
+void UEFIBench::collect(const QModelIndex & index)
+{
+    TreeModel* model = ffsEngine->treeModel();
+    if (!index.isValid())
+        return;
+
+    if (model->type(index) == Types::Section) {
+        Payload payload;
+        payload.algorithm = model->compression(index);
+        payload.compressed = model->body(index);
+        payload.scratchSize = 0;
+
+        UINT32 decompressedSize = 0;
+        UINT8 result = ERR_UNKNOWN_COMPRESSION_ALGORITHM;
+        switch (payload.algorithm) {
+        case COMPRESSION_ALGORITHM_EFI11:
+        case COMPRESSION_ALGORITHM_TIANO:
+            result = EfiTianoGetInfo(payload.compressed.constData(), payload.compressed.size(), &decompressedSize, &payload.scratchSize);
+            break;
+        case COMPRESSION_ALGORITHM_IMLZMA: {
+            // Intel modified LZMA has a section header before LZMA data, it's the same decoder otherwise
+            UINT32 headerSize = sizeOfSectionHeader((const EFI_COMMON_SECTION_HEADER*)payload.compressed.constData());
+            if ((UINT32)payload.compressed.size() < headerSize)
+                break;
+            payload.compressed = payload.compressed.mid(headerSize);
+            payload.algorithm = COMPRESSION_ALGORITHM_LZMA;
+            result = LzmaGetInfo(payload.compressed.constData(), payload.compressed.size(), &decompressedSize);
+            break;
+        }
+        case COMPRESSION_ALGORITHM_LZMA:
+            result = LzmaGetInfo(payload.compressed.constData(), payload.compressed.size(), &decompressedSize);
+            break;
+        case COMPRESSION_ALGORITHM_BROTLI:
+            result = BrotliGetInfo(payload.compressed.constData(), payload.compressed.size(), &decompressedSize, NULL);
+            break;
+        }
+
+        // Only payloads that can be decoded here are benchmarked
+        if (!result) {
+            QByteArray scratch(payload.scratchSize, 0);
+            payload.decompressed.resize(decompressedSize);
+            if (!decode(payload.algorithm, payload.compressed, payload.decompressed, scratch))
+                payloads.append(payload);
+        }
+    }
+
+    for (int i = 0; i < model->rowCount(index); i++)
+        collect(model->index(i, 0, index));
+}
+
+UINT8 UEFIBench::run(const UINT8 preset, const int repeats)
+{
+    UINT8 result;
+    results.clear();
+
+    result = benchmark("EfiDecompress", COMPRESSION_ALGORITHM_EFI11, false, preset, repeats);
+    if (result)
+        return result;
+    result = benchmark("TianoDecompress", COMPRESSION_ALGORITHM_TIANO, false, preset, repeats);
+    if (result)
+        return result;
+    result = benchmark("LzmaDecompress", COMPRESSION_ALGORITHM_LZMA, false, preset, repeats);
+    if (result)
+        return result;
+    result = benchmark("BrotliDecompress", COMPRESSION_ALGORITHM_BROTLI, false, preset, repeats);
+    if (result)
+        return result;
+    result = benchmark("EfiCompress", COMPRESSION_ALGORITHM_EFI11, true, preset, repeats);
+    if (result)
+        return result;
+    result = benchmark("TianoCompress", COMPRESSION_ALGORITHM_TIANO, true, preset, repeats);
+    if (result)
+        return result;
+    result = benchmark("LzmaCompress", COMPRESSION_ALGORITHM_LZMA, true, preset, repeats);
+    if (result)
+        return result;
+    return benchmark("BrotliCompress", COMPRESSION_ALGORITHM_BROTLI, true, preset, repeats);
+}
+
+UINT8 UEFIBench::benchmark(const QString & codec, const UINT8 algorithm, const bool encoder, const UINT8 preset, const int repeats)
+{
+    // All buffers are allocated before measuring, so only allocations made by codecs are counted
+    QVector<const Payload*> selected;
+    QVector<QByteArray> outputs;
+    QVector<QByteArray> scratches;
+    UINT64 bytes = 0;
+    for (int i = 0; i < payloads.count(); i++) {
+        const Payload & payload = payloads.at(i);
+        if (payload.algorithm != algorithm)
+            continue;
+
+        UINT32 outputSize = encoder ? encodedSizeBound(algorithm, payload.decompressed, preset) : payload.decompressed.size();
+        if (encoder && !outputSize)
+            continue;
+
+        selected.append(&payload);
+        outputs.append(QByteArray(outputSize, 0));
+        scratches.append(QByteArray(encoder ? 0 : payload.scratchSize, 0));
+        bytes += payload.decompressed.size();
+    }
+    if (selected.isEmpty())
+        return ERR_SUCCESS;
+
+    TIANO_COMPRESS_CONTEXT* context = TianoCompressCreateContext();
+    if (!context)
+        return ERR_OUT_OF_RESOURCES;
+    TianoCompressSetPreset(context, preset);
+
+    QByteArray evictBuffer;
+    QElapsedTimer timer;
+    UINT8 result = ERR_SUCCESS;
+
+    // Cold cache, every payload is measured separately after evicting everything from caches
+    Result cold;
+    cold.codec = codec;
+    cold.cache = BENCH_CACHE_COLD;
+    cold.count = selected.count();
+    cold.bytes = bytes;
+    cold.nsecs = 0;
+    cold.cycles = 0;
+    allocationCount.fetchAndStoreRelaxed(0);
+    for (int i = 0; i < selected.count() && !result; i++) {
+        evictCaches(evictBuffer);
+        timer.start();
+        UINT64 start = readTsc();
+        result = encoder ? encode(algorithm, selected[i]->decompressed, outputs[i], preset, context)
+            : decode(algorithm, selected[i]->compressed, outputs[i], scratches[i]);
+        cold.cycles += readTsc() - start;
+        cold.nsecs += timer.nsecsElapsed();
+    }
+    cold.allocations = (UINT64)allocationCount.fetchAndAddRelaxed(0);
+
+    // Warm cache, all payloads are processed in one pass right after the same pass, the fastest pass is taken
+    Result warm;
+    warm.codec = codec;
+    warm.cache = BENCH_CACHE_WARM;
+    warm.count = selected.count();
+    warm.bytes = bytes;
+    warm.nsecs = 0;
+    warm.cycles = 0;
+    warm.allocations = 0;
+    for (int pass = 0; pass < repeats && !result; pass++) {
+        allocationCount.fetchAndStoreRelaxed(0);
+        timer.start();
+        UINT64 start = readTsc();
+        for (int i = 0; i < selected.count() && !result; i++)
+            result = encoder ? encode(algorithm, selected[i]->decompressed, outputs[i], preset, context)
+                : decode(algorithm, selected[i]->compressed, outputs[i], scratches[i]);
+        UINT64 cycles = readTsc() - start;
+        qint64 nsecs = timer.nsecsElapsed();
+        if (pass == 0 || nsecs < warm.nsecs) {
+            warm.nsecs = nsecs;
+            warm.cycles = cycles;
+            warm.allocations = (UINT64)allocationCount.fetchAndAddRelaxed(0);
+        }
+    }
+
+    TianoCompressFreeContext(context);
+    if (result)
+        return result;
+
+    if (!countsAllocations())
+        cold.allocations = warm.allocations = BENCH_ALLOCATIONS_UNKNOWN;
+    results.append(cold);
+    results.append(warm);
+    return ERR_SUCCESS;
+}
+
+bool UEFIBench::countsAllocations()
+{
+#ifdef UEFIBENCH_WRAP_MALLOC
+    return true;
+#else
+    return false;
+#endif
+}
+
+void UEFIBench::print() const
+{
+    std::cout << std::left << std::setw(18) << "Codec" << std::setw(6) << "Cache"
+        << std::right << std::setw(8) << "Count" << std::setw(12) << "Bytes"
+        << std::setw(10) << "MB/s" << std::setw(12) << "Cycles/B" << std::setw(14) << "Allocations" << std::endl;
+
+    for (int i = 0; i < results.count(); i++) {
+        const Result & r = results.at(i);
+        double seconds = r.nsecs / 1e9;
+        std::cout << std::left << std::setw(18) << r.codec.toLatin1().constData()
+            << std::setw(6) << (r.cache == BENCH_CACHE_COLD ? "cold" : "warm")
+            << std::right << std::setw(8) << r.count << std::setw(12) << r.bytes
+            << std::fixed << std::setprecision(2)
+            << std::setw(10) << (seconds > 0 ? r.bytes / seconds / 1e6 : 0.0);
+#ifdef BENCH_HAVE_TSC
+        std::cout << std::setw(12) << (r.bytes ? (double)r.cycles / r.bytes : 0.0);
+#else
+        std::cout << std::setw(12) << "n/a";
+#endif
+        if (r.allocations == BENCH_ALLOCATIONS_UNKNOWN)
+            std::cout << std::setw(14) << "n/a";
+        else
+            std::cout << std::setw(14) << r.allocations;
+        std::cout << std::endl;
+    }
+}
+
+UINT8 UEFIBench::save(const QString & path) const
+{
+    QFile file(path);
+    if (!file.open(QFile::WriteOnly | QFile::Text))
+        return ERR_FILE_OPEN;
+
+    // One line per result: codec, cache mode and throughput in MB/s
+    QTextStream stream(&file);
+    for (int i = 0; i < results.count(); i++) {
+        const Result & r = results.at(i);
+        double seconds = r.nsecs / 1e9;
+        stream << r.codec << " " << (r.cache == BENCH_CACHE_COLD ? "cold" : "warm") << " "
+            << QString::number(seconds > 0 ? r.bytes / seconds / 1e6 : 0.0, 'f', 2) << "\n";
+    }
+
+    return ERR_SUCCESS;
+}
+
+UINT8 UEFIBench::compare(const QString & path, const int tolerance, QStringList & regressions) const
+{
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly | QFile::Text))
+        return ERR_FILE_OPEN;
+
+    QMap<QString, double> baseline;
+    while (!file.atEnd()) {
+        QStringList fields = QString::fromLatin1(file.readLine()).simplified().split(' ');
+        if (fields.count() != 3)
+            continue;
+        baseline.insert(fields.at(0) + " " + fields.at(1), fields.at(2).toDouble());
+    }
+
+    for (int i = 0; i < results.count(); i++) {
+        const Result & r = results.at(i);
+        QString key = r.codec + " " + (r.cache == BENCH_CACHE_COLD ? "cold" : "warm");
+        if (!baseline.contains(key))
+            continue;
+
+        double seconds = r.nsecs / 1e9;
+        double current = seconds > 0 ? r.bytes / seconds / 1e6 : 0.0;
+        double expected = baseline.value(key);
+        if (current < expected * (100 - tolerance) / 100)
+            regressions.append(QString("%1: %2 MB/s, baseline %3 MB/s")
+                .arg(key)
+                .arg(current, 0, 'f', 2)
+                .arg(expected, 0, 'f', 2));
+    }
+
+    return ERR_SUCCESS;
+}
@@ -0,0 +1,76 @@
+/* uefibench.h
+
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+*/
+
+#ifndef __UEFIBENCH_H__
+#define __UEFIBENCH_H__
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QModelIndex>
+
+#include "../basetypes.h"
+#include "../ffsengine.h"
+
+// Benchmark cache modes
+#define BENCH_CACHE_COLD 0
+#define BENCH_CACHE_WARM 1
+
+// Allocation count is unknown if heap functions can't be intercepted
+#define BENCH_ALLOCATIONS_UNKNOWN 0xFFFFFFFFFFFFFFFFULL
+
+class UEFIBench : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit UEFIBench(QObject *parent = 0);
+    ~UEFIBench();
+
+    UINT8 init(const QString & path);
+    UINT8 run(const UINT8 preset, const int repeats);
+    void print() const;
+    UINT8 save(const QString & path) const;
+    UINT8 compare(const QString & path, const int tolerance, QStringList & regressions) const;
+
+    int payloadCount() const { return payloads.count(); }
+    static bool countsAllocations();
+
+private:
+    struct Payload {
+        UINT8 algorithm;
+        QByteArray compressed;
+        QByteArray decompressed;
+        UINT32 scratchSize;
+    };
+
+    struct Result {
+        QString codec;
+        UINT8 cache;
+        UINT32 count;
+        UINT64 bytes;
+        qint64 nsecs;
+        UINT64 cycles;
+        UINT64 allocations;
+    };
+
+    FfsEngine* ffsEngine;
+    QVector<Payload> payloads;
+    QVector<Result> results;
+
+    void collect(const QModelIndex & index);
+    UINT8 benchmark(const QString & codec, const UINT8 algorithm, const bool encoder, const UINT8 preset, const int repeats);
+};
+
+#endif
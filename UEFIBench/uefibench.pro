@@ -0,0 +1,62 @@
+QT       += core
+QT       -= gui
+greaterThan(QT_MAJOR_VERSION, 4): QT += concurrent
+
+TARGET    = UEFIBench
+TEMPLATE  = app
+CONFIG   += console
+CONFIG   -= app_bundle
+DEFINES  += _CONSOLE _DISABLE_ENGINE_MESSAGES
+
+SOURCES  += uefibench_main.cpp \
+ uefibench.cpp \
+ ../types.cpp \
+ ../descriptor.cpp \
+ ../ffs.cpp \
+ ../ffsengine.cpp \
+ ../peimage.cpp \
+ ../treeitem.cpp \
+ ../treemodel.cpp \
+ ../Brotli/BrotliCompress.c \
+ ../Brotli/BrotliDecompress.c \
+ ../LZMA/LzmaCompress.c \
+ ../LZMA/LzmaDecompress.c \
+ ../LZMA/SDK/C/LzFind.c \
+ ../LZMA/SDK/C/LzFindMt.c \
+ ../LZMA/SDK/C/LzmaDec.c \
+ ../LZMA/SDK/C/LzmaEnc.c \
+ ../LZMA/SDK/C/Threads.c \
+ ../Tiano/EfiTianoDecompress.c \
+ ../Tiano/EfiTianoCompress.c \
+ ../Tiano/EfiTianoCompressLegacy.c
+
+HEADERS  += uefibench.h \
+ ../basetypes.h \
+ ../descriptor.h \
+ ../gbe.h \
+ ../me.h \
+ ../ffs.h \
+ ../peimage.h \
+ ../types.h \
+ ../ffsengine.h \
+ ../treeitem.h \
+ ../treemodel.h \
+ ../Brotli/BrotliCompress.h \
+ ../Brotli/BrotliDecompress.h \
+ ../LZMA/LzmaCompress.h \
+ ../LZMA/LzmaDecompress.h \
+ ../Tiano/EfiTianoDecompress.h \
+ ../Tiano/EfiTianoCompress.h
+
+# Brotli GUID-defined sections are only decompressed and compressed if libbrotli is found
+packagesExist(libbrotlienc libbrotlidec) {
+    CONFIG    += link_pkgconfig
+    PKGCONFIG += libbrotlienc libbrotlidec
+    DEFINES   += HAVE_BROTLI
+}
+
+# Heap allocations made by codecs are counted by wrapping allocation functions, needs GNU linker
+linux {
+    QMAKE_LFLAGS += -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
+    DEFINES      += UEFIBENCH_WRAP_MALLOC
+}
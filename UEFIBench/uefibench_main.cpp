@@ -0,0 +1,127 @@
+/* uefibench_main.cpp
+
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+*/
+#include <QCoreApplication>
+#include <QString>
+#include <QStringList>
+#include <iostream>
+#include "uefibench.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setOrganizationName("LongSoft");
+    a.setOrganizationDomain("longsoft.me");
+    a.setApplicationName("UEFIBench");
+
+    UEFIBench w;
+    UINT8 preset = COMPRESSION_PRESET_DEFAULT;
+    int repeats = 5;
+    int tolerance = 10;
+    QString outputPath;
+    QString baselinePath;
+    QStringList images;
+    bool valid = true;
+
+    QStringList arguments = a.arguments();
+    for (int i = 1; i < arguments.length() && valid; i++) {
+        const QString & argument = arguments.at(i);
+        bool optionWithValue = (argument == QString("-p") || argument == QString("-r") || argument == QString("-o")
+            || argument == QString("-c") || argument == QString("-t"));
+        if (!optionWithValue) {
+            images.append(argument);
+            continue;
+        }
+        if (i + 1 == arguments.length()) {
+            valid = false;
+            break;
+        }
+
+        const QString & value = arguments.at(++i);
+        if (argument == QString("-p")) {
+            if (value == QString("fast"))
+                preset = COMPRESSION_PRESET_FAST;
+            else if (value == QString("default"))
+                preset = COMPRESSION_PRESET_DEFAULT;
+            else if (value == QString("max"))
+                preset = COMPRESSION_PRESET_MAX;
+            else
+                valid = false;
+        }
+        else if (argument == QString("-r")) {
+            repeats = value.toInt(&valid);
+            valid = valid && repeats > 0;
+        }
+        else if (argument == QString("-t")) {
+            tolerance = value.toInt(&valid);
+            valid = valid && tolerance >= 0 && tolerance < 100;
+        }
+        else if (argument == QString("-o"))
+            outputPath = value;
+        else
+            baselinePath = value;
+    }
+
+    if (!valid || images.isEmpty()) {
+        std::cout << "UEFIBench 0.1.0 - UEFI codec benchmark utility" << std::endl << std::endl <<
+            "Usage: UEFIBench image_file [image_file ...] [-p {fast | default | max}] [-r repeats] [-o results_file] [-c baseline_file [-t tolerance]]" << std::endl << std::endl <<
+            "Compressed sections of all image files are decompressed and compressed again by every codec," << std::endl <<
+            "once with cold caches for every section and repeatedly with warm caches for all sections" << std::endl <<
+            "-p sets the compression preset used by compressors, default is default" << std::endl <<
+            "-r sets the number of warm runs, the fastest one is reported, default is 5" << std::endl <<
+            "-o saves the throughput of every codec to results_file" << std::endl <<
+            "-c compares the throughput with results_file saved before, returns 2 if any codec is slower" << std::endl <<
+            "-t sets the allowed slowdown in percents, default is 10" << std::endl <<
+            "Allocations are only counted on Linux, they are reported as n/a and not compared elsewhere" << std::endl;
+        return 1;
+    }
+
+    for (int i = 0; i < images.length(); i++) {
+        UINT8 result = w.init(images.at(i));
+        if (result) {
+            std::cout << "Image file " << images.at(i).toLocal8Bit().constData() << " can't be parsed, error " << (int)result << std::endl;
+            return 1;
+        }
+    }
+
+    if (!w.payloadCount()) {
+        std::cout << "No compressed sections found" << std::endl;
+        return 1;
+    }
+
+    UINT8 result = w.run(preset, repeats);
+    if (result) {
+        std::cout << "Benchmark failed, error " << (int)result << std::endl;
+        return 1;
+    }
+    w.print();
+
+    if (!outputPath.isEmpty() && w.save(outputPath)) {
+        std::cout << "Results file can't be written" << std::endl;
+        return 1;
+    }
+
+    if (!baselinePath.isEmpty()) {
+        QStringList regressions;
+        if (w.compare(baselinePath, tolerance, regressions)) {
+            std::cout << "Baseline file can't be read" << std::endl;
+            return 1;
+        }
+        if (!UEFIBench::countsAllocations())
+            std::cout << "Allocation counts are unavailable on this platform, only throughput is compared" << std::endl;
+        for (int i = 0; i < regressions.length(); i++)
+            std::cout << "Regression: " << regressions.at(i).toLatin1().constData() << std::endl;
+        if (!regressions.isEmpty())
+            return 2;
+    }
+
+    return 0;
+}
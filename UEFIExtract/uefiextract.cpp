@@ -24,26 +24,47 @@ UEFIExtract::~UEFIExtract()
     delete ffsEngine;
 }
 
-UINT8 UEFIExtract::init(const QString & path)
+UINT8 UEFIExtract::init(const QByteArray & buffer)
 {
-	fileInfo = QFileInfo(path);
+	return ffsEngine->parseImageFile(buffer);
+}
 
-	if (!fileInfo.exists())
-		return ERR_FILE_OPEN;
+UINT8 UEFIExtract::extract(QString path, QString selector)
+{
+    if (selector.isEmpty())
+        return ffsEngine->dump(ffsEngine->treeModel()->index(0, 0), path);
 
-	QFile inputFile;
-	inputFile.setFileName(path);
+    QModelIndexList found;
+    UINT8 result = ffsEngine->select(selector, found);
+    if (result)
+        return result;
 
-	if (!inputFile.open(QFile::ReadOnly))
-		return ERR_FILE_OPEN;
+    // Selected items are dumped with their children to the same directories as in full dump
+    QSet<void*> selected;
+    for (int i = 0; i < found.size(); i++)
+        selected.insert(found.at(i).internalPointer());
 
-	QByteArray buffer = inputFile.readAll();
-	inputFile.close();
+    for (int i = 0; i < found.size(); i++) {
+        QModelIndex index = found.at(i);
+        bool nested = false;
+        for (QModelIndex ancestor = index.parent(); ancestor.isValid() && !nested; ancestor = ancestor.parent())
+            nested = selected.contains(ancestor.internalPointer());
+        if (nested)
+            continue;
 
-	return ffsEngine->parseImageFile(buffer);
+        result = ffsEngine->dump(index, dumpPath(path, index));
+        if (result)
+            return result;
+    }
+
+    return ERR_SUCCESS;
 }
 
-UINT8 UEFIExtract::extract(QString path, QString guid)
+QString UEFIExtract::dumpPath(const QString & path, const QModelIndex & index)
 {
-    return ffsEngine->dump(ffsEngine->treeModel()->index(0, 0), path, guid);
+    TreeModel* model = ffsEngine->treeModel();
+    QString itemPath;
+    for (QModelIndex current = index; current.isValid() && current.parent().isValid(); current = current.parent())
+        itemPath.prepend(QString("/%1 %2").arg(current.row()).arg(model->text(current).isEmpty() ? model->name(current) : model->text(current)));
+    return path + itemPath;
 }
@@ -19,6 +19,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <QString>
 #include <QDir>
 #include <QFileInfo>
+#include <QSet>
 
 #include "../basetypes.h"
 #include "../ffsengine.h"
@@ -31,12 +32,13 @@ public:
     explicit UEFIExtract(QObject *parent = 0);
     ~UEFIExtract();
 
-	UINT8 init(const QString & path);
-    UINT8 extract(QString path, QString guid = QString());
+	UINT8 init(const QByteArray & buffer);
+    // Dumps the whole image or items matched by the selector, a bare file GUID is a selector too
+    UINT8 extract(QString path, QString selector = QString());
 
 private:
+    QString dumpPath(const QString & path, const QModelIndex & index);
     FfsEngine* ffsEngine;
-	QFileInfo fileInfo;
 
 };
 
@@ -1,5 +1,6 @@
 QT       += core
 QT       -= gui
+greaterThan(QT_MAJOR_VERSION, 4): QT += concurrent
 
 TARGET    = UEFIExtract
 TEMPLATE  = app
@@ -9,6 +10,8 @@ DEFINES  += _CONSOLE
 
 SOURCES  += uefiextract_main.cpp \
  uefiextract.cpp \
+ ../archive.cpp \
+ ../corpus.cpp \
  ../types.cpp \
  ../descriptor.cpp \
  ../ffs.cpp \
@@ -16,16 +19,22 @@ SOURCES  += uefiextract_main.cpp \
  ../peimage.cpp \
  ../treeitem.cpp \
  ../treemodel.cpp \
+ ../Brotli/BrotliCompress.c \
+ ../Brotli/BrotliDecompress.c \
  ../LZMA/LzmaCompress.c \
  ../LZMA/LzmaDecompress.c \
  ../LZMA/SDK/C/LzFind.c \
+ ../LZMA/SDK/C/LzFindMt.c \
  ../LZMA/SDK/C/LzmaDec.c \
  ../LZMA/SDK/C/LzmaEnc.c \
+ ../LZMA/SDK/C/Threads.c \
  ../Tiano/EfiTianoDecompress.c \
  ../Tiano/EfiTianoCompress.c \
  ../Tiano/EfiTianoCompressLegacy.c
 
 HEADERS  += uefiextract.h \
+ ../archive.h \
+ ../corpus.h \
  ../basetypes.h \
  ../descriptor.h \
  ../gbe.h \
@@ -36,8 +45,28 @@ HEADERS  += uefiextract.h \
  ../ffsengine.h \
  ../treeitem.h \
  ../treemodel.h \
+ ../Brotli/BrotliCompress.h \
+ ../Brotli/BrotliDecompress.h \
  ../LZMA/LzmaCompress.h \
  ../LZMA/LzmaDecompress.h \
  ../Tiano/EfiTianoDecompress.h \
  ../Tiano/EfiTianoCompress.h
- 
+
+# Brotli GUID-defined sections are only decompressed and compressed if libbrotli is found
+packagesExist(libbrotlienc libbrotlidec) {
+    CONFIG    += link_pkgconfig
+    PKGCONFIG += libbrotlienc libbrotlidec
+    DEFINES   += HAVE_BROTLI
+}
+
+# Images are read from .gz and .zip archives if zlib is found, and from .xz archives if liblzma is found
+packagesExist(zlib) {
+    CONFIG    += link_pkgconfig
+    PKGCONFIG += zlib
+    DEFINES   += HAVE_ZLIB
+}
+packagesExist(liblzma) {
+    CONFIG    += link_pkgconfig
+    PKGCONFIG += liblzma
+    DEFINES   += HAVE_XZ
+}
@@ -11,10 +11,13 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 
 */
 #include <QCoreApplication>
+#include <QDir>
 #include <QString>
 #include <QStringList>
 #include <iostream>
 #include "uefiextract.h"
+#include "../archive.h"
+#include "../corpus.h"
 
 int main(int argc, char *argv[])
 {
@@ -23,8 +26,8 @@ int main(int argc, char *argv[])
   a.setOrganizationDomain("coderush.me");
   a.setApplicationName("UEFIExtract");
 
-  UEFIExtract w;
   UINT8 result = ERR_SUCCESS;
+  UINT32 found = 0;
   UINT32 returned = 0;
 
   if (a.arguments().length() > 33) {
@@ -33,28 +36,65 @@ int main(int argc, char *argv[])
   }
 
   if (a.arguments().length() > 2 ) {
-    if (w.init(a.arguments().at(1)))
-      return 1;
+    // Files of a directory are read ahead while the previous ones are dumped
+    QString input = a.arguments().at(1);
+    bool directory = QFileInfo(input).isDir();
+    CorpusReader corpus(QStringList() << input);
+    CorpusEntry entry;
+    while (corpus.next(entry)) {
+      const QVector<ArchiveMember> & images = entry.images;
+      if (entry.result) {
+        if (!directory)
+          return 1;
+        std::cout << "Skipping " << entry.path.toStdString() << std::endl;
+        continue;
+      }
 
-    if (a.arguments().length() == 3) {
-      result = w.extract(a.arguments().at(2));
-      if (result)
-        return 2;
-    }
-    else {
-      for (int i = 3; i < a.arguments().length(); i++) {
-        result = w.extract(a.arguments().at(2), a.arguments().at(i));
-        if (result)
-          returned |= (1 << (i - 1));
+      // Images of an archive or directory are dumped to subdirectories named after them, anything else in it is skipped
+      for (int n = 0; n < images.size(); n++) {
+        QString path = a.arguments().at(2);
+        if (directory)
+          path = QString("%1/%2").arg(path).arg(QDir(input).relativeFilePath(images.at(n).name));
+        else if (images.size() > 1)
+          path = QString("%1/%2").arg(path).arg(QFileInfo(images.at(n).name).fileName());
+
+        UEFIExtract w;
+        if (images.at(n).result || w.init(images.at(n).data)) {
+          if (images.size() == 1 && !directory)
+            return 1;
+          std::cout << "Skipping " << images.at(n).name.toStdString() << std::endl;
+          continue;
+        }
+
+        if (a.arguments().length() == 3) {
+          result = w.extract(path);
+          if (result)
+            return 2;
+        }
+        else {
+          for (int i = 3; i < a.arguments().length(); i++) {
+            result = w.extract(path, a.arguments().at(i));
+            if (!result)
+              found |= (1 << (i - 1));
+          }
+        }
       }
-      return returned;
     }
-    
+
+    // Selector is found if it matched in any image
+    for (int i = 3; i < a.arguments().length(); i++) {
+      if (!(found & (1 << (i - 1))))
+        returned |= (1 << (i - 1));
+    }
+    return returned;
   }
   else {
     std::cout << "UEFIExtract 0.4.4" << std::endl << std::endl <<
-    "Usage: uefiextract imagefile dumpdir [FileGUID_1 FileGUID_2 ... FileGUID_31]" << std::endl <<
-    "Returned value is a bit mask where 0 on position N meant File with GUID_N was found and unpacked, 1 otherwise" << std::endl;
+    "Usage: uefiextract imagefile dumpdir [Selector_1 Selector_2 ... Selector_31]" << std::endl <<
+    "Selector is a file GUID or a path like volume[fs=FFSv2]/file[guid=...]/section[type=PE32]" << std::endl <<
+    "Imagefile can be a .zip, .gz or .xz archive, or - for standard input, images of an archive are dumped to dumpdir/imagename" << std::endl <<
+    "Imagefile can also be a directory, images in it and its subdirectories are dumped to dumpdir/relativepath" << std::endl <<
+    "Returned value is a bit mask where 0 on position N meant items matched by Selector_N were found and unpacked, 1 otherwise" << std::endl;
     return 1;
   }
 }
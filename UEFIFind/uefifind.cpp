@@ -19,6 +19,7 @@ UEFIFind::UEFIFind(QObject *parent) :
     ffsEngine = new FfsEngine(this);
     model = ffsEngine->treeModel();
     initDone = false;
+    parseDone = false;
 }
 
 UEFIFind::~UEFIFind()
@@ -27,33 +28,31 @@ UEFIFind::~UEFIFind()
     delete ffsEngine;
 }
 
-UINT8 UEFIFind::init(const QString & path)
+UINT8 UEFIFind::init(const QByteArray & buffer)
 {
-    UINT8 result;
-    
-    fileInfo = QFileInfo(path);
-
-    if (!fileInfo.exists())
-        return ERR_FILE_OPEN;
-
-    QFile inputFile;
-    inputFile.setFileName(path);
-
-    if (!inputFile.open(QFile::ReadOnly))
-        return ERR_FILE_OPEN;
+    // Pattern search doesn't need the tree, it's built on first offset or selector search
+    image = buffer;
+    parseDone = false;
+    initDone = true;
+    return ERR_SUCCESS;
+}
 
-    QByteArray buffer = inputFile.readAll();
-    inputFile.close();
+UINT8 UEFIFind::parse()
+{
+    if (!initDone)
+        return ERR_INVALID_PARAMETER;
+    if (parseDone)
+        return ERR_SUCCESS;
 
-    result = ffsEngine->parseImageFile(buffer);
+    UINT8 result = ffsEngine->parseImageFile(image);
     if (result)
         return result;
 
-    initDone = true;
+    parseDone = true;
     return ERR_SUCCESS;
 }
 
-QString UEFIFind::guidToQString(const UINT8* guid)
+static QString guidToQString(const UINT8* guid)
 {
     const UINT32 u32 = *(const UINT32*)guid;
     const UINT16 u16_1 = *(const UINT16*)(guid + 4);
@@ -71,90 +70,173 @@ QString UEFIFind::guidToQString(const UINT8* guid)
         .hexarg2(u8_3, 2).hexarg2(u8_4, 2).hexarg2(u8_5, 2).hexarg2(u8_6, 2).hexarg2(u8_7, 2).hexarg2(u8_8, 2);
 }
 
-UINT8 UEFIFind::find(const UINT8 mode, const bool count, const QString & hexPattern, QString & result)
+// Searches headers and bodies of items the same way as they are split in the tree:
+// only header of an item with children is searched, header and body of a leaf item are searched as set by mode
+// Matches are reported by GUID of the file containing the item, and by subtype GUID of a freeform section
+class FindVisitor : public FfsVisitor
 {
-    QModelIndex root = model->index(0, 0);
-    QSet<QPair<QModelIndex, QModelIndex> > files;
+public:
+    FindVisitor(const QString & hexPattern, const UINT8 mode)
+        : regexp(hexPattern, Qt::CaseInsensitive), mode(mode) {}
+
+    UINT8 enter(const FfsEvent & event)
+    {
+        if (!frames.isEmpty())
+            frames.last().hasChildren = true;
+
+        Frame frame;
+        frame.hasChildren = false;
+        frame.file = frames.isEmpty() ? -1 : frames.last().file;
+        if (event.type == Types::File) {
+            frame.file = fileGuids.size();
+            fileGuids.append(guidToQString(event.header));
+        }
+        frames.append(frame);
+        return VISIT_CONTINUE;
+    }
+
+    void leave(const FfsEvent & event)
+    {
+        Frame frame = frames.last();
+        frames.removeLast();
+
+        // Items outside of files have no GUID to report
+        if (frame.file < 0)
+            return;
+
+        QByteArray data;
+        QByteArray header = QByteArray::fromRawData((const char*)event.header, event.headerSize);
+        QByteArray body = QByteArray::fromRawData((const char*)event.body, event.bodySize);
+        if (frame.hasChildren) {
+            if (mode == SEARCH_MODE_HEADER || mode == SEARCH_MODE_ALL)
+                data.append(header);
+        }
+        else {
+            if (mode == SEARCH_MODE_HEADER)
+                data.append(header);
+            else if (mode == SEARCH_MODE_BODY)
+                data.append(body);
+            else
+                data.append(header).append(body);
+        }
+
+        QString hexBody = QString(data.toHex());
+        INT32 offset = regexp.indexIn(hexBody);
+        while (offset >= 0 && offset % 2)
+            offset = regexp.indexIn(hexBody, offset + 1);
+        if (offset < 0)
+            return;
+
+        // Subtype GUID is the last field of freeform section header
+        QString subtypeGuid;
+        if (event.type == Types::Section && event.subtype == EFI_SECTION_FREEFORM_SUBTYPE_GUID
+            && event.headerSize >= sizeof(EFI_FREEFORM_SUBTYPE_GUID_SECTION))
+            subtypeGuid = guidToQString(event.header + event.headerSize - sizeof(EFI_GUID));
+
+        QPair<int, QString> match(frame.file, subtypeGuid);
+        if (!matched.contains(match)) {
+            matched.insert(match);
+            matches.append(match);
+        }
+    }
 
+    QStringList fileGuids;
+    QVector<QPair<int, QString> > matches;
+
+private:
+    struct Frame {
+        bool hasChildren;
+        int file;
+    };
+
+    QRegExp regexp;
+    UINT8 mode;
+    QVector<Frame> frames;
+    QSet<QPair<int, QString> > matched;
+};
+
+UINT8 UEFIFind::find(const UINT8 mode, const bool count, const QString & hexPattern, QString & result)
+{
     result.clear();
 
-    UINT8 returned = findFileRecursive(root, hexPattern, mode, files);
+    if (!initDone || hexPattern.isEmpty())
+        return ERR_INVALID_PARAMETER;
+
+    // Check for "all substrings" pattern
+    if (hexPattern.count('.') == hexPattern.length())
+        return ERR_SUCCESS;
+
+    // Image is scanned without building the tree, decompressed data is freed as soon as it's searched
+    FindVisitor visitor(hexPattern, mode);
+    UINT8 returned = ffsEngine->visitImageFile(image, visitor);
     if (returned)
         return returned;
-    
+
     if (count) {
-        if (files.count())
-            result.append(QString("%1\n").arg(files.count()));
+        if (visitor.matches.count())
+            result.append(QString("%1\n").arg(visitor.matches.count()));
         return ERR_SUCCESS;
     }
 
-    QPair<QModelIndex, QModelIndex> indexes;
-    Q_FOREACH(indexes, files) {
-        QByteArray data = model->header(indexes.first).left(16);
-        result.append(guidToQString((const UINT8*)data.constData()));
-
-        // Special case of freeform subtype GUID files
-        if (indexes.second.isValid() && model->subtype(indexes.second) == EFI_SECTION_FREEFORM_SUBTYPE_GUID) {
-            data = model->header(indexes.second).left(sizeof(EFI_FREEFORM_SUBTYPE_GUID_SECTION));
-            result.append(" ").append(guidToQString((const UINT8*)data.constData() + sizeof(EFI_COMMON_SECTION_HEADER)));
-        }
-        
+    for (int i = 0; i < visitor.matches.count(); i++) {
+        result.append(visitor.fileGuids.at(visitor.matches.at(i).first));
+        if (!visitor.matches.at(i).second.isEmpty())
+            result.append(" ").append(visitor.matches.at(i).second);
         result.append("\n");
-
     }
     return ERR_SUCCESS;
 }
 
-UINT8 UEFIFind::findFileRecursive(const QModelIndex index, const QString & hexPattern, const UINT8 mode, QSet<QPair<QModelIndex, QModelIndex> > & files)
+UINT8 UEFIFind::findOffset(const UINT32 offset, QString & result)
 {
+    result.clear();
+
+    UINT8 returned = parse();
+    if (returned)
+        return returned;
+
+    QModelIndex index = model->findByOffset(offset);
     if (!index.isValid())
-        return ERR_SUCCESS;
+        return ERR_ITEM_NOT_FOUND;
 
-    if (hexPattern.isEmpty())
-        return ERR_INVALID_PARAMETER;
+    // Print all items containing the offset, from the outermost one
+    QStringList items;
+    for (; index.isValid(); index = index.parent())
+        items.prepend(itemLine(index));
+    result = items.join("");
 
-    // Check for "all substrings" pattern
-    if (hexPattern.count('.') == hexPattern.length())
-        return ERR_SUCCESS;
+    return ERR_SUCCESS;
+}
 
-    bool hasChildren = (model->rowCount(index) > 0);
-    for (int i = 0; i < model->rowCount(index); i++) {
-        findFileRecursive(index.child(i, index.column()), hexPattern, mode, files);
-    }
+UINT8 UEFIFind::findSelected(const QString & selector, QString & result)
+{
+    result.clear();
 
-    QByteArray data;
-    if (hasChildren) {
-        if (mode == SEARCH_MODE_HEADER || mode == SEARCH_MODE_ALL)
-            data.append(model->header(index));
-    }
-    else {
-        if (mode == SEARCH_MODE_HEADER)
-            data.append(model->header(index));
-        else if (mode == SEARCH_MODE_BODY)
-            data.append(model->body(index));
-        else
-            data.append(model->header(index)).append(model->body(index));
-    }
+    UINT8 returned = parse();
+    if (returned)
+        return returned;
 
-    QString hexBody = QString(data.toHex());
-    QRegExp regexp = QRegExp(QString(hexPattern), Qt::CaseInsensitive);
-    INT32 offset = regexp.indexIn(hexBody);
-    while (offset >= 0) {
-        if (offset % 2 == 0) {
-            if (model->type(index) != Types::File) {
-                QModelIndex ffs = model->findParentOfType(index, Types::File);
-                if (model->type(index) == Types::Section && model->subtype(index) == EFI_SECTION_FREEFORM_SUBTYPE_GUID)
-                    files.insert(QPair<QModelIndex, QModelIndex>(ffs, index));
-                else
-                    files.insert(QPair<QModelIndex, QModelIndex>(ffs, QModelIndex()));
-            }
-            else
-                files.insert(QPair<QModelIndex, QModelIndex>(index, QModelIndex()));
+    QModelIndexList found;
+    returned = ffsEngine->select(selector, found);
+    if (returned)
+        return returned;
 
-            break;
-        }
-        offset = regexp.indexIn(hexBody, offset + 1);
-    }
+    for (int i = 0; i < found.size(); i++)
+        result.append(itemLine(found.at(i)));
 
     return ERR_SUCCESS;
-}
\ No newline at end of file
+}
+
+QString UEFIFind::itemLine(const QModelIndex & index)
+{
+    // Items not present in the image as is, like decompressed ones, have no offset
+    UINT32 itemOffset = 0;
+    bool inImage = model->imageOffset(index, itemOffset);
+    UINT32 size = model->header(index).size() + model->body(index).size();
+    return QString("%1 %2h %3 %4 %5\n")
+        .arg(inImage ? QString("%1h").hexarg2(itemOffset, 8) : QString("-"))
+        .hexarg2(size, 8)
+        .arg(itemTypeToQString(model->type(index)))
+        .arg(itemSubtypeToQString(model->type(index), model->subtype(index)))
+        .arg(model->name(index));
+}
@@ -21,12 +21,14 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <QFileInfo>
 #include <QPair>
 #include <QSet>
+#include <QStringList>
 #include <QString>
 #include <QUuid>
 
 #include "../basetypes.h"
 #include "../ffsengine.h"
 #include "../ffs.h"
+#include "../types.h"
 
 class UEFIFind : public QObject
 {
@@ -36,17 +38,20 @@ public:
     explicit UEFIFind(QObject *parent = 0);
     ~UEFIFind();
 
-    UINT8 init(const QString & path);
+    UINT8 init(const QByteArray & buffer);
     UINT8 find(const UINT8 mode, const bool count, const QString & hexPattern, QString & result);
+    UINT8 findOffset(const UINT32 offset, QString & result);
+    UINT8 findSelected(const QString & selector, QString & result);
 
 private:
-    UINT8 findFileRecursive(const QModelIndex index, const QString & hexPattern, const UINT8 mode, QSet<QPair<QModelIndex, QModelIndex> > & files);
-    QString guidToQString(const UINT8* guid);
+    UINT8 parse();
+    QString itemLine(const QModelIndex & index);
 
     FfsEngine* ffsEngine;
     TreeModel* model;
-    QFileInfo fileInfo;
+    QByteArray image;
     bool initDone;
+    bool parseDone;
 };
 
 #endif
@@ -11,8 +11,44 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 
 */
 #include <QCoreApplication>
+#include <QtConcurrentMap>
 #include <iostream>
 #include "uefifind.h"
+#include "../archive.h"
+#include "../corpus.h"
+
+#define FIND_COMMAND_PATTERN 0
+#define FIND_COMMAND_OFFSET  1
+#define FIND_COMMAND_SELECT  2
+
+// Search in one image of the input, images of an archive are searched in parallel
+struct FindJob {
+    const ArchiveMember* image;
+    UINT8 command;
+    UINT8 mode;
+    bool count;
+    QString pattern;
+    UINT32 offset;
+    UINT8 result;
+    QString found;
+};
+
+static void runFindJob(FindJob & job)
+{
+    UEFIFind w;
+    job.result = job.image->result;
+    if (!job.result)
+        job.result = w.init(job.image->data);
+    if (job.result)
+        return;
+
+    if (job.command == FIND_COMMAND_OFFSET)
+        job.result = w.findOffset(job.offset, job.found);
+    else if (job.command == FIND_COMMAND_SELECT)
+        job.result = w.findSelected(job.pattern, job.found);
+    else
+        job.result = w.find(job.mode, job.count, job.pattern, job.found);
+}
 
 int main(int argc, char *argv[])
 {
@@ -21,52 +57,147 @@ int main(int argc, char *argv[])
     a.setOrganizationDomain("coderush.me");
     a.setApplicationName("UEFIFind");
 
-    UEFIFind w;
     UINT8 result;
+    FindJob job;
+    job.image = NULL;
+    job.mode = SEARCH_MODE_ALL;
+    job.count = false;
+    job.offset = 0;
+    job.result = ERR_SUCCESS;
+    QString path;
 
-    if (a.arguments().length() == 5) {
-        result = w.init(a.arguments().at(4));
-        if (result)
-            return result;
+    // Read-ahead options go before the command
+    int depth = CORPUS_DEFAULT_DEPTH;
+    qint64 memoryLimit = CORPUS_DEFAULT_MEMORY_LIMIT;
+    bool timing = false;
+    QStringList args = a.arguments();
+    while (args.length() > 1) {
+        bool ok = true;
+        if (args.at(1) == QString("-t"))
+            timing = true;
+        else if (args.at(1) == QString("-d") && args.length() > 2)
+            depth = args.takeAt(2).toInt(&ok);
+        else if (args.at(1) == QString("-m") && args.length() > 2)
+            memoryLimit = args.takeAt(2).toLongLong(&ok) * 1024 * 1024;
+        else
+            break;
+        if (!ok || depth <= 0 || memoryLimit <= 0)
+            return ERR_INVALID_PARAMETER;
+        args.removeAt(1);
+    }
 
+    if (args.length() == 4 && args.at(1) == QString("offset")) {
+        // Get offset
+        bool ok;
+        QString text = args.at(2);
+        if (text.endsWith('h', Qt::CaseInsensitive))
+            text.chop(1);
+        job.offset = text.toUInt(&ok, 16);
+        if (!ok)
+            return ERR_INVALID_PARAMETER;
+
+        job.command = FIND_COMMAND_OFFSET;
+        path = args.at(3);
+    }
+    else if (args.length() == 4 && args.at(1) == QString("select")) {
+        job.command = FIND_COMMAND_SELECT;
+        job.pattern = args.at(2);
+        path = args.at(3);
+    }
+    else if (args.length() == 5) {
         // Get search mode
-        UINT8 mode;
-        if (a.arguments().at(1) == QString("header"))
-            mode = SEARCH_MODE_HEADER;
-        else if (a.arguments().at(1) == QString("body"))
-            mode = SEARCH_MODE_BODY;
-        else if (a.arguments().at(1) == QString("all"))
-            mode = SEARCH_MODE_ALL;
+        if (args.at(1) == QString("header"))
+            job.mode = SEARCH_MODE_HEADER;
+        else if (args.at(1) == QString("body"))
+            job.mode = SEARCH_MODE_BODY;
+        else if (args.at(1) == QString("all"))
+            job.mode = SEARCH_MODE_ALL;
         else
             return ERR_INVALID_PARAMETER;
 
         // Get result type
-        bool count;
-        if (a.arguments().at(2) == QString("list"))
-            count = false;
-        else if (a.arguments().at(2) == QString("count"))
-            count = true;
+        if (args.at(2) == QString("list"))
+            job.count = false;
+        else if (args.at(2) == QString("count"))
+            job.count = true;
         else
             return ERR_INVALID_PARAMETER;
 
-        // Go find the supplied pattern
-        QString found;
-        result = w.find(mode, count, a.arguments().at(3), found);
-        if (result)
-            return result;
-
-        // Nothing was found
-        if (found.isEmpty())
-            return ERR_ITEM_NOT_FOUND;
-
-        // Print result
-        std::cout << found.toStdString();
-        return ERR_SUCCESS;
+        job.command = FIND_COMMAND_PATTERN;
+        job.pattern = args.at(3);
+        path = args.at(4);
     }
     else {
         std::cout << "UEFIFind 0.3.4" << std::endl << std::endl <<
-            "Usage: uefifind {header | body | all} {list | count} pattern imagefile\n";
+            "Usage: uefifind [-d depth] [-m megabytes] [-t] {header | body | all} {list | count} pattern imagefile\n"
+            "       uefifind [-d depth] [-m megabytes] [-t] offset hexoffset imagefile\n"
+            "       uefifind [-d depth] [-m megabytes] [-t] select selector imagefile\n\n"
+            "Selector is a list of steps separated by / or >, each one matches descendants of items matched by the previous one;\n"
+            "after > only those not inside a nearer item of the previous step kind, or only children after *\n"
+            "Step is an item kind {* | capsule | image | region | padding | volume | file | section | freespace}\n"
+            "with optional [key=value,...] predicates, where key is one of guid, type, fs, name or text,\n"
+            "e.g. volume[fs=FFSv2]/file[guid=F7731B4C-58A2-4DF4-8980-5645D39ECE58]>section[type=PE32]\n\n"
+            "Imagefile can be a .zip, .gz or .xz archive, or - for standard input;\n"
+            "images of an archive are searched in parallel and results are prefixed with their names\n"
+            "Imagefile can also be a directory, all files in it and its subdirectories are searched in name order;\n"
+            "-d sets the number of files read ahead while the previous ones are searched, default is 4\n"
+            "-m sets the memory limit in megabytes for images read ahead, default is 256\n"
+            "-t prints time spent on reading and searching to standard error\n";
         return ERR_INVALID_PARAMETER;
     }
-}
 
+    // Files are read ahead while the previous ones are searched
+    CorpusReader corpus(QStringList() << path, depth, memoryLimit);
+    CorpusEntry entry;
+    result = ERR_SUCCESS;
+    bool found = false;
+    while (corpus.next(entry)) {
+        if (entry.result) {
+            if (corpus.count() == 1)
+                return entry.result;
+            if (!result)
+                result = entry.result;
+            continue;
+        }
+
+        QVector<FindJob> jobs(entry.images.size(), job);
+        for (int i = 0; i < entry.images.size(); i++)
+            jobs[i].image = &entry.images.at(i);
+        QtConcurrent::blockingMap(jobs, runFindJob);
+
+        // Print results, the first error is returned if nothing was found
+        for (int i = 0; i < jobs.size(); i++) {
+            if (jobs.at(i).result) {
+                if (!result)
+                    result = jobs.at(i).result;
+                continue;
+            }
+            if (jobs.at(i).found.isEmpty())
+                continue;
+            found = true;
+
+            if (jobs.size() == 1 && corpus.count() == 1)
+                std::cout << jobs.at(i).found.toStdString();
+            else {
+                QStringList lines = jobs.at(i).found.split('\n', QString::SkipEmptyParts);
+                for (int j = 0; j < lines.size(); j++)
+                    std::cout << QString("%1: %2\n").arg(jobs.at(i).image->name).arg(lines.at(j)).toStdString();
+            }
+        }
+    }
+
+    if (timing) {
+        CorpusStats stats = corpus.stats();
+        std::cerr << QString("%1 files, %2 MiB read in %3 s, %4 s waited for reads, %5 s searched, %6 MiB read ahead at most\n")
+            .arg(stats.files)
+            .arg(stats.bytes / (1024.0 * 1024.0), 0, 'f', 1)
+            .arg(stats.readNsecs / 1e9, 0, 'f', 3)
+            .arg(stats.waitNsecs / 1e9, 0, 'f', 3)
+            .arg(stats.processNsecs / 1e9, 0, 'f', 3)
+            .arg(stats.peakBytes / (1024.0 * 1024.0), 0, 'f', 1).toStdString();
+    }
+
+    if (found)
+        return ERR_SUCCESS;
+    return result ? result : ERR_ITEM_NOT_FOUND;
+}
@@ -25,7 +25,12 @@ UEFIPatch::~UEFIPatch()
     delete ffsEngine;
 }
 
-UINT8 UEFIPatch::patchFromFile(QString path)
+void UEFIPatch::setCompressionPreset(const UINT8 preset)
+{
+    ffsEngine->setCompressionPreset(preset);
+}
+
+UINT8 UEFIPatch::patchFromFile(const QByteArray & buffer, QString path)
 {
     QFileInfo patchInfo = QFileInfo("patches.txt");
 
@@ -37,25 +42,17 @@ UINT8 UEFIPatch::patchFromFile(QString path)
 
     if (!file.open(QFile::ReadOnly | QFile::Text))
         return ERR_INVALID_FILE;
-    
-    QFileInfo fileInfo = QFileInfo(path);
 
-    if (!fileInfo.exists())
-        return ERR_FILE_OPEN;
-
-    QFile inputFile;
-    inputFile.setFileName(path);
-
-    if (!inputFile.open(QFile::ReadOnly))
-        return ERR_FILE_READ;
-
-    QByteArray buffer = inputFile.readAll();
-    inputFile.close();
 
     UINT8 result = ffsEngine->parseImageFile(buffer);
     if (result)
         return result;
 
+    // All patches are applied in one transaction, so PEI files are rebased only once
+    result = ffsEngine->beginTransaction();
+    if (result)
+        return result;
+
     UINT8 counter = 0;
     while (!file.atEnd()) {
         QByteArray line = file.readLine();
@@ -64,19 +61,33 @@ UINT8 UEFIPatch::patchFromFile(QString path)
             continue;
 
         QList<QByteArray> list = line.trimmed().split(' ');
-        if (list.count() < 3)
+        if (list.count() < 2)
             continue;
-        
-        QUuid uuid = QUuid(list.at(0));
-        QByteArray guid = QByteArray::fromRawData((const char*)&uuid.data1, sizeof(EFI_GUID));
-        bool converted;
-        UINT8 sectionType = (UINT8)list.at(1).toUShort(&converted, 16);
-        if (!converted)
-            return ERR_INVALID_PARAMETER;
-                
+
+        // Patches are given either after a selector or after file GUID and section type
+        // Lines with file GUID are applied to the first section of that file they patch, as before
+        QString selector;
+        int first = 1;
+        bool firstOnly = false;
+        if (list.at(1).contains(':'))
+            selector = QString(list.at(0));
+        else {
+            if (list.count() < 3)
+                continue;
+            bool converted;
+            UINT8 sectionType = (UINT8)list.at(1).toUShort(&converted, 16);
+            if (!converted) {
+                ffsEngine->rollbackTransaction();
+                return ERR_INVALID_PARAMETER;
+            }
+            selector = QString("file[guid=%1]>section[type=%2h]").arg(QString(list.at(0))).hexarg(sectionType);
+            first = 2;
+            firstOnly = true;
+        }
+
         QVector<PatchData> patches;
 
-        for (int i = 2; i < list.count(); i++) {
+        for (int i = first; i < list.count(); i++) {
             QList<QByteArray> patchList = list.at(i).split(':');
             PatchData patch;
             patch.type = *(UINT8*)patchList.at(0).constData();
@@ -96,14 +107,16 @@ UINT8 UEFIPatch::patchFromFile(QString path)
                 continue;
             }
         }
-        result = patchFile(model->index(0, 0), guid, sectionType, patches);
-        if (result && result != ERR_NOTHING_TO_PATCH)
+        result = patchSelected(selector, patches, firstOnly);
+        if (result && result != ERR_NOTHING_TO_PATCH) {
+            ffsEngine->rollbackTransaction();
             return result;
+        }
         counter++;
     }
     
     QByteArray reconstructed;
-    result = ffsEngine->reconstructImageFile(reconstructed);
+    result = ffsEngine->commitTransaction(reconstructed);
     if (result)
         return result;
     if (reconstructed == buffer)
@@ -121,29 +134,44 @@ UINT8 UEFIPatch::patchFromFile(QString path)
     return ERR_SUCCESS;
 }
 
-UINT8 UEFIPatch::patchFile(const QModelIndex & index, const QByteArray & fileGuid, const UINT8 sectionType, const QVector<PatchData> & patches)
+UINT8 UEFIPatch::patchSelected(const QString & selector, const QVector<PatchData> & patches, const bool firstOnly)
 {
-  
-    if (!model || !index.isValid())
+    if (!model)
         return ERR_INVALID_PARAMETER;
-    if (model->type(index) == Types::Section && model->subtype(index) == sectionType) {
-        QModelIndex fileIndex = model->findParentOfType(index, Types::File);
-        if (model->type(fileIndex) == Types::File &&
-            model->header(fileIndex).left(sizeof(EFI_GUID)) == fileGuid)
-        {
-            return ffsEngine->patch(index, patches);
-        }
-    }
 
-    if (model->rowCount(index) > 0) {
-        for (int i = 0; i < model->rowCount(index); i++) {
-            UINT8 result = patchFile(index.child(i, 0), fileGuid, sectionType, patches);
-            if (!result)
-                break;
-            else if (result != ERR_NOTHING_TO_PATCH)
-                return result;
-        }
+    QModelIndexList found;
+    UINT8 result = ffsEngine->select(selector, found);
+    if (result == ERR_ITEM_NOT_FOUND)
+        return ERR_NOTHING_TO_PATCH;
+    if (result)
+        return result;
+
+    // Patched items can be reparsed, so the rest of them is kept persistent
+    QVector<QPersistentModelIndex> items;
+    for (int i = 0; i < found.size(); i++)
+        items.append(QPersistentModelIndex(found.at(i)));
+
+    bool patched = false;
+    for (int i = 0; i < items.size(); i++) {
+        if (!items.at(i).isValid())
+            continue;
+
+        result = ffsEngine->patch(items.at(i), patches);
+        if (result == ERR_NOTHING_TO_PATCH)
+            continue;
+        if (result)
+            return result;
+        patched = true;
+
+        // Fail early if the patched file doesn't fit anymore
+        QVector<VolumeSpace> volumes;
+        UINT32 missing;
+        result = ffsEngine->checkSpace(items.at(i), volumes, missing);
+        if (result)
+            return result;
+        if (firstOnly)
+            break;
     }
 
-    return ERR_NOTHING_TO_PATCH;
+    return patched ? ERR_SUCCESS : ERR_NOTHING_TO_PATCH;
 }
@@ -33,11 +33,13 @@ public:
     explicit UEFIPatch(QObject *parent = 0);
     ~UEFIPatch();
 
-    UINT8 patchFromFile(QString path);
+    // Patches an image read from the path, patched one is saved to path.patched
+    UINT8 patchFromFile(const QByteArray & buffer, QString path);
     UINT8 patch(QString path, QString fileGuid, QString findPattern, QString replacePattern);
+    void setCompressionPreset(const UINT8 preset);
 
 private:
-    UINT8 patchFile(const QModelIndex & index, const QByteArray & fileGuid, const UINT8 sectionType, const QVector<PatchData> & patches);
+    UINT8 patchSelected(const QString & selector, const QVector<PatchData> & patches, const bool firstOnly);
     FfsEngine* ffsEngine;
     TreeModel* model;
 };
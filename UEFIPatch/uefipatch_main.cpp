@@ -15,28 +15,10 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <QStringList>
 #include <iostream>
 #include "uefipatch.h"
+#include "../archive.h"
 
-int main(int argc, char *argv[])
+static void printResult(const UINT8 result)
 {
-    QCoreApplication a(argc, argv);
-    a.setOrganizationName("LongSoft");
-    a.setOrganizationDomain("longsoft.me");
-    a.setApplicationName("UEFIPatch");
-
-    UEFIPatch w;
-    UINT8 result = ERR_SUCCESS;
-    UINT32 argumentsCount = a.arguments().length();
-    
-    if (argumentsCount == 2) {
-        result = w.patchFromFile(a.arguments().at(1));
-    }
-    else {
-        std::cout << "UEFIPatch 0.3.11 - UEFI image file patching utility" << std::endl << std::endl <<
-            "Usage: UEFIPatch image_file" << std::endl << std::endl <<
-            "Patches will be read from patches.txt file\n";
-        return ERR_SUCCESS;
-    }
-
     switch (result) {
     case ERR_SUCCESS:
         std::cout << "Image patched" << std::endl;
@@ -68,9 +50,77 @@ int main(int argc, char *argv[])
     case ERR_FILE_WRITE:
         std::cout << "Output file can't be written" << std::endl;
         break;
+    case ERR_INVALID_SELECTOR:
+        std::cout << "Invalid selector" << std::endl;
+        break;
+    case ERR_INVALID_ARCHIVE:
+        std::cout << "Invalid or corrupted archive" << std::endl;
+        break;
     default:
         std::cout << "Error " << result << std::endl;
     }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setOrganizationName("LongSoft");
+    a.setOrganizationDomain("longsoft.me");
+    a.setApplicationName("UEFIPatch");
+
+    UINT8 result = ERR_SUCCESS;
+    UINT8 preset = COMPRESSION_PRESET_DEFAULT;
+    UINT32 argumentsCount = a.arguments().length();
+    
+    if (argumentsCount == 4 && a.arguments().at(2) == QString("-p")) {
+        if (a.arguments().at(3) == QString("fast"))
+            preset = COMPRESSION_PRESET_FAST;
+        else if (a.arguments().at(3) == QString("default"))
+            preset = COMPRESSION_PRESET_DEFAULT;
+        else if (a.arguments().at(3) == QString("max"))
+            preset = COMPRESSION_PRESET_MAX;
+        else
+            result = ERR_INVALID_PARAMETER;
+    }
+    else if (argumentsCount != 2) {
+        std::cout << "UEFIPatch 0.3.11 - UEFI image file patching utility" << std::endl << std::endl <<
+            "Usage: UEFIPatch image_file [-p {fast | default | max}]" << std::endl << std::endl <<
+            "Patches will be read from patches.txt file" << std::endl <<
+            "Image_file can be a .zip, .gz or .xz archive, or - for standard input;" << std::endl <<
+            "every image of an archive is patched and saved next to it as imagename.patched" << std::endl <<
+            "-p sets the compression preset used to recompress patched sections\n";
+        return ERR_SUCCESS;
+    }
+
+    QVector<ArchiveMember> images;
+    if (!result)
+        result = readImages(a.arguments().at(1), images);
+    if (result || images.size() == 1) {
+        if (!result)
+            result = images.first().result;
+        if (!result) {
+            UEFIPatch w;
+            w.setCompressionPreset(preset);
+            result = w.patchFromFile(images.first().data, images.first().name);
+        }
+        printResult(result);
+        return result;
+    }
+
+    // Images of an archive are patched one by one, it's enough if any of them is patched
+    UINT8 returned = ERR_NOTHING_TO_PATCH;
+    for (int i = 0; i < images.size(); i++) {
+        result = images.at(i).result;
+        if (!result) {
+            UEFIPatch w;
+            w.setCompressionPreset(preset);
+            result = w.patchFromFile(images.at(i).data, images.at(i).name);
+        }
+        std::cout << images.at(i).name.toStdString() << ": ";
+        printResult(result);
+        if (!result)
+            returned = ERR_SUCCESS;
+    }
 
-    return result;
+    return returned;
 }
@@ -25,25 +25,17 @@ UEFIReplace::~UEFIReplace()
     delete ffsEngine;
 }
 
-UINT8 UEFIReplace::replace(QString inPath, const QByteArray & guid, const UINT8 sectionType, const QString contentPath)
+void UEFIReplace::setCompressionPreset(const UINT8 preset)
 {
-    QFileInfo fileInfo = QFileInfo(inPath);
-    if (!fileInfo.exists())
-        return ERR_FILE_OPEN;
+    ffsEngine->setCompressionPreset(preset);
+}
 
-    fileInfo = QFileInfo(contentPath);
+UINT8 UEFIReplace::replace(const QByteArray & buffer, QString inPath, const QString & selector, const QString contentPath)
+{
+    QFileInfo fileInfo = QFileInfo(contentPath);
     if (!fileInfo.exists())
         return ERR_FILE_OPEN;
 
-    QFile inputFile;
-    inputFile.setFileName(inPath);
-
-    if (!inputFile.open(QFile::ReadOnly))
-        return ERR_FILE_READ;
-
-    QByteArray buffer = inputFile.readAll();
-    inputFile.close();
-
     UINT8 result = ffsEngine->parseImageFile(buffer);
     if (result)
         return result;
@@ -57,7 +49,15 @@ UINT8 UEFIReplace::replace(QString inPath, const QByteArray & guid, const UINT8
     QByteArray contents = contentFile.readAll();
     contentFile.close();
 
-    result = replaceInFile(model->index(0, 0), guid, sectionType, contents);
+    // Only the first matched item is replaced
+    QModelIndexList found;
+    result = ffsEngine->select(selector, found);
+    if (result == ERR_ITEM_NOT_FOUND)
+        return ERR_NOTHING_TO_PATCH;
+    if (result)
+        return result;
+
+    result = ffsEngine->replace(found.first(), contents, REPLACE_MODE_BODY);
     if (result)
         return result;
 
@@ -79,30 +79,3 @@ UINT8 UEFIReplace::replace(QString inPath, const QByteArray & guid, const UINT8
 
     return ERR_SUCCESS;
 }
-
-UINT8 UEFIReplace::replaceInFile(const QModelIndex & index, const QByteArray & guid, const UINT8 sectionType, const QByteArray & newData)
-{
-    if (!model || !index.isValid())
-        return ERR_INVALID_PARAMETER;
-    if (model->subtype(index) == sectionType) {
-        QModelIndex fileIndex = model->findParentOfType(index, Types::File);
-        QByteArray fileGuid = model->header(fileIndex).left(sizeof(EFI_GUID));
-        if (fileGuid == guid) {
-            return ffsEngine->replace(index, newData, REPLACE_MODE_BODY);
-        }
-    }
-
-    bool patched = false;
-    if (model->rowCount(index) > 0) {
-        for (int i = 0; i < model->rowCount(index); i++) {
-            UINT8 result = replaceInFile(index.child(i, 0), guid, sectionType, newData);
-            if (!result) {
-                patched = true;
-                break;
-            } else if (result != ERR_NOTHING_TO_PATCH)
-                return result;
-        }
-    }
-
-    return patched ? ERR_SUCCESS : ERR_NOTHING_TO_PATCH;
-}
@@ -30,10 +30,11 @@ public:
     explicit UEFIReplace(QObject *parent = 0);
     ~UEFIReplace();
 
-    UINT8 replace(const QString inPath, const QByteArray & guid, const UINT8 sectionType, const QString contentPath);
+    // Replaces body of an item of an image read from the path, modified image is saved to path.patched
+    UINT8 replace(const QByteArray & buffer, QString inPath, const QString & selector, const QString contentPath);
+    void setCompressionPreset(const UINT8 preset);
 
 private:
-    UINT8 replaceInFile(const QModelIndex & index, const QByteArray & guid, const UINT8 sectionType, const QByteArray & contents);
     FfsEngine* ffsEngine;
     TreeModel* model;
 };
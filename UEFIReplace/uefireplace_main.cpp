@@ -15,33 +15,10 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <QStringList>
 #include <iostream>
 #include "uefireplace.h"
+#include "../archive.h"
 
-int main(int argc, char *argv[])
+static void printResult(const UINT8 result)
 {
-    QCoreApplication a(argc, argv);
-    a.setOrganizationName("CodeRush");
-    a.setOrganizationDomain("coderush.me");
-    a.setApplicationName("UEFIReplace");
-
-    UEFIReplace r;
-    UINT8 result = ERR_SUCCESS;
-    QStringList args = a.arguments();
-
-    if (args.length() < 5) {
-        std::cout << "UEFIReplace 0.3.9 - UEFI image file replacement utility" << std::endl << std::endl <<
-            "Usage: UEFIReplace image_file guid section_type contents_file" << std::endl;
-        return ERR_SUCCESS;
-    }
-
-    QUuid uuid = QUuid(args.at(2));
-    QByteArray guid = QByteArray::fromRawData((const char*)&uuid.data1, sizeof(EFI_GUID));
-    bool converted;
-    UINT8 sectionType = (UINT8)args.at(3).toUShort(&converted, 16);
-    if (!converted)
-        result = ERR_INVALID_PARAMETER;
-    else
-        result = r.replace(args.at(1), guid, sectionType, args.at(4));
-
     switch (result) {
     case ERR_SUCCESS:
         std::cout << "File replaced" << std::endl;
@@ -70,9 +47,111 @@ int main(int argc, char *argv[])
     case ERR_FILE_WRITE:
         std::cout << "Output file can't be written" << std::endl;
         break;
+    case ERR_INVALID_SELECTOR:
+        std::cout << "Invalid selector" << std::endl;
+        break;
+    case ERR_INVALID_ARCHIVE:
+        std::cout << "Invalid or corrupted archive" << std::endl;
+        break;
     default:
         std::cout << "Error " << result << std::endl;
     }
+}
+
+static void printUsage()
+{
+    std::cout << "UEFIReplace 0.3.9 - UEFI image file replacement utility" << std::endl << std::endl <<
+        "Usage: UEFIReplace image_file guid section_type contents_file [-p {fast | default | max}]" << std::endl <<
+        "       UEFIReplace image_file selector contents_file [-p {fast | default | max}]" << std::endl << std::endl <<
+        "Selector is a path like volume[fs=FFSv2]/file[guid=...]>section[type=PE32], body of the first matched item is replaced" << std::endl <<
+        "Guid and section_type select the first section of that type in the file itself, not in files nested in it" << std::endl <<
+        "Image_file can be a .zip, .gz or .xz archive, or - for standard input;" << std::endl <<
+        "the item is replaced in every image of an archive, which is saved next to it as imagename.patched" << std::endl <<
+        "-p sets the compression preset used to recompress modified sections" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setOrganizationName("CodeRush");
+    a.setOrganizationDomain("coderush.me");
+    a.setApplicationName("UEFIReplace");
+
+    UINT8 result = ERR_SUCCESS;
+    UINT8 preset = COMPRESSION_PRESET_DEFAULT;
+    QStringList args = a.arguments();
+
+    // Item is given either by a selector or by file GUID and section type
+    bool selectorGiven = (args.length() == 4 || (args.length() == 6 && args.at(4) == QString("-p")));
+    if (args.length() < 4) {
+        printUsage();
+        return ERR_SUCCESS;
+    }
+
+    // Get compression preset
+    int presetArg = selectorGiven ? 4 : 5;
+    if (args.length() > presetArg) {
+        if (args.length() != presetArg + 2 || args.at(presetArg) != QString("-p")) {
+            printUsage();
+            return ERR_INVALID_PARAMETER;
+        }
+
+        if (args.at(presetArg + 1) == QString("fast"))
+            preset = COMPRESSION_PRESET_FAST;
+        else if (args.at(presetArg + 1) == QString("default"))
+            preset = COMPRESSION_PRESET_DEFAULT;
+        else if (args.at(presetArg + 1) == QString("max"))
+            preset = COMPRESSION_PRESET_MAX;
+        else {
+            std::cout << "Invalid compression preset " << args.at(presetArg + 1).toStdString() << std::endl;
+            return ERR_INVALID_PARAMETER;
+        }
+    }
+
+    QString selector;
+    QString contentPath;
+    if (selectorGiven) {
+        selector = args.at(2);
+        contentPath = args.at(3);
+    }
+    else {
+        bool converted;
+        UINT8 sectionType = (UINT8)args.at(3).toUShort(&converted, 16);
+        if (!converted)
+            result = ERR_INVALID_PARAMETER;
+        selector = QString("file[guid=%1]>section[type=%2h]").arg(args.at(2)).hexarg(sectionType);
+        contentPath = args.at(4);
+    }
+
+    QVector<ArchiveMember> images;
+    if (!result)
+        result = readImages(args.at(1), images);
+    if (result || images.size() == 1) {
+        if (!result)
+            result = images.first().result;
+        if (!result) {
+            UEFIReplace r;
+            r.setCompressionPreset(preset);
+            result = r.replace(images.first().data, images.first().name, selector, contentPath);
+        }
+        printResult(result);
+        return result;
+    }
+
+    // Images of an archive are modified one by one, it's enough if the item is replaced in any of them
+    UINT8 returned = ERR_NOTHING_TO_PATCH;
+    for (int i = 0; i < images.size(); i++) {
+        result = images.at(i).result;
+        if (!result) {
+            UEFIReplace r;
+            r.setCompressionPreset(preset);
+            result = r.replace(images.at(i).data, images.at(i).name, selector, contentPath);
+        }
+        std::cout << images.at(i).name.toStdString() << ": ";
+        printResult(result);
+        if (!result)
+            returned = ERR_SUCCESS;
+    }
 
-    return result;
+    return returned;
 }
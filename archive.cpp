@@ -0,0 +1,413 @@
+/* archive.cpp
+
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHWARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*/
+
+#include <stdio.h>
+#include <limits.h>
+#include <string.h>
+
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QStringList>
+#include <QtConcurrentMap>
+
+#include "archive.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_XZ
+#include <lzma.h>
+#endif
+
+// Compressed data is read and decompressed by chunks of this size
+#define ARCHIVE_CHUNK_SIZE 0x40000
+
+static const QByteArray GZIP_SIGNATURE("\x1F\x8B", 2);
+static const QByteArray XZ_SIGNATURE("\xFD\x37\x7A\x58\x5A\x00", 6);
+static const QByteArray ZIP_SIGNATURE("\x50\x4B\x03\x04", 4);
+
+// ZIP member to be decompressed
+struct ZipEntry {
+    int index;
+    ArchiveMember* member;
+    const char* data;
+    UINT32 compressedSize;
+    UINT32 uncompressedSize;
+    UINT16 method;
+    UINT32 crc32;
+};
+
+static QString chopExtension(const QString & name, const QString & extension)
+{
+    if (name.endsWith(extension, Qt::CaseInsensitive) && name.length() > extension.length())
+        return name.left(name.length() - extension.length());
+    return name;
+}
+
+// Path of a member in the archive is flattened to a file name, so members of different directories
+// don't collide and ".." or absolute paths can't point outside of the directory of the archive
+static QString memberFileName(const QString & path)
+{
+    QStringList parts;
+    QStringList components = QString(path).replace('\\', '/').split('/', QString::SkipEmptyParts);
+    for (int i = 0; i < components.size(); i++) {
+        const QString & component = components.at(i);
+        if (component == QString(".") || component == QString("..") || component.endsWith(':'))
+            continue;
+        parts.append(component);
+    }
+    return parts.isEmpty() ? QString("member") : parts.join("_");
+}
+
+// Reads the rest of the device, standard input has no size to check before reading
+static UINT8 readLimited(QIODevice & device, const UINT32 maxSize, QByteArray & data)
+{
+    data.clear();
+    if (!device.isSequential() && device.size() - device.pos() > maxSize)
+        return ERR_INVALID_ARCHIVE;
+
+    for (;;) {
+        QByteArray chunk = device.read(ARCHIVE_CHUNK_SIZE);
+        if (chunk.isEmpty())
+            return ERR_SUCCESS;
+        if ((UINT32)data.size() + chunk.size() > maxSize) {
+            data.clear();
+            return ERR_INVALID_ARCHIVE;
+        }
+        data.append(chunk);
+    }
+}
+
+// Decompresses gzip stream, concatenated gzip members are decoded as one file
+static UINT8 gunzipStream(QIODevice & device, const UINT32 maxSize, QByteArray & data)
+{
+#ifdef HAVE_ZLIB
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+        return ERR_OUT_OF_MEMORY;
+
+    QByteArray input;
+    int lastMemberEnd = -1;
+    int ret = Z_OK;
+    data.clear();
+    for (;;) {
+        if (!stream.avail_in) {
+            input = device.read(ARCHIVE_CHUNK_SIZE);
+            if (input.isEmpty()) {
+                // Input can't end in the middle of a member
+                if (data.size() != lastMemberEnd)
+                    lastMemberEnd = -1;
+                break;
+            }
+            stream.next_in = (Bytef*)input.data();
+            stream.avail_in = input.size();
+        }
+
+        // Decompression bombs are stopped at the image size limit
+        int used = data.size();
+        if ((UINT32)used > maxSize) {
+            lastMemberEnd = -1;
+            break;
+        }
+        data.resize(used + ARCHIVE_CHUNK_SIZE);
+        stream.next_out = (Bytef*)data.data() + used;
+        stream.avail_out = ARCHIVE_CHUNK_SIZE;
+        ret = inflate(&stream, Z_NO_FLUSH);
+        data.resize(data.size() - stream.avail_out);
+
+        if (ret == Z_STREAM_END) {
+            lastMemberEnd = data.size();
+            inflateReset(&stream);
+        }
+        else if (ret != Z_OK && ret != Z_BUF_ERROR)
+            break;
+    }
+    inflateEnd(&stream);
+
+    // Anything after the last complete member, like zero padding, is dropped
+    if (lastMemberEnd < 0 || (UINT32)lastMemberEnd > maxSize)
+        return ERR_INVALID_ARCHIVE;
+    data.resize(lastMemberEnd);
+    return ERR_SUCCESS;
+#else
+    (void)device;
+    (void)maxSize;
+    (void)data;
+    return ERR_NOT_IMPLEMENTED;
+#endif
+}
+
+// Decompresses xz stream, concatenated streams are decoded as one file
+static UINT8 unxzStream(QIODevice & device, const UINT32 maxSize, QByteArray & data)
+{
+#ifdef HAVE_XZ
+    lzma_stream stream = LZMA_STREAM_INIT;
+    if (lzma_stream_decoder(&stream, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+        return ERR_OUT_OF_MEMORY;
+
+    QByteArray input;
+    lzma_action action = LZMA_RUN;
+    lzma_ret ret = LZMA_OK;
+    data.clear();
+    while (ret == LZMA_OK) {
+        if (!stream.avail_in && action == LZMA_RUN) {
+            input = device.read(ARCHIVE_CHUNK_SIZE);
+            if (input.isEmpty())
+                action = LZMA_FINISH;
+            stream.next_in = (const uint8_t*)input.constData();
+            stream.avail_in = input.size();
+        }
+
+        // Decompression bombs are stopped at the image size limit
+        int used = data.size();
+        if ((UINT32)used > maxSize)
+            break;
+        data.resize(used + ARCHIVE_CHUNK_SIZE);
+        stream.next_out = (uint8_t*)data.data() + used;
+        stream.avail_out = ARCHIVE_CHUNK_SIZE;
+        ret = lzma_code(&stream, action);
+        data.resize(data.size() - stream.avail_out);
+    }
+    lzma_end(&stream);
+
+    return ret == LZMA_STREAM_END && (UINT32)data.size() <= maxSize ? ERR_SUCCESS : ERR_INVALID_ARCHIVE;
+#else
+    (void)device;
+    (void)maxSize;
+    (void)data;
+    return ERR_NOT_IMPLEMENTED;
+#endif
+}
+
+static void unzipEntry(ZipEntry & entry)
+{
+    ArchiveMember* member = entry.member;
+
+    // Size is checked against the image size limit before, so it's never above INT_MAX
+    if (entry.method == ZIP_METHOD_STORED) {
+        if (entry.compressedSize != entry.uncompressedSize) {
+            member->result = ERR_INVALID_ARCHIVE;
+            return;
+        }
+        member->data = QByteArray(entry.data, entry.compressedSize);
+    }
+    else if (entry.method == ZIP_METHOD_DEFLATED) {
+#ifdef HAVE_ZLIB
+        // Sizes are known from the directory, so the member is inflated at once
+        member->data.resize((int)entry.uncompressedSize);
+        if ((UINT32)member->data.size() != entry.uncompressedSize) {
+            member->data.clear();
+            member->result = ERR_OUT_OF_MEMORY;
+            return;
+        }
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+            member->result = ERR_OUT_OF_MEMORY;
+            return;
+        }
+        stream.next_in = (Bytef*)entry.data;
+        stream.avail_in = entry.compressedSize;
+        stream.next_out = (Bytef*)member->data.data();
+        stream.avail_out = member->data.size();
+        int ret = inflate(&stream, Z_FINISH);
+        inflateEnd(&stream);
+        if (ret != Z_STREAM_END || stream.avail_out) {
+            member->data.clear();
+            member->result = ERR_INVALID_ARCHIVE;
+            return;
+        }
+#else
+        member->result = ERR_NOT_IMPLEMENTED;
+        return;
+#endif
+    }
+    else {
+        member->result = ERR_NOT_IMPLEMENTED;
+        return;
+    }
+
+#ifdef HAVE_ZLIB
+    if (crc32(crc32(0L, Z_NULL, 0), (const Bytef*)member->data.constData(), member->data.size()) != entry.crc32) {
+        member->data.clear();
+        member->result = ERR_INVALID_ARCHIVE;
+        return;
+    }
+#endif
+    member->result = ERR_SUCCESS;
+}
+
+static UINT8 unzipArchive(const QByteArray & archive, const QString & directory, const UINT32 maxImageSize, QVector<ArchiveMember> & members)
+{
+    const char* data = archive.constData();
+    UINT32 size = archive.size();
+
+    // End of central directory record is the last one, but it can be followed by the archive comment
+    if (size < sizeof(ZIP_END_OF_CENTRAL_DIRECTORY))
+        return ERR_INVALID_ARCHIVE;
+    const ZIP_END_OF_CENTRAL_DIRECTORY* end = NULL;
+    UINT32 limit = size > 0xFFFF + sizeof(ZIP_END_OF_CENTRAL_DIRECTORY) ? size - 0xFFFF - sizeof(ZIP_END_OF_CENTRAL_DIRECTORY) : 0;
+    for (UINT32 offset = size - sizeof(ZIP_END_OF_CENTRAL_DIRECTORY) + 1; offset-- > limit;) {
+        const ZIP_END_OF_CENTRAL_DIRECTORY* candidate = (const ZIP_END_OF_CENTRAL_DIRECTORY*)(data + offset);
+        if (candidate->Signature == ZIP_END_OF_CENTRAL_DIRECTORY_SIGNATURE &&
+            offset + sizeof(ZIP_END_OF_CENTRAL_DIRECTORY) + candidate->CommentLength == size) {
+            end = candidate;
+            break;
+        }
+    }
+    if (!end || end->DiskNumber != end->CentralDirectoryDisk || (UINT64)end->CentralDirectoryOffset + end->CentralDirectorySize > size)
+        return ERR_INVALID_ARCHIVE;
+
+    // Walk the central directory, directories and empty files are skipped
+    QVector<ZipEntry> entries;
+    QSet<QString> names;
+    members.reserve(end->Entries);
+    UINT32 offset = end->CentralDirectoryOffset;
+    for (UINT16 i = 0; i < end->Entries; i++) {
+        if (offset + sizeof(ZIP_CENTRAL_FILE_HEADER) > size)
+            return ERR_INVALID_ARCHIVE;
+        const ZIP_CENTRAL_FILE_HEADER* header = (const ZIP_CENTRAL_FILE_HEADER*)(data + offset);
+        UINT32 next = offset + sizeof(ZIP_CENTRAL_FILE_HEADER) + header->NameLength + header->ExtraLength + header->CommentLength;
+        if (header->Signature != ZIP_CENTRAL_FILE_HEADER_SIGNATURE || next > size)
+            return ERR_INVALID_ARCHIVE;
+        QString name = QString::fromUtf8(data + offset + sizeof(ZIP_CENTRAL_FILE_HEADER), header->NameLength);
+        offset = next;
+
+        if (name.endsWith('/') || !header->UncompressedSize)
+            continue;
+
+        // Names are compared case-insensitively, as file systems of Windows and macOS do
+        QString fileName = memberFileName(name);
+        QString uniqueName = fileName;
+        for (int n = 2; names.contains(uniqueName.toLower()); n++)
+            uniqueName = QString("%1~%2").arg(fileName).arg(n);
+        names.insert(uniqueName.toLower());
+
+        ArchiveMember member;
+        member.name = QString("%1/%2").arg(directory).arg(uniqueName);
+        member.result = ERR_SUCCESS;
+        members.append(member);
+
+        // Encrypted and ZIP64 members are not supported
+        if ((header->Flags & ZIP_FLAG_ENCRYPTED) || header->CompressedSize == ZIP64_SIZE || header->UncompressedSize == ZIP64_SIZE) {
+            members.last().result = ERR_NOT_IMPLEMENTED;
+            continue;
+        }
+
+        // Output buffer is allocated by the size from the directory, so it's limited before anything is inflated
+        if (header->UncompressedSize > maxImageSize) {
+            members.last().result = ERR_INVALID_ARCHIVE;
+            continue;
+        }
+
+        // Sizes are taken from the central directory, local ones can be in data descriptor
+        const ZIP_LOCAL_FILE_HEADER* local = (const ZIP_LOCAL_FILE_HEADER*)(data + header->LocalHeaderOffset);
+        if ((UINT64)header->LocalHeaderOffset + sizeof(ZIP_LOCAL_FILE_HEADER) > size || local->Signature != ZIP_LOCAL_FILE_HEADER_SIGNATURE) {
+            members.last().result = ERR_INVALID_ARCHIVE;
+            continue;
+        }
+        UINT64 dataOffset = (UINT64)header->LocalHeaderOffset + sizeof(ZIP_LOCAL_FILE_HEADER) + local->NameLength + local->ExtraLength;
+        if (dataOffset + header->CompressedSize > size) {
+            members.last().result = ERR_INVALID_ARCHIVE;
+            continue;
+        }
+
+        ZipEntry entry;
+        entry.index = members.size() - 1;
+        entry.member = NULL;
+        entry.data = data + dataOffset;
+        entry.compressedSize = header->CompressedSize;
+        entry.uncompressedSize = header->UncompressedSize;
+        entry.method = header->Method;
+        entry.crc32 = header->Crc32;
+        entries.append(entry);
+    }
+
+    // Members are referenced once the vector is complete and won't reallocate anymore
+    for (int i = 0; i < entries.size(); i++)
+        entries[i].member = members.data() + entries.at(i).index;
+    QtConcurrent::blockingMap(entries, unzipEntry);
+
+    return ERR_SUCCESS;
+}
+
+UINT8 readImages(const QString & path, QVector<ArchiveMember> & members, const UINT32 maxImageSize)
+{
+    members.clear();
+
+    // QByteArray can't hold more than INT_MAX bytes, data is decompressed by chunks
+    UINT32 maxSize = maxImageSize < (UINT32)(INT_MAX - ARCHIVE_CHUNK_SIZE) ? maxImageSize : (UINT32)(INT_MAX - ARCHIVE_CHUNK_SIZE);
+
+    QFile file;
+    bool standardInput = (path == QString("-"));
+    if (standardInput) {
+        if (!file.open(stdin, QFile::ReadOnly))
+            return ERR_FILE_OPEN;
+    }
+    else {
+        file.setFileName(path);
+        if (!file.exists())
+            return ERR_FILE_OPEN;
+        if (!file.open(QFile::ReadOnly))
+            return ERR_FILE_READ;
+    }
+
+    QString name = standardInput ? QString("stdin") : path;
+    QByteArray signature = file.peek(XZ_SIGNATURE.size());
+
+    // Single file archives are decompressed while they are read
+    ArchiveMember member;
+    member.result = ERR_SUCCESS;
+    if (signature.startsWith(GZIP_SIGNATURE)) {
+        member.name = chopExtension(name, ".gz");
+        member.result = gunzipStream(file, maxSize, member.data);
+        if (member.result)
+            return member.result;
+        members.append(member);
+        return ERR_SUCCESS;
+    }
+    if (signature.startsWith(XZ_SIGNATURE)) {
+        member.name = chopExtension(name, ".xz");
+        member.result = unxzStream(file, maxSize, member.data);
+        if (member.result)
+            return member.result;
+        members.append(member);
+        return ERR_SUCCESS;
+    }
+
+    // ZIP files are read from their ends, so regular files are mapped instead of being read
+    if (signature.startsWith(ZIP_SIGNATURE)) {
+        QString directory = standardInput ? QString(".") : QFileInfo(path).path();
+        if (!standardInput) {
+            if (file.size() > INT_MAX)
+                return ERR_INVALID_ARCHIVE;
+            uchar* mapped = file.map(0, file.size());
+            if (mapped)
+                return unzipArchive(QByteArray::fromRawData((const char*)mapped, (int)file.size()), directory, maxSize, members);
+        }
+        // Archive can hold several images, so it's only limited by what QByteArray can hold
+        QByteArray archive;
+        UINT8 result = readLimited(file, (UINT32)(INT_MAX - ARCHIVE_CHUNK_SIZE), archive);
+        if (result)
+            return result;
+        return unzipArchive(archive, directory, maxSize, members);
+    }
+
+    member.name = name;
+    member.result = readLimited(file, maxSize, member.data);
+    if (member.result)
+        return member.result;
+    members.append(member);
+    return ERR_SUCCESS;
+}
@@ -0,0 +1,104 @@
+/* archive.h
+
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHWARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*/
+
+#ifndef __ARCHIVE_H__
+#define __ARCHIVE_H__
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include "basetypes.h"
+
+// Make sure we use right packing rules
+#pragma pack(push, 1)
+
+// ZIP local file header, followed by file name, extra field and file data
+typedef struct _ZIP_LOCAL_FILE_HEADER {
+    UINT32 Signature;              // 0x04034B50
+    UINT16 VersionNeeded;
+    UINT16 Flags;
+    UINT16 Method;
+    UINT16 Time;
+    UINT16 Date;
+    UINT32 Crc32;
+    UINT32 CompressedSize;
+    UINT32 UncompressedSize;
+    UINT16 NameLength;
+    UINT16 ExtraLength;
+} ZIP_LOCAL_FILE_HEADER;
+
+#define ZIP_LOCAL_FILE_HEADER_SIGNATURE 0x04034B50
+
+// ZIP central directory file header, followed by file name, extra field and comment
+typedef struct _ZIP_CENTRAL_FILE_HEADER {
+    UINT32 Signature;              // 0x02014B50
+    UINT16 VersionMadeBy;
+    UINT16 VersionNeeded;
+    UINT16 Flags;
+    UINT16 Method;
+    UINT16 Time;
+    UINT16 Date;
+    UINT32 Crc32;
+    UINT32 CompressedSize;
+    UINT32 UncompressedSize;
+    UINT16 NameLength;
+    UINT16 ExtraLength;
+    UINT16 CommentLength;
+    UINT16 DiskNumber;
+    UINT16 InternalAttributes;
+    UINT32 ExternalAttributes;
+    UINT32 LocalHeaderOffset;
+} ZIP_CENTRAL_FILE_HEADER;
+
+#define ZIP_CENTRAL_FILE_HEADER_SIGNATURE 0x02014B50
+
+// ZIP end of central directory record, followed by archive comment
+typedef struct _ZIP_END_OF_CENTRAL_DIRECTORY {
+    UINT32 Signature;              // 0x06054B50
+    UINT16 DiskNumber;
+    UINT16 CentralDirectoryDisk;
+    UINT16 DiskEntries;
+    UINT16 Entries;
+    UINT32 CentralDirectorySize;
+    UINT32 CentralDirectoryOffset;
+    UINT16 CommentLength;
+} ZIP_END_OF_CENTRAL_DIRECTORY;
+
+#define ZIP_END_OF_CENTRAL_DIRECTORY_SIGNATURE 0x06054B50
+
+// ZIP general purpose flags and compression methods
+#define ZIP_FLAG_ENCRYPTED     0x0001
+#define ZIP_METHOD_STORED      0
+#define ZIP_METHOD_DEFLATED    8
+
+// Sizes of ZIP64 entries are stored in extra field only
+#define ZIP64_SIZE             0xFFFFFFFF
+
+// Restore previous packing rules
+#pragma pack(pop)
+
+// Images bigger than this are not read, sizes in archives can't be trusted
+#define ARCHIVE_DEFAULT_MAX_IMAGE_SIZE 0x40000000
+
+// Image read from a file, standard input or archive member
+struct ArchiveMember {
+    // Path to save the image to, archive members are placed next to the archive
+    QString name;
+    UINT8 result;
+    QByteArray data;
+};
+
+// Reads an image, or all members of a .zip, .gz or .xz archive, to memory; "-" stands for standard input
+// Archives are recognized by their signatures and decompressed while they are read, ZIP members are decompressed in parallel
+// Members which can't be decompressed or are bigger than maxImageSize are returned with non-zero result
+UINT8 readImages(const QString & path, QVector<ArchiveMember> & members, const UINT32 maxImageSize = ARCHIVE_DEFAULT_MAX_IMAGE_SIZE);
+
+#endif
@@ -87,6 +87,10 @@ typedef unsigned int UINTN;
 #define ERR_DEPEX_PARSE_FAILED              42
 #define ERR_TRUNCATED_IMAGE                 43
 #define ERR_BAD_RELOCATION_ENTRY            44
+#define ERR_DUPLICATE_FILE_GUID             45
+#define ERR_VERIFICATION_FAILED             46
+#define ERR_INVALID_SELECTOR                47
+#define ERR_INVALID_ARCHIVE                 48
 #define ERR_NOT_IMPLEMENTED                 0xFF
 
 // UDK porting definitions
@@ -107,6 +111,12 @@ typedef unsigned int UINTN;
 #define COMPRESSION_ALGORITHM_TIANO   3
 #define COMPRESSION_ALGORITHM_LZMA    4
 #define COMPRESSION_ALGORITHM_IMLZMA  5
+#define COMPRESSION_ALGORITHM_BROTLI  6
+
+// Compression presets
+#define COMPRESSION_PRESET_FAST       0
+#define COMPRESSION_PRESET_DEFAULT    1
+#define COMPRESSION_PRESET_MAX        2
 
 // Item create modes
 #define CREATE_MODE_APPEND    0
@@ -140,6 +150,22 @@ typedef unsigned int UINTN;
 #define SEARCH_MODE_BODY      2
 #define SEARCH_MODE_ALL       3
 
+// Visitor results
+#define VISIT_CONTINUE        0
+#define VISIT_SKIP_CHILDREN   1
+#define VISIT_STOP            2
+
+// Selector predicate keys
+#define SELECTOR_KEY_GUID     0
+#define SELECTOR_KEY_TYPE     1
+#define SELECTOR_KEY_FS       2
+#define SELECTOR_KEY_NAME     3
+#define SELECTOR_KEY_TEXT     4
+
+// Selector step axes
+#define SELECTOR_AXIS_DESCENDANT 0
+#define SELECTOR_AXIS_OWNED      1
+
 // EFI GUID
 typedef struct _EFI_GUID {
     UINT8 Data[16];
@@ -0,0 +1,162 @@
+/* corpus.cpp
+
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHWARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*/
+
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include "corpus.h"
+
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+CorpusReader::CorpusReader(const QStringList & paths, const int depth, const qint64 memoryLimit, QObject *parent)
+    : QThread(parent), depth(depth > 0 ? depth : 1), memoryLimit(memoryLimit),
+    stopping(false), done(false), buffered(0), current(0), returned(-1)
+{
+    // Files of directories are read in name order, so results don't depend on the file system
+    for (int i = 0; i < paths.count(); i++) {
+        const QString & path = paths.at(i);
+        if (path == QString("-") || !QFileInfo(path).isDir()) {
+            files.append(path);
+            continue;
+        }
+
+        QStringList found;
+        QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext())
+            found.append(it.next());
+        found.sort();
+        files.append(found);
+    }
+
+    statistics.files = 0;
+    statistics.bytes = 0;
+    statistics.peakBytes = 0;
+    statistics.readNsecs = 0;
+    statistics.waitNsecs = 0;
+    statistics.processNsecs = 0;
+
+    timer.start();
+    start();
+}
+
+CorpusReader::~CorpusReader()
+{
+    mutex.lock();
+    stopping = true;
+    entryTaken.wakeAll();
+    mutex.unlock();
+    wait();
+}
+
+qint64 CorpusReader::entrySize(const CorpusEntry & entry)
+{
+    qint64 size = 0;
+    for (int i = 0; i < entry.images.count(); i++)
+        size += entry.images.at(i).data.size();
+    return size;
+}
+
+void CorpusReader::adviseWillNeed(const QString & path)
+{
+    // Let the kernel read the file to page cache while the reader waits for the consumer,
+    // this doesn't count against the memory limit
+#if defined(Q_OS_LINUX)
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY);
+    if (fd < 0)
+        return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    ::close(fd);
+#else
+    Q_UNUSED(path);
+#endif
+}
+
+void CorpusReader::run()
+{
+    for (int i = 0; i < files.count(); i++) {
+        const QString & path = files.at(i);
+        bool standardInput = (path == QString("-"));
+
+        // File size is used as an estimate of its images size until it's read
+        qint64 size = standardInput ? 0 : QFileInfo(path).size();
+        if (!standardInput)
+            adviseWillNeed(path);
+
+        mutex.lock();
+        while (!stopping && !queue.isEmpty() && (queue.count() >= depth || buffered + size > memoryLimit))
+            entryTaken.wait(&mutex);
+        if (stopping) {
+            mutex.unlock();
+            return;
+        }
+        buffered += size;
+        mutex.unlock();
+
+        CorpusEntry entry;
+        entry.path = path;
+        qint64 begin = timer.nsecsElapsed();
+        entry.result = readImages(path, entry.images);
+        qint64 elapsed = timer.nsecsElapsed() - begin;
+        qint64 read = entrySize(entry);
+
+        mutex.lock();
+        buffered += read - size;
+        if ((UINT64)buffered > statistics.peakBytes)
+            statistics.peakBytes = buffered;
+        statistics.files++;
+        statistics.bytes += read;
+        statistics.readNsecs += elapsed;
+        queue.enqueue(entry);
+        entryQueued.wakeOne();
+        mutex.unlock();
+    }
+
+    mutex.lock();
+    done = true;
+    entryQueued.wakeOne();
+    mutex.unlock();
+}
+
+bool CorpusReader::next(CorpusEntry & entry)
+{
+    // Images of the previous entry aren't used anymore
+    entry = CorpusEntry();
+
+    QMutexLocker locker(&mutex);
+    qint64 called = timer.nsecsElapsed();
+    if (returned >= 0)
+        statistics.processNsecs += called - returned;
+    buffered -= current;
+    current = 0;
+    entryTaken.wakeOne();
+
+    while (queue.isEmpty() && !done)
+        entryQueued.wait(&mutex);
+    returned = timer.nsecsElapsed();
+    statistics.waitNsecs += returned - called;
+    if (queue.isEmpty())
+        return false;
+
+    entry = queue.dequeue();
+    current = entrySize(entry);
+    entryTaken.wakeOne();
+    return true;
+}
+
+CorpusStats CorpusReader::stats() const
+{
+    QMutexLocker locker(&mutex);
+    return statistics;
+}
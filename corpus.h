@@ -0,0 +1,90 @@
+/* corpus.h
+
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHWARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*/
+
+#ifndef __CORPUS_H__
+#define __CORPUS_H__
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QQueue>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+#include "basetypes.h"
+#include "archive.h"
+
+// Default number of files read ahead and memory ceiling for files read but not yet processed
+#define CORPUS_DEFAULT_DEPTH        4
+#define CORPUS_DEFAULT_MEMORY_LIMIT (256LL * 1024 * 1024)
+
+// Images read from one file of a corpus
+struct CorpusEntry {
+    QString path;
+    UINT8 result;
+    QVector<ArchiveMember> images;
+};
+
+// Time is in nanoseconds; waiting is the time the consumer was blocked on reads,
+// processing is the time from returning an entry to it until it asked for the next one
+struct CorpusStats {
+    UINT32 files;
+    UINT64 bytes;
+    UINT64 peakBytes;
+    qint64 readNsecs;
+    qint64 waitNsecs;
+    qint64 processNsecs;
+};
+
+// Reads files, and all files of directories, given as paths in a background thread,
+// so the next ones are read while the current one is processed
+// Reading stops when depth files are queued or the queued images together with the current one
+// exceed memoryLimit bytes, at least one file is always read ahead
+class CorpusReader : public QThread
+{
+public:
+    explicit CorpusReader(const QStringList & paths, const int depth = CORPUS_DEFAULT_DEPTH,
+        const qint64 memoryLimit = CORPUS_DEFAULT_MEMORY_LIMIT, QObject *parent = 0);
+    ~CorpusReader();
+
+    int count() const { return files.count(); }
+
+    // Returns the next entry, or false if all files were returned; images of the previous entry are released
+    bool next(CorpusEntry & entry);
+    CorpusStats stats() const;
+
+protected:
+    void run();
+
+private:
+    QStringList files;
+    int depth;
+    qint64 memoryLimit;
+
+    mutable QMutex mutex;
+    QWaitCondition entryQueued;
+    QWaitCondition entryTaken;
+    QQueue<CorpusEntry> queue;
+    bool stopping;
+    bool done;
+    qint64 buffered;
+    qint64 current;
+
+    QElapsedTimer timer;
+    qint64 returned;
+    CorpusStats statistics;
+
+    static qint64 entrySize(const CorpusEntry & entry);
+    static void adviseWillNeed(const QString & path);
+};
+
+#endif
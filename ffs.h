@@ -435,6 +435,8 @@ typedef struct _EFI_COMPRESSION_SECTION2 {
 #define EFI_NOT_COMPRESSED          0x00
 #define EFI_STANDARD_COMPRESSION    0x01
 #define EFI_CUSTOMIZED_COMPRESSION  0x02
+// Not defined by PI specification, used for Brotli GUID-defined sections
+#define EFI_CUSTOMIZED_COMPRESSION_BROTLI 0x80
 
 //GUID defined section
 typedef struct _EFI_GUID_DEFINED_SECTION {
@@ -468,6 +470,9 @@ const QByteArray EFI_GUIDED_SECTION_TIANO // A31280AD-481E-41B6-95E8-127F4C98477
 const QByteArray EFI_GUIDED_SECTION_LZMA // EE4E5898-3914-4259-9D6E-DC7BD79403CF
 ("\x98\x58\x4E\xEE\x14\x39\x59\x42\x9D\x6E\xDC\x7B\xD7\x94\x03\xCF", 16);
 
+const QByteArray EFI_GUIDED_SECTION_BROTLI // 3D532050-5CDA-4FD0-879E-0F7F630D5AFB
+("\x50\x20\x53\x3D\xDA\x5C\xD0\x4F\x87\x9E\x0F\x7F\x63\x0D\x5A\xFB", 16);
+
 const QByteArray EFI_FIRMWARE_CONTENTS_SIGNED_GUID //0F9D89E8-9259-4F76-A5AF-0C89E34023DF
 ("\xE8\x89\x9D\x0F\x59\x92\x76\x4F\xA5\xAF\x0C\x89\xE3\x40\x23\xDF", 16);
 
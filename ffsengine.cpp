@@ -10,7 +10,9 @@ THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
 WITHWARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 */
 
+#include <limits.h>
 #include <math.h>
+#include <string.h>
 
 #include "ffsengine.h"
 #include "types.h"
@@ -23,6 +25,14 @@ WITHWARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include "Tiano/EfiTianoDecompress.h"
 #include "LZMA/LzmaCompress.h"
 #include "LZMA/LzmaDecompress.h"
+#include "Brotli/BrotliCompress.h"
+#include "Brotli/BrotliDecompress.h"
+
+#include <QThreadStorage>
+#include <QtConcurrentMap>
+#include <QtConcurrentRun>
+#include <QCryptographicHash>
+#include <QUuid>
 
 #ifdef _CONSOLE
 #include <iostream>
@@ -77,6 +87,10 @@ QString errorMessage(UINT8 errorCode)
     case ERR_DEPEX_PARSE_FAILED:              return QObject::tr("Dependency expression parsing failed");
     case ERR_TRUNCATED_IMAGE:                 return QObject::tr("Image is truncated");
     case ERR_BAD_RELOCATION_ENTRY:            return QObject::tr("Bad image relocation entry");
+    case ERR_DUPLICATE_FILE_GUID:             return QObject::tr("File with the same GUID already exists in the volume");
+    case ERR_VERIFICATION_FAILED:             return QObject::tr("Reconstructed image doesn't match the modified structure");
+    case ERR_INVALID_SELECTOR:                return QObject::tr("Invalid selector");
+    case ERR_INVALID_ARCHIVE:                 return QObject::tr("Invalid or corrupted archive");
     default:                                  return QObject::tr("Unknown error %1").arg(errorCode);
     }
 }
@@ -87,7 +101,18 @@ FfsEngine::FfsEngine(QObject *parent)
     model = new TreeModel();
     oldPeiCoreEntryPoint = 0;
     newPeiCoreEntryPoint = 0;
+    compressionPreset = COMPRESSION_PRESET_DEFAULT;
+    lzmaMultithreadThreshold = LZMA_MULTITHREAD_THRESHOLD;
+    decompressionCacheEnabled = false;
+    transactionActive = false;
+    transactionMessageCount = 0;
     dumped = false;
+    itemMessages = NULL;
+    deferredMessages = NULL;
+    rebaseImages = NULL;
+
+    // Items with replaced bodies are parsed when expanded
+    connect(model, SIGNAL(parseRequested(QModelIndex)), this, SLOT(parsePending(QModelIndex)));
 }
 
 FfsEngine::~FfsEngine(void)
@@ -102,6 +127,18 @@ TreeModel* FfsEngine::treeModel() const
 
 void FfsEngine::msg(const QString & message, const QModelIndex & index)
 {
+    // Messages of regions parsed concurrently are shown in descriptor order once all of them are parsed
+    if (deferredMessages) {
+        deferredMessages->append(qMakePair(QPersistentModelIndex(index), message));
+        return;
+    }
+
+    // Messages of an image parsed for verification are kept with their items
+    if (itemMessages) {
+        itemMessages->insert(index.internalPointer(), message);
+        return;
+    }
+
 #ifndef _DISABLE_ENGINE_MESSAGES
 #ifndef _CONSOLE
     messageItems.enqueue(MessageListItem(message, NULL, 0, index));
@@ -142,6 +179,22 @@ bool FfsEngine::hasIntersection(const UINT32 begin1, const UINT32 end1, const UI
 
 // Firmware image parsing
 UINT8 FfsEngine::parseImageFile(const QByteArray & buffer)
+{
+    // Removed items refer to the opened image, it's shared with the caller's buffer
+    openedImage = buffer;
+    removed.clear();
+
+    // Identical compressed payloads are decompressed and parsed only once per image
+    // The cache refers to tree items, so it can't outlive the parsing
+    decompressionCache.clear();
+    decompressionCacheEnabled = true;
+    UINT8 result = parseImage(buffer);
+    decompressionCacheEnabled = false;
+    decompressionCache.clear();
+    return result;
+}
+
+UINT8 FfsEngine::parseImage(const QByteArray & buffer)
 {
     oldPeiCoreEntryPoint = 0;
     newPeiCoreEntryPoint = 0;
@@ -556,38 +609,76 @@ UINT8 FfsEngine::parseIntelImage(const QByteArray & intelImage, QModelIndex & in
     // Sort regions in ascending order
     qSort(offsets);
 
-    // Parse regions
-    UINT8 result = 0;
+    // Get region types in ascending order
+    QVector<UINT8> subtypes;
+    int biosPosition = -1;
     for (int i = 0; i < offsets.count(); i++) {
-        // Parse GbE region
-        if (offsets.at(i) == gbeBegin) {
-            QModelIndex gbeIndex;
-            result = parseGbeRegion(gbe, gbeIndex, index);
-        }
-        // Parse ME region
-        else if (offsets.at(i) == meBegin) {
-            QModelIndex meIndex;
-            result = parseMeRegion(me, meIndex, index);
-        }
-        // Parse BIOS region
+        if (offsets.at(i) == gbeBegin)
+            subtypes.append(Subtypes::GbeRegion);
+        else if (offsets.at(i) == meBegin)
+            subtypes.append(Subtypes::MeRegion);
         else if (offsets.at(i) == biosBegin) {
-            QModelIndex biosIndex;
-            result = parseBiosRegion(bios, biosIndex, index);
+            subtypes.append(Subtypes::BiosRegion);
+            biosPosition = i;
         }
-        // Parse PDR region
-        else if (offsets.at(i) == pdrBegin) {
-            QModelIndex pdrIndex;
-            result = parsePdrRegion(pdr, pdrIndex, index);
-        }
-        // Parse EC region
-        else if (descriptorVersion == 2 && offsets.at(i) == ecBegin) {
-            QModelIndex ecIndex;
-            result = parseEcRegion(ec, ecIndex, index);
+        else if (offsets.at(i) == pdrBegin)
+            subtypes.append(Subtypes::PdrRegion);
+        else
+            subtypes.append(Subtypes::EcRegion);
+    }
+
+    // Parse regions other than BIOS concurrently with it
+    QVector<QFuture<RegionParse> > futures(offsets.count());
+    for (int i = 0; i < offsets.count(); i++) {
+        if (subtypes.at(i) == Subtypes::GbeRegion)
+            futures[i] = QtConcurrent::run(this, &FfsEngine::parseDetachedRegion, subtypes.at(i), gbe);
+        else if (subtypes.at(i) == Subtypes::MeRegion)
+            futures[i] = QtConcurrent::run(this, &FfsEngine::parseDetachedRegion, subtypes.at(i), me);
+        else if (subtypes.at(i) == Subtypes::PdrRegion)
+            futures[i] = QtConcurrent::run(this, &FfsEngine::parseDetachedRegion, subtypes.at(i), pdr);
+        else if (subtypes.at(i) == Subtypes::EcRegion)
+            futures[i] = QtConcurrent::run(this, &FfsEngine::parseDetachedRegion, subtypes.at(i), ec);
+    }
+
+    // Parse BIOS region
+    UINT8 biosResult = ERR_SUCCESS;
+    QPersistentModelIndex biosIndex;
+    QVector<QPair<QPersistentModelIndex, QString> > biosMessages;
+    if (biosPosition >= 0) {
+        QVector<QPair<QPersistentModelIndex, QString> >* previousMessages = deferredMessages;
+        deferredMessages = &biosMessages;
+        QModelIndex parsedIndex;
+        biosResult = parseBiosRegion(bios, parsedIndex, index);
+        biosIndex = parsedIndex;
+        deferredMessages = previousMessages;
+    }
+
+    // Attach parsed regions in ascending order
+    UINT8 result = 0;
+    for (int i = 0; i < offsets.count(); i++) {
+        if (i == biosPosition) {
+            replayMessages(biosMessages);
+            result = biosResult;
         }
-        if (result)
+        else if (i < biosPosition && biosIndex.isValid())
+            result = attachDetachedRegion(futures[i].result(), index, biosIndex);
+        else
+            result = attachDetachedRegion(futures[i].result(), index, QModelIndex());
+
+        if (result) {
+            // Regions after the failed one are not added, as if they were never parsed
+            for (int j = i + 1; j < offsets.count(); j++)
+                futures[j].waitForFinished();
+            if (i < biosPosition && biosIndex.isValid())
+                model->removeItem(biosIndex);
             return result;
+        }
     }
 
+    // Regions follow the descriptor in ascending order
+    for (int i = 0; i < offsets.count(); i++)
+        model->setOffset(index.child(i + 1, 0), offsets.at(i));
+
     // Add the data after the last region as padding
     UINT32 IntelDataEnd = 0;
     UINT32 LastRegionOffset = offsets.last();
@@ -615,12 +706,89 @@ UINT8 FfsEngine::parseIntelImage(const QByteArray & intelImage, QModelIndex & in
         info = tr("Full size: %1h (%2)")
             .hexarg(padding.size()).arg(padding.size());
         // Add tree item
-        model->addItem(Types::Padding, getPaddingType(padding), COMPRESSION_ALGORITHM_NONE, name, "", info, QByteArray(), padding, index);
+        QModelIndex paddingIndex = model->addItem(Types::Padding, getPaddingType(padding), COMPRESSION_ALGORITHM_NONE, name, "", info, QByteArray(), padding, index);
+        model->setOffset(paddingIndex, IntelDataEnd);
     }
 
     return ERR_SUCCESS;
 }
 
+FfsEngine::RegionParse FfsEngine::parseDetachedRegion(const UINT8 subtype, const QByteArray & region) const
+{
+    // Region is parsed into a tree of its own engine, which is attached later by the calling one
+    RegionParse parsed;
+    parsed.engine = QSharedPointer<FfsEngine>(new FfsEngine());
+    FfsEngine* engine = parsed.engine.data();
+    engine->compressionPreset = compressionPreset;
+    engine->lzmaMultithreadThreshold = lzmaMultithreadThreshold;
+    engine->decompressionCacheEnabled = decompressionCacheEnabled;
+    engine->deferredMessages = &parsed.messages;
+
+    switch (subtype) {
+    case Subtypes::GbeRegion:
+        parsed.result = engine->parseGbeRegion(region, parsed.index);
+        break;
+    case Subtypes::MeRegion:
+        parsed.result = engine->parseMeRegion(region, parsed.index);
+        break;
+    case Subtypes::PdrRegion:
+        parsed.result = engine->parsePdrRegion(region, parsed.index);
+        break;
+    case Subtypes::EcRegion:
+        parsed.result = engine->parseEcRegion(region, parsed.index);
+        break;
+    default:
+        parsed.result = ERR_UNKNOWN_ITEM_TYPE;
+    }
+
+    engine->deferredMessages = NULL;
+    return parsed;
+}
+
+UINT8 FfsEngine::attachDetachedRegion(const RegionParse & parsed, const QModelIndex & parent, const QModelIndex & before)
+{
+    if (!parsed.engine)
+        return ERR_INVALID_PARAMETER;
+
+    // Copy region item to this tree, before the given item or to the end of parent item
+    QModelIndex index;
+    if (parsed.index.isValid()) {
+        const TreeModel* source = parsed.engine->model;
+        index = model->addItem(source->type(parsed.index), source->subtype(parsed.index), source->compression(parsed.index),
+            source->name(parsed.index), source->text(parsed.index), source->info(parsed.index),
+            source->header(parsed.index), source->body(parsed.index),
+            before.isValid() ? before : parent, before.isValid() ? CREATE_MODE_BEFORE : CREATE_MODE_APPEND);
+        model->copyChildren(parsed.index, index);
+    }
+
+    // PEI core can only be found in PDR region parsed as BIOS space
+    if (!oldPeiCoreEntryPoint)
+        oldPeiCoreEntryPoint = parsed.engine->oldPeiCoreEntryPoint;
+
+    // Show messages for the copied items
+    for (int i = 0; i < parsed.messages.size(); i++) {
+        QModelIndex sourceIndex = parsed.messages.at(i).first;
+        QModelIndex messageIndex;
+        if (sourceIndex.isValid() && index.isValid()) {
+            QVector<int> rows;
+            for (; sourceIndex.isValid() && sourceIndex != parsed.index; sourceIndex = sourceIndex.parent())
+                rows.prepend(sourceIndex.row());
+            messageIndex = index;
+            for (int j = 0; j < rows.size(); j++)
+                messageIndex = model->index(rows.at(j), 0, messageIndex);
+        }
+        msg(parsed.messages.at(i).second, messageIndex);
+    }
+
+    return parsed.result;
+}
+
+void FfsEngine::replayMessages(const QVector<QPair<QPersistentModelIndex, QString> > & messages)
+{
+    for (int i = 0; i < messages.size(); i++)
+        msg(messages.at(i).second, messages.at(i).first);
+}
+
 UINT8 FfsEngine::parseGbeRegion(const QByteArray & gbe, QModelIndex & index, const QModelIndex & parent, const UINT8 mode)
 {
     // Check sanity
@@ -815,7 +983,8 @@ UINT8 FfsEngine::parseBios(const QByteArray & bios, const QModelIndex & parent)
             info = tr("Full size: %1h (%2)")
                 .hexarg(padding.size()).arg(padding.size());
             // Add tree item
-            model->addItem(Types::Padding, getPaddingType(padding), COMPRESSION_ALGORITHM_NONE, name, "", info, QByteArray(), padding, parent);
+            QModelIndex paddingIndex = model->addItem(Types::Padding, getPaddingType(padding), COMPRESSION_ALGORITHM_NONE, name, "", info, QByteArray(), padding, parent);
+            model->setOffset(paddingIndex, prevVolumeOffset + prevVolumeSize);
         }
 
         // Get volume size
@@ -862,6 +1031,7 @@ UINT8 FfsEngine::parseBios(const QByteArray & bios, const QModelIndex & parent)
         UINT8 result = parseVolume(bios.mid(volumeOffset, volumeSize), index, parent);
         if (result)
             msg(tr("parseBios: volume parsing failed with error \"%1\"").arg(errorMessage(result)), parent);
+        model->setOffset(index, volumeOffset);
 
         // Show messages
         if (msgAlignmentBitsSet)
@@ -891,7 +1061,8 @@ UINT8 FfsEngine::parseBios(const QByteArray & bios, const QModelIndex & parent)
                 info = tr("Full size: %1h (%2)")
                     .hexarg(padding.size()).arg(padding.size());
                 // Add tree item
-                model->addItem(Types::Padding, getPaddingType(padding), COMPRESSION_ALGORITHM_NONE, name, "", info, QByteArray(), padding, parent);
+                QModelIndex paddingIndex = model->addItem(Types::Padding, getPaddingType(padding), COMPRESSION_ALGORITHM_NONE, name, "", info, QByteArray(), padding, parent);
+                model->setOffset(paddingIndex, bios.size() - endPaddingSize);
             }
             break;
         }
@@ -900,6 +1071,456 @@ UINT8 FfsEngine::parseBios(const QByteArray & bios, const QModelIndex & parent)
     return ERR_SUCCESS;
 }
 
+// Event-driven parsing
+// Items are read in place, nothing is allocated for them and nothing is added to the tree
+static bool guidInList(const UINT8* guid, const QVector<QByteArray> & list)
+{
+    for (int i = 0; i < list.size(); i++) {
+        if (!memcmp(guid, list.at(i).constData(), sizeof(EFI_GUID)))
+            return true;
+    }
+    return false;
+}
+
+static bool isEmptyData(const UINT8* data, const UINT32 size, const char empty)
+{
+    for (UINT32 i = 0; i < size; i++) {
+        if (data[i] != (UINT8)empty)
+            return false;
+    }
+    return true;
+}
+
+UINT8 FfsEngine::visitImageFile(const QByteArray & buffer, FfsVisitor & visitor)
+{
+    if ((UINT32)buffer.size() <= sizeof(EFI_CAPSULE_HEADER))
+        return ERR_INVALID_PARAMETER;
+
+    const UINT8* data = (const UINT8*)buffer.constData();
+    UINT32 size = buffer.size();
+
+    // Capsule header
+    FfsEvent capsule;
+    memset(&capsule, 0, sizeof(capsule));
+    capsule.type = Types::Capsule;
+    capsule.compression = COMPRESSION_ALGORITHM_NONE;
+    capsule.inImage = true;
+    if (buffer.startsWith(EFI_CAPSULE_GUID) || buffer.startsWith(INTEL_CAPSULE_GUID)) {
+        capsule.subtype = Subtypes::UefiCapsule;
+        capsule.headerSize = ((const EFI_CAPSULE_HEADER*)data)->HeaderSize;
+    }
+    else if (buffer.startsWith(TOSHIBA_CAPSULE_GUID)) {
+        capsule.subtype = Subtypes::ToshibaCapsule;
+        capsule.headerSize = ((const TOSHIBA_CAPSULE_HEADER*)data)->HeaderSize;
+    }
+    else if (buffer.startsWith(APTIO_SIGNED_CAPSULE_GUID) || buffer.startsWith(APTIO_UNSIGNED_CAPSULE_GUID)) {
+        capsule.subtype = buffer.startsWith(APTIO_SIGNED_CAPSULE_GUID) ? Subtypes::AptioSignedCapsule : Subtypes::AptioUnsignedCapsule;
+        capsule.headerSize = ((const APTIO_CAPSULE_HEADER*)data)->RomImageOffset;
+    }
+    if (capsule.headerSize >= size)
+        return ERR_INVALID_PARAMETER;
+
+    UINT8 depth = 0;
+    if (capsule.headerSize) {
+        capsule.header = data;
+        capsule.body = data + capsule.headerSize;
+        capsule.bodySize = size - capsule.headerSize;
+        UINT8 action = visitor.enter(capsule);
+        if (action != VISIT_CONTINUE)
+            return ERR_SUCCESS;
+        depth++;
+    }
+
+    // Flash chip image
+    FfsEvent image;
+    memset(&image, 0, sizeof(image));
+    image.type = Types::Image;
+    image.subtype = Subtypes::UefiImage;
+    image.compression = COMPRESSION_ALGORITHM_NONE;
+    image.depth = depth;
+    image.inImage = true;
+    image.offset = capsule.headerSize;
+    image.body = data + capsule.headerSize;
+    image.bodySize = size - capsule.headerSize;
+
+    // BIOS and PDR regions of Intel image are parsed as BIOS space like in the tree, if their bounds are sane
+    UINT8 regionSubtypes[2];
+    UINT32 regionBegins[2];
+    UINT32 regionSizes[2];
+    int regionCount = 0;
+    if (image.bodySize >= FLASH_DESCRIPTOR_SIZE && ((const FLASH_DESCRIPTOR_HEADER*)image.body)->Signature == FLASH_DESCRIPTOR_SIGNATURE) {
+        const FLASH_DESCRIPTOR_MAP* descriptorMap = (const FLASH_DESCRIPTOR_MAP*)(image.body + sizeof(FLASH_DESCRIPTOR_HEADER));
+        if (descriptorMap->RegionBase <= FLASH_DESCRIPTOR_MAX_BASE) {
+            const FLASH_DESCRIPTOR_REGION_SECTION* regionSection = (const FLASH_DESCRIPTOR_REGION_SECTION*)calculateAddress8(image.body, descriptorMap->RegionBase);
+            if (regionSection->BiosLimit) {
+                UINT32 begin = calculateRegionOffset(regionSection->BiosBase);
+                UINT32 regionSize = calculateRegionSize(regionSection->BiosBase, regionSection->BiosLimit);
+                // Gigabyte-specific descriptor map has BIOS region covering the whole image, it's parsed as is
+                if (begin >= FLASH_DESCRIPTOR_SIZE && regionSize < image.bodySize && begin + regionSize <= image.bodySize) {
+                    image.subtype = Subtypes::IntelImage;
+                    regionSubtypes[regionCount] = Subtypes::BiosRegion;
+                    regionBegins[regionCount] = begin;
+                    regionSizes[regionCount] = regionSize;
+                    regionCount++;
+                }
+            }
+            if (image.subtype == Subtypes::IntelImage && regionSection->PdrLimit) {
+                UINT32 begin = calculateRegionOffset(regionSection->PdrBase);
+                UINT32 regionSize = calculateRegionSize(regionSection->PdrBase, regionSection->PdrLimit);
+                if (begin >= FLASH_DESCRIPTOR_SIZE && regionSize && regionSize <= image.bodySize - begin && begin < image.bodySize
+                    && (begin + regionSize <= regionBegins[0] || begin >= regionBegins[0] + regionSizes[0])) {
+                    regionSubtypes[regionCount] = Subtypes::PdrRegion;
+                    regionBegins[regionCount] = begin;
+                    regionSizes[regionCount] = regionSize;
+                    regionCount++;
+                }
+            }
+        }
+    }
+
+    // Regions are visited in ascending order, as they are added to the tree
+    if (regionCount == 2 && regionBegins[1] < regionBegins[0]) {
+        qSwap(regionSubtypes[0], regionSubtypes[1]);
+        qSwap(regionBegins[0], regionBegins[1]);
+        qSwap(regionSizes[0], regionSizes[1]);
+    }
+
+    UINT8 action = visitor.enter(image);
+    if (action == VISIT_STOP)
+        return ERR_SUCCESS;
+    if (action == VISIT_CONTINUE) {
+        if (image.subtype == Subtypes::IntelImage) {
+            for (int i = 0; i < regionCount; i++) {
+                FfsEvent region;
+                memset(&region, 0, sizeof(region));
+                region.type = Types::Region;
+                region.subtype = regionSubtypes[i];
+                region.compression = COMPRESSION_ALGORITHM_NONE;
+                region.depth = depth + 1;
+                region.inImage = true;
+                region.offset = image.offset + regionBegins[i];
+                region.body = image.body + regionBegins[i];
+                region.bodySize = regionSizes[i];
+
+                action = visitor.enter(region);
+                if (action == VISIT_STOP)
+                    return ERR_SUCCESS;
+                if (action == VISIT_CONTINUE) {
+                    if (visitBios(visitor, region.body, region.bodySize, region.offset, true, depth + 2) == VISIT_STOP)
+                        return ERR_SUCCESS;
+                    visitor.leave(region);
+                }
+            }
+        }
+        else if (visitBios(visitor, image.body, image.bodySize, image.offset, true, depth + 1) == VISIT_STOP)
+            return ERR_SUCCESS;
+        visitor.leave(image);
+    }
+
+    if (capsule.headerSize)
+        visitor.leave(capsule);
+
+    return ERR_SUCCESS;
+}
+
+UINT8 FfsEngine::visitBios(FfsVisitor & visitor, const UINT8* data, const UINT32 size, const UINT32 offset, const bool inImage, const UINT8 depth)
+{
+    const UINT32 signature = *(const UINT32*)EFI_FV_SIGNATURE.constData();
+    UINT32 current = 0;
+    while (current + EFI_FV_SIGNATURE_OFFSET + sizeof(UINT32) <= size) {
+        // Search for the next volume signature
+        UINT32 volumeOffset = current;
+        while (volumeOffset + EFI_FV_SIGNATURE_OFFSET + sizeof(UINT32) <= size
+            && *(const UINT32*)(data + volumeOffset + EFI_FV_SIGNATURE_OFFSET) != signature)
+            volumeOffset++;
+        if (volumeOffset + EFI_FV_SIGNATURE_OFFSET + sizeof(UINT32) > size)
+            break;
+
+        // Skip the signature if volume size is not sane
+        const EFI_FIRMWARE_VOLUME_HEADER* volumeHeader = (const EFI_FIRMWARE_VOLUME_HEADER*)(data + volumeOffset);
+        if (size - volumeOffset < sizeof(EFI_FIRMWARE_VOLUME_HEADER)
+            || volumeHeader->FvLength < sizeof(EFI_FIRMWARE_VOLUME_HEADER)
+            || volumeHeader->FvLength > size - volumeOffset) {
+            current = volumeOffset + 1;
+            continue;
+        }
+
+        UINT32 volumeSize = (UINT32)volumeHeader->FvLength;
+        if (visitVolume(visitor, data + volumeOffset, volumeSize, offset + volumeOffset, inImage, depth) == VISIT_STOP)
+            return VISIT_STOP;
+        current = volumeOffset + volumeSize;
+    }
+
+    return VISIT_CONTINUE;
+}
+
+UINT8 FfsEngine::visitVolume(FfsVisitor & visitor, const UINT8* data, const UINT32 size, const UINT32 offset, const bool inImage, const UINT8 depth)
+{
+    const EFI_FIRMWARE_VOLUME_HEADER* volumeHeader = (const EFI_FIRMWARE_VOLUME_HEADER*)data;
+
+    // Calculate volume header size
+    UINT32 headerSize = volumeHeader->HeaderLength;
+    if (volumeHeader->Revision > 1 && volumeHeader->ExtHeaderOffset
+        && size >= ALIGN8(volumeHeader->ExtHeaderOffset + sizeof(EFI_FIRMWARE_VOLUME_EXT_HEADER))) {
+        const EFI_FIRMWARE_VOLUME_EXT_HEADER* extendedHeader = (const EFI_FIRMWARE_VOLUME_EXT_HEADER*)(data + volumeHeader->ExtHeaderOffset);
+        headerSize = volumeHeader->ExtHeaderOffset + extendedHeader->ExtHeaderSize;
+    }
+    headerSize = ALIGN8(headerSize);
+    if (headerSize > size)
+        headerSize = size;
+
+    FfsEvent event;
+    event.type = Types::Volume;
+    event.subtype = Subtypes::UnknownVolume;
+    if (guidInList(volumeHeader->FileSystemGuid.Data, FFSv2Volumes))
+        event.subtype = Subtypes::Ffs2Volume;
+    else if (guidInList(volumeHeader->FileSystemGuid.Data, FFSv3Volumes))
+        event.subtype = Subtypes::Ffs3Volume;
+    event.compression = COMPRESSION_ALGORITHM_NONE;
+    event.depth = depth;
+    event.inImage = inImage;
+    event.offset = offset;
+    event.header = data;
+    event.headerSize = headerSize;
+    event.body = data + headerSize;
+    event.bodySize = size - headerSize;
+
+    UINT8 action = visitor.enter(event);
+    if (action != VISIT_CONTINUE)
+        return action == VISIT_STOP ? VISIT_STOP : VISIT_CONTINUE;
+
+    // Files of unknown volumes are not parsed
+    if (event.subtype != Subtypes::UnknownVolume) {
+        char empty = volumeHeader->Attributes & EFI_FVB_ERASE_POLARITY ? '\xFF' : '\x00';
+        UINT32 fileOffset = headerSize;
+        while (fileOffset + sizeof(EFI_FFS_FILE_HEADER) <= size) {
+            const EFI_FFS_FILE_HEADER* fileHeader = (const EFI_FFS_FILE_HEADER*)(data + fileOffset);
+            UINT32 fileHeaderSize = sizeof(EFI_FFS_FILE_HEADER);
+            UINT32 fileSize = uint24ToUint32(fileHeader->Size);
+            if (volumeHeader->Revision > 1 && (fileHeader->Attributes & FFS_ATTRIB_LARGE_FILE)) {
+                if (fileOffset + sizeof(EFI_FFS_FILE_HEADER2) > size)
+                    break;
+                fileHeaderSize = sizeof(EFI_FFS_FILE_HEADER2);
+                fileSize = (UINT32)((const EFI_FFS_FILE_HEADER2*)fileHeader)->ExtendedSize;
+            }
+
+            // Free space or non-UEFI data ends the files
+            if (isEmptyData((const UINT8*)fileHeader, fileHeaderSize, empty)
+                || fileSize < fileHeaderSize || fileSize > size - fileOffset)
+                break;
+
+            if (visitFile(visitor, data + fileOffset, fileSize, volumeHeader->Revision, empty, offset + fileOffset, inImage, depth + 1) == VISIT_STOP)
+                return VISIT_STOP;
+            fileOffset = ALIGN8(fileOffset + fileSize);
+        }
+    }
+
+    visitor.leave(event);
+    return VISIT_CONTINUE;
+}
+
+UINT8 FfsEngine::visitFile(FfsVisitor & visitor, const UINT8* data, const UINT32 size, const UINT8 revision, const char empty, const UINT32 offset, const bool inImage, const UINT8 depth)
+{
+    const EFI_FFS_FILE_HEADER* fileHeader = (const EFI_FFS_FILE_HEADER*)data;
+    UINT32 headerSize = sizeof(EFI_FFS_FILE_HEADER);
+    if (revision > 1 && (fileHeader->Attributes & FFS_ATTRIB_LARGE_FILE))
+        headerSize = sizeof(EFI_FFS_FILE_HEADER2);
+
+    // Tail is not a part of file body
+    UINT32 bodySize = size - headerSize;
+    if (revision == 1 && (fileHeader->Attributes & FFS_ATTRIB_TAIL_PRESENT) && bodySize >= sizeof(UINT16))
+        bodySize -= sizeof(UINT16);
+
+    FfsEvent event;
+    event.type = Types::File;
+    event.subtype = fileHeader->Type;
+    event.compression = COMPRESSION_ALGORITHM_NONE;
+    event.depth = depth;
+    event.inImage = inImage;
+    event.offset = offset;
+    event.header = data;
+    event.headerSize = headerSize;
+    event.body = data + headerSize;
+    event.bodySize = bodySize;
+
+    UINT8 action = visitor.enter(event);
+    if (action != VISIT_CONTINUE)
+        return action == VISIT_STOP ? VISIT_STOP : VISIT_CONTINUE;
+
+    // Empty files, pad files and files of unknown types have no children
+    if (!isEmptyData(event.body, bodySize, empty)) {
+        UINT32 bodyOffset = offset + headerSize;
+        switch (fileHeader->Type) {
+        case EFI_FV_FILETYPE_ALL:
+        case EFI_FV_FILETYPE_RAW:
+            if (visitBios(visitor, event.body, bodySize, bodyOffset, inImage, depth + 1) == VISIT_STOP)
+                return VISIT_STOP;
+            break;
+        case EFI_FV_FILETYPE_FREEFORM:
+        case EFI_FV_FILETYPE_SECURITY_CORE:
+        case EFI_FV_FILETYPE_PEI_CORE:
+        case EFI_FV_FILETYPE_DXE_CORE:
+        case EFI_FV_FILETYPE_PEIM:
+        case EFI_FV_FILETYPE_DRIVER:
+        case EFI_FV_FILETYPE_COMBINED_PEIM_DRIVER:
+        case EFI_FV_FILETYPE_APPLICATION:
+        case EFI_FV_FILETYPE_SMM:
+        case EFI_FV_FILETYPE_FIRMWARE_VOLUME_IMAGE:
+        case EFI_FV_FILETYPE_COMBINED_SMM_DXE:
+        case EFI_FV_FILETYPE_SMM_CORE:
+        case EFI_FV_FILETYPE_SMM_STANDALONE:
+        case EFI_FV_FILETYPE_SMM_CORE_STANDALONE:
+            if (visitSections(visitor, event.body, bodySize, bodyOffset, inImage, depth + 1) == VISIT_STOP)
+                return VISIT_STOP;
+            break;
+        default:
+            break;
+        }
+    }
+
+    visitor.leave(event);
+    return VISIT_CONTINUE;
+}
+
+UINT8 FfsEngine::visitSections(FfsVisitor & visitor, const UINT8* data, const UINT32 size, const UINT32 offset, const bool inImage, const UINT8 depth)
+{
+    UINT32 sectionOffset = 0;
+    while (sectionOffset + sizeof(EFI_COMMON_SECTION_HEADER) <= size) {
+        const EFI_COMMON_SECTION_HEADER* sectionHeader = (const EFI_COMMON_SECTION_HEADER*)(data + sectionOffset);
+        UINT32 sectionSize = uint24ToUint32(sectionHeader->Size);
+        if (sectionSize == EFI_SECTION2_IS_USED) {
+            if (sectionOffset + sizeof(EFI_COMMON_SECTION_HEADER2) > size)
+                break;
+            sectionSize = ((const EFI_COMMON_SECTION_HEADER2*)sectionHeader)->ExtendedSize;
+        }
+        if (sectionSize < sizeof(EFI_COMMON_SECTION_HEADER) || sectionSize > size - sectionOffset)
+            break;
+
+        if (visitSection(visitor, data + sectionOffset, sectionSize, offset + sectionOffset, inImage, depth) == VISIT_STOP)
+            return VISIT_STOP;
+        sectionOffset = ALIGN4(sectionOffset + sectionSize);
+    }
+
+    return VISIT_CONTINUE;
+}
+
+UINT8 FfsEngine::visitSection(FfsVisitor & visitor, const UINT8* data, const UINT32 size, const UINT32 offset, const bool inImage, const UINT8 depth)
+{
+    const EFI_COMMON_SECTION_HEADER* sectionHeader = (const EFI_COMMON_SECTION_HEADER*)data;
+    bool extended = (uint24ToUint32(sectionHeader->Size) == EFI_SECTION2_IS_USED);
+
+    // Fields of compression and GUID-defined section headers are read only if the section is big enough for them
+    const UINT8* guid = NULL;
+    UINT16 attributes = 0;
+    bool valid = true;
+    if (sectionHeader->Type == EFI_SECTION_COMPRESSION)
+        valid = size >= (extended ? sizeof(EFI_COMPRESSION_SECTION2) : sizeof(EFI_COMPRESSION_SECTION));
+    else if (sectionHeader->Type == EFI_SECTION_GUID_DEFINED) {
+        valid = size >= (extended ? sizeof(EFI_GUID_DEFINED_SECTION2) : sizeof(EFI_GUID_DEFINED_SECTION));
+        if (valid) {
+            if (extended) {
+                guid = ((const EFI_GUID_DEFINED_SECTION2*)sectionHeader)->SectionDefinitionGuid.Data;
+                attributes = ((const EFI_GUID_DEFINED_SECTION2*)sectionHeader)->Attributes;
+            }
+            else {
+                guid = ((const EFI_GUID_DEFINED_SECTION*)sectionHeader)->SectionDefinitionGuid.Data;
+                attributes = ((const EFI_GUID_DEFINED_SECTION*)sectionHeader)->Attributes;
+            }
+
+            // Certificate header of signed section follows the section header
+            if (!memcmp(guid, EFI_FIRMWARE_CONTENTS_SIGNED_GUID.constData(), sizeof(EFI_GUID)))
+                valid = size >= (extended ? sizeof(EFI_GUID_DEFINED_SECTION2) : sizeof(EFI_GUID_DEFINED_SECTION)) + sizeof(WIN_CERTIFICATE);
+        }
+    }
+
+    // Truncated sections are reported with common header only and have no children
+    UINT32 headerSize = valid ? sizeOfSectionHeader(sectionHeader)
+        : (extended ? sizeof(EFI_COMMON_SECTION_HEADER2) : sizeof(EFI_COMMON_SECTION_HEADER));
+    if (headerSize > size)
+        headerSize = size;
+
+    // Compression type of the data after the header, if any
+    UINT8 compressionType = EFI_NOT_COMPRESSED;
+    bool hasSections = false;
+    bool hasVolumes = false;
+    switch (sectionHeader->Type) {
+    case EFI_SECTION_COMPRESSION:
+        if (!valid)
+            break;
+        compressionType = extended ? ((const EFI_COMPRESSION_SECTION2*)sectionHeader)->CompressionType
+            : ((const EFI_COMPRESSION_SECTION*)sectionHeader)->CompressionType;
+        hasSections = true;
+        break;
+    case EFI_SECTION_GUID_DEFINED:
+        if (!valid)
+            break;
+        hasSections = true;
+        if (attributes & EFI_GUIDED_SECTION_PROCESSING_REQUIRED) {
+            if (!memcmp(guid, EFI_GUIDED_SECTION_TIANO.constData(), sizeof(EFI_GUID)))
+                compressionType = EFI_STANDARD_COMPRESSION;
+            else if (!memcmp(guid, EFI_GUIDED_SECTION_LZMA.constData(), sizeof(EFI_GUID)))
+                compressionType = EFI_CUSTOMIZED_COMPRESSION;
+            else if (!memcmp(guid, EFI_GUIDED_SECTION_BROTLI.constData(), sizeof(EFI_GUID)))
+                compressionType = EFI_CUSTOMIZED_COMPRESSION_BROTLI;
+            // Certificate of signed section is a part of its header, other sections can't be processed
+            else if (memcmp(guid, EFI_FIRMWARE_CONTENTS_SIGNED_GUID.constData(), sizeof(EFI_GUID)))
+                hasSections = false;
+        }
+        break;
+    case EFI_SECTION_DISPOSABLE:
+        hasSections = true;
+        break;
+    case EFI_SECTION_FIRMWARE_VOLUME_IMAGE:
+    case EFI_SECTION_RAW:
+        hasVolumes = true;
+        break;
+    default:
+        break;
+    }
+
+    FfsEvent event;
+    event.type = Types::Section;
+    event.subtype = sectionHeader->Type;
+    event.compression = compressionType == EFI_NOT_COMPRESSED ? COMPRESSION_ALGORITHM_NONE : COMPRESSION_ALGORITHM_UNKNOWN;
+    event.depth = depth;
+    event.inImage = inImage;
+    event.offset = offset;
+    event.header = data;
+    event.headerSize = headerSize;
+    event.body = data + headerSize;
+    event.bodySize = size - headerSize;
+
+    UINT8 action = visitor.enter(event);
+    if (action != VISIT_CONTINUE)
+        return action == VISIT_STOP ? VISIT_STOP : VISIT_CONTINUE;
+
+    if (hasSections && compressionType != EFI_NOT_COMPRESSED) {
+        if (visitDecompressed(visitor, event.body, event.bodySize, compressionType, depth + 1) == VISIT_STOP)
+            return VISIT_STOP;
+    }
+    else if (hasSections) {
+        if (visitSections(visitor, event.body, event.bodySize, offset + headerSize, inImage, depth + 1) == VISIT_STOP)
+            return VISIT_STOP;
+    }
+    else if (hasVolumes) {
+        if (visitBios(visitor, event.body, event.bodySize, offset + headerSize, inImage, depth + 1) == VISIT_STOP)
+            return VISIT_STOP;
+    }
+
+    visitor.leave(event);
+    return VISIT_CONTINUE;
+}
+
+UINT8 FfsEngine::visitDecompressed(FfsVisitor & visitor, const UINT8* data, const UINT32 size, const UINT8 compressionType, const UINT8 depth)
+{
+    // Decompressed data is the only allocation, it's freed once its sections are visited
+    QByteArray decompressed;
+    if (decompress(QByteArray::fromRawData((const char*)data, size), compressionType, decompressed))
+        return VISIT_CONTINUE;
+
+    return visitSections(visitor, (const UINT8*)decompressed.constData(), decompressed.size(), 0, false, depth);
+}
+
 UINT8 FfsEngine::findNextVolume(const QByteArray & bios, UINT32 volumeOffset, UINT32 & nextVolumeOffset)
 {
     int nextIndex = bios.indexOf(EFI_FV_SIGNATURE, volumeOffset);
@@ -1085,10 +1706,12 @@ UINT8  FfsEngine::parseVolume(const QByteArray & volume, QModelIndex & index, co
             // All the rest is either free space or non-UEFI data
             QByteArray rest = volume.right(volumeSize - fileOffset);
             if (rest.count(empty) == rest.size()) { // It's a free space
-                model->addItem(Types::FreeSpace, 0, COMPRESSION_ALGORITHM_NONE, tr("Volume free space"), "", tr("Full size: %1h (%2)").hexarg(rest.size()).arg(rest.size()), QByteArray(), rest, index);
+                QModelIndex freeIndex = model->addItem(Types::FreeSpace, 0, COMPRESSION_ALGORITHM_NONE, tr("Volume free space"), "", tr("Full size: %1h (%2)").hexarg(rest.size()).arg(rest.size()), QByteArray(), rest, index);
+                model->setOffset(freeIndex, fileOffset - headerSize);
             }
             else { //It's non-UEFI data
                 QModelIndex dataIndex = model->addItem(Types::Padding, Subtypes::DataPadding, COMPRESSION_ALGORITHM_NONE, tr("Non-UEFI data"), "", tr("Full size: %1h (%2)").hexarg(rest.size()).arg(rest.size()), QByteArray(), rest, index);
+                model->setOffset(dataIndex, fileOffset - headerSize);
                 msg(tr("parseVolume: non-UEFI data found in volume's free space"), dataIndex);
             }
             // Exit from loop
@@ -1106,10 +1729,12 @@ UINT8  FfsEngine::parseVolume(const QByteArray & volume, QModelIndex & index, co
                 // All the rest is either free space or non-UEFI data
                 QByteArray rest = volume.right(volumeSize - fileOffset);
                 if (rest.count(empty) == rest.size()) { // It's a free space
-                    model->addItem(Types::FreeSpace, 0, COMPRESSION_ALGORITHM_NONE, tr("Volume free space"), "", tr("Full size: %1h (%2)").hexarg(rest.size()).arg(rest.size()), QByteArray(), rest, index);
+                    QModelIndex freeIndex = model->addItem(Types::FreeSpace, 0, COMPRESSION_ALGORITHM_NONE, tr("Volume free space"), "", tr("Full size: %1h (%2)").hexarg(rest.size()).arg(rest.size()), QByteArray(), rest, index);
+                    model->setOffset(freeIndex, fileOffset - headerSize);
                 }
                 else { //It's non-UEFI data
                     QModelIndex dataIndex = model->addItem(Types::Padding, Subtypes::DataPadding, COMPRESSION_ALGORITHM_NONE, tr("Non-UEFI data"), "", tr("Full size: %1h (%2)").hexarg(rest.size()).arg(rest.size()), QByteArray(), rest, index);
+                    model->setOffset(dataIndex, fileOffset - headerSize);
                     msg(tr("parseVolume: non-UEFI data found in volume's free space"), dataIndex);
                 }
                 // Exit from loop
@@ -1153,16 +1778,19 @@ UINT8  FfsEngine::parseVolume(const QByteArray & volume, QModelIndex & index, co
                 // Add all bytes before as free space...
                 if (i > 0) {
                     QByteArray free = freeSpace.left(i);
-                    model->addItem(Types::FreeSpace, 0, COMPRESSION_ALGORITHM_NONE, tr("Volume free space"), "", tr("Full size: %1h (%2)").hexarg(free.size()).arg(free.size()), QByteArray(), free, index);
+                    QModelIndex freeIndex = model->addItem(Types::FreeSpace, 0, COMPRESSION_ALGORITHM_NONE, tr("Volume free space"), "", tr("Full size: %1h (%2)").hexarg(free.size()).arg(free.size()), QByteArray(), free, index);
+                    model->setOffset(freeIndex, fileOffset - headerSize);
                 }
                 // ... and all bytes after as a padding
                 QByteArray padding = freeSpace.mid(i);
                 QModelIndex dataIndex = model->addItem(Types::Padding, Subtypes::DataPadding, COMPRESSION_ALGORITHM_NONE, tr("Non-UEFI data"), "", tr("Full size: %1h (%2)").hexarg(padding.size()).arg(padding.size()), QByteArray(), padding, index);
+                model->setOffset(dataIndex, fileOffset - headerSize + i);
                 msg(tr("parseVolume: non-UEFI data found in volume's free space"), dataIndex);
             }
             else {
                 // Add free space element
-                model->addItem(Types::FreeSpace, 0, COMPRESSION_ALGORITHM_NONE, tr("Volume free space"), "", tr("Full size: %1h (%2)").hexarg(freeSpace.size()).arg(freeSpace.size()), QByteArray(), freeSpace, index);
+                QModelIndex freeIndex = model->addItem(Types::FreeSpace, 0, COMPRESSION_ALGORITHM_NONE, tr("Volume free space"), "", tr("Full size: %1h (%2)").hexarg(freeSpace.size()).arg(freeSpace.size()), QByteArray(), freeSpace, index);
+                model->setOffset(freeIndex, fileOffset - headerSize);
             }
             break; // Exit from loop
         }
@@ -1189,6 +1817,7 @@ UINT8  FfsEngine::parseVolume(const QByteArray & volume, QModelIndex & index, co
         result = parseFile(file, fileIndex, volumeHeader->Revision, empty == '\xFF' ? ERASE_POLARITY_TRUE : ERASE_POLARITY_FALSE, index);
         if (result && result != ERR_VOLUMES_NOT_FOUND && result != ERR_INVALID_VOLUME)
             msg(tr("parseVolume: FFS file parsing failed with error \"%1\"").arg(errorMessage(result)), index);
+        model->setOffset(fileIndex, fileOffset - headerSize);
 
         // Show messages
         if (msgUnalignedFile)
@@ -1356,6 +1985,7 @@ UINT8 FfsEngine::parseFile(const QByteArray & file, QModelIndex & index, const U
         // ... and all bytes after as a padding
         QByteArray padding = body.mid(i);
         QModelIndex dataIndex = model->addItem(Types::Padding, Subtypes::DataPadding, COMPRESSION_ALGORITHM_NONE, tr("Non-UEFI data"), "", tr("Full size: %1h (%2)").hexarg(padding.size()).arg(padding.size()), QByteArray(), padding, index, mode);
+        model->setOffset(dataIndex, i);
 
         // Show message
         msg(tr("parseFile: non-empty pad-file contents will be destroyed after volume modifications"), dataIndex);
@@ -1419,6 +2049,7 @@ UINT8 FfsEngine::parseSections(const QByteArray & body, const QModelIndex & pare
         // Parse section
         QModelIndex sectionIndex;
         result = parseSection(body.mid(sectionOffset, sectionSize), sectionIndex, parent);
+        model->setOffset(sectionIndex, sectionOffset);
         if (result)
             return result;
 
@@ -1583,7 +2214,10 @@ UINT8 FfsEngine::parseSection(const QByteArray & section, QModelIndex & index, c
         if (!parseCurrentSection)
             msg(tr("parseSection: decompression failed with error \"%1\"").arg(errorMessage(result)), index);
         else { // Parse decompressed data
-            result = parseSections(decompressed, index);
+            // Keep it for body extraction, the data is shared with the decompression cache
+            if (algorithm != COMPRESSION_ALGORITHM_NONE)
+                model->setUncompressedData(index, decompressed);
+            result = parseDecompressedSections(body, compressedSectionHeader->CompressionType, decompressed, index);
             if (result)
                 return result;
         }
@@ -1618,13 +2252,15 @@ UINT8 FfsEngine::parseSection(const QByteArray & section, QModelIndex & index, c
             .hexarg2(guidDefinedSectionHeader->Attributes, 4);
 
         UINT8 algorithm = COMPRESSION_ALGORITHM_NONE;
+        UINT8 compressionType = EFI_NOT_COMPRESSED;
         // Check if section requires processing
         if (guidDefinedSectionHeader->Attributes & EFI_GUIDED_SECTION_PROCESSING_REQUIRED) {
             // Tiano compressed section
             if (QByteArray((const char*)&guidDefinedSectionHeader->SectionDefinitionGuid, sizeof(EFI_GUID)) == EFI_GUIDED_SECTION_TIANO) {
                 algorithm = COMPRESSION_ALGORITHM_UNKNOWN;
+                compressionType = EFI_STANDARD_COMPRESSION;
 
-                result = decompress(body, EFI_STANDARD_COMPRESSION, processed, &algorithm);
+                result = decompress(body, compressionType, processed, &algorithm);
                 if (result)
                     parseCurrentSection = false;
 
@@ -1642,8 +2278,9 @@ UINT8 FfsEngine::parseSection(const QByteArray & section, QModelIndex & index, c
             // LZMA compressed section
             else if (QByteArray((const char*)&guidDefinedSectionHeader->SectionDefinitionGuid, sizeof(EFI_GUID)) == EFI_GUIDED_SECTION_LZMA) {
                 algorithm = COMPRESSION_ALGORITHM_UNKNOWN;
+                compressionType = EFI_CUSTOMIZED_COMPRESSION;
 
-                result = decompress(body, EFI_CUSTOMIZED_COMPRESSION, processed, &algorithm);
+                result = decompress(body, compressionType, processed, &algorithm);
                 if (result)
                     parseCurrentSection = false;
 
@@ -1654,6 +2291,22 @@ UINT8 FfsEngine::parseSection(const QByteArray & section, QModelIndex & index, c
                 else
                     info += tr("\nCompression type: unknown");
             }
+            // Brotli compressed section
+            else if (QByteArray((const char*)&guidDefinedSectionHeader->SectionDefinitionGuid, sizeof(EFI_GUID)) == EFI_GUIDED_SECTION_BROTLI) {
+                algorithm = COMPRESSION_ALGORITHM_UNKNOWN;
+                compressionType = EFI_CUSTOMIZED_COMPRESSION_BROTLI;
+
+                result = decompress(body, compressionType, processed, &algorithm);
+                if (result)
+                    parseCurrentSection = false;
+
+                if (algorithm == COMPRESSION_ALGORITHM_BROTLI) {
+                    info += tr("\nCompression type: Brotli");
+                    info += tr("\nDecompressed size: %1h (%2)").hexarg(processed.length()).arg(processed.length());
+                }
+                else
+                    info += tr("\nCompression type: unknown");
+            }
             // Signed section
             else if (QByteArray((const char*)&guidDefinedSectionHeader->SectionDefinitionGuid, sizeof(EFI_GUID)) == EFI_FIRMWARE_CONTENTS_SIGNED_GUID) {
                 msgSigned = true;
@@ -1749,6 +2402,12 @@ UINT8 FfsEngine::parseSection(const QByteArray & section, QModelIndex & index, c
         if (!parseCurrentSection) {
             msg(tr("parseSection: GUID defined section can not be processed"), index);
         }
+        else if (compressionType != EFI_NOT_COMPRESSED) { // Parse decompressed data
+            model->setUncompressedData(index, processed);
+            result = parseDecompressedSections(body, compressionType, processed, index);
+            if (result)
+                return result;
+        }
         else { // Parse processed data
             result = parseSections(processed, index);
             if (result)
@@ -2300,6 +2959,10 @@ UINT8 FfsEngine::create(const QModelIndex & index, const UINT8 type, const QByte
         // Set action
         model->setAction(fileIndex, action);
 
+        // Check it's GUID on commit
+        if (transactionActive)
+            transactionFiles.append(QPersistentModelIndex(fileIndex));
+
         // Rebase all PEI-files that follow
         rebasePeiFiles(fileIndex);
     }
@@ -2417,6 +3080,12 @@ UINT8 FfsEngine::create(const QModelIndex & index, const UINT8 type, const QByte
 
 void FfsEngine::rebasePeiFiles(const QModelIndex & index)
 {
+    // Inside a transaction PEI files are rebased once on commit
+    if (transactionActive) {
+        transactionRebase.append(QPersistentModelIndex(index));
+        return;
+    }
+
     // Rebase all PE32 and TE sections in PEI-files after modified file
     for (int i = index.row(); i < model->rowCount(index.parent()); i++) {
         // PEI-file
@@ -2520,6 +3189,9 @@ UINT8 FfsEngine::replace(const QModelIndex & index, const QByteArray & object, c
             result = create(index, Types::Section, object.left(headerSize), object.right(object.size() - headerSize), CREATE_MODE_AFTER, Actions::Replace);
         }
         else if (mode == REPLACE_MODE_BODY) {
+            // Leaf sections don't need to be created and parsed again
+            if (canReplaceBodyInPlace(index, object))
+                return replaceBodyInPlace(index, object);
             result = create(index, Types::Section, model->header(index), object, CREATE_MODE_AFTER, Actions::Replace, model->compression(index));
         }
         else
@@ -2532,22 +3204,123 @@ UINT8 FfsEngine::replace(const QModelIndex & index, const QByteArray & object, c
     if (result)
         return result;
 
+    // Replacing item takes the place of the replaced one, fixed files are kept there
+    QModelIndex replacing = index.sibling(index.row() + 1, 0);
+    if (replacing.isValid() && model->action(replacing) == Actions::Replace)
+        model->setOffset(replacing, model->offset(index));
+
     // Set remove action to replaced item
     model->setAction(index, Actions::Remove);
 
     return ERR_SUCCESS;
 }
 
-UINT8 FfsEngine::extract(const QModelIndex & index, QByteArray & extracted, const UINT8 mode)
+bool FfsEngine::canReplaceBodyInPlace(const QModelIndex & index, const QByteArray & body)
+{
+    if (model->type(index) != Types::Section || model->rowCount(index) || model->action(index) == Actions::Remove)
+        return false;
+
+    if (model->compression(index) != COMPRESSION_ALGORITHM_NONE)
+        return false;
+
+    switch (model->subtype(index)) {
+    case EFI_SECTION_PE32:
+    case EFI_SECTION_TE:
+    case EFI_SECTION_PIC:
+    case EFI_SECTION_RAW:
+    case EFI_SECTION_USER_INTERFACE:
+        break;
+    default:
+        return false;
+    }
+
+    // Large sections are not supported by create either
+    QByteArray header = model->header(index);
+    if ((UINT32)header.size() < sizeof(EFI_COMMON_SECTION_HEADER))
+        return false;
+    const EFI_COMMON_SECTION_HEADER* commonHeader = (const EFI_COMMON_SECTION_HEADER*)header.constData();
+    if (uint24ToUint32(commonHeader->Size) == EFI_SECTION2_IS_USED)
+        return false;
+    return (UINT32)(header.size() + body.size()) < EFI_SECTION2_IS_USED;
+}
+
+UINT8 FfsEngine::replaceBodyInPlace(const QModelIndex & index, const QByteArray & body)
+{
+    // Correct section size
+    QByteArray header = model->header(index);
+    EFI_COMMON_SECTION_HEADER* commonHeader = (EFI_COMMON_SECTION_HEADER*)header.data();
+    UINT32 size = header.size() + body.size();
+    uint32ToUint24(size, commonHeader->Size);
+    model->setHeader(index, header);
+    model->setBody(index, body);
+
+    // Only standard info is updated, file sizes and checksums are corrected on reconstruction
+    QString info = tr("Type: %1h\nFull size: %2h (%3)\nHeader size: %4h (%5)\nBody size: %6h (%7)")
+        .hexarg2(commonHeader->Type, 2)
+        .hexarg(size).arg(size)
+        .hexarg(header.size()).arg(header.size())
+        .hexarg(body.size()).arg(body.size());
+
+    QModelIndex fileIndex = model->findParentOfType(index, Types::File);
+    if (commonHeader->Type == EFI_SECTION_USER_INTERFACE) {
+        QString text = QString::fromUtf16((const ushort*)body.constData(), body.size() / 2);
+        int end = text.indexOf(QChar(0));
+        if (end >= 0)
+            text.truncate(end);
+        info += tr("\nText: %1").arg(text);
+        model->setText(fileIndex, text);
+    }
+    else if (commonHeader->Type == EFI_SECTION_RAW) {
+        // New body may contain volumes, it's parsed only when expanded
+        QByteArray fileGuid = model->header(fileIndex).left(sizeof(EFI_GUID));
+        model->setPendingParse(index, fileGuid != EFI_PEI_APRIORI_FILE_GUID && fileGuid != EFI_DXE_APRIORI_FILE_GUID);
+    }
+    model->setInfo(index, info);
+
+    // Keep actions of new items
+    UINT8 action = model->action(index);
+    if (action != Actions::Insert && action != Actions::Create && action != Actions::Replace)
+        model->setAction(index, Actions::Replace);
+
+    // Rebase all PEI-files that follow
+    rebasePeiFiles(fileIndex);
+
+    return ERR_SUCCESS;
+}
+
+void FfsEngine::parsePending(const QModelIndex & index)
+{
+    if (!model->pendingParse(index))
+        return;
+    model->setPendingParse(index, false);
+
+    // Parse section body as BIOS space
+    UINT8 result = parseBios(model->body(index), index);
+    if (result && result != ERR_VOLUMES_NOT_FOUND && result != ERR_INVALID_VOLUME)
+        msg(tr("parsePending: parsing raw section as BIOS failed with error \"%1\"").arg(errorMessage(result)), index);
+}
+
+void FfsEngine::parseAllPending(const QModelIndex & index)
+{
+    parsePending(index);
+    for (int i = 0; i < model->rowCount(index); i++)
+        parseAllPending(model->index(i, 0, index));
+}
+
+UINT8 FfsEngine::extractParts(const QModelIndex & index, const UINT8 mode, QByteArray & header, QByteArray & body, QByteArray & tail)
 {
     if (!index.isValid())
         return ERR_INVALID_PARAMETER;
 
+    // All parts share data with the tree, nothing is copied here
+    header.clear();
+    body.clear();
+    tail.clear();
+
     if (mode == EXTRACT_MODE_AS_IS) {
         // Extract as is, with header and body
-        extracted.clear();
-        extracted.append(model->header(index));
-        extracted.append(model->body(index));
+        header = model->header(index);
+        body = model->body(index);
         if (model->type(index) == Types::File) {
             UINT8 revision = 2;
             QModelIndex parent = model->parent(index);
@@ -2556,48 +3329,33 @@ UINT8 FfsEngine::extract(const QModelIndex & index, QByteArray & extracted, cons
                 revision = volumeHeader->Revision;
             }
 
-            const EFI_FFS_FILE_HEADER* fileHeader = (const EFI_FFS_FILE_HEADER*)model->header(index).constData();
+            const EFI_FFS_FILE_HEADER* fileHeader = (const EFI_FFS_FILE_HEADER*)header.constData();
             if (revision == 1 && fileHeader->Attributes & FFS_ATTRIB_TAIL_PRESENT) {
                 UINT8 ht = ~fileHeader->IntegrityCheck.Checksum.Header;
                 UINT8 ft = ~fileHeader->IntegrityCheck.Checksum.File;
-                extracted.append(ht).append(ft);
+                tail.append(ht).append(ft);
             }
         }
     }
     else if (mode == EXTRACT_MODE_BODY) {
         // Extract without header and tail
-        extracted.clear();
-        // Special case of compressed bodies
+        // Special case of compressed bodies, they are extracted decompressed
+        // Decompressed data and the algorithm were kept when the section was parsed
         if (model->type(index) == Types::Section) {
-            QByteArray decompressed;
-            UINT8 result;
-            if (model->subtype(index) == EFI_SECTION_COMPRESSION) {
-                const EFI_COMPRESSION_SECTION* compressedHeader = (const EFI_COMPRESSION_SECTION*)model->header(index).constData();
-                result = decompress(model->body(index), compressedHeader->CompressionType, decompressed);
-                if (result)
-                    return result;
-                extracted.append(decompressed);
+            switch (model->compression(index)) {
+            case COMPRESSION_ALGORITHM_EFI11:
+            case COMPRESSION_ALGORITHM_TIANO:
+            case COMPRESSION_ALGORITHM_LZMA:
+            case COMPRESSION_ALGORITHM_IMLZMA:
+            case COMPRESSION_ALGORITHM_BROTLI:
+                body = model->uncompressedData(index);
                 return ERR_SUCCESS;
-            }
-            else if (model->subtype(index) == EFI_SECTION_GUID_DEFINED) {
-                QByteArray decompressed;
-                // Check if section requires processing
-                const EFI_GUID_DEFINED_SECTION* guidDefinedSectionHeader = (const EFI_GUID_DEFINED_SECTION*)model->header(index).constData();
-                if (guidDefinedSectionHeader->Attributes & EFI_GUIDED_SECTION_PROCESSING_REQUIRED) {
-                    // Try to decompress section body using both known compression algorithms
-                    result = decompress(model->body(index), EFI_STANDARD_COMPRESSION, decompressed);
-                    if (result) {
-                        result = decompress(model->body(index), EFI_CUSTOMIZED_COMPRESSION, decompressed);
-                        if (result)
-                            return result;
-                    }
-                    extracted.append(decompressed);
-                    return ERR_SUCCESS;
-                }
+            case COMPRESSION_ALGORITHM_UNKNOWN:
+                return ERR_UNKNOWN_COMPRESSION_ALGORITHM;
             }
         }
 
-        extracted.append(model->body(index));
+        body = model->body(index);
     }
     else
         return ERR_UNKNOWN_EXTRACT_MODE;
@@ -2605,38 +3363,101 @@ UINT8 FfsEngine::extract(const QModelIndex & index, QByteArray & extracted, cons
     return ERR_SUCCESS;
 }
 
-UINT8 FfsEngine::remove(const QModelIndex & index)
+UINT8 FfsEngine::extract(const QModelIndex & index, QByteArray & extracted, const UINT8 mode)
 {
-    if (!index.isValid())
-        return ERR_INVALID_PARAMETER;
-
-    // Set action for the item
-    model->setAction(index, Actions::Remove);
-
-    QModelIndex fileIndex;
+    QByteArray header, body, tail;
+    UINT8 result = extractParts(index, mode, header, body, tail);
+    if (result)
+        return result;
 
-    if (model->type(index) == Types::Volume && model->rowCount(index) > 0)
-        fileIndex = index.child(0, 0);
-    else if (model->type(index) == Types::File)
-        fileIndex = index;
-    else if (model->type(index) == Types::Section)
-        fileIndex = model->findParentOfType(index, Types::File);
-    else
+    // Body alone is returned without a copy
+    if (header.isEmpty() && tail.isEmpty()) {
+        extracted = body;
         return ERR_SUCCESS;
+    }
 
-    // Rebase all PEI-files that follow
-    rebasePeiFiles(fileIndex);
-
+    extracted.clear();
+    extracted.reserve(header.size() + body.size() + tail.size());
+    extracted.append(header).append(body).append(tail);
     return ERR_SUCCESS;
 }
 
-UINT8 FfsEngine::rebuild(const QModelIndex & index)
+UINT8 FfsEngine::extract(const QModelIndex & index, QIODevice & device, const UINT8 mode)
 {
-    if (!index.isValid())
-        return ERR_INVALID_PARAMETER;
-
-    // Set action for the item
-    model->setAction(index, Actions::Rebuild);
+    if (!device.isOpen() || !device.isWritable())
+        return ERR_FILE_WRITE;
+
+    QByteArray header, body, tail;
+    UINT8 result = extractParts(index, mode, header, body, tail);
+    if (result)
+        return result;
+
+    result = writeChunked(device, header);
+    if (result)
+        return result;
+    result = writeChunked(device, body);
+    if (result)
+        return result;
+    return writeChunked(device, tail);
+}
+
+UINT8 FfsEngine::writeChunked(QIODevice & device, const QByteArray & data)
+{
+    // Write in chunks and wait for sequential devices to drain,
+    // so their write buffers never hold a copy of the whole item
+    const qint64 chunkSize = 0x100000;
+    const char* current = data.constData();
+    qint64 rest = data.size();
+    while (rest > 0) {
+        qint64 written = device.write(current, rest < chunkSize ? rest : chunkSize);
+        if (written <= 0)
+            return ERR_FILE_WRITE;
+        current += written;
+        rest -= written;
+
+        if (device.isSequential()) {
+            while (device.bytesToWrite() > 0) {
+                if (!device.waitForBytesWritten(-1))
+                    return ERR_FILE_WRITE;
+            }
+        }
+    }
+
+    return ERR_SUCCESS;
+}
+
+UINT8 FfsEngine::remove(const QModelIndex & index)
+{
+    if (!index.isValid())
+        return ERR_INVALID_PARAMETER;
+
+    // Set action for the item
+    model->setAction(index, Actions::Remove);
+
+    QModelIndex fileIndex;
+
+    if (model->type(index) == Types::Volume && model->rowCount(index) > 0)
+        fileIndex = index.child(0, 0);
+    else if (model->type(index) == Types::File)
+        fileIndex = index;
+    else if (model->type(index) == Types::Section)
+        fileIndex = model->findParentOfType(index, Types::File);
+    else
+        return ERR_SUCCESS;
+
+    // Rebase all PEI-files that follow
+    rebasePeiFiles(fileIndex);
+
+    return ERR_SUCCESS;
+}
+
+UINT8 FfsEngine::rebuild(const QModelIndex & index)
+{
+    if (!index.isValid())
+        return ERR_INVALID_PARAMETER;
+
+    // Set action for the item
+    model->setAction(index, Actions::Rebuild);
 
     QModelIndex fileIndex;
 
@@ -2655,8 +3476,356 @@ UINT8 FfsEngine::rebuild(const QModelIndex & index)
     return ERR_SUCCESS;
 }
 
+UINT8 FfsEngine::defragment(const QModelIndex & index)
+{
+    if (!index.isValid() || model->type(index) != Types::Volume)
+        return ERR_INVALID_PARAMETER;
+
+    if (model->subtype(index) != Subtypes::Ffs2Volume && model->subtype(index) != Subtypes::Ffs3Volume) {
+        msg(tr("defragment: only FFSv2 and FFSv3 volumes can be defragmented"), index);
+        return ERR_INVALID_VOLUME;
+    }
+
+    if (model->action(index) == Actions::Remove)
+        return ERR_INVALID_PARAMETER;
+
+    UINT32 usedBefore = estimateVolumeUsedSize(index);
+
+    // Pad files are removed, reconstruction merges free space at the end of the volume
+    // and makes single pad files only where needed for alignment and fixed files
+    QModelIndex firstPad;
+    UINT32 count = 0;
+    for (int i = 0; i < model->rowCount(index); i++) {
+        QModelIndex current = index.child(i, 0);
+        if (model->type(current) != Types::File || model->subtype(current) != EFI_FV_FILETYPE_PAD)
+            continue;
+        if (model->action(current) == Actions::Remove || model->rowCount(current))
+            continue;
+
+        model->setAction(current, Actions::Remove);
+        if (!firstPad.isValid())
+            firstPad = current;
+        count++;
+    }
+
+    if (!count) {
+        msg(tr("defragment: no pad files found"), index);
+        return ERR_SUCCESS;
+    }
+
+    // Files after the first pad can move, keep PEI files valid for XIP
+    rebasePeiFiles(firstPad);
+
+    UINT32 usedAfter = estimateVolumeUsedSize(index);
+    msg(tr("defragment: %1 pad file(s) removed, %2h (%3) byte(s) of free space regained")
+        .arg(count)
+        .hexarg(usedBefore > usedAfter ? usedBefore - usedAfter : 0)
+        .arg(usedBefore > usedAfter ? usedBefore - usedAfter : 0), index);
+    return ERR_SUCCESS;
+}
+
+UINT8 FfsEngine::compact(const QModelIndex & index)
+{
+    // Items created by a transaction can be deleted by its rollback only
+    if (transactionActive)
+        return ERR_INVALID_PARAMETER;
+
+    // Find topmost removed items first, indexes of the rest are kept updated while rows are deleted
+    QVector<QPersistentModelIndex> found;
+    findRemovedItems(index, found);
+    if (found.isEmpty())
+        return ERR_SUCCESS;
+
+#ifndef _CONSOLE
+    // Messages about items inside removed subtrees lose their indexes
+    QVector<QPersistentModelIndex> messageIndexes;
+    for (int i = 0; i < messageItems.count(); i++) {
+        QModelIndex current = messageItems.at(i).index();
+        for (QModelIndex parent = current; parent.isValid(); parent = model->parent(parent)) {
+            if (model->action(parent) == Actions::Remove) {
+                current = QModelIndex();
+                break;
+            }
+        }
+        messageIndexes.append(QPersistentModelIndex(current));
+    }
+#endif
+
+    // All items are recorded before any row is deleted, so the paths and offsets are of the same tree
+    QVector<RemovedItem> records;
+    for (int i = 0; i < found.count(); i++) {
+        RemovedItem item;
+        item.path = itemPath(found.at(i));
+        item.type = model->type(found.at(i));
+        item.subtype = model->subtype(found.at(i));
+        item.inImage = model->imageOffset(found.at(i), item.offset);
+        if (!item.inImage)
+            item.offset = 0;
+        item.size = 0;
+
+        // Only the hash is kept, it stays empty if the item can't be reconstructed
+        QByteArray header, body, tail;
+        if (!extractParts(found.at(i), EXTRACT_MODE_AS_IS, header, body, tail)) {
+            QCryptographicHash hash(QCryptographicHash::Sha1);
+            hash.addData(header);
+            hash.addData(body);
+            hash.addData(tail);
+            item.hash = hash.result();
+            item.size = header.size() + body.size() + tail.size();
+        }
+        records.append(item);
+    }
+    removed += records;
+
+    for (int i = 0; i < found.count(); i++)
+        model->removeItem(found.at(i));
+
+#ifndef _CONSOLE
+    for (int i = 0; i < messageItems.count(); i++) {
+        QModelIndex current = messageIndexes.at(i);
+        messageItems[i].setIndex(current);
+    }
+#endif
+
+    return ERR_SUCCESS;
+}
+
+QVector<RemovedItem> FfsEngine::removedItems() const
+{
+    return removed;
+}
+
+UINT8 FfsEngine::extractRemoved(const int i, QByteArray & object) const
+{
+    if (i < 0 || i >= removed.size())
+        return ERR_INVALID_PARAMETER;
+
+    // Items created or changed after opening the image have no data left
+    const RemovedItem & item = removed.at(i);
+    if (!item.inImage || item.hash.isEmpty() || (quint64)item.offset + item.size > (quint64)openedImage.size())
+        return ERR_ITEM_NOT_FOUND;
+
+    QByteArray data = openedImage.mid(item.offset, item.size);
+    if (QCryptographicHash::hash(data, QCryptographicHash::Sha1) != item.hash)
+        return ERR_ITEM_NOT_FOUND;
+
+    object = data;
+    return ERR_SUCCESS;
+}
+
+QString FfsEngine::itemPath(const QModelIndex & index)
+{
+    QString path;
+    for (QModelIndex current = index; current.isValid(); current = model->parent(current)) {
+        QString name = model->text(current).isEmpty() ? model->name(current) : model->text(current);
+        path = path.isEmpty() ? name : name + "/" + path;
+    }
+    return path;
+}
+
+void FfsEngine::findRemovedItems(const QModelIndex & index, QVector<QPersistentModelIndex> & found)
+{
+    if (index.isValid() && model->action(index) == Actions::Remove) {
+        found.append(QPersistentModelIndex(index));
+        return;
+    }
+
+    for (int i = 0; i < model->rowCount(index); i++)
+        findRemovedItems(model->index(i, 0, index), found);
+}
+
+UINT8 FfsEngine::beginTransaction()
+{
+    if (transactionActive)
+        return ERR_INVALID_PARAMETER;
+
+    // New files are checked against GUIDs of files existing before the transaction
+    transactionFileGuids.clear();
+    indexFileGuids(QModelIndex());
+    transactionFiles.clear();
+    transactionRebase.clear();
+    transactionOldPeiCoreEntryPoint = oldPeiCoreEntryPoint;
+    transactionNewPeiCoreEntryPoint = newPeiCoreEntryPoint;
+#ifndef _CONSOLE
+    transactionMessageCount = messageItems.count();
+#endif
+
+    model->startJournal();
+    transactionActive = true;
+    return ERR_SUCCESS;
+}
+
+UINT8 FfsEngine::commitTransaction(QByteArray & reconstructed)
+{
+    if (!transactionActive)
+        return ERR_INVALID_PARAMETER;
+    transactionActive = false;
+
+    UINT8 result = checkTransactionFiles();
+    if (!result) {
+        // Rebase PEI files of every volume once, starting from the first modified file
+        for (int i = 0; i < transactionRebase.count(); i++) {
+            const QPersistentModelIndex & file = transactionRebase.at(i);
+            if (!file.isValid())
+                continue;
+
+            bool first = true;
+            for (int j = 0; j < transactionRebase.count() && first; j++) {
+                const QPersistentModelIndex & other = transactionRebase.at(j);
+                if (j != i && other.isValid() && other.parent() == file.parent()
+                    && (other.row() < file.row() || (other.row() == file.row() && j < i)))
+                    first = false;
+            }
+            if (first)
+                rebasePeiFiles(file);
+        }
+
+        result = reconstructImageFile(reconstructed);
+    }
+
+    if (result) {
+        msg(tr("commitTransaction: all changes are rolled back, error \"%1\"").arg(errorMessage(result)));
+        revertTransaction();
+        return result;
+    }
+
+    model->stopJournal();
+    transactionFileGuids.clear();
+    transactionFiles.clear();
+    transactionRebase.clear();
+    return ERR_SUCCESS;
+}
+
+void FfsEngine::rollbackTransaction()
+{
+    if (!transactionActive)
+        return;
+
+    transactionActive = false;
+    revertTransaction();
+}
+
+void FfsEngine::revertTransaction()
+{
+#ifndef _CONSOLE
+    // Messages added by the transaction can refer to items being deleted
+    QVector<QPersistentModelIndex> messageIndexes;
+    for (int i = 0; i < messageItems.count(); i++)
+        messageIndexes.append(i < transactionMessageCount ? QPersistentModelIndex(messageItems.at(i).index()) : QPersistentModelIndex());
+#endif
+
+    model->revertJournal();
+    oldPeiCoreEntryPoint = transactionOldPeiCoreEntryPoint;
+    newPeiCoreEntryPoint = transactionNewPeiCoreEntryPoint;
+
+#ifndef _CONSOLE
+    for (int i = 0; i < messageItems.count(); i++) {
+        QModelIndex current = messageIndexes.at(i);
+        messageItems[i].setIndex(current);
+    }
+#endif
+
+    transactionFileGuids.clear();
+    transactionFiles.clear();
+    transactionRebase.clear();
+}
+
+void FfsEngine::indexFileGuids(const QModelIndex & index)
+{
+    if (model->type(index) == Types::File)
+        transactionFileGuids.insert(model->header(index).left(sizeof(EFI_GUID)), QPersistentModelIndex(index));
+
+    for (int i = 0; i < model->rowCount(index); i++)
+        indexFileGuids(model->index(i, 0, index));
+}
+
+UINT8 FfsEngine::checkTransactionFiles()
+{
+    // A volume can't have two files with the same GUID, except pad files
+    for (int i = 0; i < transactionFiles.count(); i++) {
+        const QPersistentModelIndex & file = transactionFiles.at(i);
+        if (!file.isValid() || model->action(file) == Actions::Remove || model->subtype(file) == EFI_FV_FILETYPE_PAD)
+            continue;
+
+        QByteArray guid = model->header(file).left(sizeof(EFI_GUID));
+        QList<QPersistentModelIndex> others = transactionFileGuids.values(guid);
+        for (int j = 0; j < others.count(); j++) {
+            const QPersistentModelIndex & other = others.at(j);
+            if (other.isValid() && other != file && other.parent() == file.parent()
+                && model->action(other) != Actions::Remove) {
+                msg(tr("commitTransaction: file with GUID %1 already exists in the volume").arg(guidToQString(*(const EFI_GUID*)guid.constData())), file);
+                return ERR_DUPLICATE_FILE_GUID;
+            }
+        }
+
+        // Files created later are checked against this one too
+        transactionFileGuids.insert(guid, file);
+    }
+
+    return ERR_SUCCESS;
+}
+
 // Compression routines
 UINT8 FfsEngine::decompress(const QByteArray & compressedData, const UINT8 compressionType, QByteArray & decompressedData, UINT8 * algorithm)
+{
+    if (!decompressionCacheEnabled)
+        return decompressPayload(compressedData, compressionType, decompressedData, algorithm);
+
+    // Return the result of previous decompression of the same data, decompressed data is shared
+    const DecompressionCacheKey key(compressionType, compressedData);
+    QHash<DecompressionCacheKey, DecompressedPayload>::const_iterator cached = decompressionCache.constFind(key);
+    if (cached == decompressionCache.constEnd()) {
+        DecompressedPayload payload;
+        payload.algorithm = COMPRESSION_ALGORITHM_UNKNOWN;
+        payload.result = decompressPayload(compressedData, compressionType, payload.data, &payload.algorithm);
+        payload.fileTextChanged = false;
+        cached = decompressionCache.insert(key, payload);
+    }
+
+    if (algorithm)
+        *algorithm = cached->algorithm;
+    if (cached->result == ERR_SUCCESS)
+        decompressedData = cached->data;
+    return cached->result;
+}
+
+UINT8 FfsEngine::parseDecompressedSections(const QByteArray & compressed, const UINT8 compressionType, const QByteArray & decompressed, const QModelIndex & index)
+{
+    if (!decompressionCacheEnabled)
+        return parseSections(decompressed, index);
+
+    // Parsing of sections depends on the file they are in,
+    // so the subtree is only copied to a section in a file with the same GUID and type
+    QModelIndex file = model->findParentOfType(index, Types::File);
+    QByteArray fileKey = model->header(file).left(sizeof(EFI_GUID)).append((char)model->subtype(file));
+
+    const DecompressionCacheKey key(compressionType, compressed);
+    QHash<DecompressionCacheKey, DecompressedPayload>::iterator payload = decompressionCache.find(key);
+    if (payload != decompressionCache.end() && payload->parsed.isValid() && payload->parsedFile == fileKey) {
+        model->copyChildren(payload->parsed, index);
+        if (payload->fileTextChanged)
+            model->setText(file, payload->fileText);
+        return ERR_SUCCESS;
+    }
+
+    QString fileText = model->text(file);
+    UINT8 result = parseSections(decompressed, index);
+    if (result)
+        return result;
+
+    // Nested parsing could have rehashed the cache, so search for the payload again
+    payload = decompressionCache.find(key);
+    if (payload != decompressionCache.end() && !payload->parsed.isValid()) {
+        payload->parsed = index;
+        payload->parsedFile = fileKey;
+        payload->fileText = model->text(file);
+        payload->fileTextChanged = (payload->fileText != fileText);
+    }
+
+    return ERR_SUCCESS;
+}
+
+UINT8 FfsEngine::decompressPayload(const QByteArray & compressedData, const UINT8 compressionType, QByteArray & decompressedData, UINT8 * algorithm)
 {
     const UINT8* data;
     UINT32 dataSize;
@@ -2768,6 +3937,35 @@ UINT8 FfsEngine::decompress(const QByteArray & compressedData, const UINT8 compr
 
         delete[] decompressed;
         return ERR_SUCCESS;
+    case EFI_CUSTOMIZED_COMPRESSION_BROTLI:
+        // Get buffer sizes
+        data = (const UINT8*)compressedData.constData();
+        dataSize = compressedData.size();
+
+        // Get info
+        if (ERR_SUCCESS != BrotliGetInfo(data, dataSize, &decompressedSize, NULL))
+            return ERR_CUSTOMIZED_DECOMPRESSION_FAILED;
+
+        // Decoded size comes from the section itself, so it must fit into QByteArray before anything is written
+        if (decompressedSize > INT_MAX)
+            return ERR_CUSTOMIZED_DECOMPRESSION_FAILED;
+        decompressedData.resize((int)decompressedSize);
+        if (decompressedData.size() != (int)decompressedSize) {
+            decompressedData.clear();
+            return ERR_CUSTOMIZED_DECOMPRESSION_FAILED;
+        }
+
+        // Decompress section data directly into the resulting array
+        if (ERR_SUCCESS != BrotliDecompress(data, dataSize, decompressedData.data(), (UINT32)decompressedData.size())) {
+            if (algorithm)
+                *algorithm = COMPRESSION_ALGORITHM_UNKNOWN;
+            decompressedData.clear();
+            return ERR_CUSTOMIZED_DECOMPRESSION_FAILED;
+        }
+
+        if (algorithm)
+            *algorithm = COMPRESSION_ALGORITHM_BROTLI;
+        return ERR_SUCCESS;
     default:
         msg(tr("decompress: unknown compression type %1").arg(compressionType));
         if (algorithm)
@@ -2776,6 +3974,54 @@ UINT8 FfsEngine::decompress(const QByteArray & compressedData, const UINT8 compr
     }
 }
 
+// Tiano/EFI 1.1 compressor contexts of a thread, reused by all compress calls made on it
+class TianoCompressContexts
+{
+public:
+    TianoCompressContexts() : current(TianoCompressCreateContext()), legacy(TianoCompressLegacyCreateContext()) {}
+    ~TianoCompressContexts() { TianoCompressFreeContext(current); TianoCompressLegacyFreeContext(legacy); }
+
+    TIANO_COMPRESS_CONTEXT* current;
+    TIANO_COMPRESS_LEGACY_CONTEXT* legacy;
+};
+
+static QThreadStorage<TianoCompressContexts*> tianoCompressContexts;
+
+static EFI_STATUS tianoCompressWithContext(const UINT8 algorithm, const bool legacy, const UINT8 preset, const QByteArray & data, QByteArray & compressedData, UINT32 & compressedSize)
+{
+    if (!tianoCompressContexts.hasLocalData())
+        tianoCompressContexts.setLocalData(new TianoCompressContexts);
+    TianoCompressContexts* contexts = tianoCompressContexts.localData();
+    TianoCompressSetPreset(contexts->current, preset);
+
+    if (algorithm == COMPRESSION_ALGORITHM_EFI11)
+        return legacy ? EfiCompressLegacyWithContext(contexts->legacy, data.constData(), data.size(), compressedData.data(), &compressedSize)
+                      : EfiCompressWithContext(contexts->current, data.constData(), data.size(), compressedData.data(), &compressedSize);
+    return legacy ? TianoCompressLegacyWithContext(contexts->legacy, data.constData(), data.size(), compressedData.data(), &compressedSize)
+                  : TianoCompressWithContext(contexts->current, data.constData(), data.size(), compressedData.data(), &compressedSize);
+}
+
+// Compresses data with Tiano/EFI 1.1 compression in a single encoding pass
+// The output buffer is preallocated to EFI_TIANO_COMPRESS_BOUND, so the size query call is only needed if that estimate is exceeded
+static UINT8 tianoCompress(const UINT8 algorithm, const bool legacy, const UINT8 preset, const QByteArray & data, QByteArray & compressedData)
+{
+    UINT32 compressedSize = EFI_TIANO_COMPRESS_BOUND(data.size());
+    compressedData.resize(compressedSize);
+    EFI_STATUS result = tianoCompressWithContext(algorithm, legacy, preset, data, compressedData, compressedSize);
+    if (result == EFI_BUFFER_TOO_SMALL) {
+        // compressedSize now holds the exact size needed
+        compressedData.resize(compressedSize);
+        result = tianoCompressWithContext(algorithm, legacy, preset, data, compressedData, compressedSize);
+    }
+    if (result != EFI_SUCCESS) {
+        compressedData.clear();
+        return ERR_STANDARD_COMPRESSION_FAILED;
+    }
+
+    compressedData.resize(compressedSize);
+    return ERR_SUCCESS;
+}
+
 UINT8 FfsEngine::compress(const QByteArray & data, const UINT8 algorithm, QByteArray & compressedData)
 {
     UINT8* compressed;
@@ -2788,88 +4034,42 @@ UINT8 FfsEngine::compress(const QByteArray & data, const UINT8 algorithm, QByteA
     }
         break;
     case COMPRESSION_ALGORITHM_EFI11:
-    {
-        // Try legacy function first
-        UINT32 compressedSize = 0;
-        if (EfiCompressLegacy(data.constData(), data.size(), NULL, &compressedSize) != ERR_BUFFER_TOO_SMALL)
-            return ERR_STANDARD_COMPRESSION_FAILED;
-        compressed = new UINT8[compressedSize];
-        if (EfiCompressLegacy(data.constData(), data.size(), compressed, &compressedSize) != ERR_SUCCESS) {
-            delete[] compressed;
-            return ERR_STANDARD_COMPRESSION_FAILED;
-        }
-        compressedData = QByteArray((const char*)compressed, compressedSize);
-
-        // Check that compressed data can be decompressed normally
-        QByteArray decompressed;
-        if (decompress(compressedData, EFI_STANDARD_COMPRESSION, decompressed, NULL) == ERR_SUCCESS
-            && decompressed == data) {
-            delete[] compressed;
-            return ERR_SUCCESS;
-        }
-        delete[] compressed;
-
-        // Legacy function failed, use current one
-        compressedSize = 0;
-        if (EfiCompress(data.constData(), data.size(), NULL, &compressedSize) != ERR_BUFFER_TOO_SMALL)
-            return ERR_STANDARD_COMPRESSION_FAILED;
-        compressed = new UINT8[compressedSize];
-        if (EfiCompress(data.constData(), data.size(), compressed, &compressedSize) != ERR_SUCCESS) {
-            delete[] compressed;
-            return ERR_STANDARD_COMPRESSION_FAILED;
-        }
-        compressedData = QByteArray((const char*)compressed, compressedSize);
-
-        // New functions will be trusted here, because another check will reduce performance
-        delete[] compressed;
-        return ERR_SUCCESS;
-    }
-        break;
     case COMPRESSION_ALGORITHM_TIANO:
     {
+        // Fast preset skips the slower legacy function and uses hash chain match finder of the current one
+        if (compressionPreset == COMPRESSION_PRESET_FAST)
+            return tianoCompress(algorithm, false, compressionPreset, data, compressedData);
+
         // Try legacy function first
-        UINT32 compressedSize = 0;
-        if (TianoCompressLegacy(data.constData(), data.size(), NULL, &compressedSize) != ERR_BUFFER_TOO_SMALL)
-            return ERR_STANDARD_COMPRESSION_FAILED;
-        compressed = new UINT8[compressedSize];
-        if (TianoCompressLegacy(data.constData(), data.size(), compressed, &compressedSize) != ERR_SUCCESS) {
-            delete[] compressed;
+        if (tianoCompress(algorithm, true, compressionPreset, data, compressedData) != ERR_SUCCESS)
             return ERR_STANDARD_COMPRESSION_FAILED;
-        }
-        compressedData = QByteArray((const char*)compressed, compressedSize);
 
         // Check that compressed data can be decompressed normally
         QByteArray decompressed;
-        if (decompress(compressedData, EFI_STANDARD_COMPRESSION, decompressed, NULL) == ERR_SUCCESS
-            && decompressed == data) {
-            delete[] compressed;
+        bool legacyValid = (decompress(compressedData, EFI_STANDARD_COMPRESSION, decompressed, NULL) == ERR_SUCCESS
+            && decompressed == data);
+        if (legacyValid && compressionPreset != COMPRESSION_PRESET_MAX)
             return ERR_SUCCESS;
-        }
-        delete[] compressed;
 
-        // Legacy function failed, use current one
-        compressedSize = 0;
-        if (TianoCompress(data.constData(), data.size(), NULL, &compressedSize) != ERR_BUFFER_TOO_SMALL)
-            return ERR_STANDARD_COMPRESSION_FAILED;
-        compressed = new UINT8[compressedSize];
-        if (TianoCompress(data.constData(), data.size(), compressed, &compressedSize) != ERR_SUCCESS) {
-            delete[] compressed;
+        // Legacy function failed or max preset is used, try current one with its optimal parser
+        // New functions will be trusted here, because another check will reduce performance
+        QByteArray current;
+        if (tianoCompress(algorithm, false, compressionPreset, data, current) != ERR_SUCCESS)
             return ERR_STANDARD_COMPRESSION_FAILED;
-        }
-        compressedData = QByteArray((const char*)compressed, compressedSize);
 
-        // New functions will be trusted here, because another check will reduce performance
-        delete[] compressed;
+        // Keep the smaller one of valid results
+        if (!legacyValid || current.size() < compressedData.size())
+            compressedData = current;
         return ERR_SUCCESS;
     }
         break;
     case COMPRESSION_ALGORITHM_LZMA:
     {
         UINT32 compressedSize = 0;
-        if (LzmaCompress((const UINT8*)data.constData(), data.size(), NULL, &compressedSize) != ERR_BUFFER_TOO_SMALL)
+        if (LzmaCompressWithOptions((const UINT8*)data.constData(), data.size(), NULL, &compressedSize, compressionPreset, lzmaMultithreadThreshold) != ERR_BUFFER_TOO_SMALL)
             return ERR_CUSTOMIZED_COMPRESSION_FAILED;
         compressed = new UINT8[compressedSize];
-        if (LzmaCompress((const UINT8*)data.constData(), data.size(), compressed, &compressedSize) != ERR_SUCCESS) {
+        if (LzmaCompressWithOptions((const UINT8*)data.constData(), data.size(), compressed, &compressedSize, compressionPreset, lzmaMultithreadThreshold) != ERR_SUCCESS) {
             delete[] compressed;
             return ERR_CUSTOMIZED_COMPRESSION_FAILED;
         }
@@ -2886,10 +4086,10 @@ UINT8 FfsEngine::compress(const QByteArray & data, const UINT8 algorithm, QByteA
         UINT32 headerSize = sizeOfSectionHeader(sectionHeader);
         header = data.left(headerSize);
         QByteArray newData = data.mid(headerSize);
-        if (LzmaCompress((const UINT8*)newData.constData(), newData.size(), NULL, &compressedSize) != ERR_BUFFER_TOO_SMALL)
+        if (LzmaCompressWithOptions((const UINT8*)newData.constData(), newData.size(), NULL, &compressedSize, compressionPreset, lzmaMultithreadThreshold) != ERR_BUFFER_TOO_SMALL)
             return ERR_CUSTOMIZED_COMPRESSION_FAILED;
         compressed = new UINT8[compressedSize];
-        if (LzmaCompress((const UINT8*)newData.constData(), newData.size(), compressed, &compressedSize) != ERR_SUCCESS) {
+        if (LzmaCompressWithOptions((const UINT8*)newData.constData(), newData.size(), compressed, &compressedSize, compressionPreset, lzmaMultithreadThreshold) != ERR_SUCCESS) {
             delete[] compressed;
             return ERR_CUSTOMIZED_COMPRESSION_FAILED;
         }
@@ -2898,12 +4098,36 @@ UINT8 FfsEngine::compress(const QByteArray & data, const UINT8 algorithm, QByteA
         return ERR_SUCCESS;
     }
         break;
+    case COMPRESSION_ALGORITHM_BROTLI:
+    {
+        UINT32 compressedSize = 0;
+        if (BrotliCompressWithPreset((const UINT8*)data.constData(), data.size(), NULL, &compressedSize, compressionPreset) != ERR_BUFFER_TOO_SMALL)
+            return ERR_CUSTOMIZED_COMPRESSION_FAILED;
+        compressedData.resize(compressedSize);
+        if (BrotliCompressWithPreset((const UINT8*)data.constData(), data.size(), (UINT8*)compressedData.data(), &compressedSize, compressionPreset) != ERR_SUCCESS) {
+            compressedData.clear();
+            return ERR_CUSTOMIZED_COMPRESSION_FAILED;
+        }
+        compressedData.resize(compressedSize);
+        return ERR_SUCCESS;
+    }
+        break;
     default:
         msg(tr("compress: unknown compression algorithm %1").arg(algorithm));
         return ERR_UNKNOWN_COMPRESSION_ALGORITHM;
     }
 }
 
+void FfsEngine::setCompressionPreset(const UINT8 preset)
+{
+    compressionPreset = preset;
+}
+
+void FfsEngine::setLzmaMultithreadThreshold(const UINT32 threshold)
+{
+    lzmaMultithreadThreshold = threshold;
+}
+
 // Construction routines
 UINT8 FfsEngine::constructPadFile(const QByteArray &guid, const UINT32 size, const UINT8 revision, const UINT8 erasePolarity, QByteArray & pad)
 {
@@ -3225,6 +4449,211 @@ UINT8 FfsEngine::reconstructPadding(const QModelIndex& index, QByteArray& recons
     return ERR_NOT_IMPLEMENTED;
 }
 
+UINT8 FfsEngine::checkSpace(const QModelIndex & index, QVector<VolumeSpace> & volumes, UINT32 & missing)
+{
+    volumes.clear();
+    missing = 0;
+    if (!index.isValid())
+        return ERR_INVALID_PARAMETER;
+
+    // Every volume up to the root is affected
+    for (QModelIndex current = index; current.isValid(); current = current.parent()) {
+        if (model->type(current) != Types::Volume || model->action(current) == Actions::Remove)
+            continue;
+
+        VolumeSpace space;
+        space.volume = current;
+        space.size = model->body(current).size();
+        space.used = estimateVolumeUsedSize(current);
+        UINT8 parentType = model->type(current.parent());
+        space.growable = (parentType == Types::File || parentType == Types::Section);
+        volumes.append(space);
+
+        // Growable volumes are accounted for by their parents
+        if (!space.growable && space.used > space.size) {
+            msg(tr("checkSpace: volume needs %1h (%2) byte(s) more").hexarg(space.used - space.size).arg(space.used - space.size), current);
+            if (space.used - space.size > missing)
+                missing = space.used - space.size;
+        }
+    }
+
+    return missing ? ERR_INVALID_VOLUME : ERR_SUCCESS;
+}
+
+UINT32 FfsEngine::estimateVolumeUsedSize(const QModelIndex & index)
+{
+    // Follows the layout made by reconstructVolume, using estimated file sizes
+    if (model->action(index) == Actions::NoAction || !model->rowCount(index))
+        return model->body(index).size();
+
+    const EFI_FIRMWARE_VOLUME_HEADER* volumeHeader = (const EFI_FIRMWARE_VOLUME_HEADER*)model->header(index).constData();
+    UINT8 revision = volumeHeader->Revision;
+    UINT32 headerSize = model->header(index).size();
+    UINT32 bodySize = model->body(index).size();
+    UINT32 offset = 0;
+    UINT32 vtfSize = 0;
+    UINT32 nonUefiDataSize = 0;
+    bool pinFixedFiles = pinsFixedFiles(index);
+    for (int i = 0; i < model->rowCount(index); i++) {
+        QModelIndex current = index.child(i, 0);
+        if (model->type(current) == Types::File) {
+            offset = ALIGN8(offset);
+
+            UINT32 size = estimateSize(current, revision);
+            if (!size)
+                continue;
+
+            // Pad files are made again where needed
+            if (model->subtype(current) == EFI_FV_FILETYPE_PAD)
+                continue;
+
+            QByteArray header = model->header(current);
+            if (header.left(sizeof(EFI_GUID)) == EFI_FFS_VOLUME_TOP_FILE_GUID) {
+                vtfSize = size;
+                continue;
+            }
+
+            // Fixed file keeps it's original offset
+            if (pinFixedFiles && isFixedFile(current)) {
+                UINT32 fixedOffset = originalOffset(current);
+                if (offset < fixedOffset)
+                    offset = fixedOffset;
+                offset += size;
+                continue;
+            }
+
+            // Pad file is added before unaligned file
+            const EFI_FFS_FILE_HEADER* fileHeader = (const EFI_FFS_FILE_HEADER*)header.constData();
+            UINT32 fileHeaderSize = (revision > 1 && (fileHeader->Attributes & FFS_ATTRIB_LARGE_FILE)) ? sizeof(EFI_FFS_FILE_HEADER2) : sizeof(EFI_FFS_FILE_HEADER);
+            UINT32 alignment = (UINT32)(1UL << ffsAlignmentTable[(fileHeader->Attributes & FFS_ATTRIB_DATA_ALIGNMENT) >> 3]);
+            UINT32 alignmentBase = headerSize + offset + fileHeaderSize;
+            if (alignmentBase % alignment) {
+                UINT32 padSize = alignment - (alignmentBase % alignment);
+                while (padSize < sizeof(EFI_FFS_FILE_HEADER))
+                    padSize += alignment;
+                offset += padSize;
+            }
+
+            offset += size;
+        }
+        else if (model->type(current) == Types::FreeSpace) {
+            // Non-UEFI data after free space keeps it's offset
+            if (offset + (UINT32)model->body(current).size() < bodySize) {
+                nonUefiDataSize = model->body(index.child(i + 1, 0)).size();
+                break;
+            }
+        }
+    }
+
+    // VTF and non-UEFI data are placed at the end of the volume
+    return offset + vtfSize + nonUefiDataSize;
+}
+
+UINT32 FfsEngine::estimateSectionsSize(const QModelIndex & index, const UINT8 revision)
+{
+    // Sections are aligned to 4 byte boundary
+    UINT32 offset = 0;
+    for (int i = 0; i < model->rowCount(index); i++) {
+        UINT32 size = estimateSize(index.child(i, 0), revision);
+        if (size)
+            offset = ALIGN4(offset) + size;
+    }
+    return offset;
+}
+
+UINT32 FfsEngine::estimateSize(const QModelIndex & index, const UINT8 revision)
+{
+    UINT8 action = model->action(index);
+    if (action == Actions::Remove)
+        return 0;
+
+    UINT32 headerSize = model->header(index).size();
+    UINT32 bodySize = model->body(index).size();
+    UINT32 tailSize = 0;
+    if (model->type(index) == Types::File) {
+        const EFI_FFS_FILE_HEADER* fileHeader = (const EFI_FFS_FILE_HEADER*)model->header(index).constData();
+        if (revision == 1 && (fileHeader->Attributes & FFS_ATTRIB_TAIL_PRESENT))
+            tailSize = sizeof(UINT16);
+    }
+
+    // Items without changes and items without children are reconstructed as is
+    if (action == Actions::NoAction || action == Actions::Rebase || !model->rowCount(index))
+        return headerSize + bodySize + tailSize;
+
+    switch (model->type(index)) {
+    case Types::Volume: {
+        UINT32 used = estimateVolumeUsedSize(index);
+        if (used <= bodySize)
+            return headerSize + bodySize;
+
+        // Volume grows by whole blocks
+        const EFI_FIRMWARE_VOLUME_HEADER* volumeHeader = (const EFI_FIRMWARE_VOLUME_HEADER*)model->header(index).constData();
+        const EFI_FV_BLOCK_MAP_ENTRY* blockMap = (const EFI_FV_BLOCK_MAP_ENTRY*)(model->header(index).constData() + sizeof(EFI_FIRMWARE_VOLUME_HEADER));
+        UINT32 size = headerSize + used;
+        if (volumeHeader->HeaderLength >= sizeof(EFI_FIRMWARE_VOLUME_HEADER) + sizeof(EFI_FV_BLOCK_MAP_ENTRY) && blockMap[0].Length)
+            size += blockMap[0].Length - size % blockMap[0].Length;
+        return size;
+    }
+    case Types::File: {
+        // Raw files contain volumes one after another
+        if (model->subtype(index) == EFI_FV_FILETYPE_ALL || model->subtype(index) == EFI_FV_FILETYPE_RAW) {
+            UINT32 size = 0;
+            for (int i = 0; i < model->rowCount(index); i++)
+                size += estimateSize(index.child(i, 0), revision);
+            return headerSize + size + tailSize;
+        }
+        return headerSize + estimateSectionsSize(index, revision) + tailSize;
+    }
+    case Types::Section: {
+        UINT32 size = estimateSectionsSize(index, revision);
+        if (model->compression(index) == COMPRESSION_ALGORITHM_NONE)
+            return headerSize + size;
+
+        // Compressed size is estimated using the compression ratio of the original body
+        UINT32 uncompressedSize = model->uncompressedData(index).size();
+        if (uncompressedSize)
+            size = (UINT32)(((UINT64)size * bodySize + uncompressedSize - 1) / uncompressedSize);
+        return headerSize + size;
+    }
+    default:
+        return headerSize + bodySize;
+    }
+}
+
+bool FfsEngine::isFixedFile(const QModelIndex & index)
+{
+    if (model->type(index) != Types::File)
+        return false;
+
+    // Inserted files have no original offset, replacing files take it from the replaced ones
+    UINT8 action = model->action(index);
+    if (action == Actions::Insert || action == Actions::Create)
+        return false;
+
+    const EFI_FFS_FILE_HEADER* fileHeader = (const EFI_FFS_FILE_HEADER*)model->header(index).constData();
+    return (fileHeader->Attributes & FFS_ATTRIB_FIXED) != 0;
+}
+
+bool FfsEngine::pinsFixedFiles(const QModelIndex & index)
+{
+    // Fixed files are only kept in place when pad files before them are removed, as defragment does,
+    // otherwise files are packed one after another as before
+    for (int i = 0; i < model->rowCount(index); i++) {
+        QModelIndex current = index.child(i, 0);
+        if (model->type(current) == Types::File && model->subtype(current) == EFI_FV_FILETYPE_PAD
+            && model->action(current) == Actions::Remove)
+            return true;
+    }
+    return false;
+}
+
+UINT32 FfsEngine::originalOffset(const QModelIndex & index)
+{
+    // Offset in the volume body is stored when the file is parsed, the tree can't be used
+    // because removed items and pad files may already be compacted out of it
+    return model->offset(index);
+}
+
 UINT8 FfsEngine::reconstructVolume(const QModelIndex & index, QByteArray & reconstructed)
 {
     if (!index.isValid())
@@ -3341,11 +4770,14 @@ UINT8 FfsEngine::reconstructVolume(const QModelIndex & index, QByteArray & recon
 
             // Reconstruct files in volume
             UINT32 offset = 0;
+            QVector<RebaseImage> fileImages;
+            QVector<RebaseFile> rebaseFiles;
             QByteArray padFileGuid = EFI_FFS_PAD_FILE_GUID;
             QByteArray vtf;
             QModelIndex vtfIndex;
             UINT32 nonUefiDataOffset = 0;
             QByteArray nonUefiData;
+            bool pinFixedFiles = pinsFixedFiles(index);
             for (int i = 0; i < model->rowCount(index); i++) {
                 // Inside a volume can be files, free space or padding with non-UEFI data
                 if (model->type(index.child(i, 0)) == Types::File) { // Next item is a file
@@ -3361,8 +4793,11 @@ UINT8 FfsEngine::reconstructVolume(const QModelIndex & index, QByteArray & recon
                     // Calculate file base
                     UINT32 fileBase = volumeBase ? volumeBase + header.size() + offset : 0;
 
-                    // Reconstruct file
+                    // Reconstruct file, collecting it's images to rebase
+                    fileImages.clear();
+                    rebaseImages = &fileImages;
                     result = reconstructFile(index.child(i, 0), volumeHeader->Revision, polarity, fileBase, file);
+                    rebaseImages = NULL;
                     if (result)
                         return result;
 
@@ -3396,6 +4831,43 @@ UINT8 FfsEngine::reconstructVolume(const QModelIndex & index, QByteArray & recon
                         continue;
                     }
 
+                    // Fixed file must stay at it's original offset
+                    if (pinFixedFiles && isFixedFile(index.child(i, 0))) {
+                        UINT32 fixedOffset = originalOffset(index.child(i, 0));
+                        if (offset > fixedOffset) {
+                            msg(tr("reconstructVolume: no space left before fixed file, need %1h (%2) byte(s) more")
+                                .hexarg(offset - fixedOffset).arg(offset - fixedOffset), index.child(i, 0));
+                            return ERR_INVALID_VOLUME;
+                        }
+                        if (offset < fixedOffset) {
+                            // Gap is filled with a single pad file
+                            UINT32 size = fixedOffset - offset;
+                            if (size < sizeof(EFI_FFS_FILE_HEADER)) {
+                                msg(tr("reconstructVolume: gap of %1h (%2) byte(s) before fixed file is too small for a pad file")
+                                    .hexarg(size).arg(size), index.child(i, 0));
+                                return ERR_INVALID_VOLUME;
+                            }
+                            QByteArray pad;
+                            result = constructPadFile(padFileGuid, size, volumeHeader->Revision, polarity, pad);
+                            if (result)
+                                return result;
+                            reconstructed.append(pad);
+                            offset += size;
+
+                            // Reconstruct file again with it's original base
+                            fileImages.clear();
+                            rebaseImages = &fileImages;
+                            result = reconstructFile(index.child(i, 0), volumeHeader->Revision, polarity, volumeBase ? volumeBase + header.size() + offset : 0, file);
+                            rebaseImages = NULL;
+                            if (result)
+                                return result;
+                        }
+                        addRebaseFile(rebaseFiles, fileImages, file, fileHeaderSize, offset, volumeHeader->Revision);
+                        reconstructed.append(file);
+                        offset += file.size();
+                        continue;
+                    }
+
                     // Normal file
                     // Ensure correct alignment
                     UINT8 alignmentPower;
@@ -3422,6 +4894,7 @@ UINT8 FfsEngine::reconstructVolume(const QModelIndex & index, QByteArray & recon
                     }
 
                     // Append current file to new volume body
+                    addRebaseFile(rebaseFiles, fileImages, file, fileHeaderSize, offset, volumeHeader->Revision);
                     reconstructed.append(file);
 
                     // Change current file offset
@@ -3438,6 +4911,11 @@ UINT8 FfsEngine::reconstructVolume(const QModelIndex & index, QByteArray & recon
                 }
             }
 
+            // Relocate PEI images of all files at their final places
+            result = applyRebasePlan(rebaseFiles, reconstructed, volumeBase + header.size(), index);
+            if (result)
+                return result;
+
             // Check volume sanity
             if (!vtf.isEmpty() && !nonUefiData.isEmpty()) {
                 msg(tr("reconstructVolume: both VTF and non-UEFI data found in the volume, reconstruction is not possible"), index);
@@ -3698,10 +5176,15 @@ UINT8 FfsEngine::reconstructFile(const QModelIndex& index, const UINT8 revision,
 
                     // Reconstruct section
                     QByteArray section;
+                    int firstImage = rebaseImages ? rebaseImages->size() : 0;
                     result = reconstructSection(index.child(i, 0), sectionBase, section);
                     if (result)
                         return result;
 
+                    // Planned images are placed relative to the file
+                    for (int j = firstImage; rebaseImages && j < rebaseImages->size(); j++)
+                        (*rebaseImages)[j].offset += headerSize + offset;
+
                     // Check for empty section
                     if (section.isEmpty())
                         continue;
@@ -3917,7 +5400,15 @@ UINT8 FfsEngine::reconstructSection(const QModelIndex& index, const UINT32 base,
                 teFixup = teHeader->StrippedSize - sizeof(EFI_IMAGE_TE_HEADER);
             }*/
 
-            if (base) {
+            // Inside a volume images are added to it's rebase plan
+            if (base && rebaseImages) {
+                RebaseImage image;
+                image.offset = header.size();
+                image.size = reconstructed.size();
+                image.peiCore = (model->subtype(index.parent()) == EFI_FV_FILETYPE_PEI_CORE);
+                rebaseImages->append(image);
+            }
+            else if (base) {
                 result = rebase(reconstructed, base - teFixup + header.size());
                 if (result) {
                     msg(tr("reconstructSection: executable section rebase failed"), index);
@@ -3984,11 +5475,15 @@ UINT8 FfsEngine::reconstruct(const QModelIndex &index, QByteArray& reconstructed
             return result;
         break;
 
-    case Types::Volume:
+    case Types::Volume: {
+        // Nested volume has it's own rebase plan
+        QVector<RebaseImage>* outerImages = rebaseImages;
+        rebaseImages = NULL;
         result = reconstructVolume(index, reconstructed);
+        rebaseImages = outerImages;
         if (result)
             return result;
-        break;
+    } break;
 
     case Types::File: //Must not be called that way
         msg(tr("reconstruct: call of generic function is not supported for files").arg(model->type(index)), index);
@@ -4059,6 +5554,190 @@ UINT8 FfsEngine::reconstructImageFile(QByteArray & reconstructed)
     return reconstruct(model->index(0, 0), reconstructed);
 }
 
+// Verification routines
+UINT8 FfsEngine::verifyImageFile(const QByteArray & reconstructed)
+{
+    QFuture<void> parsed;
+    UINT8 result = startVerification(reconstructed, parsed);
+    if (result)
+        return result;
+
+    return finishVerification();
+}
+
+UINT8 FfsEngine::startVerification(const QByteArray & reconstructed, QFuture<void> & parsed)
+{
+    if (!model->rowCount(QModelIndex()))
+        return ERR_INVALID_PARAMETER;
+
+    // Bodies replaced in place are compared with their children
+    parseAllPending(QModelIndex());
+
+    // Reconstructed image is parsed on another thread while the modified tree is hashed on this one
+    verification = QtConcurrent::run(&FfsEngine::parseForVerification, reconstructed);
+    parsed = verification;
+
+    // VTF body is patched during reconstruction if PEI core entry point has changed
+    bool vtfPatched = newPeiCoreEntryPoint && oldPeiCoreEntryPoint != newPeiCoreEntryPoint;
+    verificationExpected.clear();
+    collectVerifyNodes(model, QModelIndex(), QString(), true, false, vtfPatched, NULL, verificationExpected);
+    for (int i = 0; i < verificationExpected.size(); i++)
+        verificationExpected[i].offsetKept = keepsOffset(verificationExpected.at(i).index);
+
+    return ERR_SUCCESS;
+}
+
+bool FfsEngine::keepsOffset(const QModelIndex & index)
+{
+    // Children of unchanged items, regions placed by the descriptor and pinned fixed files don't move
+    QModelIndex parent = index.parent();
+    if (!parent.isValid() || model->action(parent) == Actions::NoAction)
+        return true;
+    if (model->type(index) == Types::Region)
+        return true;
+    return model->type(parent) == Types::Volume && pinsFixedFiles(parent) && isFixedFile(index);
+}
+
+UINT8 FfsEngine::finishVerification()
+{
+    // Not started verification has no result
+    verification.waitForFinished();
+    if (!verification.resultCount())
+        return ERR_INVALID_PARAMETER;
+
+    QVector<VerifyNode> edited = verificationExpected;
+    QVector<VerifyNode> rebuilt = verification.result();
+    verification = QFuture<QVector<VerifyNode> >();
+    verificationExpected.clear();
+
+    UINT32 divergences = 0;
+    int count = qMin(edited.size(), rebuilt.size());
+    for (int i = 0; i < count; i++) {
+        const VerifyNode & expected = edited.at(i);
+        const VerifyNode & actual = rebuilt.at(i);
+
+        // Structure differs, the rest of the nodes can't be matched
+        if (expected.type != actual.type || expected.subtype != actual.subtype) {
+            msg(tr("verifyImageFile: %1 %2 is reconstructed as %3 %4 %5")
+                .arg(itemTypeToQString(expected.type))
+                .arg(expected.path)
+                .arg(itemTypeToQString(actual.type))
+                .arg(itemSubtypeToQString(actual.type, actual.subtype))
+                .arg(actual.path), expected.index);
+            return ERR_VERIFICATION_FAILED;
+        }
+
+        if (expected.compression != actual.compression) {
+            msg(tr("verifyImageFile: %1 is reconstructed with %2 compression instead of %3")
+                .arg(expected.path)
+                .arg(compressionTypeToQString(actual.compression))
+                .arg(compressionTypeToQString(expected.compression)), expected.index);
+            divergences++;
+        }
+
+        if (expected.offsetKept && expected.offset != actual.offset) {
+            msg(tr("verifyImageFile: %1 is reconstructed at offset %2h instead of %3h")
+                .arg(expected.path)
+                .hexarg(actual.offset)
+                .hexarg(expected.offset), expected.index);
+            divergences++;
+        }
+
+        if (!expected.hash.isEmpty() && expected.hash != actual.hash) {
+            msg(tr("verifyImageFile: %1 body differs after reconstruction").arg(expected.path), expected.index);
+            divergences++;
+        }
+
+        // Parser messages for reconstructed items are divergences, like invalid checksums
+        // Unchanged items keep their problems from the original image
+        if (expected.action != Actions::NoAction) {
+            for (int j = 0; j < actual.messages.size(); j++) {
+                msg(tr("verifyImageFile: %1: %2").arg(expected.path).arg(actual.messages.at(j)), expected.index);
+                divergences++;
+            }
+        }
+    }
+
+    if (edited.size() != rebuilt.size()) {
+        msg(tr("verifyImageFile: %1 item(s) expected, %2 found in reconstructed image").arg(edited.size()).arg(rebuilt.size()));
+        return ERR_VERIFICATION_FAILED;
+    }
+
+    return divergences ? ERR_VERIFICATION_FAILED : ERR_SUCCESS;
+}
+
+QVector<FfsEngine::VerifyNode> FfsEngine::parseForVerification(const QByteArray & image)
+{
+    QVector<VerifyNode> nodes;
+    QMultiHash<void*, QString> messages;
+
+    FfsEngine engine;
+    engine.itemMessages = &messages;
+    if (engine.parseImageFile(image))
+        return nodes;
+
+    collectVerifyNodes(engine.model, QModelIndex(), QString(), false, false, false, &messages, nodes);
+    return nodes;
+}
+
+void FfsEngine::collectVerifyNodes(const TreeModel* model, const QModelIndex & index, const QString & path, const bool edited, const bool skipBody, const bool skipVtfBody, const QMultiHash<void*, QString>* messages, QVector<VerifyNode> & nodes)
+{
+    bool skipChildrenBody = skipBody;
+    if (index.isValid()) {
+        VerifyNode node;
+        node.index = index;
+        node.path = path;
+        node.type = model->type(index);
+        node.subtype = model->subtype(index);
+        node.compression = model->compression(index);
+        node.action = model->action(index);
+        node.offset = model->offset(index);
+        node.offsetKept = false;
+
+        // Rebased images have their bodies changed during reconstruction
+        if (edited && node.action == Actions::Rebase)
+            skipChildrenBody = true;
+
+        // Only leaf bodies are compared, headers are regenerated
+        if (!model->rowCount(index) && !skipChildrenBody)
+            node.hash = QCryptographicHash::hash(model->body(index), QCryptographicHash::Sha1);
+
+        if (messages) {
+            QList<QString> found = messages->values(index.internalPointer());
+            // Values are returned in reverse order of insertion
+            for (int i = found.size() - 1; i >= 0; i--)
+                node.messages.append(found.at(i));
+        }
+        nodes.append(node);
+    }
+
+    // Removed items, free space and pad files are not expected in reconstructed image
+    // VTF is always placed at the end of the volume
+    int vtfRow = -1;
+    for (int i = 0; i < model->rowCount(index); i++) {
+        QModelIndex current = model->index(i, 0, index);
+        if (edited && model->action(current) == Actions::Remove)
+            continue;
+        if (model->type(current) == Types::FreeSpace)
+            continue;
+        if (model->type(current) == Types::File && model->subtype(current) == EFI_FV_FILETYPE_PAD)
+            continue;
+        if (model->type(current) == Types::File && model->header(current).left(sizeof(EFI_GUID)) == EFI_FFS_VOLUME_TOP_FILE_GUID) {
+            vtfRow = i;
+            continue;
+        }
+
+        QString name = model->text(current).isEmpty() ? model->name(current) : model->text(current);
+        collectVerifyNodes(model, current, path.isEmpty() ? name : path + "/" + name, edited, skipChildrenBody, skipVtfBody, messages, nodes);
+    }
+
+    if (vtfRow >= 0) {
+        QModelIndex vtf = model->index(vtfRow, 0, index);
+        QString name = model->text(vtf).isEmpty() ? model->name(vtf) : model->text(vtf);
+        collectVerifyNodes(model, vtf, path.isEmpty() ? name : path + "/" + name, edited, skipChildrenBody || skipVtfBody, false, messages, nodes);
+    }
+}
+
 // Search routines
 UINT8 FfsEngine::findHexPattern(const QModelIndex & index, const QByteArray & hexPattern, const UINT8 mode)
 {
@@ -4214,70 +5893,449 @@ UINT8 FfsEngine::findTextPattern(const QModelIndex & index, const QString & patt
     return ERR_SUCCESS;
 }
 
+// Selector routines
+struct SelectorTypeName {
+    const char* name;
+    UINT8 value;
+};
+
+// EDK names of file and section types, accepted in addition to the names shown in the tree
+static const SelectorTypeName selectorFileTypes[] = {
+    { "RAW",                   EFI_FV_FILETYPE_RAW },
+    { "FREEFORM",              EFI_FV_FILETYPE_FREEFORM },
+    { "SEC",                   EFI_FV_FILETYPE_SECURITY_CORE },
+    { "SECURITY_CORE",         EFI_FV_FILETYPE_SECURITY_CORE },
+    { "PEI_CORE",              EFI_FV_FILETYPE_PEI_CORE },
+    { "DXE_CORE",              EFI_FV_FILETYPE_DXE_CORE },
+    { "PEIM",                  EFI_FV_FILETYPE_PEIM },
+    { "DRIVER",                EFI_FV_FILETYPE_DRIVER },
+    { "COMBINED_PEIM_DRIVER",  EFI_FV_FILETYPE_COMBINED_PEIM_DRIVER },
+    { "APPLICATION",           EFI_FV_FILETYPE_APPLICATION },
+    { "SMM",                   EFI_FV_FILETYPE_SMM },
+    { "FV",                    EFI_FV_FILETYPE_FIRMWARE_VOLUME_IMAGE },
+    { "FIRMWARE_VOLUME_IMAGE", EFI_FV_FILETYPE_FIRMWARE_VOLUME_IMAGE },
+    { "COMBINED_SMM_DXE",      EFI_FV_FILETYPE_COMBINED_SMM_DXE },
+    { "SMM_CORE",              EFI_FV_FILETYPE_SMM_CORE },
+    { "SMM_STANDALONE",        EFI_FV_FILETYPE_SMM_STANDALONE },
+    { "SMM_CORE_STANDALONE",   EFI_FV_FILETYPE_SMM_CORE_STANDALONE },
+    { "PAD",                   EFI_FV_FILETYPE_PAD },
+    { NULL,                    0 }
+};
+
+static const SelectorTypeName selectorSectionTypes[] = {
+    { "COMPRESSION",           EFI_SECTION_COMPRESSION },
+    { "GUID_DEFINED",          EFI_SECTION_GUID_DEFINED },
+    { "DISPOSABLE",            EFI_SECTION_DISPOSABLE },
+    { "PE32",                  EFI_SECTION_PE32 },
+    { "PIC",                   EFI_SECTION_PIC },
+    { "TE",                    EFI_SECTION_TE },
+    { "DXE_DEPEX",             EFI_SECTION_DXE_DEPEX },
+    { "VERSION",               EFI_SECTION_VERSION },
+    { "UI",                    EFI_SECTION_USER_INTERFACE },
+    { "USER_INTERFACE",        EFI_SECTION_USER_INTERFACE },
+    { "COMPATIBILITY16",       EFI_SECTION_COMPATIBILITY16 },
+    { "FV",                    EFI_SECTION_FIRMWARE_VOLUME_IMAGE },
+    { "FIRMWARE_VOLUME_IMAGE", EFI_SECTION_FIRMWARE_VOLUME_IMAGE },
+    { "FREEFORM_SUBTYPE_GUID", EFI_SECTION_FREEFORM_SUBTYPE_GUID },
+    { "RAW",                   EFI_SECTION_RAW },
+    { "PEI_DEPEX",             EFI_SECTION_PEI_DEPEX },
+    { "SMM_DEPEX",             EFI_SECTION_SMM_DEPEX },
+    { NULL,                    0 }
+};
+
+// Returns normalized GUID string as used for item names, or empty string
+static QString selectorGuid(const QString & text)
+{
+    QUuid uuid(text.startsWith('{') ? text : QString("{%1}").arg(text));
+    if (uuid.isNull())
+        return QString();
+    return uuid.toString().mid(1, 36).toUpper();
+}
+
+static bool selectorSubtypeMatches(const UINT8 type, const UINT8 subtype, const QString & value)
+{
+    if (!itemSubtypeToQString(type, subtype).compare(value, Qt::CaseInsensitive))
+        return true;
+
+    const SelectorTypeName* names = NULL;
+    if (type == Types::File)
+        names = selectorFileTypes;
+    else if (type == Types::Section)
+        names = selectorSectionTypes;
+    for (; names && names->name; names++) {
+        if (names->value == subtype && !value.compare(QLatin1String(names->name), Qt::CaseInsensitive))
+            return true;
+    }
+
+    // Hexadecimal subtype, like 10, 10h or 0x10
+    QString number = value;
+    if (number.startsWith("0x", Qt::CaseInsensitive))
+        number = number.mid(2);
+    else if (number.endsWith('h', Qt::CaseInsensitive))
+        number.chop(1);
+    bool converted;
+    UINT32 parsed = number.toUInt(&converted, 16);
+    return converted && parsed == subtype;
+}
+
+UINT8 FfsEngine::compileSelector(const QString & selector, SelectorPlan & plan)
+{
+    plan.clear();
+
+    QString text = selector.trimmed();
+    if (text.startsWith('/'))
+        text = text.mid(1);
+    if (text.isEmpty())
+        return ERR_INVALID_SELECTOR;
+
+    // Split selector into steps, separators inside of predicates are parts of values
+    QStringList steps;
+    QVector<UINT8> axes;
+    QString current;
+    axes.append(SELECTOR_AXIS_DESCENDANT);
+    int depth = 0;
+    bool quoted = false;
+    for (int i = 0; i < text.length(); i++) {
+        QChar c = text.at(i);
+        if (c == '"')
+            quoted = !quoted;
+        else if (!quoted && c == '[')
+            depth++;
+        else if (!quoted && c == ']' && --depth < 0)
+            return ERR_INVALID_SELECTOR;
+        else if (!quoted && !depth && (c == '/' || c == '>')) {
+            steps.append(current);
+            axes.append(c == '>' ? SELECTOR_AXIS_OWNED : SELECTOR_AXIS_DESCENDANT);
+            current.clear();
+            continue;
+        }
+        current.append(c);
+    }
+    if (quoted || depth)
+        return ERR_INVALID_SELECTOR;
+    steps.append(current);
+
+    for (int i = 0; i < steps.size(); i++) {
+        SelectorStep step;
+        UINT8 result = compileSelectorStep(steps.at(i).trimmed(), step);
+        if (result) {
+            plan.clear();
+            return result;
+        }
+        step.axis = axes.at(i);
+        plan.append(step);
+    }
+
+    return ERR_SUCCESS;
+}
+
+UINT8 FfsEngine::compileSelectorStep(const QString & text, SelectorStep & step)
+{
+    step.predicates.clear();
+
+    int bracket = text.indexOf('[');
+    QString kind = (bracket < 0 ? text : text.left(bracket)).trimmed().toLower();
+
+    // Bare GUID selects files with it, as GUIDs given to the tools before
+    if (bracket < 0) {
+        QString guid = selectorGuid(kind);
+        if (!guid.isEmpty()) {
+            SelectorPredicate predicate;
+            predicate.key = SELECTOR_KEY_GUID;
+            predicate.value = guid;
+            step.type = Types::File;
+            step.predicates.append(predicate);
+            return ERR_SUCCESS;
+        }
+    }
+
+    if (kind == "*")
+        step.type = Types::Root;
+    else if (kind == "capsule")
+        step.type = Types::Capsule;
+    else if (kind == "image")
+        step.type = Types::Image;
+    else if (kind == "region")
+        step.type = Types::Region;
+    else if (kind == "padding")
+        step.type = Types::Padding;
+    else if (kind == "volume")
+        step.type = Types::Volume;
+    else if (kind == "file")
+        step.type = Types::File;
+    else if (kind == "section")
+        step.type = Types::Section;
+    else if (kind == "freespace")
+        step.type = Types::FreeSpace;
+    else
+        return ERR_INVALID_SELECTOR;
+
+    // Predicates are given as [key=value,key=value] or [key=value][key=value]
+    int pos = bracket;
+    while (pos >= 0 && pos < text.length()) {
+        if (text.at(pos) != '[')
+            return ERR_INVALID_SELECTOR;
+
+        QStringList predicates;
+        QString current;
+        bool quoted = false;
+        int end = -1;
+        for (int i = pos + 1; i < text.length(); i++) {
+            QChar c = text.at(i);
+            if (c == '"')
+                quoted = !quoted;
+            else if (!quoted && c == ']') {
+                end = i;
+                break;
+            }
+            else if (!quoted && c == ',') {
+                predicates.append(current);
+                current.clear();
+                continue;
+            }
+            current.append(c);
+        }
+        if (end < 0)
+            return ERR_INVALID_SELECTOR;
+        predicates.append(current);
+
+        for (int i = 0; i < predicates.size(); i++) {
+            int equals = predicates.at(i).indexOf('=');
+            if (equals < 0)
+                return ERR_INVALID_SELECTOR;
+            QString key = predicates.at(i).left(equals).trimmed().toLower();
+            QString value = predicates.at(i).mid(equals + 1).trimmed();
+            if (value.length() >= 2 && value.startsWith('"') && value.endsWith('"'))
+                value = value.mid(1, value.length() - 2);
+            if (value.isEmpty())
+                return ERR_INVALID_SELECTOR;
+
+            SelectorPredicate predicate;
+            predicate.value = value;
+            if (key == "guid") {
+                predicate.key = SELECTOR_KEY_GUID;
+                predicate.value = selectorGuid(value);
+                if (predicate.value.isEmpty())
+                    return ERR_INVALID_SELECTOR;
+            }
+            else if (key == "fs") {
+                // Volumes are named by their file system GUIDs
+                QString guid = selectorGuid(value);
+                predicate.key = guid.isEmpty() ? SELECTOR_KEY_FS : SELECTOR_KEY_GUID;
+                if (!guid.isEmpty())
+                    predicate.value = guid;
+            }
+            else if (key == "type")
+                predicate.key = SELECTOR_KEY_TYPE;
+            else if (key == "name")
+                predicate.key = SELECTOR_KEY_NAME;
+            else if (key == "text")
+                predicate.key = SELECTOR_KEY_TEXT;
+            else
+                return ERR_INVALID_SELECTOR;
+            step.predicates.append(predicate);
+        }
+
+        pos = end + 1;
+        while (pos < text.length() && text.at(pos).isSpace())
+            pos++;
+    }
+
+    return ERR_SUCCESS;
+}
+
+bool FfsEngine::selectorMatches(const SelectorStep & step, const QModelIndex & index) const
+{
+    UINT8 type = model->type(index);
+    if (step.type != Types::Root && type != step.type)
+        return false;
+
+    UINT8 subtype = model->subtype(index);
+    for (int i = 0; i < step.predicates.size(); i++) {
+        const SelectorPredicate & predicate = step.predicates.at(i);
+        switch (predicate.key) {
+        case SELECTOR_KEY_GUID:
+        case SELECTOR_KEY_NAME:
+            if (model->name(index) != predicate.value)
+                return false;
+            break;
+        case SELECTOR_KEY_TEXT:
+            if (model->text(index).compare(predicate.value, Qt::CaseInsensitive))
+                return false;
+            break;
+        case SELECTOR_KEY_FS:
+            if (type != Types::Volume || itemSubtypeToQString(type, subtype).compare(predicate.value, Qt::CaseInsensitive))
+                return false;
+            break;
+        case SELECTOR_KEY_TYPE:
+            if (!selectorSubtypeMatches(type, subtype, predicate.value))
+                return false;
+            break;
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void FfsEngine::collectItems(const QModelIndex & index, QModelIndexList & items) const
+{
+    for (int i = 0; i < model->rowCount(index); i++) {
+        QModelIndex child = model->index(i, 0, index);
+        items.append(child);
+        collectItems(child, items);
+    }
+}
+
+UINT8 FfsEngine::select(const QString & selector, QModelIndexList & found, const QModelIndex & scope)
+{
+    found.clear();
+
+    SelectorPlan plan;
+    UINT8 result = compileSelector(selector, plan);
+    if (result)
+        return result;
+
+    return select(plan, found, scope);
+}
+
+UINT8 FfsEngine::select(const SelectorPlan & plan, QModelIndexList & found, const QModelIndex & scope)
+{
+    found.clear();
+    if (plan.isEmpty())
+        return ERR_INVALID_SELECTOR;
+
+    QSet<void*> matched;
+    for (int i = 0; i < plan.size(); i++) {
+        const SelectorStep & step = plan.at(i);
+
+        // Subtrees of matched items are complete before the next step is looked for there
+        for (int j = 0; j < found.size(); j++)
+            parseAllPending(found.at(j));
+
+        // Candidates are taken from name or type index of the model, if the step allows it
+        QString name;
+        for (int j = 0; j < step.predicates.size() && name.isEmpty(); j++) {
+            if (step.predicates.at(j).key == SELECTOR_KEY_GUID || step.predicates.at(j).key == SELECTOR_KEY_NAME)
+                name = step.predicates.at(j).value;
+        }
+        QModelIndexList candidates;
+        if (!name.isEmpty())
+            candidates = model->findByName(name);
+        else if (step.type != Types::Root)
+            candidates = model->findByType(step.type);
+        else if (i > 0) {
+            for (int j = 0; j < found.size(); j++)
+                collectItems(found.at(j), candidates);
+        }
+        else if (scope.isValid()) {
+            candidates.append(scope);
+            collectItems(scope, candidates);
+        }
+        else
+            collectItems(QModelIndex(), candidates);
+
+        QModelIndexList next;
+        QSet<void*> nextMatched;
+        for (int j = 0; j < candidates.size(); j++) {
+            const QModelIndex & candidate = candidates.at(j);
+            if (nextMatched.contains(candidate.internalPointer()) || !selectorMatches(step, candidate))
+                continue;
+
+            // First step is matched under the scope, the others under items matched by the previous step
+            // Owned items are not looked for past the nearest ancestor of the previous step type
+            bool under = (i == 0 && !scope.isValid());
+            for (QModelIndex ancestor = (i == 0 ? candidate : candidate.parent()); !under && ancestor.isValid(); ancestor = ancestor.parent()) {
+                if (i == 0 ? ancestor.internalPointer() == scope.internalPointer() : matched.contains(ancestor.internalPointer()))
+                    under = true;
+                else if (i > 0 && step.axis == SELECTOR_AXIS_OWNED
+                    && (plan.at(i - 1).type == Types::Root || model->type(ancestor) == plan.at(i - 1).type))
+                    break;
+            }
+            if (!under)
+                continue;
+
+            next.append(candidate);
+            nextMatched.insert(candidate.internalPointer());
+        }
+
+        found = next;
+        matched = nextMatched;
+        if (found.isEmpty())
+            break;
+    }
+
+    return found.isEmpty() ? ERR_ITEM_NOT_FOUND : ERR_SUCCESS;
+}
+
 UINT8 FfsEngine::rebase(QByteArray &executable, const UINT32 base)
+{
+    // Relocations are applied to the data directly
+    return rebaseImage((UINT8*)executable.data(), executable.size(), base);
+}
+
+UINT8 FfsEngine::rebaseImage(UINT8* image, const UINT32 size, const UINT32 base, const bool checkOnly)
 {
     UINT32 delta;       // Difference between old and new base addresses
     UINT32 relocOffset; // Offset of relocation region
     UINT32 relocSize;   // Size of relocation region
     UINT32 teFixup = 0; // Bytes removed form PE header for TE images
-
-    // Copy input data to local storage
-    QByteArray file = executable;
+    UINT32* base32 = NULL; // Image base field of PE32 header
+    UINT64* base64 = NULL; // Image base field of PE32+ and TE headers
 
     // Populate DOS header
-    if ((UINT32)file.size() < sizeof(EFI_IMAGE_DOS_HEADER))
+    if (size < sizeof(EFI_IMAGE_DOS_HEADER))
         return ERR_INVALID_FILE;
-    EFI_IMAGE_DOS_HEADER* dosHeader = (EFI_IMAGE_DOS_HEADER*)file.data();
+    EFI_IMAGE_DOS_HEADER* dosHeader = (EFI_IMAGE_DOS_HEADER*)image;
 
     // Check signature
     if (dosHeader->e_magic == EFI_IMAGE_DOS_SIGNATURE){
         UINT32 offset = dosHeader->e_lfanew;
-        if ((UINT32)file.size() < offset + sizeof(EFI_IMAGE_PE_HEADER))
+        if (size < offset + sizeof(EFI_IMAGE_PE_HEADER))
             return ERR_UNKNOWN_IMAGE_TYPE;
-        EFI_IMAGE_PE_HEADER* peHeader = (EFI_IMAGE_PE_HEADER*)(file.data() + offset);
+        EFI_IMAGE_PE_HEADER* peHeader = (EFI_IMAGE_PE_HEADER*)(image + offset);
         if (peHeader->Signature != EFI_IMAGE_PE_SIGNATURE)
             return ERR_UNKNOWN_IMAGE_TYPE;
         offset += sizeof(EFI_IMAGE_PE_HEADER);
         // Skip file header
         offset += sizeof(EFI_IMAGE_FILE_HEADER);
         // Check optional header magic
-        if ((UINT32)file.size() < offset + sizeof(UINT16))
+        if (size < offset + sizeof(UINT16))
             return ERR_UNKNOWN_IMAGE_TYPE;
-        UINT16 magic = *(UINT16*)(file.data() + offset);
+        UINT16 magic = *(UINT16*)(image + offset);
         if (magic == EFI_IMAGE_PE_OPTIONAL_HDR32_MAGIC) {
-            if ((UINT32)file.size() < offset + sizeof(EFI_IMAGE_OPTIONAL_HEADER32))
+            if (size < offset + sizeof(EFI_IMAGE_OPTIONAL_HEADER32))
                 return ERR_UNKNOWN_PE_OPTIONAL_HEADER_TYPE;
-            EFI_IMAGE_OPTIONAL_HEADER32* optHeader = (EFI_IMAGE_OPTIONAL_HEADER32*)(file.data() + offset);
+            EFI_IMAGE_OPTIONAL_HEADER32* optHeader = (EFI_IMAGE_OPTIONAL_HEADER32*)(image + offset);
             delta = base - optHeader->ImageBase;
             if (!delta)
                 // No need to rebase
                 return ERR_SUCCESS;
             relocOffset = optHeader->DataDirectory[EFI_IMAGE_DIRECTORY_ENTRY_BASERELOC].VirtualAddress;
             relocSize = optHeader->DataDirectory[EFI_IMAGE_DIRECTORY_ENTRY_BASERELOC].Size;
-            // Set new base
-            optHeader->ImageBase = base;
+            base32 = &optHeader->ImageBase;
         }
         else if (magic == EFI_IMAGE_PE_OPTIONAL_HDR64_MAGIC) {
-            if ((UINT32)file.size() < offset + sizeof(EFI_IMAGE_OPTIONAL_HEADER64))
+            if (size < offset + sizeof(EFI_IMAGE_OPTIONAL_HEADER64))
                 return ERR_UNKNOWN_PE_OPTIONAL_HEADER_TYPE;
-            EFI_IMAGE_OPTIONAL_HEADER64* optHeader = (EFI_IMAGE_OPTIONAL_HEADER64*)(file.data() + offset);
+            EFI_IMAGE_OPTIONAL_HEADER64* optHeader = (EFI_IMAGE_OPTIONAL_HEADER64*)(image + offset);
             delta = base - optHeader->ImageBase;
             if (!delta)
                 // No need to rebase
                 return ERR_SUCCESS;
             relocOffset = optHeader->DataDirectory[EFI_IMAGE_DIRECTORY_ENTRY_BASERELOC].VirtualAddress;
             relocSize = optHeader->DataDirectory[EFI_IMAGE_DIRECTORY_ENTRY_BASERELOC].Size;
-            // Set new base
-            optHeader->ImageBase = base;
+            base64 = &optHeader->ImageBase;
         }
         else
             return ERR_UNKNOWN_PE_OPTIONAL_HEADER_TYPE;
     }
     else if (dosHeader->e_magic == EFI_IMAGE_TE_SIGNATURE){
         // Populate TE header
-        if ((UINT32)file.size() < sizeof(EFI_IMAGE_TE_HEADER))
+        if (size < sizeof(EFI_IMAGE_TE_HEADER))
             return ERR_INVALID_FILE;
-        EFI_IMAGE_TE_HEADER* teHeader = (EFI_IMAGE_TE_HEADER*)file.data();
+        EFI_IMAGE_TE_HEADER* teHeader = (EFI_IMAGE_TE_HEADER*)image;
         delta = base - teHeader->ImageBase;
         if (!delta)
             // No need to rebase
@@ -4285,83 +6343,169 @@ UINT8 FfsEngine::rebase(QByteArray &executable, const UINT32 base)
         relocOffset = teHeader->DataDirectory[EFI_IMAGE_TE_DIRECTORY_ENTRY_BASERELOC].VirtualAddress;
         teFixup = teHeader->StrippedSize - sizeof(EFI_IMAGE_TE_HEADER);
         relocSize = teHeader->DataDirectory[EFI_IMAGE_TE_DIRECTORY_ENTRY_BASERELOC].Size;
-        // Set new base
-        teHeader->ImageBase = base;
+        base64 = &teHeader->ImageBase;
     }
     else
         return ERR_UNKNOWN_IMAGE_TYPE;
 
-    // No relocations
-    if (relocOffset == 0) {
-        // No need to fix relocations
-        executable = file;
-        return ERR_SUCCESS;
+    // Relocation region must be inside the image
+    if (relocOffset && (relocOffset < teFixup || relocOffset - teFixup > size || relocSize > size - (relocOffset - teFixup)))
+        return ERR_BAD_RELOCATION_ENTRY;
+
+    // All relocations are checked before anything is written, so a bad image is left intact
+    for (int pass = 0; pass < (checkOnly ? 1 : 2) && relocOffset; pass++) {
+        UINT8* block = image + relocOffset - teFixup;
+        UINT8* blockEnd = block + relocSize;
+        while (block < blockEnd) {
+            if ((UINT32)(blockEnd - block) < sizeof(EFI_IMAGE_BASE_RELOCATION))
+                return ERR_BAD_RELOCATION_ENTRY;
+            EFI_IMAGE_BASE_RELOCATION* relocBase = (EFI_IMAGE_BASE_RELOCATION*)block;
+            if (relocBase->SizeOfBlock < sizeof(EFI_IMAGE_BASE_RELOCATION)
+                || relocBase->SizeOfBlock > (UINT32)(blockEnd - block)
+                || relocBase->SizeOfBlock % sizeof(UINT16))
+                return ERR_BAD_RELOCATION_ENTRY;
+            UINT16* reloc = (UINT16*)(block + sizeof(EFI_IMAGE_BASE_RELOCATION));
+            UINT16* relocEnd = (UINT16*)(block + relocBase->SizeOfBlock);
+
+            // Run this relocation block
+            for (; reloc < relocEnd; reloc++) {
+                UINT32 width;
+                switch ((*reloc) >> 12) {
+                case EFI_IMAGE_REL_BASED_ABSOLUTE:
+                    // Do nothing
+                    continue;
+                case EFI_IMAGE_REL_BASED_HIGH:
+                case EFI_IMAGE_REL_BASED_LOW:
+                    width = sizeof(UINT16);
+                    break;
+                case EFI_IMAGE_REL_BASED_HIGHLOW:
+                    width = sizeof(UINT32);
+                    break;
+                case EFI_IMAGE_REL_BASED_DIR64:
+                    width = sizeof(UINT64);
+                    break;
+                default:
+                    return ERR_UNKNOWN_RELOCATION_TYPE;
+                }
+
+                // The whole fixup must be inside the image
+                UINT64 location = (UINT64)relocBase->VirtualAddress + (*reloc & 0x0FFF);
+                if (location < teFixup || location - teFixup + width > size)
+                    return ERR_BAD_RELOCATION_ENTRY;
+                if (pass == 0)
+                    continue;
+
+                UINT8* data = image + (UINT32)(location - teFixup);
+                switch ((*reloc) >> 12) {
+                case EFI_IMAGE_REL_BASED_HIGH:
+                    // Add second 16 bits of delta
+                    *(UINT16*)data = (UINT16)(*(UINT16*)data + (UINT16)(delta >> 16));
+                    break;
+                case EFI_IMAGE_REL_BASED_LOW:
+                    // Add first 16 bits of delta
+                    *(UINT16*)data = (UINT16)(*(UINT16*)data + (UINT16)delta);
+                    break;
+                case EFI_IMAGE_REL_BASED_HIGHLOW:
+                    // Add first 32 bits of delta
+                    *(UINT32*)data = *(UINT32*)data + delta;
+                    break;
+                case EFI_IMAGE_REL_BASED_DIR64:
+                    // Add all 64 bits of delta
+                    *(UINT64*)data = *(UINT64*)data + (UINT64)delta;
+                    break;
+                }
+            }
+
+            // Next relocation block
+            block = (UINT8*)relocEnd;
+        }
     }
 
-    EFI_IMAGE_BASE_RELOCATION *RelocBase;
-    EFI_IMAGE_BASE_RELOCATION *RelocBaseEnd;
-    UINT16                    *Reloc;
-    UINT16                    *RelocEnd;
-    UINT16                    *F16;
-    UINT32                    *F32;
-    UINT64                    *F64;
+    // Set new base
+    if (!checkOnly) {
+        if (base32)
+            *base32 = base;
+        else
+            *base64 = base;
+    }
 
-    // Run the whole relocation block
-    RelocBase = (EFI_IMAGE_BASE_RELOCATION*)(file.data() + relocOffset - teFixup);
-    RelocBaseEnd = (EFI_IMAGE_BASE_RELOCATION*)(file.data() + relocOffset - teFixup + relocSize);
+    return ERR_SUCCESS;
+}
 
-    while (RelocBase < RelocBaseEnd) {
-        Reloc = (UINT16*)((UINT8*)RelocBase + sizeof(EFI_IMAGE_BASE_RELOCATION));
-        RelocEnd = (UINT16*)((UINT8*)RelocBase + RelocBase->SizeOfBlock);
+void FfsEngine::addRebaseFile(QVector<RebaseFile> & files, const QVector<RebaseImage> & images, const QByteArray & file, const UINT32 headerSize, const UINT32 offset, const UINT8 revision)
+{
+    if (images.isEmpty())
+        return;
+
+    RebaseFile rebaseFile;
+    rebaseFile.offset = offset;
+    rebaseFile.data = NULL;
+    rebaseFile.base = 0;
+    rebaseFile.headerSize = headerSize;
+    rebaseFile.size = file.size();
+    rebaseFile.revision = revision;
+    rebaseFile.result = ERR_SUCCESS;
+    rebaseFile.images = images;
+    files.append(rebaseFile);
+}
 
-        // Run this relocation record
-        while (Reloc < RelocEnd) {
-            UINT32 RelocLocation = RelocBase->VirtualAddress - teFixup + (*Reloc & 0x0FFF);
-            if ((UINT32)file.size() < RelocLocation)
-                return ERR_BAD_RELOCATION_ENTRY;
-            UINT8* data = (UINT8*)(file.data() + RelocLocation);
-            switch ((*Reloc) >> 12) {
-            case EFI_IMAGE_REL_BASED_ABSOLUTE:
-                // Do nothing
-                break;
+void FfsEngine::rebaseFile(RebaseFile & file)
+{
+    // Files are relocated in place, so nothing is written until all their images are known to be valid
+    for (int i = 0; i < file.images.size(); i++) {
+        const RebaseImage & image = file.images.at(i);
+        file.result = rebaseImage(file.data + image.offset, image.size, file.base + image.offset, true);
+        if (file.result)
+            return;
+    }
 
-            case EFI_IMAGE_REL_BASED_HIGH:
-                // Add second 16 bits of delta
-                F16 = (UINT16*)data;
-                *F16 = (UINT16)(*F16 + (UINT16)(((UINT32)delta) >> 16));
-                break;
+    for (int i = 0; i < file.images.size(); i++) {
+        const RebaseImage & image = file.images.at(i);
+        file.result = rebaseImage(file.data + image.offset, image.size, file.base + image.offset);
+        if (file.result)
+            return;
+    }
 
-            case EFI_IMAGE_REL_BASED_LOW:
-                // Add first 16 bits of delta
-                F16 = (UINT16*)data;
-                *F16 = (UINT16)(*F16 + (UINT16)delta);
-                break;
+    // Data checksum covers relocated images
+    EFI_FFS_FILE_HEADER* fileHeader = (EFI_FFS_FILE_HEADER*)file.data;
+    UINT32 tailSize = (file.revision == 1 && (fileHeader->Attributes & FFS_ATTRIB_TAIL_PRESENT)) ? sizeof(UINT16) : 0;
+    if (fileHeader->Attributes & FFS_ATTRIB_CHECKSUM) {
+        fileHeader->IntegrityCheck.Checksum.File = calculateChecksum8(file.data + file.headerSize, file.size - file.headerSize - tailSize);
+        if (tailSize)
+            file.data[file.size - 1] = ~fileHeader->IntegrityCheck.Checksum.File;
+    }
+}
 
-            case EFI_IMAGE_REL_BASED_HIGHLOW:
-                // Add first 32 bits of delta
-                F32 = (UINT32*)data;
-                *F32 = *F32 + (UINT32)delta;
-                break;
+UINT8 FfsEngine::applyRebasePlan(QVector<RebaseFile> & files, QByteArray & body, const UINT32 base, const QModelIndex & index)
+{
+    if (files.isEmpty())
+        return ERR_SUCCESS;
 
-            case EFI_IMAGE_REL_BASED_DIR64:
-                // Add all 64 bits of delta
-                F64 = (UINT64*)data;
-                *F64 = *F64 + (UINT64)delta;
-                break;
+    // All files are in the body now, so pointers to them stay valid
+    UINT8* data = (UINT8*)body.data();
+    for (int i = 0; i < files.size(); i++) {
+        files[i].data = data + files[i].offset;
+        files[i].base = base + files[i].offset;
+    }
 
-            default:
-                return ERR_UNKNOWN_RELOCATION_TYPE;
-            }
+    // Files don't overlap and are relocated in parallel
+    QtConcurrent::blockingMap(files, &FfsEngine::rebaseFile);
 
-            // Next relocation record
-            Reloc += 1;
+    for (int i = 0; i < files.size(); i++) {
+        const RebaseFile & file = files.at(i);
+        if (file.result) {
+            msg(tr("reconstructVolume: executable section rebase failed"), index);
+            return file.result;
         }
 
-        // Next relocation block
-        RelocBase = (EFI_IMAGE_BASE_RELOCATION*)RelocEnd;
+        // Special case of PEI Core rebase
+        for (int j = 0; j < file.images.size(); j++) {
+            const RebaseImage & image = file.images.at(j);
+            if (image.peiCore && getEntryPoint(QByteArray::fromRawData((const char*)file.data + image.offset, image.size), newPeiCoreEntryPoint))
+                msg(tr("reconstructVolume: can't get entry point of PEI core"), index);
+        }
     }
 
-    executable = file;
     return ERR_SUCCESS;
 }
 
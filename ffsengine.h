@@ -14,12 +14,20 @@ WITHWARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #define __FFSENGINE_H__
 
 #include <QDir>
+#include <QFuture>
 #include <QFile>
 #include <QFileInfo>
+#include <QIODevice>
 #include <QObject>
 #include <QModelIndex>
+#include <QPersistentModelIndex>
 #include <QByteArray>
+#include <QHash>
+#include <QMultiHash>
+#include <QPair>
 #include <QQueue>
+#include <QSharedPointer>
+#include <QStringList>
 #include <QVector>
 
 #include "basetypes.h"
@@ -41,6 +49,72 @@ struct PatchData {
     QByteArray hexReplacePattern;
 };
 
+// Estimated space in a volume after reconstruction
+struct VolumeSpace {
+    QModelIndex volume;
+    UINT32 size;
+    UINT32 used;
+    bool growable;
+};
+
+// Item deleted by compaction, recorded without its data
+// Data of items unchanged since the image was opened is taken from it again, see FfsEngine::extractRemoved
+struct RemovedItem {
+    QString path;
+    UINT8 type;
+    UINT8 subtype;
+    // Offset in the opened image, if the item is stored there as is
+    bool inImage;
+    UINT32 offset;
+    UINT32 size;
+    // SHA-1 of the item as it was removed, empty if it couldn't be extracted
+    QByteArray hash;
+};
+
+// Item found by event-driven parsing
+// Header and body point to the parsed buffer or to decompressed data and are valid only during the call
+struct FfsEvent {
+    UINT8 type;
+    UINT8 subtype;
+    // COMPRESSION_ALGORITHM_UNKNOWN for compressed sections, the algorithm is known after decompression only
+    UINT8 compression;
+    UINT8 depth;
+    // Offset is in the image, or in decompressed data of the nearest compressed section
+    bool inImage;
+    UINT32 offset;
+    const UINT8* header;
+    UINT32 headerSize;
+    const UINT8* body;
+    UINT32 bodySize;
+};
+
+// Receives items of an image in parsing order, see FfsEngine::visitImageFile
+class FfsVisitor
+{
+public:
+    virtual ~FfsVisitor() {}
+    // Called before children of the item, returns one of VISIT_* values
+    virtual UINT8 enter(const FfsEvent & event) = 0;
+    // Called after children of the item, if it was entered with VISIT_CONTINUE and parsing was not stopped
+    virtual void leave(const FfsEvent & event) { (void)event; }
+};
+
+// Step of a compiled selector, see FfsEngine::compileSelector
+struct SelectorPredicate {
+    UINT8 key;
+    QString value;
+};
+
+struct SelectorStep {
+    // Types::Root matches items of any type
+    UINT8 type;
+    // Relation to items matched by the previous step, one of SELECTOR_AXIS_* values
+    UINT8 axis;
+    QVector<SelectorPredicate> predicates;
+};
+
+typedef QVector<SelectorStep> SelectorPlan;
+
 class FfsEngine : public QObject
 {
     Q_OBJECT
@@ -53,6 +127,12 @@ public:
     // Returns model for Qt view classes
     TreeModel* treeModel() const;
 
+public slots:
+    // Parses children of an item with pending parse
+    void parsePending(const QModelIndex & index);
+
+public:
+
 #ifndef _CONSOLE
     // Returns message items queue
     QQueue<MessageListItem> messages() const;
@@ -69,6 +149,8 @@ public:
     UINT8 parsePdrRegion(const QByteArray & pdr, QModelIndex & index, const QModelIndex & parent, const UINT8 mode = CREATE_MODE_APPEND);
     UINT8 parseEcRegion(const QByteArray & ec, QModelIndex & index, const QModelIndex & parent, const UINT8 mode = CREATE_MODE_APPEND);
     UINT8 parseBios(const QByteArray & bios, const QModelIndex & parent = QModelIndex());
+    // Event-driven parsing of capsules, images, volumes, files and sections without building the tree
+    UINT8 visitImageFile(const QByteArray & buffer, FfsVisitor & visitor);
     UINT8 parseVolume(const QByteArray & volume, QModelIndex & index, const QModelIndex & parent = QModelIndex(), const UINT8 mode = CREATE_MODE_APPEND);
     UINT8 parseFile(const QByteArray & file, QModelIndex & index, const UINT8 revision = 2, const UINT8 erasePolarity = ERASE_POLARITY_UNKNOWN, const QModelIndex & parent = QModelIndex(), const UINT8 mode = CREATE_MODE_APPEND);
     UINT8 parseSections(const QByteArray & body, const QModelIndex & parent = QModelIndex());
@@ -77,9 +159,18 @@ public:
     // Compression routines
     UINT8 decompress(const QByteArray & compressed, const UINT8 compressionType, QByteArray & decompressedData, UINT8 * algorithm = NULL);
     UINT8 compress(const QByteArray & data, const UINT8 algorithm, QByteArray & compressedData);
+    // Sets one of COMPRESSION_PRESET_* to be used by compress()
+    void setCompressionPreset(const UINT8 preset);
+    // Sets minimal input size for multithreaded LZMA compression, 0 disables it
+    void setLzmaMultithreadThreshold(const UINT32 threshold);
 
     // Construction routines
     UINT8 reconstructImageFile(QByteArray &reconstructed);
+    // Reparses reconstructed image and compares it with the modified tree
+    UINT8 verifyImageFile(const QByteArray & reconstructed);
+    // Same in two steps, reconstructed image is parsed in background until parsed future is finished
+    UINT8 startVerification(const QByteArray & reconstructed, QFuture<void> & parsed);
+    UINT8 finishVerification();
     UINT8 reconstruct(const QModelIndex &index, QByteArray & reconstructed);
     UINT8 reconstructIntelImage(const QModelIndex& index, QByteArray & reconstructed);
     UINT8 reconstructRegion(const QModelIndex& index, QByteArray & reconstructed, bool includeHeader = true);
@@ -91,19 +182,54 @@ public:
 
     // Operations on tree items
     UINT8 extract(const QModelIndex & index, QByteArray & extracted, const UINT8 mode);
+    // Writes extracted item to an opened file or socket in chunks, without building it in memory
+    UINT8 extract(const QModelIndex & index, QIODevice & device, const UINT8 mode);
     UINT8 create(const QModelIndex & index, const UINT8 type, const QByteArray & header, const QByteArray & body, const UINT8 mode, const UINT8 action, const UINT8 algorithm = COMPRESSION_ALGORITHM_NONE);
     UINT8 insert(const QModelIndex & index, const QByteArray & object, const UINT8 mode);
     UINT8 replace(const QModelIndex & index, const QByteArray & object, const UINT8 mode);
+    // Swaps body of a leaf section in place, without reparsing it
+    bool canReplaceBodyInPlace(const QModelIndex & index, const QByteArray & body);
+    UINT8 replaceBodyInPlace(const QModelIndex & index, const QByteArray & body);
+    // Parses children of all items with pending parse under the item
+    void parseAllPending(const QModelIndex & index);
     UINT8 remove(const QModelIndex & index);
     UINT8 rebuild(const QModelIndex & index);
+    // Removes pad files of FFSv2/v3 volume, keeping fixed files in place and PEI files rebased
+    UINT8 defragment(const QModelIndex & index);
     UINT8 dump(const QModelIndex & index, const QString & path, const QString & filter = QString());
     UINT8 patch(const QModelIndex & index, const QVector<PatchData> & patches);
 
+    // Deletes subtrees of items marked for removal, they are skipped on reconstruction anyway
+    // Removed items are recorded in compact form until another image is parsed, see removedItems()
+    UINT8 compact(const QModelIndex & index = QModelIndex());
+    QVector<RemovedItem> removedItems() const;
+    // Returns the removed item as is, if it's still the same as in the opened image
+    UINT8 extractRemoved(const int i, QByteArray & object) const;
+
+    // Fast pre-flight check of volumes containing the item, estimated from the tree without reconstruction
+    // Returns ERR_INVALID_VOLUME and the number of bytes missing, if any of them can't fit its new contents
+    UINT8 checkSpace(const QModelIndex & index, QVector<VolumeSpace> & volumes, UINT32 & missing);
+
+    // Edit transactions
+    // Edits made after begin are checked for duplicate file GUIDs and PEI files are rebased once on commit,
+    // then the image is reconstructed; if anything fails, all the edits are rolled back
+    UINT8 beginTransaction();
+    UINT8 commitTransaction(QByteArray & reconstructed);
+    void rollbackTransaction();
+
     // Search routines
     UINT8 findHexPattern(const QModelIndex & index, const QByteArray & hexPattern, const UINT8 mode);
     UINT8 findGuidPattern(const QModelIndex & index, const QByteArray & guidPattern, const UINT8 mode);
     UINT8 findTextPattern(const QModelIndex & index, const QString & pattern, const bool unicode, const Qt::CaseSensitivity caseSensitive);
 
+    // Selectors like volume[fs=FFSv2]/file[guid=...]/section[type=PE32], each step after / matches descendants of items matched by the previous one
+    // Step after > matches only items owned by them, with no item of the previous step type in between, or children for * step
+    static UINT8 compileSelector(const QString & selector, SelectorPlan & plan);
+    // Finds items matched by the plan in tree order, the first step is matched under the scope item only
+    // Items with pending parse are parsed only under items matched by steps before the last one
+    UINT8 select(const SelectorPlan & plan, QModelIndexList & found, const QModelIndex & scope = QModelIndex());
+    UINT8 select(const QString & selector, QModelIndexList & found, const QModelIndex & scope = QModelIndex());
+
 private:
     TreeModel *model;
 
@@ -111,6 +237,97 @@ private:
     UINT32 oldPeiCoreEntryPoint;
     UINT32 newPeiCoreEntryPoint;
 
+    // Topmost items marked for removal, deleted by compaction
+    void findRemovedItems(const QModelIndex & index, QVector<QPersistentModelIndex> & found);
+    QString itemPath(const QModelIndex & index);
+
+    // Opened image and items deleted from its tree by compaction
+    QByteArray openedImage;
+    QVector<RemovedItem> removed;
+
+    // Edit transaction state
+    bool transactionActive;
+    QMultiHash<QByteArray, QPersistentModelIndex> transactionFileGuids;
+    QVector<QPersistentModelIndex> transactionFiles;
+    QVector<QPersistentModelIndex> transactionRebase;
+    UINT32 transactionOldPeiCoreEntryPoint;
+    UINT32 transactionNewPeiCoreEntryPoint;
+    int transactionMessageCount;
+    void revertTransaction();
+    void indexFileGuids(const QModelIndex & index);
+    UINT8 checkTransactionFiles();
+
+    // Compression preset
+    UINT8 compressionPreset;
+    UINT32 lzmaMultithreadThreshold;
+
+    // Decompression results of the image being parsed, keyed by compression type and compressed data
+    struct DecompressedPayload {
+        UINT8 result;
+        UINT8 algorithm;
+        QByteArray data;
+        // Section which children were parsed from data, and GUID and type of its file
+        QModelIndex parsed;
+        QByteArray parsedFile;
+        // Text set to that file while parsing, if any
+        bool fileTextChanged;
+        QString fileText;
+    };
+    typedef QPair<UINT8, QByteArray> DecompressionCacheKey;
+    QHash<DecompressionCacheKey, DecompressedPayload> decompressionCache;
+    bool decompressionCacheEnabled;
+    UINT8 decompressPayload(const QByteArray & compressed, const UINT8 compressionType, QByteArray & decompressedData, UINT8 * algorithm);
+
+    // Verification helpers
+    struct VerifyNode {
+        QModelIndex index;
+        QString path;
+        UINT8 type;
+        UINT8 subtype;
+        UINT8 compression;
+        UINT8 action;
+        // Offset is compared only for items which can't move during reconstruction
+        UINT32 offset;
+        bool offsetKept;
+        QByteArray hash;
+        QStringList messages;
+    };
+    QMultiHash<void*, QString>* itemMessages;
+    QFuture<QVector<VerifyNode> > verification;
+    QVector<VerifyNode> verificationExpected;
+    bool keepsOffset(const QModelIndex & index);
+    static QVector<VerifyNode> parseForVerification(const QByteArray & image);
+    static void collectVerifyNodes(const TreeModel* model, const QModelIndex & index, const QString & path, const bool edited, const bool skipBody, const bool skipVtfBody, const QMultiHash<void*, QString>* messages, QVector<VerifyNode> & nodes);
+
+    // Selector helpers
+    static UINT8 compileSelectorStep(const QString & text, SelectorStep & step);
+    bool selectorMatches(const SelectorStep & step, const QModelIndex & index) const;
+    void collectItems(const QModelIndex & index, QModelIndexList & items) const;
+
+    // Regions of Intel image parsed concurrently with BIOS region by separate engines
+    struct RegionParse {
+        UINT8 result;
+        QSharedPointer<FfsEngine> engine;
+        QModelIndex index;
+        QVector<QPair<QPersistentModelIndex, QString> > messages;
+    };
+    QVector<QPair<QPersistentModelIndex, QString> >* deferredMessages;
+    RegionParse parseDetachedRegion(const UINT8 subtype, const QByteArray & region) const;
+    UINT8 attachDetachedRegion(const RegionParse & parsed, const QModelIndex & parent, const QModelIndex & before);
+    void replayMessages(const QVector<QPair<QPersistentModelIndex, QString> > & messages);
+
+    // Event-driven parsing helpers, return VISIT_STOP if parsing is stopped
+    UINT8 visitBios(FfsVisitor & visitor, const UINT8* data, const UINT32 size, const UINT32 offset, const bool inImage, const UINT8 depth);
+    UINT8 visitVolume(FfsVisitor & visitor, const UINT8* data, const UINT32 size, const UINT32 offset, const bool inImage, const UINT8 depth);
+    UINT8 visitFile(FfsVisitor & visitor, const UINT8* data, const UINT32 size, const UINT8 revision, const char empty, const UINT32 offset, const bool inImage, const UINT8 depth);
+    UINT8 visitSections(FfsVisitor & visitor, const UINT8* data, const UINT32 size, const UINT32 offset, const bool inImage, const UINT8 depth);
+    UINT8 visitSection(FfsVisitor & visitor, const UINT8* data, const UINT32 size, const UINT32 offset, const bool inImage, const UINT8 depth);
+    UINT8 visitDecompressed(FfsVisitor & visitor, const UINT8* data, const UINT32 size, const UINT8 compressionType, const UINT8 depth);
+
+    // Extraction helpers
+    UINT8 extractParts(const QModelIndex & index, const UINT8 mode, QByteArray & header, QByteArray & body, QByteArray & tail);
+    UINT8 writeChunked(QIODevice & device, const QByteArray & data);
+
     // Parsing helpers
     UINT32 getPaddingType(const QByteArray & padding);
     void  parseAprioriRawSection(const QByteArray & body, QString & parsed);
@@ -118,8 +335,16 @@ private:
     UINT8 findNextVolume(const QByteArray & bios, const UINT32 volumeOffset, UINT32 & nextVolumeOffset);
     UINT8 getVolumeSize(const QByteArray & bios, const UINT32 volumeOffset, UINT32 & volumeSize, UINT32 & bmVolumeSize);
     UINT8 getSectionSize(const QByteArray & file, const UINT32 sectionOffset, UINT32 & sectionSize);
+    UINT8 parseImage(const QByteArray & buffer);
+    UINT8 parseDecompressedSections(const QByteArray & compressed, const UINT8 compressionType, const QByteArray & decompressed, const QModelIndex & index);
 
     // Reconstruction helpers
+    UINT32 estimateSize(const QModelIndex & index, const UINT8 revision);
+    UINT32 estimateSectionsSize(const QModelIndex & index, const UINT8 revision);
+    UINT32 estimateVolumeUsedSize(const QModelIndex & index);
+    bool isFixedFile(const QModelIndex & index);
+    bool pinsFixedFiles(const QModelIndex & index);
+    UINT32 originalOffset(const QModelIndex & index);
     UINT8 constructPadFile(const QByteArray &guid, const UINT32 size, const UINT8 revision, const UINT8 erasePolarity, QByteArray & pad);
     UINT8 growVolume(QByteArray & header, const UINT32 size, UINT32 & newSize);
 
@@ -127,6 +352,28 @@ private:
     UINT8 getBase(const QByteArray& file, UINT32& base);
     UINT8 getEntryPoint(const QByteArray& file, UINT32 &entryPoint);
     UINT8 rebase(QByteArray & executable, const UINT32 base);
+    static UINT8 rebaseImage(UINT8* image, const UINT32 size, const UINT32 base, const bool checkOnly = false);
+
+    // Rebase plan of a volume, PEI images are relocated in place once the volume layout is final
+    struct RebaseImage {
+        UINT32 offset;
+        UINT32 size;
+        bool peiCore;
+    };
+    struct RebaseFile {
+        UINT32 offset;
+        UINT8* data;
+        UINT32 base;
+        UINT32 headerSize;
+        UINT32 size;
+        UINT8 revision;
+        UINT8 result;
+        QVector<RebaseImage> images;
+    };
+    QVector<RebaseImage>* rebaseImages;
+    static void addRebaseFile(QVector<RebaseFile> & files, const QVector<RebaseImage> & images, const QByteArray & file, const UINT32 headerSize, const UINT32 offset, const UINT8 revision);
+    static void rebaseFile(RebaseFile & file);
+    UINT8 applyRebasePlan(QVector<RebaseFile> & files, QByteArray & body, const UINT32 base, const QModelIndex & index);
     void  rebasePeiFiles(const QModelIndex & index);
 
     // Patch routines
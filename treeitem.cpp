@@ -28,6 +28,8 @@ TreeItem::TreeItem(const UINT8 type, const UINT8 subtype, const UINT8 compressio
     itemInfo(info),
     itemHeader(header),
     itemBody(body),
+    itemPendingParse(false),
+    itemOffset(0),
     parentItem(parent)
 {
 }
@@ -65,6 +67,16 @@ UINT8 TreeItem::insertChildAfter(TreeItem *item, TreeItem *newItem)
     return ERR_SUCCESS;
 }
 
+UINT8 TreeItem::removeChild(TreeItem *item)
+{
+    int index = childItems.indexOf(item);
+    if (index == -1)
+        return ERR_ITEM_NOT_FOUND;
+    childItems.removeAt(index);
+    delete item;
+    return ERR_SUCCESS;
+}
+
 TreeItem *TreeItem::child(int row)
 {
     return childItems.value(row, NULL);
@@ -193,6 +205,51 @@ bool TreeItem::hasEmptyBody() const
     return itemBody.isEmpty();
 }
 
+void TreeItem::setHeader(const QByteArray &header)
+{
+    itemHeader = header;
+}
+
+void TreeItem::setBody(const QByteArray &body)
+{
+    itemBody = body;
+}
+
+bool TreeItem::pendingParse() const
+{
+    return itemPendingParse;
+}
+
+void TreeItem::setPendingParse(const bool pending)
+{
+    itemPendingParse = pending;
+}
+
+UINT32 TreeItem::offset() const
+{
+    return itemOffset;
+}
+
+void TreeItem::setOffset(const UINT32 offset)
+{
+    itemOffset = offset;
+}
+
+QByteArray TreeItem::uncompressedData() const
+{
+    return itemUncompressedData;
+}
+
+bool TreeItem::hasEmptyUncompressedData() const
+{
+    return itemUncompressedData.isEmpty();
+}
+
+void TreeItem::setUncompressedData(const QByteArray &data)
+{
+    itemUncompressedData = data;
+}
+
 UINT8 TreeItem::action() const
 {
     return itemAction;
@@ -213,3 +270,8 @@ void TreeItem::setAction(const UINT8 action)
         parentItem->setAction(Actions::Rebuild);
 }
 
+void TreeItem::restoreAction(const UINT8 action)
+{
+    itemAction = action;
+}
+
@@ -35,6 +35,7 @@ public:
     void prependChild(TreeItem *item);
     UINT8 insertChildBefore(TreeItem *item, TreeItem *newItem);
     UINT8 insertChildAfter(TreeItem *item, TreeItem *newItem);
+    UINT8 removeChild(TreeItem *item);
 
     // Model support operations
     TreeItem *child(int row);
@@ -59,9 +60,15 @@ public:
 
     QByteArray header() const;
     bool hasEmptyHeader() const;
+    void setHeader(const QByteArray &header);
 
     QByteArray body() const;
     bool hasEmptyBody() const;
+    void setBody(const QByteArray &body);
+
+    QByteArray uncompressedData() const;
+    bool hasEmptyUncompressedData() const;
+    void setUncompressedData(const QByteArray &data);
 
     QString info() const;
     void addInfo(const QString &info);
@@ -69,9 +76,19 @@ public:
     
     UINT8 action() const;
     void setAction(const UINT8 action);
+    // Sets action without changing actions of parents and children
+    void restoreAction(const UINT8 action);
 
     UINT8 compression() const;
 
+    // Body is not parsed for children yet
+    bool pendingParse() const;
+    void setPendingParse(const bool pending);
+
+    // Offset in the body of parent item, or in decompressed data of a compressed parent
+    UINT32 offset() const;
+    void setOffset(const UINT32 offset);
+
 private:
     QList<TreeItem*> childItems;
     UINT8      itemAction;
@@ -83,6 +100,9 @@ private:
     QString    itemInfo;
     QByteArray itemHeader;
     QByteArray itemBody;
+    QByteArray itemUncompressedData;
+    bool       itemPendingParse;
+    UINT32     itemOffset;
     TreeItem *parentItem;
 };
 
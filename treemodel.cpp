@@ -18,6 +18,9 @@ TreeModel::TreeModel(QObject *parent)
     : QAbstractItemModel(parent)
 {
     rootItem = new TreeItem(Types::Root);
+    journalEnabled = false;
+    offsetIndexValid = false;
+    itemIndexValid = false;
 }
 
 TreeModel::~TreeModel()
@@ -132,6 +135,26 @@ int TreeModel::rowCount(const QModelIndex &parent) const
     return parentItem->childCount();
 }
 
+bool TreeModel::hasChildren(const QModelIndex &parent) const
+{
+    if (parent.isValid() && static_cast<TreeItem*>(parent.internalPointer())->pendingParse())
+        return true;
+    return rowCount(parent) > 0;
+}
+
+bool TreeModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (!parent.isValid())
+        return false;
+    return static_cast<TreeItem*>(parent.internalPointer())->pendingParse();
+}
+
+void TreeModel::fetchMore(const QModelIndex &parent)
+{
+    if (canFetchMore(parent))
+        emit parseRequested(parent);
+}
+
 UINT8 TreeModel::type(const QModelIndex &index) const
 {
     if (!index.isValid())
@@ -180,6 +203,22 @@ bool TreeModel::hasEmptyBody(const QModelIndex &index) const
     return item->hasEmptyBody();
 }
 
+QByteArray TreeModel::uncompressedData(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return QByteArray();
+    TreeItem *item = static_cast<TreeItem*>(index.internalPointer());
+    return item->uncompressedData();
+}
+
+bool TreeModel::hasEmptyUncompressedData(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return true;
+    TreeItem *item = static_cast<TreeItem*>(index.internalPointer());
+    return item->hasEmptyUncompressedData();
+}
+
 QString TreeModel::name(const QModelIndex &index) const
 {
     if (!index.isValid())
@@ -220,6 +259,175 @@ UINT8 TreeModel::compression(const QModelIndex &index) const
     return item->compression();
 }
 
+bool TreeModel::pendingParse(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return false;
+    TreeItem *item = static_cast<TreeItem*>(index.internalPointer());
+    return item->pendingParse();
+}
+
+UINT32 TreeModel::offset(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return 0;
+    TreeItem *item = static_cast<TreeItem*>(index.internalPointer());
+    return item->offset();
+}
+
+void TreeModel::setOffset(const QModelIndex &index, const UINT32 offset)
+{
+    if (!index.isValid())
+        return;
+
+    TreeItem *item = static_cast<TreeItem*>(index.internalPointer());
+    item->setOffset(offset);
+    offsetIndexValid = false;
+}
+
+// Items added by modifications are not in the parsed image
+static bool isNewItem(const TreeItem *item)
+{
+    return item->action() == Actions::Create || item->action() == Actions::Insert || item->action() == Actions::Replace;
+}
+
+bool TreeModel::imageOffset(const QModelIndex &index, UINT32 &offset) const
+{
+    if (!index.isValid())
+        return false;
+
+    UINT32 current = 0;
+    for (TreeItem *item = static_cast<TreeItem*>(index.internalPointer()); item && item != rootItem; item = item->parent()) {
+        if (isNewItem(item))
+            return false;
+        current += item->offset();
+
+        // Children of compressed items are in decompressed data
+        TreeItem *parentItem = item->parent();
+        if (parentItem && parentItem != rootItem) {
+            if (parentItem->compression() != COMPRESSION_ALGORITHM_NONE)
+                return false;
+            current += parentItem->header().size();
+        }
+    }
+
+    offset = current;
+    return true;
+}
+
+QModelIndex TreeModel::findByOffset(const UINT32 offset) const
+{
+    if (!offsetIndexValid)
+        buildOffsetIndex();
+
+    // Find the last segment beginning at or before the offset
+    int low = 0;
+    int high = offsetSegments.size();
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (offsetSegments.at(middle).begin <= offset)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low == 0)
+        return QModelIndex();
+
+    TreeItem *item = offsetSegments.at(low - 1).item;
+    if (!item || item == rootItem)
+        return QModelIndex();
+    return createIndex(item->row(), 0, item);
+}
+
+void TreeModel::buildOffsetIndex() const
+{
+    offsetSegments.clear();
+    addOffsetSegments(rootItem, 0, 0xFFFFFFFF);
+    offsetIndexValid = true;
+}
+
+void TreeModel::appendOffsetSegment(const UINT32 begin, TreeItem *item) const
+{
+    // Empty segment at the same offset is replaced
+    if (!offsetSegments.isEmpty() && offsetSegments.last().begin == begin) {
+        offsetSegments.last().item = item;
+        return;
+    }
+
+    OffsetSegment segment;
+    segment.begin = begin;
+    segment.item = item;
+    offsetSegments.append(segment);
+}
+
+void TreeModel::addOffsetSegments(TreeItem *item, const UINT32 begin, const UINT32 end) const
+{
+    appendOffsetSegment(begin, item);
+
+    // Children of compressed items are not in the image
+    if (item != rootItem && item->compression() != COMPRESSION_ALGORITHM_NONE)
+        return;
+
+    UINT32 bodyBegin = begin + (item == rootItem ? 0 : item->header().size());
+    UINT32 current = begin;
+    for (int i = 0; i < item->childCount(); i++) {
+        TreeItem *child = item->child(i);
+        if (isNewItem(child))
+            continue;
+
+        // Children are sorted by offset and don't overlap, anything else is skipped
+        UINT32 childBegin = bodyBegin + child->offset();
+        UINT32 childEnd = childBegin + child->header().size() + child->body().size();
+        if (childBegin < current || childEnd <= childBegin || childEnd > end)
+            continue;
+
+        addOffsetSegments(child, childBegin, childEnd);
+        current = childEnd;
+
+        // The rest of the item up to the next child
+        appendOffsetSegment(childEnd, item);
+    }
+}
+
+QModelIndexList TreeModel::findByName(const QString & name) const
+{
+    if (!itemIndexValid)
+        buildItemIndex();
+    return indexList(nameItems.value(name));
+}
+
+QModelIndexList TreeModel::findByType(const UINT8 type) const
+{
+    if (!itemIndexValid)
+        buildItemIndex();
+    return indexList(typeItems.value(type));
+}
+
+void TreeModel::buildItemIndex() const
+{
+    nameItems.clear();
+    typeItems.clear();
+    for (int i = 0; i < rootItem->childCount(); i++)
+        addIndexItems(rootItem->child(i));
+    itemIndexValid = true;
+}
+
+void TreeModel::addIndexItems(TreeItem *item) const
+{
+    nameItems[item->name()].append(item);
+    typeItems[item->type()].append(item);
+    for (int i = 0; i < item->childCount(); i++)
+        addIndexItems(item->child(i));
+}
+
+QModelIndexList TreeModel::indexList(const QVector<TreeItem*> & items) const
+{
+    QModelIndexList list;
+    for (int i = 0; i < items.size(); i++)
+        list.append(createIndex(items.at(i)->row(), 0, items.at(i)));
+    return list;
+}
+
 void TreeModel::setSubtype(const QModelIndex & index, const UINT8 subtype)
 {
     if (!index.isValid())
@@ -227,6 +435,7 @@ void TreeModel::setSubtype(const QModelIndex & index, const UINT8 subtype)
 
     TreeItem *item = static_cast<TreeItem*>(index.internalPointer());
     item->setSubtype(subtype);
+    itemIndexValid = false;
     emit dataChanged(index, index);
 }
 
@@ -237,6 +446,7 @@ void TreeModel::setName(const QModelIndex &index, const QString &data)
 
     TreeItem *item = static_cast<TreeItem*>(index.internalPointer());
     item->setName(data);
+    itemIndexValid = false;
     emit dataChanged(index, index);
 }
 
@@ -247,6 +457,7 @@ void TreeModel::setType(const QModelIndex &index, const UINT8 data)
 
     TreeItem *item = static_cast<TreeItem*>(index.internalPointer());
     item->setType(data);
+    itemIndexValid = false;
     emit dataChanged(index, index);
 }
 
@@ -256,16 +467,79 @@ void TreeModel::setText(const QModelIndex &index, const QString &data)
         return;
 
     TreeItem *item = static_cast<TreeItem*>(index.internalPointer());
+    if (journalEnabled)
+        journalItem(item);
     item->setText(data);
     emit dataChanged(index, index);
 }
 
+void TreeModel::setUncompressedData(const QModelIndex &index, const QByteArray &data)
+{
+    if (!index.isValid())
+        return;
+
+    TreeItem *item = static_cast<TreeItem*>(index.internalPointer());
+    item->setUncompressedData(data);
+}
+
+void TreeModel::setHeader(const QModelIndex &index, const QByteArray &header)
+{
+    if (!index.isValid())
+        return;
+
+    TreeItem *item = static_cast<TreeItem*>(index.internalPointer());
+    offsetIndexValid = false;
+    if (journalEnabled)
+        journalItem(item);
+    item->setHeader(header);
+}
+
+void TreeModel::setBody(const QModelIndex &index, const QByteArray &body)
+{
+    if (!index.isValid())
+        return;
+
+    TreeItem *item = static_cast<TreeItem*>(index.internalPointer());
+    offsetIndexValid = false;
+    if (journalEnabled)
+        journalItem(item);
+    item->setBody(body);
+}
+
+void TreeModel::setInfo(const QModelIndex &index, const QString &info)
+{
+    if (!index.isValid())
+        return;
+
+    TreeItem *item = static_cast<TreeItem*>(index.internalPointer());
+    if (journalEnabled)
+        journalItem(item);
+    item->setInfo(info);
+    emit dataChanged(index, index);
+}
+
+void TreeModel::setPendingParse(const QModelIndex &index, const bool pending)
+{
+    if (!index.isValid())
+        return;
+
+    TreeItem *item = static_cast<TreeItem*>(index.internalPointer());
+    if (journalEnabled)
+        journalItem(item);
+    item->setPendingParse(pending);
+}
+
 void TreeModel::setAction(const QModelIndex &index, const UINT8 action)
 {
     if (!index.isValid())
         return;
 
     TreeItem *item = static_cast<TreeItem*>(index.internalPointer());
+    offsetIndexValid = false;
+    // Setting an action can also set rebuild action for all parents
+    if (journalEnabled)
+        for (TreeItem *current = item; current && current != rootItem; current = current->parent())
+            journalItem(current);
     item->setAction(action);
     emit dataChanged(this->index(0, 0), index);
 }
@@ -293,31 +567,49 @@ QModelIndex TreeModel::addItem(const UINT8 type, const UINT8 subtype, const UINT
         }
     }
 
+    // Rows are inserted properly, so persistent indexes of other items stay valid
+    int row;
+    if (mode == CREATE_MODE_APPEND)
+        row = parentItem->childCount();
+    else if (mode == CREATE_MODE_PREPEND)
+        row = 0;
+    else if (mode == CREATE_MODE_BEFORE)
+        row = item->row();
+    else if (mode == CREATE_MODE_AFTER)
+        row = item->row() + 1;
+    else
+        return QModelIndex();
+
+    QModelIndex parentIndex;
+    if (parentItem != rootItem)
+        parentIndex = createIndex(parentItem->row(), 0, parentItem);
+
     TreeItem *newItem = new TreeItem(type, subtype, compression, name, text, info, header, body, parentItem);
-    if (mode == CREATE_MODE_APPEND) {
-        emit layoutAboutToBeChanged();
+    offsetIndexValid = false;
+    itemIndexValid = false;
+    beginInsertRows(parentIndex, row, row);
+    if (mode == CREATE_MODE_APPEND)
         parentItem->appendChild(newItem);
-    }
-    else if (mode == CREATE_MODE_PREPEND) {
-        emit layoutAboutToBeChanged();
+    else if (mode == CREATE_MODE_PREPEND)
         parentItem->prependChild(newItem);
-    }
-    else if (mode == CREATE_MODE_BEFORE) {
-        emit layoutAboutToBeChanged();
+    else if (mode == CREATE_MODE_BEFORE)
         parentItem->insertChildBefore(item, newItem);
-    }
-    else if (mode == CREATE_MODE_AFTER) {
-        emit layoutAboutToBeChanged();
+    else
         parentItem->insertChildAfter(item, newItem);
-    }
-    else {
-        delete newItem;
-        return QModelIndex();
+    endInsertRows();
+
+    QModelIndex created = createIndex(newItem->row(), parentColumn, newItem);
+    if (journalEnabled) {
+        JournalEntry entry;
+        entry.index = created;
+        entry.created = true;
+        entry.action = Actions::NoAction;
+        entry.pendingParse = false;
+        journal.append(entry);
+        journaledItems.insert(newItem);
     }
 
-    emit layoutChanged();
-
-    return createIndex(newItem->row(), parentColumn, newItem);
+    return created;
 }
 
 QModelIndex TreeModel::findParentOfType(const QModelIndex& index, UINT8 type) const
@@ -337,3 +629,120 @@ QModelIndex TreeModel::findParentOfType(const QModelIndex& index, UINT8 type) co
 
     return QModelIndex();
 }
+
+static void copyChildItems(TreeItem* source, TreeItem* destination)
+{
+    for (int i = 0; i < source->childCount(); i++) {
+        TreeItem* child = source->child(i);
+        TreeItem* copy = new TreeItem(child->type(), child->subtype(), child->compression(),
+            child->name(), child->text(), child->info(), child->header(), child->body(), destination);
+        copy->setAction(child->action());
+        copy->setUncompressedData(child->uncompressedData());
+        copy->setPendingParse(child->pendingParse());
+        copy->setOffset(child->offset());
+        destination->appendChild(copy);
+        copyChildItems(child, copy);
+    }
+}
+
+void TreeModel::copyChildren(const QModelIndex & source, const QModelIndex & destination)
+{
+    if (!source.isValid() || !destination.isValid())
+        return;
+
+    TreeItem *sourceItem = static_cast<TreeItem*>(source.internalPointer());
+    TreeItem *destinationItem = static_cast<TreeItem*>(destination.internalPointer());
+    if (!sourceItem->childCount())
+        return;
+
+    // Copies are appended as new rows, so persistent indexes of other items stay valid
+    int first = destinationItem->childCount();
+    offsetIndexValid = false;
+    itemIndexValid = false;
+    beginInsertRows(destination, first, first + sourceItem->childCount() - 1);
+    copyChildItems(sourceItem, destinationItem);
+    endInsertRows();
+}
+
+void TreeModel::removeItem(const QModelIndex & index)
+{
+    if (!index.isValid())
+        return;
+
+    TreeItem *item = static_cast<TreeItem*>(index.internalPointer());
+    TreeItem *parentItem = item->parent();
+    if (!parentItem)
+        return;
+
+    // Rows are removed properly, so persistent indexes of other items stay valid
+    int row = item->row();
+    offsetIndexValid = false;
+    itemIndexValid = false;
+    beginRemoveRows(parent(index), row, row);
+    parentItem->removeChild(item);
+    endRemoveRows();
+}
+
+void TreeModel::startJournal()
+{
+    journal.clear();
+    journaledItems.clear();
+    journalEnabled = true;
+}
+
+void TreeModel::stopJournal()
+{
+    journalEnabled = false;
+    journal.clear();
+    journaledItems.clear();
+}
+
+void TreeModel::journalItem(TreeItem *item)
+{
+    // Only the state before the first change is needed
+    if (journaledItems.contains(item))
+        return;
+    journaledItems.insert(item);
+
+    JournalEntry entry;
+    entry.index = createIndex(item->row(), 0, item);
+    entry.created = false;
+    entry.action = item->action();
+    entry.text = item->text();
+    entry.info = item->info();
+    entry.header = item->header();
+    entry.body = item->body();
+    entry.pendingParse = item->pendingParse();
+    journal.append(entry);
+}
+
+void TreeModel::revertJournal()
+{
+    journalEnabled = false;
+    offsetIndexValid = false;
+    itemIndexValid = false;
+
+    // Children are added after their parents, so they are deleted first
+    for (int i = journal.count() - 1; i >= 0; i--) {
+        const JournalEntry & entry = journal.at(i);
+        if (entry.created && entry.index.isValid())
+            removeItem(entry.index);
+    }
+
+    for (int i = journal.count() - 1; i >= 0; i--) {
+        const JournalEntry & entry = journal.at(i);
+        if (entry.created || !entry.index.isValid())
+            continue;
+
+        TreeItem *item = static_cast<TreeItem*>(entry.index.internalPointer());
+        item->restoreAction(entry.action);
+        item->setText(entry.text);
+        item->setInfo(entry.info);
+        item->setHeader(entry.header);
+        item->setBody(entry.body);
+        item->setPendingParse(entry.pendingParse);
+        emit dataChanged(entry.index, entry.index);
+    }
+
+    stopJournal();
+}
@@ -15,9 +15,13 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #define __TREEMODEL_H__
 
 #include <QAbstractItemModel>
+#include <QHash>
 #include <QModelIndex>
+#include <QPersistentModelIndex>
+#include <QSet>
 #include <QString>
 #include <QVariant>
+#include <QVector>
 
 
 #include "basetypes.h"
@@ -43,12 +47,22 @@ public:
     int rowCount(const QModelIndex &parent = QModelIndex()) const;
     int columnCount(const QModelIndex &parent = QModelIndex()) const;
 
+    // Items with pending parse can be expanded, their children are requested when it happens
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const;
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+
     void setAction(const QModelIndex &index, const UINT8 action);
     void setType(const QModelIndex &index, const UINT8 type);
     void setSubtype(const QModelIndex &index, const UINT8 subtype);
     void setName(const QModelIndex &index, const QString &name);
     void setText(const QModelIndex &index, const QString &text);
     void setParsingData(const QModelIndex &index, const QByteArray &data);
+    void setUncompressedData(const QModelIndex &index, const QByteArray &data);
+    void setHeader(const QModelIndex &index, const QByteArray &header);
+    void setBody(const QModelIndex &index, const QByteArray &body);
+    void setInfo(const QModelIndex &index, const QString &info);
+    void setPendingParse(const QModelIndex &index, const bool pending);
 
     QString name(const QModelIndex &index) const;
     QString text(const QModelIndex &index) const;
@@ -61,8 +75,22 @@ public:
     bool hasEmptyBody(const QModelIndex &index) const;
     QByteArray parsingData(const QModelIndex &index) const;
     bool hasEmptyParsingData(const QModelIndex &index) const;
+    QByteArray uncompressedData(const QModelIndex &index) const;
+    bool hasEmptyUncompressedData(const QModelIndex &index) const;
     UINT8 action(const QModelIndex &index) const;
     UINT8 compression(const QModelIndex &index) const;
+    bool pendingParse(const QModelIndex &index) const;
+
+    // Offset of the item in the body of its parent, or in decompressed data of a compressed parent
+    UINT32 offset(const QModelIndex &index) const;
+    void setOffset(const QModelIndex &index, const UINT32 offset);
+    // Offset of the item in the parsed image, false if the item is not there as is
+    bool imageOffset(const QModelIndex &index, UINT32 &offset) const;
+    // Deepest item of the parsed image which contains the offset
+    QModelIndex findByOffset(const UINT32 offset) const;
+    // Items with the name or of the type, in tree order
+    QModelIndexList findByName(const QString & name) const;
+    QModelIndexList findByType(const UINT8 type) const;
 
     QModelIndex addItem(const UINT8 type, const UINT8 subtype = 0, const UINT8 compression = COMPRESSION_ALGORITHM_NONE,
         const QString & name = QString(), const QString & text = QString(), const QString & info = QString(),
@@ -71,8 +99,59 @@ public:
 
     QModelIndex findParentOfType(const QModelIndex & index, UINT8 type) const;
 
+    // Appends copies of all children of source item to destination item
+    void copyChildren(const QModelIndex & source, const QModelIndex & destination);
+
+    // Deletes an item with all its children
+    void removeItem(const QModelIndex & index);
+
+    // Journal of added items and changed actions, texts and contents,
+    // reverting it undoes all those changes made since it was started
+    void startJournal();
+    void stopJournal();
+    void revertJournal();
+
+signals:
+    // Emitted when an item with pending parse is expanded
+    void parseRequested(const QModelIndex &index);
+
 private:
     TreeItem *rootItem;
+
+    struct JournalEntry {
+        QPersistentModelIndex index;
+        bool created;
+        UINT8 action;
+        QString text;
+        QString info;
+        QByteArray header;
+        QByteArray body;
+        bool pendingParse;
+    };
+    bool journalEnabled;
+    QVector<JournalEntry> journal;
+    QSet<TreeItem*> journaledItems;
+    void journalItem(TreeItem *item);
+
+    // Image is split into segments with the same deepest item, sorted by offset
+    // The index is rebuilt on the first query after the tree is changed
+    struct OffsetSegment {
+        UINT32 begin;
+        TreeItem *item;
+    };
+    mutable QVector<OffsetSegment> offsetSegments;
+    mutable bool offsetIndexValid;
+    void buildOffsetIndex() const;
+    void appendOffsetSegment(const UINT32 begin, TreeItem *item) const;
+    void addOffsetSegments(TreeItem *item, const UINT32 begin, const UINT32 end) const;
+
+    // Items by name and by type, rebuilt on the first query after the tree is changed
+    mutable QHash<QString, QVector<TreeItem*> > nameItems;
+    mutable QHash<UINT8, QVector<TreeItem*> > typeItems;
+    mutable bool itemIndexValid;
+    void buildItemIndex() const;
+    void addIndexItems(TreeItem *item) const;
+    QModelIndexList indexList(const QVector<TreeItem*> & items) const;
 };
 
 #endif
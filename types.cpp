@@ -128,6 +128,8 @@ QString compressionTypeToQString(const UINT8 algorithm)
         return QObject::tr("LZMA");
     case COMPRESSION_ALGORITHM_IMLZMA:
         return QObject::tr("Intel modified LZMA");
+    case COMPRESSION_ALGORITHM_BROTLI:
+        return QObject::tr("Brotli");
     default:
         return QObject::tr("Unknown");
     }
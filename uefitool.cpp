@@ -47,6 +47,7 @@ version(tr("0.22.1"))
     connect(ui->actionOpenImageFileInNewWindow, SIGNAL(triggered()), this, SLOT(openImageFileInNewWindow()));
     connect(ui->actionSaveImageFile, SIGNAL(triggered()), this, SLOT(saveImageFile()));
     connect(ui->actionSearch, SIGNAL(triggered()), this, SLOT(search()));
+    connect(ui->actionGoToOffset, SIGNAL(triggered()), this, SLOT(goToOffset()));
     connect(ui->actionExtract, SIGNAL(triggered()), this, SLOT(extractAsIs()));
     connect(ui->actionExtractBody, SIGNAL(triggered()), this, SLOT(extractBody()));
     connect(ui->actionInsertInto, SIGNAL(triggered()), this, SLOT(insertInto()));
@@ -56,6 +57,8 @@ version(tr("0.22.1"))
     connect(ui->actionReplaceBody, SIGNAL(triggered()), this, SLOT(replaceBody()));
     connect(ui->actionRemove, SIGNAL(triggered()), this, SLOT(remove()));
     connect(ui->actionRebuild, SIGNAL(triggered()), this, SLOT(rebuild()));
+    connect(ui->actionDefragment, SIGNAL(triggered()), this, SLOT(defragment()));
+    connect(ui->actionExtractRemoved, SIGNAL(triggered()), this, SLOT(extractRemoved()));
     connect(ui->actionMessagesCopy, SIGNAL(triggered()), this, SLOT(copyMessage()));
     connect(ui->actionMessagesCopyAll, SIGNAL(triggered()), this, SLOT(copyAllMessages()));
     connect(ui->actionMessagesClear, SIGNAL(triggered()), this, SLOT(clearMessages()));
@@ -69,6 +72,7 @@ version(tr("0.22.1"))
     connect(ui->actionNormal, SIGNAL(triggered()), this, SLOT(setZoomFactor()));
     connect(ui->actionMessagebox, SIGNAL(triggered()), this, SLOT(hideWindowPanes()));
     connect(ui->actionInfobox, SIGNAL(triggered()), this, SLOT(hideWindowPanes()));
+    connect(ui->actionMaxCompression, SIGNAL(toggled(bool)), this, SLOT(setMaxCompression(bool)));
 
 
     connect(ui->closeButton, SIGNAL(clicked()),this, SLOT(exit()));
@@ -395,12 +399,14 @@ void UEFITool::init()
     ui->menuSectionActions->setDisabled(true);
     ui->actionMessagesCopy->setDisabled(true);
     ui->actionMessagesCopyAll->setDisabled(true);
+    ui->actionExtractRemoved->setDisabled(true);
 
     // Make new ffsEngine
     if (ffsEngine)
         delete ffsEngine;
     ffsEngine = new FfsEngine(this);
     ui->structureTreeView->setModel(ffsEngine->treeModel());
+    setMaxCompression(ui->actionMaxCompression->isChecked());
 
     // Connect
     connect(ui->structureTreeView->selectionModel(), SIGNAL(currentChanged(const QModelIndex &, const QModelIndex &)),
@@ -421,7 +427,11 @@ void UEFITool::populateUi(const QModelIndex &current)
     UINT8 subtype = model->subtype(current);
 
     // Set info text
-    ui->infoEdit->setPlainText(model->info(current));
+    UINT32 offset;
+    if (model->imageOffset(current, offset))
+        ui->infoEdit->setPlainText(tr("Offset: %1h\n").hexarg(offset) + model->info(current));
+    else
+        ui->infoEdit->setPlainText(model->info(current));
 
     // Enable menus
     ui->menuCapsuleActions->setEnabled(type == Types::Capsule);
@@ -435,6 +445,7 @@ void UEFITool::populateUi(const QModelIndex &current)
     // Enable actions
     ui->actionExtract->setDisabled(model->hasEmptyHeader(current) && model->hasEmptyBody(current));
     ui->actionRebuild->setEnabled(type == Types::Volume || type == Types::File || type == Types::Section);
+    ui->actionDefragment->setEnabled(type == Types::Volume && (subtype == Subtypes::Ffs2Volume || subtype == Subtypes::Ffs3Volume));
     ui->actionExtractBody->setDisabled(model->hasEmptyBody(current));
     ui->actionRemove->setEnabled(type == Types::Volume || type == Types::File || type == Types::Section);
     ui->actionInsertInto->setEnabled((type == Types::Volume && subtype != Subtypes::UnknownVolume) ||
@@ -497,6 +508,32 @@ void UEFITool::search()
     }
 }
 
+void UEFITool::goToOffset()
+{
+    bool ok;
+    QString text = QInputDialog::getText(this, tr("Go to offset"), tr("Offset in the image (hex):"), QLineEdit::Normal, QString(), &ok);
+    if (!ok || text.isEmpty())
+        return;
+
+    text = text.trimmed();
+    if (text.endsWith('h', Qt::CaseInsensitive))
+        text.chop(1);
+    UINT32 offset = text.toUInt(&ok, 16);
+    if (!ok) {
+        QMessageBox::warning(this, tr("Go to offset"), tr("%1 is not a hexadecimal offset").arg(text), QMessageBox::Ok);
+        return;
+    }
+
+    QModelIndex index = ffsEngine->treeModel()->findByOffset(offset);
+    if (!index.isValid()) {
+        ui->statusBar->showMessage(tr("Offset %1h is outside of the image").hexarg(offset));
+        return;
+    }
+
+    ui->structureTreeView->scrollTo(index, QAbstractItemView::PositionAtCenter);
+    ui->structureTreeView->setCurrentIndex(index);
+}
+
 void UEFITool::rebuild()
 {
     QModelIndex index = ui->structureTreeView->selectionModel()->currentIndex();
@@ -509,6 +546,51 @@ void UEFITool::rebuild()
         ui->actionSaveImageFile->setEnabled(true);
 }
 
+void UEFITool::defragment()
+{
+    QModelIndex index = ui->structureTreeView->selectionModel()->currentIndex();
+    if (!index.isValid())
+        return;
+
+    UINT8 result = ffsEngine->defragment(index);
+    showMessages();
+
+    if (result == ERR_SUCCESS)
+        ui->actionSaveImageFile->setEnabled(true);
+}
+
+void UEFITool::extractRemoved()
+{
+    QVector<RemovedItem> items = ffsEngine->removedItems();
+    if (items.isEmpty())
+        return;
+
+    // Same path can be removed more than once, so items are numbered
+    QStringList names;
+    for (int i = 0; i < items.size(); i++)
+        names.append(tr("%1: %2 (%3h bytes)%4").arg(i + 1).arg(items.at(i).path).hexarg(items.at(i).size)
+            .arg(items.at(i).inImage ? QString() : tr(", not in opened image")));
+    bool ok;
+    QString name = QInputDialog::getItem(this, tr("Extract removed item"), tr("Item:"), names, names.size() - 1, false, &ok);
+    if (!ok)
+        return;
+
+    QByteArray object;
+    UINT8 result = ffsEngine->extractRemoved(names.indexOf(name), object);
+    if (result) {
+        QMessageBox::critical(this, tr("Extraction failed"), tr("Item was created or changed after the image was opened, its data is not kept"), QMessageBox::Ok);
+        return;
+    }
+
+    QString path = QFileDialog::getSaveFileName(this, tr("Save removed item to file"), currentDir, "Binary files (*.bin);;All files (*)");
+    if (path.trimmed().isEmpty())
+        return;
+
+    QSaveFile outputFile(path);
+    if (!outputFile.open(QFile::WriteOnly) || outputFile.write(object) != object.size() || !outputFile.commit())
+        QMessageBox::critical(this, tr("Extraction failed"), tr("Can't write output file"), QMessageBox::Ok);
+}
+
 void UEFITool::remove()
 {
     QModelIndex index = ui->structureTreeView->selectionModel()->currentIndex();
@@ -574,6 +656,9 @@ void UEFITool::insert(const UINT8 mode)
         return;
     }
     ui->actionSaveImageFile->setEnabled(true);
+
+    // Warn early if the modified image won't fit
+    checkSpace(index);
 }
 
 void UEFITool::insertInto()
@@ -697,6 +782,20 @@ void UEFITool::replace(const UINT8 mode)
         return;
     }
     ui->actionSaveImageFile->setEnabled(true);
+
+    // Warn early if the modified image won't fit
+    checkSpace(index);
+}
+
+void UEFITool::checkSpace(const QModelIndex & index)
+{
+    QVector<VolumeSpace> volumes;
+    UINT32 missing;
+    if (ffsEngine->checkSpace(index, volumes, missing)) {
+        showMessages();
+        QMessageBox::warning(this, tr("Not enough space"),
+            tr("Modified volume needs %1 byte(s) more than available, the image can't be saved as is").arg(missing), QMessageBox::Ok);
+    }
 }
 
 void UEFITool::extractAsIs()
@@ -782,22 +881,21 @@ void UEFITool::extract(const UINT8 mode)
     if (path.trimmed().isEmpty())
         return;
 
-    QByteArray extracted;
-    UINT8 result = ffsEngine->extract(index, extracted, mode);
-    if (result) {
-        QMessageBox::critical(this, tr("Extraction failed"), errorMessage(result), QMessageBox::Ok);
+    // Object is streamed to a temporary file which replaces the output one only if extraction succeeds
+    QSaveFile outputFile(path);
+    if (!outputFile.open(QFile::WriteOnly)) {
+        QMessageBox::critical(this, tr("Extraction failed"), tr("Can't open output file for rewriting"), QMessageBox::Ok);
         return;
     }
 
-    QFile outputFile;
-    outputFile.setFileName(path);
-    if (!outputFile.open(QFile::WriteOnly)) {
-        QMessageBox::critical(this, tr("Extraction failed"), tr("Can't open output file for rewriting"), QMessageBox::Ok);
+    UINT8 result = ffsEngine->extract(index, outputFile, mode);
+    if (result) {
+        outputFile.cancelWriting();
+        QMessageBox::critical(this, tr("Extraction failed"), errorMessage(result), QMessageBox::Ok);
         return;
     }
-    outputFile.resize(0);
-    outputFile.write(extracted);
-    outputFile.close();
+    if (!outputFile.commit())
+        QMessageBox::critical(this, tr("Extraction failed"), tr("Can't write output file"), QMessageBox::Ok);
 }
 
 void UEFITool::about()
@@ -840,6 +938,31 @@ void UEFITool::saveImageFile()
         return;
     }
 
+    // Check that reconstructed image parses back to the same structure
+    bool verified = true;
+    if (ui->actionVerifyOnSave->isChecked()) {
+        QFuture<void> parsed;
+        result = ffsEngine->startVerification(reconstructed, parsed);
+        if (!result) {
+            // Reconstructed image is parsed in background, the window keeps repainting meanwhile
+            QProgressDialog progress(tr("Verifying reconstructed image..."), QString(), 0, 0, this);
+            progress.setWindowModality(Qt::WindowModal);
+            progress.setMinimumDuration(500);
+            QEventLoop loop;
+            QFutureWatcher<void> watcher;
+            connect(&watcher, SIGNAL(finished()), &loop, SLOT(quit()));
+            watcher.setFuture(parsed);
+            if (!parsed.isFinished())
+                loop.exec();
+            result = ffsEngine->finishVerification();
+        }
+        showMessages();
+        verified = !result;
+        if (result && QMessageBox::warning(this, tr("Image verification failed"), tr("%1, save it anyway?").arg(errorMessage(result)), QMessageBox::Yes, QMessageBox::No)
+            != QMessageBox::Yes)
+            return;
+    }
+
     QFile outputFile;
     outputFile.setFileName(path);
 
@@ -851,6 +974,14 @@ void UEFITool::saveImageFile()
     outputFile.resize(0);
     outputFile.write(reconstructed);
     outputFile.close();
+
+    // Removed items are already gone from the saved image, don't keep their subtrees
+    // Image saved despite failed verification keeps them for inspection
+    if (verified) {
+        ffsEngine->compact();
+        showMessages();
+        ui->actionExtractRemoved->setEnabled(!ffsEngine->removedItems().isEmpty());
+    }
     if (QMessageBox::information(this, tr("Image reconstruction successful"), tr("Open reconstructed file?"), QMessageBox::Yes, QMessageBox::No)
         == QMessageBox::Yes)
         openImageFile(path);
@@ -858,13 +989,13 @@ void UEFITool::saveImageFile()
 
 void UEFITool::openImageFile()
 {
-    QString path = QFileDialog::getOpenFileName(this, tr("Open BIOS image file"), currentDir, "BIOS image files (*.rom *.bin *.cap *.bio *.fd *.wph *.dec *.F10);;All files (*)");
+    QString path = QFileDialog::getOpenFileName(this, tr("Open BIOS image file"), currentDir, "BIOS image files (*.rom *.bin *.cap *.bio *.fd *.wph *.dec *.F10);;Archives (*.zip *.gz *.xz);;All files (*)");
     openImageFile(path);
 }
 
 void UEFITool::openImageFileInNewWindow()
 {
-    QString path = QFileDialog::getOpenFileName(this, tr("Open BIOS image file in new window"), currentDir, "BIOS image files (*.rom *.bin *.cap *.bio *.fd *.wph *.dec);;All files (*)");
+    QString path = QFileDialog::getOpenFileName(this, tr("Open BIOS image file in new window"), currentDir, "BIOS image files (*.rom *.bin *.cap *.bio *.fd *.wph *.dec);;Archives (*.zip *.gz *.xz);;All files (*)");
     if (path.trimmed().isEmpty())
         return;
     QProcess::startDetached(currentProgramPath, QStringList(path));
@@ -882,21 +1013,44 @@ void UEFITool::openImageFile(QString path)
         return;
     }
 
-    QFile inputFile;
-    inputFile.setFileName(path);
-
-    if (!inputFile.open(QFile::ReadOnly)) {
+    // Archives are decompressed in memory, one of their images is opened
+    QVector<ArchiveMember> images;
+    UINT8 result = readImages(path, images);
+    if (result == ERR_FILE_READ) {
         QMessageBox::critical(this, tr("Image parsing failed"), tr("Can't open input file for reading"), QMessageBox::Ok);
         return;
     }
+    if (!result && images.isEmpty())
+        result = ERR_ITEM_NOT_FOUND;
+    if (result) {
+        QMessageBox::critical(this, tr("Image parsing failed"), errorMessage(result), QMessageBox::Ok);
+        return;
+    }
 
-    QByteArray buffer = inputFile.readAll();
-    inputFile.close();
+    int member = 0;
+    if (images.size() > 1) {
+        // Member names are unique, so the chosen one gives the row
+        QStringList names;
+        for (int i = 0; i < images.size(); i++)
+            names.append(QFileInfo(images.at(i).name).fileName());
+        bool ok;
+        QString name = QInputDialog::getItem(this, tr("Open image from archive"), tr("Image:"), names, 0, false, &ok);
+        if (!ok)
+            return;
+        member = names.indexOf(name);
+    }
+    if (images.at(member).result) {
+        QMessageBox::critical(this, tr("Image parsing failed"), errorMessage(images.at(member).result), QMessageBox::Ok);
+        return;
+    }
+    QByteArray buffer = images.at(member).data;
+    if (images.size() > 1 || images.at(member).name != path)
+        fileInfo = QFileInfo(images.at(member).name);
 
     init();
     this->setWindowTitle(tr("UEFITool %1 - %2").arg(version).arg(fileInfo.fileName()));
 
-    UINT8 result = ffsEngine->parseImageFile(buffer);
+    result = ffsEngine->parseImageFile(buffer);
     showMessages();
     if (result)
         QMessageBox::critical(this, tr("Image parsing failed"), errorMessage(result), QMessageBox::Ok);
@@ -905,6 +1059,7 @@ void UEFITool::openImageFile(QString path)
 
     // Enable search
     ui->actionSearch->setEnabled(true);
+    ui->actionGoToOffset->setEnabled(true);
 
     // Set current directory
     currentDir = fileInfo.absolutePath();
@@ -1047,6 +1202,8 @@ void UEFITool::readSettings()
     ui->structureTreeView->setColumnWidth(1, settings.value("tree/columnWidth1", ui->structureTreeView->columnWidth(1)).toInt());
     ui->structureTreeView->setColumnWidth(2, settings.value("tree/columnWidth2", ui->structureTreeView->columnWidth(2)).toInt());
     ui->structureTreeView->setColumnWidth(3, settings.value("tree/columnWidth3", ui->structureTreeView->columnWidth(3)).toInt());
+    ui->actionMaxCompression->setChecked(settings.value("compression/max", false).toBool());
+    ui->actionVerifyOnSave->setChecked(settings.value("save/verify", true).toBool());
 }
 
 void UEFITool::writeSettings()
@@ -1062,4 +1219,12 @@ void UEFITool::writeSettings()
     settings.setValue("tree/columnWidth1", ui->structureTreeView->columnWidth(1));
     settings.setValue("tree/columnWidth2", ui->structureTreeView->columnWidth(2));
     settings.setValue("tree/columnWidth3", ui->structureTreeView->columnWidth(3));
+    settings.setValue("compression/max", ui->actionMaxCompression->isChecked());
+    settings.setValue("save/verify", ui->actionVerifyOnSave->isChecked());
+}
+
+void UEFITool::setMaxCompression(bool enabled)
+{
+    if (ffsEngine)
+        ffsEngine->setCompressionPreset(enabled ? COMPRESSION_PRESET_MAX : COMPRESSION_PRESET_DEFAULT);
 }
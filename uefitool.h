@@ -19,15 +19,20 @@
 #include <QClipboard>
 #include <QDragEnterEvent>
 #include <QDropEvent>
+#include <QEventLoop>
 #include <QFile>
 #include <QFileDialog>
 #include <QFileInfo>
+#include <QFutureWatcher>
+#include <QInputDialog>
 #include <QListWidget>
 #include <QMenu>
 #include <QMessageBox>
 #include <QMimeData>
 #include <QPlainTextEdit>
 #include <QProcess>
+#include <QProgressDialog>
+#include <QSaveFile>
 #include <QSettings>
 #include <QSplitter>
 #include <QString>
@@ -35,6 +40,7 @@
 #include <QUrl>
 #include <QPixmap>
 
+#include "archive.h"
 #include "basetypes.h"
 #include "ffs.h"
 #include "ffsengine.h"
@@ -67,6 +73,7 @@ public:
     void openImageFileInNewWindow();
     void saveImageFile();
     void search();
+    void goToOffset();
 
     void extract(const UINT8 mode);
     void extractAsIs();
@@ -82,6 +89,8 @@ public:
     void replaceBody();
 
     void rebuild();
+    void defragment();
+    void extractRemoved();
 
     void remove();
 
@@ -101,6 +110,7 @@ public:
     void saveScreenshot();
     void setZoomFactor();
     void hideWindowPanes();
+    void setMaxCompression(bool enabled);
     void updateSplitValues();
 
 private:
@@ -120,6 +130,7 @@ private:
 
     void createMask();
     void showMessages();
+    void checkSpace(const QModelIndex & index);
 
     void setRoundedStyle();
 
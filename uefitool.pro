@@ -1,5 +1,5 @@
 QT       += core gui
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
 
 TARGET    = UEFITool
 TEMPLATE  = app
@@ -7,6 +7,7 @@ TEMPLATE  = app
 SOURCES  += uefitool_main.cpp \
  uefitool.cpp \
  searchdialog.cpp \
+ archive.cpp \
  types.cpp \
  descriptor.cpp \
  ffs.cpp \
@@ -16,11 +17,15 @@ SOURCES  += uefitool_main.cpp \
  treemodel.cpp \
  messagelistitem.cpp \
  guidlineedit.cpp \
+ Brotli/BrotliCompress.c \
+ Brotli/BrotliDecompress.c \
  LZMA/LzmaCompress.c \
  LZMA/LzmaDecompress.c \
  LZMA/SDK/C/LzFind.c \
+ LZMA/SDK/C/LzFindMt.c \
  LZMA/SDK/C/LzmaDec.c \
  LZMA/SDK/C/LzmaEnc.c \
+ LZMA/SDK/C/Threads.c \
  Tiano/EfiTianoDecompress.c \
  Tiano/EfiTianoCompress.c \
  Tiano/EfiTianoCompressLegacy.c \
@@ -29,6 +34,7 @@ SOURCES  += uefitool_main.cpp \
 
 HEADERS  += uefitool.h \
  searchdialog.h \
+ archive.h \
  basetypes.h \
  descriptor.h \
  gbe.h \
@@ -41,6 +47,8 @@ HEADERS  += uefitool.h \
  treemodel.h \
  messagelistitem.h \
  guidlineedit.h \
+ Brotli/BrotliCompress.h \
+ Brotli/BrotliDecompress.h \
  LZMA/LzmaCompress.h \
  LZMA/LzmaDecompress.h \
  Tiano/EfiTianoDecompress.h \
@@ -61,3 +69,21 @@ DISTFILES += \
 RESOURCES += \
     resources.qrc
 
+# Brotli GUID-defined sections are only decompressed and compressed if libbrotli is found
+packagesExist(libbrotlienc libbrotlidec) {
+    CONFIG    += link_pkgconfig
+    PKGCONFIG += libbrotlienc libbrotlidec
+    DEFINES   += HAVE_BROTLI
+}
+
+# Images are read from .gz and .zip archives if zlib is found, and from .xz archives if liblzma is found
+packagesExist(zlib) {
+    CONFIG    += link_pkgconfig
+    PKGCONFIG += zlib
+    DEFINES   += HAVE_ZLIB
+}
+packagesExist(liblzma) {
+    CONFIG    += link_pkgconfig
+    PKGCONFIG += liblzma
+    DEFINES   += HAVE_XZ
+}